@@ -44,6 +44,7 @@ check_include_file("winsock2.h"          HAVE_WINSOCK2_H)
 include(CheckFunctionExists)
 check_function_exists("chown"            HAVE_CHOWN)
 check_function_exists("gethostbyname2"   HAVE_GETHOSTBYNAME2)
+check_function_exists("getnameinfo"      HAVE_GETNAMEINFO)
 check_function_exists("getprotobynumber" HAVE_GETPROTOBYNUMBER)
 check_function_exists("inet_ntop"        HAVE_INET_NTOP_PROTO)
 check_function_exists("issetugid"        HAVE_ISSETUGID)
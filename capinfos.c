@@ -73,6 +73,7 @@
 #include <epan/report_err.h>
 #include "wtap.h"
 #include <wsutil/privileges.h>
+#include <wsutil/processors.h>
 
 #ifdef HAVE_LIBGCRYPT
 #include <gcrypt.h>
@@ -151,11 +152,6 @@ static gboolean cap_file_hashes = TRUE;     /* Calculate file hashes */
 #define HASH_STR_SIZE (41) /* Max hash size * 2 + '\0' */
 #define HASH_BUF_SIZE (1024 * 1024)
 
-
-static gchar file_sha1[HASH_STR_SIZE];
-static gchar file_rmd160[HASH_STR_SIZE];
-static gchar file_md5[HASH_STR_SIZE];
-
 #define FILE_HASH_OPT "H"
 #else
 #define FILE_HASH_OPT ""
@@ -183,8 +179,51 @@ typedef struct _capture_info {
   double        packet_size;
   double        data_rate;              /* in bytes */
   gboolean      in_order;
+#ifdef HAVE_LIBGCRYPT
+  gchar         file_sha1[HASH_STR_SIZE];
+  gchar         file_rmd160[HASH_STR_SIZE];
+  gchar         file_md5[HASH_STR_SIZE];
+#endif
 } capture_info;
 
+/*
+ * The files are summarised by up to "max_jobs" threads at a time, each
+ * taking the next file not yet taken, and the results are reported in
+ * the order of the command line as they become available.
+ */
+static int max_jobs = 0;                    /* 0: one per processor */
+
+/* Maximum number of threads */
+#define MAX_JOBS 64
+
+typedef enum {
+  JOB_OK,
+  JOB_OPEN_FAILED,
+  JOB_READ_FAILED,
+  JOB_SIZE_FAILED
+} job_status_t;
+
+typedef struct {
+  const char    *filename;
+  gboolean      done;                   /* the fields below are set */
+  job_status_t  status;
+  int           err;
+  gchar         *err_info;
+  capture_info  cf_info;
+} file_job_t;
+
+/* What each thread needs for hashing */
+typedef struct {
+#ifdef HAVE_LIBGCRYPT
+  gcry_md_hd_t  hd;
+  char          *hash_buf;
+  FILE          *hash_fh;               /* the file being hashed, or NULL */
+  gint64        hashed;                 /* bytes of it hashed so far */
+#else
+  int           unused;
+#endif
+} job_worker_t;
+
 static void
 enable_all_infos(void)
 {
@@ -333,9 +372,9 @@ print_stats(const gchar *filename, capture_info *cf_info)
   if (cap_packet_rate)    print_value("Average packet rate: ", 2, " packets/sec", cf_info->packet_rate);
 #ifdef HAVE_LIBGCRYPT
   if (cap_file_hashes) {
-                          printf     ("SHA1:                %s\n", file_sha1);
-                          printf     ("RIPEMD160:           %s\n", file_rmd160);
-                          printf     ("MD5:                 %s\n", file_md5);
+                          printf     ("SHA1:                %s\n", cf_info->file_sha1);
+                          printf     ("RIPEMD160:           %s\n", cf_info->file_rmd160);
+                          printf     ("MD5:                 %s\n", cf_info->file_md5);
   }
 #endif /* HAVE_LIBGCRYPT */
   if (cap_in_order)       printf     ("Strict time order:   %s\n", (cf_info->in_order) ? "True" : "False");
@@ -533,17 +572,17 @@ print_stats_table(const gchar *filename, capture_info *cf_info)
   if (cap_file_hashes) {
     putsep();
     putquote();
-    printf("%s", file_sha1);
+    printf("%s", cf_info->file_sha1);
     putquote();
 
     putsep();
     putquote();
-    printf("%s", file_rmd160);
+    printf("%s", cf_info->file_rmd160);
     putquote();
 
     putsep();
     putquote();
-    printf("%s", file_md5);
+    printf("%s", cf_info->file_md5);
     putquote();
   }
 #endif /* HAVE_LIBGCRYPT */
@@ -558,11 +597,22 @@ print_stats_table(const gchar *filename, capture_info *cf_info)
   printf("\n");
 }
 
-static int
-process_cap_file(wtap *wth, const char *filename)
+#ifdef HAVE_LIBGCRYPT
+static void hash_up_to(job_worker_t *worker, gint64 offset);
+#endif
+
+/* Bring the hashes up to where wiretap has read every this many packets */
+#define HASH_FOLLOW_PACKETS 1024
+
+/*
+ * Go through the packet headers of an open file and fill in "cf_info";
+ * runs on the job threads, so it must not print anything.  If "worker"
+ * isn't NULL, the file's hashes follow the reading.
+ */
+static job_status_t
+scan_cap_file(job_worker_t *worker _U_, wtap *wth, capture_info *cf_info,
+              int *err, gchar **err_info)
 {
-  int                   err;
-  gchar                 *err_info;
   gint64                size;
   gint64                data_offset;
 
@@ -571,15 +621,15 @@ process_cap_file(wtap *wth, const char *filename)
   guint32               snaplen_min_inferred = 0xffffffff;
   guint32               snaplen_max_inferred =          0;
   const struct wtap_pkthdr *phdr;
-  capture_info          cf_info;
   double                start_time = 0;
   double                stop_time  = 0;
   double                cur_time   = 0;
   double		prev_time = 0;
   gboolean		in_order = TRUE;
 
-  /* Tally up data that we need to parse through the file to find */
-  while (wtap_read(wth, &err, &err_info, &data_offset))  {
+  /* Tally up data that we need to parse through the file to find; */
+  /* only the headers of the packets are needed, not their data.   */
+  while (wtap_read_header(wth, err, err_info, &data_offset))  {
     phdr = wtap_phdr(wth);
     prev_time = cur_time;
     cur_time = secs_nsecs(&phdr->ts);
@@ -601,6 +651,11 @@ process_cap_file(wtap *wth, const char *filename)
     bytes+=phdr->len;
     packet++;
 
+#ifdef HAVE_LIBGCRYPT
+    if (worker != NULL && packet % HASH_FOLLOW_PACKETS == 0)
+      hash_up_to(worker, wtap_read_so_far(wth, NULL));
+#endif
+
     /* If caplen < len for a rcd, then presumably           */
     /* 'Limit packet capture length' was done for this rcd. */
     /* Keep track as to the min/max actual snapshot lengths */
@@ -614,77 +669,118 @@ process_cap_file(wtap *wth, const char *filename)
 
   }
 
-  if (err != 0) {
-    fprintf(stderr,
-            "capinfos: An error occurred after reading %u packets from \"%s\": %s.\n",
-            packet, filename, wtap_strerror(err));
-    switch (err) {
+  /* # of packets */
+  cf_info->packet_count = packet;
 
-    case WTAP_ERR_UNSUPPORTED:
-    case WTAP_ERR_UNSUPPORTED_ENCAP:
-    case WTAP_ERR_BAD_RECORD:
-      fprintf(stderr, "(%s)\n", err_info);
-      g_free(err_info);
-      break;
-    }
-    return 1;
-  }
+  if (*err != 0)
+    return JOB_READ_FAILED;
 
   /* File size */
-  size = wtap_file_size(wth, &err);
-  if (size == -1) {
-    fprintf(stderr,
-            "capinfos: Can't get size of \"%s\": %s.\n",
-            filename, g_strerror(err));
-    return 1;
-  }
+  size = wtap_file_size(wth, err);
+  if (size == -1)
+    return JOB_SIZE_FAILED;
 
-  cf_info.filesize = size;
+  cf_info->filesize = size;
 
   /* File Type */
-  cf_info.file_type = wtap_file_type(wth);
+  cf_info->file_type = wtap_file_type(wth);
 
   /* File Encapsulation */
-  cf_info.file_encap = wtap_file_encap(wth);
+  cf_info->file_encap = wtap_file_encap(wth);
 
   /* Packet size limit (snaplen) */
-  cf_info.snaplen = wtap_snapshot_length(wth);
-  if(cf_info.snaplen > 0)
-    cf_info.snap_set = TRUE;
+  cf_info->snaplen = wtap_snapshot_length(wth);
+  if(cf_info->snaplen > 0)
+    cf_info->snap_set = TRUE;
   else
-    cf_info.snap_set = FALSE;
+    cf_info->snap_set = FALSE;
 
-  cf_info.snaplen_min_inferred = snaplen_min_inferred;
-  cf_info.snaplen_max_inferred = snaplen_max_inferred;
-
-  /* # of packets */
-  cf_info.packet_count = packet;
+  cf_info->snaplen_min_inferred = snaplen_min_inferred;
+  cf_info->snaplen_max_inferred = snaplen_max_inferred;
 
   /* File Times */
-  cf_info.start_time = start_time;
-  cf_info.stop_time = stop_time;
-  cf_info.duration = stop_time-start_time;
-  cf_info.in_order = in_order;
+  cf_info->start_time = start_time;
+  cf_info->stop_time = stop_time;
+  cf_info->duration = stop_time-start_time;
+  cf_info->in_order = in_order;
 
   /* Number of packet bytes */
-  cf_info.packet_bytes = bytes;
+  cf_info->packet_bytes = bytes;
 
-  cf_info.data_rate   = 0.0;
-  cf_info.packet_rate = 0.0;
-  cf_info.packet_size = 0.0;
+  cf_info->data_rate   = 0.0;
+  cf_info->packet_rate = 0.0;
+  cf_info->packet_size = 0.0;
 
   if (packet > 0) {
-    if (cf_info.duration > 0.0) {
-      cf_info.data_rate   = (double)bytes  / (stop_time-start_time); /* Data rate per second */
-      cf_info.packet_rate = (double)packet / (stop_time-start_time); /* packet rate per second */
+    if (cf_info->duration > 0.0) {
+      cf_info->data_rate   = (double)bytes  / (stop_time-start_time); /* Data rate per second */
+      cf_info->packet_rate = (double)packet / (stop_time-start_time); /* packet rate per second */
     }
-    cf_info.packet_size = (double)bytes / packet;                  /* Avg packet size      */
+    cf_info->packet_size = (double)bytes / packet;                  /* Avg packet size      */
+  }
+
+  return JOB_OK;
+}
+
+/*
+ * Print what was found for a file, or why nothing was, in the same way
+ * whether or not the files were summarised in parallel; returns the exit
+ * status if capinfos should stop.
+ */
+static int
+report_job(file_job_t *job, gboolean first)
+{
+  if (job->status == JOB_OPEN_FAILED) {
+    fprintf(stderr, "capinfos: Can't open %s: %s\n", job->filename,
+      wtap_strerror(job->err));
+    switch (job->err) {
+
+    case WTAP_ERR_UNSUPPORTED:
+    case WTAP_ERR_UNSUPPORTED_ENCAP:
+    case WTAP_ERR_BAD_RECORD:
+      fprintf(stderr, "(%s)\n", job->err_info);
+      g_free(job->err_info);
+      break;
+    }
+    if(!continue_after_wtap_open_offline_failure)
+      return 1;
+    return 0;
+  }
+
+  if (!first && long_report)
+    printf("\n");
+
+  switch (job->status) {
+
+  case JOB_READ_FAILED:
+    fprintf(stderr,
+            "capinfos: An error occurred after reading %u packets from \"%s\": %s.\n",
+            job->cf_info.packet_count, job->filename, wtap_strerror(job->err));
+    switch (job->err) {
+
+    case WTAP_ERR_UNSUPPORTED:
+    case WTAP_ERR_UNSUPPORTED_ENCAP:
+    case WTAP_ERR_BAD_RECORD:
+      fprintf(stderr, "(%s)\n", job->err_info);
+      g_free(job->err_info);
+      break;
+    }
+    return 1;
+
+  case JOB_SIZE_FAILED:
+    fprintf(stderr,
+            "capinfos: Can't get size of \"%s\": %s.\n",
+            job->filename, g_strerror(job->err));
+    return 1;
+
+  default:
+    break;
   }
 
   if(long_report) {
-    print_stats(filename, &cf_info);
+    print_stats(job->filename, &job->cf_info);
   } else {
-    print_stats_table(filename, &cf_info);
+    print_stats_table(job->filename, &job->cf_info);
   }
 
   return 0;
@@ -759,6 +855,8 @@ usage(gboolean is_error)
   fprintf(output, "  -h display this help and exit\n");
   fprintf(output, "  -C cancel processing if file open fails (default is to continue)\n");
   fprintf(output, "  -A generate all infos (default)\n");
+  fprintf(output, "  -j <jobs> process up to <jobs> files at once\n");
+  fprintf(output, "            (default is the number of processors)\n");
   fprintf(output, "\n");
   fprintf(output, "Options are processed from left to right order with later options superceeding\n");
   fprintf(output, "or adding to earlier options.\n");
@@ -794,22 +892,280 @@ hash_to_str(const unsigned char *hash, size_t length, char *str) {
 }
 #endif /* HAVE_LIBGCRYPT */
 
+#if defined(HAVE_LIBGCRYPT) && defined(G_THREADS_ENABLED) && \
+    (!defined(GCRYPT_VERSION_NUMBER) || GCRYPT_VERSION_NUMBER < 0x010600)
+/*
+ * Before 1.6, libgcrypt has to be given mutexes before it's used from
+ * more than one thread, as the job threads hash; it gets GLib's.
+ */
+#define CAPINFOS_GCRY_THREAD_CBS
+
+static int
+gcry_glib_mutex_init(void **priv)
+{
+  *priv = g_mutex_new();
+  return *priv != NULL ? 0 : ENOMEM;
+}
+
+static int
+gcry_glib_mutex_destroy(void **priv)
+{
+  g_mutex_free((GMutex *)*priv);
+  return 0;
+}
+
+static int
+gcry_glib_mutex_lock(void **priv)
+{
+  g_mutex_lock((GMutex *)*priv);
+  return 0;
+}
+
+static int
+gcry_glib_mutex_unlock(void **priv)
+{
+  g_mutex_unlock((GMutex *)*priv);
+  return 0;
+}
+
+static struct gcry_thread_cbs gcry_threads_glib = {
+#ifdef GCRY_THREAD_OPTION_VERSION
+  GCRY_THREAD_OPTION_USER | (GCRY_THREAD_OPTION_VERSION << 8),
+#else
+  GCRY_THREAD_OPTION_USER,
+#endif
+  NULL,
+  gcry_glib_mutex_init, gcry_glib_mutex_destroy,
+  gcry_glib_mutex_lock, gcry_glib_mutex_unlock,
+  NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL
+};
+#endif
+
+#ifdef HAVE_LIBGCRYPT
+/*
+ * The hashes are of the file as it is on disk, read through a handle of
+ * their own, but they're taken while the file is scanned: every so many
+ * packets they are brought up to where wiretap has read, so that the
+ * data is hashed while it's still in the page cache and a file larger
+ * than memory is read from the disk once.  Whatever the scan skips or
+ * leaves unread is hashed at the end.
+ */
+static void
+hash_start(job_worker_t *worker, const char *filename, capture_info *cf_info)
+{
+  strcpy(cf_info->file_sha1, "<unknown>");
+  strcpy(cf_info->file_rmd160, "<unknown>");
+  strcpy(cf_info->file_md5, "<unknown>");
+
+  worker->hash_fh = NULL;
+  worker->hashed = 0;
+  if (cap_file_hashes && worker->hd)
+    worker->hash_fh = ws_fopen(filename, "rb");
+}
+
+/* Hash the file up to "offset"; -1 is ignored, as the scan may give it */
+static void
+hash_up_to(job_worker_t *worker, gint64 offset)
+{
+  size_t want, hash_bytes;
+
+  if (worker->hash_fh == NULL)
+    return;
+  while (worker->hashed < offset) {
+    want = (size_t)MIN(offset - worker->hashed, HASH_BUF_SIZE);
+    hash_bytes = fread(worker->hash_buf, 1, want, worker->hash_fh);
+    if (hash_bytes == 0)
+      break;
+    gcry_md_write(worker->hd, worker->hash_buf, hash_bytes);
+    worker->hashed += hash_bytes;
+  }
+}
+
+/* Hash the rest of the file, and put the hashes into "cf_info" */
+static void
+hash_finish(job_worker_t *worker, capture_info *cf_info)
+{
+  if (worker->hash_fh == NULL)
+    return;
+  hash_up_to(worker, G_MAXINT64);
+  if (!ferror(worker->hash_fh)) {
+    gcry_md_final(worker->hd);
+    hash_to_str(gcry_md_read(worker->hd, GCRY_MD_SHA1), HASH_SIZE_SHA1, cf_info->file_sha1);
+    hash_to_str(gcry_md_read(worker->hd, GCRY_MD_RMD160), HASH_SIZE_RMD160, cf_info->file_rmd160);
+    hash_to_str(gcry_md_read(worker->hd, GCRY_MD_MD5), HASH_SIZE_MD5, cf_info->file_md5);
+  }
+  fclose(worker->hash_fh);
+  worker->hash_fh = NULL;
+  gcry_md_reset(worker->hd);
+}
+#endif /* HAVE_LIBGCRYPT */
+
+static void
+job_worker_init(job_worker_t *worker)
+{
+#ifdef HAVE_LIBGCRYPT
+  worker->hd = NULL;
+  worker->hash_buf = NULL;
+  worker->hash_fh = NULL;
+  if (cap_file_hashes) {
+    gcry_md_open(&worker->hd, GCRY_MD_SHA1, 0);
+    if (worker->hd) {
+      gcry_md_enable(worker->hd, GCRY_MD_RMD160);
+      gcry_md_enable(worker->hd, GCRY_MD_MD5);
+    }
+    worker->hash_buf = (char *)g_malloc(HASH_BUF_SIZE);
+  }
+#else
+  worker->unused = 0;
+#endif
+}
+
+static void
+job_worker_cleanup(job_worker_t *worker _U_)
+{
+#ifdef HAVE_LIBGCRYPT
+  if (worker->hd)
+    gcry_md_close(worker->hd);
+  g_free(worker->hash_buf);
+#endif
+}
+
+#ifdef G_THREADS_ENABLED
+/*
+ * Opening a file tries the heuristic readers of all the file types, and
+ * some of them (the ones built on lex and yacc, for example) keep their
+ * state in globals, so only one file is opened at a time.  The readers
+ * of the libpcap and pcap-ng types keep everything in the wtap, so their
+ * files are read in parallel; the others are read with the lock held.
+ */
+static GMutex *wtap_lock = NULL;
+static GMutex *job_lock = NULL;         /* for the fields below */
+static GCond  *job_done = NULL;
+#endif
+static file_job_t *jobs = NULL;
+static int     n_jobs = 0;
+static int     next_job = 0;
+
+static gboolean
+file_type_is_reentrant(int file_type)
+{
+  switch (file_type) {
+
+  case WTAP_FILE_PCAP:
+  case WTAP_FILE_PCAP_NSEC:
+  case WTAP_FILE_PCAP_AIX:
+  case WTAP_FILE_PCAP_SS990417:
+  case WTAP_FILE_PCAP_SS990915:
+  case WTAP_FILE_PCAP_SS991029:
+  case WTAP_FILE_PCAP_NOKIA:
+  case WTAP_FILE_PCAPNG:
+    return TRUE;
+
+  default:
+    return FALSE;
+  }
+}
+
+static void
+lock_wtap(void)
+{
+#ifdef G_THREADS_ENABLED
+  if (wtap_lock)
+    g_mutex_lock(wtap_lock);
+#endif
+}
+
+static void
+unlock_wtap(void)
+{
+#ifdef G_THREADS_ENABLED
+  if (wtap_lock)
+    g_mutex_unlock(wtap_lock);
+#endif
+}
+
+static void
+process_job(job_worker_t *worker _U_, file_job_t *job)
+{
+  wtap *wth;
+  gboolean locked;
+
+#ifdef HAVE_LIBGCRYPT
+  hash_start(worker, job->filename, &job->cf_info);
+#endif
+
+  lock_wtap();
+  wth = wtap_open_offline(job->filename, &job->err, &job->err_info, FALSE);
+  if (!wth) {
+    job->status = JOB_OPEN_FAILED;
+    locked = TRUE;
+  } else {
+    locked = !file_type_is_reentrant(wtap_file_type(wth));
+    if (!locked)
+      unlock_wtap();
+    /* files scanned with the lock held are hashed after it's let go */
+    job->status = scan_cap_file(locked ? NULL : worker, wth, &job->cf_info,
+                                &job->err, &job->err_info);
+    wtap_close(wth);
+  }
+  if (locked)
+    unlock_wtap();
+
+#ifdef HAVE_LIBGCRYPT
+  hash_finish(worker, &job->cf_info);
+#endif
+}
+
+#ifdef G_THREADS_ENABLED
+static gpointer
+job_thread(gpointer data)
+{
+  job_worker_t *worker = (job_worker_t *)data;
+  int i;
+
+  job_worker_init(worker);
+  for (;;) {
+    g_mutex_lock(job_lock);
+    i = next_job;
+    if (i < n_jobs)
+      next_job++;
+    g_mutex_unlock(job_lock);
+    if (i >= n_jobs)
+      break;
+
+    process_job(worker, &jobs[i]);
+
+    g_mutex_lock(job_lock);
+    jobs[i].done = TRUE;
+    g_cond_broadcast(job_done);
+    g_mutex_unlock(job_lock);
+  }
+  job_worker_cleanup(worker);
+  return NULL;
+}
+#endif /* G_THREADS_ENABLED */
+
 int
 main(int argc, char *argv[])
 {
-  wtap *wth;
-  int err;
-  gchar *err_info;
   int opt;
   int status = 0;
+  int i;
+  char *p;
+  job_worker_t main_worker;
+#ifdef G_THREADS_ENABLED
+  job_worker_t *workers = NULL;
+  GThread **threads = NULL;
+  int n_threads = 0;
+#endif
 #ifdef HAVE_PLUGINS
   char* init_progfile_dir_error;
 #endif
-#ifdef HAVE_LIBGCRYPT
-  FILE *fh;
-  char *hash_buf = NULL;
-  gcry_md_hd_t hd = NULL;
-  size_t hash_bytes;
+
+#ifdef G_THREADS_ENABLED
+  /* Before any other GLib call */
+  if (!g_thread_supported())
+    g_thread_init(NULL);
 #endif
 
   /*
@@ -831,7 +1187,7 @@ main(int argc, char *argv[])
 
   /* Process the options */
 
-  while ((opt = getopt(argc, argv, "tEcs" FILE_HASH_OPT "dluaeyizvhxoCALTRrSNqQBmb")) !=-1) {
+  while ((opt = getopt(argc, argv, "tEcs" FILE_HASH_OPT "dluaeyizvhxoCALTRrSNqQBmbj:")) !=-1) {
 
     switch (opt) {
 
@@ -924,6 +1280,17 @@ main(int argc, char *argv[])
       enable_all_infos();
       break;
 
+    case 'j':
+      max_jobs = strtol(optarg, &p, 10);
+      if (p == optarg || *p != '\0' || max_jobs < 1) {
+        fprintf(stderr, "capinfos: \"%s\" isn't a valid number of jobs\n",
+                optarg);
+        exit(1);
+      }
+      if (max_jobs > MAX_JOBS)
+        max_jobs = MAX_JOBS;
+      break;
+
     case 'L':
       long_report = TRUE;
       break;
@@ -987,66 +1354,65 @@ main(int argc, char *argv[])
 
 #ifdef HAVE_LIBGCRYPT
   if (cap_file_hashes) {
+#ifdef CAPINFOS_GCRY_THREAD_CBS
+    /* before anything else of libgcrypt, and before the job threads */
+    gcry_control(GCRYCTL_SET_THREAD_CBS, &gcry_threads_glib);
+#endif
     gcry_check_version(NULL);
-    gcry_md_open(&hd, GCRY_MD_SHA1, 0);
-    if (hd) {
-      gcry_md_enable(hd, GCRY_MD_RMD160);
-      gcry_md_enable(hd, GCRY_MD_MD5);
-    }
-    hash_buf = (char *)g_malloc(HASH_BUF_SIZE);
   }
 #endif
 
-  for (opt = optind; opt < argc; opt++) {
-
-#ifdef HAVE_LIBGCRYPT
-    strcpy(file_sha1, "<unknown>");
-    strcpy(file_rmd160, "<unknown>");
-    strcpy(file_md5, "<unknown>");
-
-    if (cap_file_hashes) {
-      fh = ws_fopen(argv[opt], "rb");
-      if (fh && hd) {
-        while((hash_bytes = fread(hash_buf, 1, HASH_BUF_SIZE, fh)) > 0) {
-          gcry_md_write(hd, hash_buf, hash_bytes);
-        }
-        gcry_md_final(hd);
-        hash_to_str(gcry_md_read(hd, GCRY_MD_SHA1), HASH_SIZE_SHA1, file_sha1);
-        hash_to_str(gcry_md_read(hd, GCRY_MD_RMD160), HASH_SIZE_RMD160, file_rmd160);
-        hash_to_str(gcry_md_read(hd, GCRY_MD_MD5), HASH_SIZE_MD5, file_md5);
-      }
-      if (fh) fclose(fh);
-      if (hd) gcry_md_reset(hd);
-    }
-#endif /* HAVE_LIBGCRYPT */
-
-    wth = wtap_open_offline(argv[opt], &err, &err_info, FALSE);
-
-    if (!wth) {
-      fprintf(stderr, "capinfos: Can't open %s: %s\n", argv[opt],
-        wtap_strerror(err));
-      switch (err) {
-
-      case WTAP_ERR_UNSUPPORTED:
-      case WTAP_ERR_UNSUPPORTED_ENCAP:
-      case WTAP_ERR_BAD_RECORD:
-        fprintf(stderr, "(%s)\n", err_info);
-        g_free(err_info);
+  n_jobs = argc - optind;
+  jobs = g_new0(file_job_t, n_jobs);
+  for (i = 0; i < n_jobs; i++)
+    jobs[i].filename = argv[optind + i];
+
+  /* One file per processor, up to 16, if -j isn't given */
+  if (max_jobs == 0)
+    max_jobs = get_processor_count(16);
+
+#ifdef G_THREADS_ENABLED
+  if (max_jobs > 1 && n_jobs > 1) {
+    wtap_lock = g_mutex_new();
+    job_lock = g_mutex_new();
+    job_done = g_cond_new();
+    workers = g_new(job_worker_t, MIN(max_jobs, n_jobs));
+    threads = g_new(GThread *, MIN(max_jobs, n_jobs));
+    for (n_threads = 0; n_threads < MIN(max_jobs, n_jobs); n_threads++) {
+      threads[n_threads] = g_thread_create(job_thread, &workers[n_threads],
+                                           TRUE, NULL);
+      if (threads[n_threads] == NULL)
         break;
-      }
-      if(!continue_after_wtap_open_offline_failure)
-        exit(1);
     }
+  }
+#endif
 
-    if(wth) {
-      if ((opt > optind) && (long_report))
-        printf("\n");
-      status = process_cap_file(wth, argv[opt]);
+  /* Without threads the files are summarised here, one by one */
+  job_worker_init(&main_worker);
+
+  for (i = 0; i < n_jobs; i++) {
+#ifdef G_THREADS_ENABLED
+    if (n_threads > 0) {
+      g_mutex_lock(job_lock);
+      while (!jobs[i].done)
+        g_cond_wait(job_done, job_lock);
+      g_mutex_unlock(job_lock);
+    } else
+#endif
+      process_job(&main_worker, &jobs[i]);
 
-      wtap_close(wth);
-      if (status)
-        exit(status);
-    }
+    status = report_job(&jobs[i], i == 0);
+    if (status)
+      exit(status);
   }
+
+#ifdef G_THREADS_ENABLED
+  while (n_threads > 0)
+    g_thread_join(threads[--n_threads]);
+  g_free(threads);
+  g_free(workers);
+#endif
+  job_worker_cleanup(&main_worker);
+  g_free(jobs);
   return 0;
 }
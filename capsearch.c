@@ -0,0 +1,575 @@
+/* Pick packets out of capture files written by dumpcap, using the indexes
+ * dumpcap -x writes next to them
+ *
+ * $Id$
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+/*
+ * Just make sure we include the prototype for strptime as well
+ * (needed for glibc 2.2) but make sure we do this only if not
+ * yet defined.
+ */
+
+#ifndef __USE_XOPEN
+#  define __USE_XOPEN
+#endif
+
+#include <time.h>
+#include <glib.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_NETINET_IN_H
+# include <netinet/in.h>
+#endif
+
+#ifdef HAVE_ARPA_INET_H
+#include <arpa/inet.h>
+#endif
+
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>     /* needed to define AF_ values on UNIX */
+#endif
+
+#ifdef HAVE_WINSOCK2_H
+#include <winsock2.h>       /* needed to define AF_ values on Windows */
+#endif
+
+#ifdef NEED_INET_V6DEFS_H
+# include "wsutil/inet_v6defs.h"
+#endif
+
+#ifdef HAVE_GETOPT_H
+#include <getopt.h>
+#else
+#include "wsutil/wsgetopt.h"
+#endif
+
+#ifdef NEED_STRPTIME_H
+# include "wsutil/strptime.h"
+#endif
+
+#include "svnversion.h"
+#include "capture_index.h"
+#include "wsutil/file_util.h"
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+/* what we're looking for */
+static guint64  start_us = 0;
+static guint64  stop_us = G_MAXUINT64;
+static guint8   host[16];
+static int      host_len = 0;           /* 0 for any host */
+static int      port = -1;              /* -1 for any port */
+static gboolean verbose = FALSE;
+
+typedef struct {
+  const char *name;
+  capture_index_reader_t *idx;
+} search_file_t;
+
+/* largest record we copy; dumpcap never writes anything close to it */
+#define MAX_RECORD_LEN (16*1024*1024)
+
+#define PCAP_MAGIC          0xa1b2c3d4
+#define PCAP_SWAPPED_MAGIC  0xd4c3b2a1
+#define PCAPNG_BLOCK_SHB    0x0A0D0D0A
+#define PCAPNG_MAGIC        0x1A2B3C4D
+#define PCAPNG_BLOCK_EPB    0x00000006
+
+/*
+ * Show the usage
+ */
+static void
+usage(void)
+{
+
+  fprintf(stderr, "Capsearch %s"
+#ifdef SVNVERSION
+	  " (" SVNVERSION " from " SVNPATH ")"
+#endif
+	  "\n", VERSION);
+  fprintf(stderr, "Copy the packets of some hosts, ports or times out of capture files,\n");
+  fprintf(stderr, "using the indexes that \"dumpcap -x\" writes.\n");
+  fprintf(stderr, "See http://www.wireshark.org for more information.\n");
+  fprintf(stderr, "\n");
+  fprintf(stderr, "Usage: capsearch [options] -w <outfile>|- <infile> ...\n");
+  fprintf(stderr, "\n");
+  fprintf(stderr, "Packet selection:\n");
+  fprintf(stderr, "  -A <start time>   only packets at or after this time,\n");
+  fprintf(stderr, "                    given as YYYY-MM-DD hh:mm:ss.\n");
+  fprintf(stderr, "  -B <stop time>    only packets before this time.\n");
+  fprintf(stderr, "  -H <address>      only packets to or from this IPv4 or IPv6 address.\n");
+  fprintf(stderr, "  -P <port>         only packets to or from this TCP, UDP or SCTP port.\n");
+  fprintf(stderr, "\n");
+  fprintf(stderr, "Output:\n");
+  fprintf(stderr, "  -w <outfile>|-    set the output filename to <outfile> or '-' for stdout.\n");
+  fprintf(stderr, "\n");
+  fprintf(stderr, "Miscellaneous:\n");
+  fprintf(stderr, "  -h                display this help and exit.\n");
+  fprintf(stderr, "  -v                verbose output.\n");
+}
+
+static guint64
+parse_time(const char *str)
+{
+  struct tm tm;
+  time_t t;
+
+  memset(&tm, 0, sizeof(struct tm));
+  if (!strptime(str, "%Y-%m-%d %T", &tm)) {
+    fprintf(stderr, "capsearch: \"%s\" isn't a valid time format\n", str);
+    exit(1);
+  }
+  tm.tm_isdst = -1;
+  t = mktime(&tm);
+  if (t < 0)
+    return 0;
+  return (guint64)t * 1000000;
+}
+
+static gboolean
+flow_matches(const capture_index_flow_t *flow)
+{
+  int addr_len = flow->key.family == 4 ? 4 : 16;
+
+  if (flow->last_us < start_us || flow->first_us >= stop_us)
+    return FALSE;
+  if (host_len != 0 &&
+      (addr_len != host_len ||
+       (memcmp(flow->key.addr_a, host, host_len) != 0 &&
+        memcmp(flow->key.addr_b, host, host_len) != 0)))
+    return FALSE;
+  if (port >= 0 && flow->key.port_a != port && flow->key.port_b != port)
+    return FALSE;
+  return TRUE;
+}
+
+/* Why the index says there's nothing in the file, or NULL */
+static const char *
+file_excluded(capture_index_reader_t *idx)
+{
+  const capture_index_info_t *info = capture_index_info(idx);
+
+  if (info->packets == 0)
+    return "no packets";
+  if (info->last_us < start_us || info->first_us >= stop_us)
+    return "not in the time range";
+  if (host_len != 0 && !capture_index_may_have_addr(idx, host, host_len))
+    return "address not in the file";
+  if (port >= 0 && !capture_index_may_have_port(idx, (guint16)port))
+    return "port not in the file";
+  return NULL;
+}
+
+static gint
+offset_cmp(gconstpointer a, gconstpointer b)
+{
+  gint64 oa = *(const gint64 *)a, ob = *(const gint64 *)b;
+
+  return oa < ob ? -1 : (oa > ob ? 1 : 0);
+}
+
+/* The record offsets of the matching flows, in file order; NULL on error */
+static GArray *
+matching_offsets(search_file_t *sf)
+{
+  capture_index_flow_t flow;
+  GArray *offsets;
+  guint n;
+  int err;
+
+  offsets = g_array_new(FALSE, FALSE, sizeof(gint64));
+  while (capture_index_next_flow(sf->idx, &flow, &err)) {
+    if (!flow_matches(&flow))
+      continue;
+    n = offsets->len;
+    g_array_set_size(offsets, n + flow.packets);
+    n += capture_index_flow_offsets(&flow, &g_array_index(offsets, gint64, n));
+    g_array_set_size(offsets, n);
+  }
+  if (err != 0) {
+    fprintf(stderr, "capsearch: Can't read the index of \"%s\": %s\n", sf->name,
+            err == CAPTURE_INDEX_ERR_FORMAT ? "it's damaged" : g_strerror(err));
+    g_array_free(offsets, TRUE);
+    return NULL;
+  }
+  g_array_sort(offsets, offset_cmp);
+  return offsets;
+}
+
+static gboolean
+read_fully(int fd, void *buf, size_t len)
+{
+  size_t done = 0;
+  int n;
+
+  while (done < len) {
+    n = ws_read(fd, (char *)buf + done, (unsigned int)(len - done));
+    if (n <= 0)
+      return FALSE;
+    done += n;
+  }
+  return TRUE;
+}
+
+static guint32
+rec_u32(const guint8 *p, gboolean swapped)
+{
+  guint32 v;
+
+  memcpy(&v, p, 4);
+  return swapped ? GUINT32_SWAP_LE_BE(v) : v;
+}
+
+/*
+ * Read the record at the current position of fd into *buf; returns its
+ * length, 0 at the end of the file, or -1 if it's bad.  *ts_us is set to
+ * its time stamp, or to G_MAXUINT64 for pcapng blocks that aren't packets.
+ */
+static int
+read_record(int fd, gboolean pcapng, gboolean swapped, GByteArray *buf,
+            guint64 *ts_us)
+{
+  guint8 hdr[28];
+  guint32 len, hdr_len;
+
+  hdr_len = pcapng ? 8 : 16;
+  if (!read_fully(fd, hdr, hdr_len))
+    return 0;
+
+  if (pcapng)
+    len = rec_u32(hdr + 4, swapped);
+  else
+    len = 16 + rec_u32(hdr + 8, swapped);
+  if (len < hdr_len || len > MAX_RECORD_LEN)
+    return -1;
+
+  g_byte_array_set_size(buf, len);
+  memcpy(buf->data, hdr, hdr_len);
+  if (!read_fully(fd, buf->data + hdr_len, len - hdr_len))
+    return -1;
+
+  if (!pcapng) {
+    *ts_us = (guint64)rec_u32(hdr, swapped) * 1000000 + rec_u32(hdr + 4, swapped);
+  } else if (rec_u32(hdr, swapped) == PCAPNG_BLOCK_EPB && len >= 20) {
+    /* dumpcap writes microsecond time stamps */
+    *ts_us = ((guint64)rec_u32(buf->data + 12, swapped) << 32) |
+             rec_u32(buf->data + 16, swapped);
+  } else {
+    *ts_us = G_MAXUINT64;
+  }
+  return (int)len;
+}
+
+/*
+ * Copy the matching packets of a file to the output; the header of the
+ * file, too, if it's the first one copied.
+ */
+static gboolean
+search_file(search_file_t *sf, FILE *out, gboolean *header_written,
+            guint64 *copied)
+{
+  const capture_index_info_t *info = capture_index_info(sf->idx);
+  GArray *offsets = NULL;
+  GByteArray *buf;
+  guint8 magic[12];
+  gboolean swapped, ok = FALSE;
+  guint64 ts_us, n = 0;
+  gint64 pos;
+  guint i = 0;
+  int fd, len;
+
+  /* with only a time range every packet in it is wanted, IP or not, so
+     read the file from the start; otherwise take the flows' records */
+  if (host_len != 0 || port >= 0) {
+    offsets = matching_offsets(sf);
+    if (offsets == NULL)
+      return FALSE;
+    if (offsets->len == 0) {
+      if (verbose)
+        fprintf(stderr, "capsearch: %s: no matching flows\n", sf->name);
+      g_array_free(offsets, TRUE);
+      return TRUE;
+    }
+  }
+
+  fd = ws_open(sf->name, O_RDONLY|O_BINARY, 0000 /* no creation so don't matter */);
+  if (fd < 0) {
+    fprintf(stderr, "capsearch: Can't open \"%s\": %s\n", sf->name, g_strerror(errno));
+    if (offsets != NULL)
+      g_array_free(offsets, TRUE);
+    return FALSE;
+  }
+  buf = g_byte_array_new();
+
+  /* the byte order of the records is that of the file header */
+  if (!read_fully(fd, magic, sizeof magic))
+    goto bad;
+  if (info->pcapng) {
+    if (rec_u32(magic, FALSE) != PCAPNG_BLOCK_SHB)
+      goto bad;
+    swapped = rec_u32(magic + 8, FALSE) != PCAPNG_MAGIC;
+    if (swapped && rec_u32(magic + 8, TRUE) != PCAPNG_MAGIC)
+      goto bad;
+  } else {
+    if (rec_u32(magic, FALSE) != PCAP_MAGIC &&
+        rec_u32(magic, FALSE) != PCAP_SWAPPED_MAGIC)
+      goto bad;
+    swapped = rec_u32(magic, FALSE) == PCAP_SWAPPED_MAGIC;
+  }
+
+  if (!*header_written) {
+    g_byte_array_set_size(buf, (guint)info->header_len);
+    if (ws_lseek(fd, 0, SEEK_SET) != 0 ||
+        !read_fully(fd, buf->data, buf->len))
+      goto bad;
+    if (fwrite(buf->data, 1, buf->len, out) != buf->len)
+      goto write_error;
+    *header_written = TRUE;
+  }
+
+  pos = -1;
+  if (offsets == NULL) {
+    pos = (gint64)info->header_len;
+    if (ws_lseek(fd, pos, SEEK_SET) != pos)
+      goto bad;
+  }
+  for (;;) {
+    if (offsets != NULL) {
+      if (i == offsets->len)
+        break;
+      /* records of one flow often follow each other */
+      if (g_array_index(offsets, gint64, i) != pos) {
+        pos = g_array_index(offsets, gint64, i);
+        if (ws_lseek(fd, pos, SEEK_SET) != pos)
+          goto bad;
+      }
+      i++;
+    }
+    len = read_record(fd, info->pcapng, swapped, buf, &ts_us);
+    if (len < 0)
+      goto bad;
+    if (len == 0) {
+      if (offsets != NULL)
+        goto bad;
+      break;
+    }
+    pos += len;
+    if (ts_us == G_MAXUINT64 || ts_us < start_us || ts_us >= stop_us)
+      continue;
+    if (fwrite(buf->data, 1, len, out) != (size_t)len)
+      goto write_error;
+    n++;
+  }
+
+  if (verbose)
+    fprintf(stderr, "capsearch: %s: %" G_GINT64_MODIFIER "u packets\n", sf->name, n);
+  *copied += n;
+  ok = TRUE;
+  goto done;
+
+bad:
+  fprintf(stderr, "capsearch: \"%s\" doesn't match its index, or is damaged\n", sf->name);
+  goto done;
+
+write_error:
+  fprintf(stderr, "capsearch: Can't write the output: %s\n", g_strerror(errno));
+
+done:
+  ws_close(fd);
+  g_byte_array_free(buf, TRUE);
+  if (offsets != NULL)
+    g_array_free(offsets, TRUE);
+  return ok;
+}
+
+static int
+file_cmp(const void *a, const void *b)
+{
+  const capture_index_info_t *ia = capture_index_info(((const search_file_t *)a)->idx);
+  const capture_index_info_t *ib = capture_index_info(((const search_file_t *)b)->idx);
+
+  if (ia->first_us != ib->first_us)
+    return ia->first_us < ib->first_us ? -1 : 1;
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int opt;
+  char *out_filename = NULL;
+  char *p;
+  long n;
+  search_file_t *files;
+  int file_count = 0;
+  const capture_index_info_t *info, *first_info = NULL;
+  const char *why;
+  gboolean header_written = FALSE;
+  guint64 copied = 0;
+  FILE *out;
+  int i, err;
+  int ret = 0;
+
+  while ((opt = getopt(argc, argv, "A:B:hH:P:vw:")) != -1) {
+
+    switch (opt) {
+    case 'A':
+      start_us = parse_time(optarg);
+      break;
+
+    case 'B':
+      stop_us = parse_time(optarg);
+      break;
+
+    case 'H':
+      if (inet_pton(AF_INET, optarg, host) == 1) {
+        host_len = 4;
+      } else if (inet_pton(AF_INET6, optarg, host) == 1) {
+        host_len = 16;
+      } else {
+        fprintf(stderr, "capsearch: \"%s\" isn't an IPv4 or IPv6 address\n", optarg);
+        exit(1);
+      }
+      break;
+
+    case 'P':
+      n = strtol(optarg, &p, 10);
+      if (p == optarg || *p != '\0' || n < 0 || n > 65535) {
+        fprintf(stderr, "capsearch: \"%s\" isn't a port number\n", optarg);
+        exit(1);
+      }
+      port = (int)n;
+      break;
+
+    case 'v':
+      verbose = TRUE;
+      break;
+
+    case 'w':
+      out_filename = optarg;
+      break;
+
+    case 'h':
+      usage();
+      exit(0);
+      break;
+
+    case '?':              /* Bad options if GNU getopt */
+      usage();
+      return 1;
+      break;
+    }
+  }
+
+  if (out_filename == NULL || argc - optind < 1) {
+    if (out_filename == NULL)
+      fprintf(stderr, "capsearch: an output filename must be set with -w\n");
+    usage();
+    return 1;
+  }
+
+  /* Open the indexes, and leave out the files they rule out */
+  files = g_malloc(sizeof(search_file_t) * (argc - optind));
+  for (i = optind; i < argc; i++) {
+    files[file_count].name = argv[i];
+    files[file_count].idx = capture_index_open(argv[i], &err);
+    if (files[file_count].idx == NULL) {
+      fprintf(stderr, "capsearch: Can't read the index of \"%s\": %s\n", argv[i],
+              err == CAPTURE_INDEX_ERR_FORMAT ? "it isn't an index capsearch knows"
+                                              : g_strerror(err));
+      ret = 2;
+      continue;
+    }
+    why = file_excluded(files[file_count].idx);
+    if (why != NULL) {
+      if (verbose)
+        fprintf(stderr, "capsearch: %s: skipped, %s\n", argv[i], why);
+      capture_index_close(files[file_count].idx);
+      continue;
+    }
+
+    /* the records are copied as they are, under the first file's header */
+    info = capture_index_info(files[file_count].idx);
+    if (first_info == NULL) {
+      first_info = info;
+    } else if (info->pcapng != first_info->pcapng ||
+               info->linktype != first_info->linktype) {
+      fprintf(stderr, "capsearch: \"%s\" has another format or link-layer type than \"%s\"\n",
+              argv[i], files[0].name);
+      exit(2);
+    }
+    file_count++;
+  }
+
+  /* ring buffer files don't overlap, so this gives the packets in order */
+  qsort(files, file_count, sizeof(search_file_t), file_cmp);
+
+  if (strcmp(out_filename, "-") == 0) {
+    out = stdout;
+  } else {
+    out = ws_fopen(out_filename, "wb");
+    if (out == NULL) {
+      fprintf(stderr, "capsearch: Can't open or create %s: %s\n", out_filename,
+              g_strerror(errno));
+      exit(1);
+    }
+  }
+
+  for (i = 0; i < file_count; i++) {
+    if (!search_file(&files[i], out, &header_written, &copied))
+      ret = 2;
+    capture_index_close(files[i].idx);
+  }
+  g_free(files);
+
+  if (fclose(out) == EOF) {
+    fprintf(stderr, "capsearch: Error writing to %s: %s\n", out_filename,
+            g_strerror(errno));
+    ret = 2;
+  }
+  if (verbose)
+    fprintf(stderr, "capsearch: %" G_GINT64_MODIFIER "u packets copied\n", copied);
+
+  /* an output without even a file header isn't a capture file */
+  if (!header_written && strcmp(out_filename, "-") != 0)
+    ws_unlink(out_filename);
+
+  return ret;
+}
@@ -0,0 +1,684 @@
+/* capture_index.c
+ * Routines for the index files dumpcap can write next to capture files
+ *
+ * $Id$
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <glib.h>
+
+#include "capture_index.h"
+#include <wsutil/file_util.h>
+
+#define INDEX_MAGIC        "WSCI"
+#define INDEX_VERSION      1
+#define INDEX_FLAG_PCAPNG  0x00000001
+
+#define INDEX_HEADER_LEN   64
+#define INDEX_FLOW_LEN     64
+#define BLOOM_BYTES        (CAPTURE_INDEX_BLOOM_BITS / 8)
+/* Most hashes per value a reader takes; each lookup computes them all */
+#define MAX_BLOOM_HASHES   32
+
+/* Link-layer types, as in libpcap file headers, of the packets we look
+   into; DLT_RAW has more than one value */
+#define LT_NULL            0
+#define LT_EN10MB          1
+#define LT_RAW_12          12
+#define LT_RAW_14          14
+#define LT_RAW             101
+#define LT_LOOP            108
+#define LT_LINUX_SLL       113
+#define LT_IPV4            228
+#define LT_IPV6            229
+
+typedef struct {
+  capture_index_flow_key_t key;
+  guint64     first_us, last_us;
+  guint32     packets;
+  gint64      last_offset;
+  GByteArray *offsets;
+} index_flow_t;
+
+struct capture_index {
+  int         linktype;
+  gboolean    pcapng;
+  gint64      header_len;
+  guint64     packets;
+  guint64     first_us, last_us;
+  GHashTable *flows;
+  guint8      bloom[BLOOM_BYTES];
+};
+
+struct capture_index_reader {
+  FILE       *fh;
+  capture_index_info_t info;
+  guint32     bloom_bits;
+  guint32     bloom_hashes;
+  guint8     *bloom;
+  guint8     *table;        /* the flow table, once it has been read */
+  gsize       table_len;
+  gsize       table_pos;
+  guint32     flows_read;
+};
+
+gchar *
+capture_index_filename(const char *capture_file)
+{
+  return g_strconcat(capture_file, CAPTURE_INDEX_SUFFIX, NULL);
+}
+
+/*
+ * Little-endian numbers and varints.
+ */
+
+static void
+put_le16(guint8 *p, guint16 v)
+{
+  p[0] = (guint8)v;
+  p[1] = (guint8)(v >> 8);
+}
+
+static void
+put_le32(guint8 *p, guint32 v)
+{
+  put_le16(p, (guint16)v);
+  put_le16(p + 2, (guint16)(v >> 16));
+}
+
+static void
+put_le64(guint8 *p, guint64 v)
+{
+  put_le32(p, (guint32)v);
+  put_le32(p + 4, (guint32)(v >> 32));
+}
+
+static guint16
+get_le16(const guint8 *p)
+{
+  return (guint16)(p[0] | (p[1] << 8));
+}
+
+static guint32
+get_le32(const guint8 *p)
+{
+  return get_le16(p) | ((guint32)get_le16(p + 2) << 16);
+}
+
+static guint64
+get_le64(const guint8 *p)
+{
+  return get_le32(p) | ((guint64)get_le32(p + 4) << 32);
+}
+
+static void
+append_varint(GByteArray *ba, guint64 v)
+{
+  guint8 buf[10];
+  int n = 0;
+
+  while (v >= 0x80) {
+    buf[n++] = (guint8)(v | 0x80);
+    v >>= 7;
+  }
+  buf[n++] = (guint8)v;
+  g_byte_array_append(ba, buf, n);
+}
+
+/*
+ * Bloom filter; the values are hashed once, and the bit positions are
+ * derived from the two halves of the hash.
+ */
+
+static guint64
+index_hash(guint8 tag, const guint8 *p, int len)
+{
+  guint64 h = G_GINT64_CONSTANT(14695981039346656037U);
+  int i;
+
+  h = (h ^ tag) * G_GINT64_CONSTANT(1099511628211U);
+  for (i = 0; i < len; i++)
+    h = (h ^ p[i]) * G_GINT64_CONSTANT(1099511628211U);
+  return h;
+}
+
+#define BLOOM_POS(h, i, bits) \
+  ((guint32)(((guint32)(h) + (i) * ((guint32)((h) >> 32) | 1)) % (bits)))
+
+static void
+bloom_add(guint8 *bloom, guint8 tag, const guint8 *p, int len)
+{
+  guint64 h = index_hash(tag, p, len);
+  guint32 i, pos;
+
+  for (i = 0; i < CAPTURE_INDEX_BLOOM_HASHES; i++) {
+    pos = BLOOM_POS(h, i, CAPTURE_INDEX_BLOOM_BITS);
+    bloom[pos / 8] |= 1 << (pos % 8);
+  }
+}
+
+static gboolean
+bloom_test(const guint8 *bloom, guint32 bits, guint32 hashes, guint8 tag,
+           const guint8 *p, int len)
+{
+  guint64 h = index_hash(tag, p, len);
+  guint32 i, pos;
+
+  for (i = 0; i < hashes; i++) {
+    pos = BLOOM_POS(h, i, bits);
+    if (!(bloom[pos / 8] & (1 << (pos % 8))))
+      return FALSE;
+  }
+  return TRUE;
+}
+
+/*
+ * Building.
+ */
+
+static guint
+flow_hash(gconstpointer key)
+{
+  return (guint)index_hash(0, key, sizeof(capture_index_flow_key_t));
+}
+
+static gboolean
+flow_equal(gconstpointer a, gconstpointer b)
+{
+  return memcmp(a, b, sizeof(capture_index_flow_key_t)) == 0;
+}
+
+static void
+flow_free(gpointer data)
+{
+  index_flow_t *flow = data;
+
+  g_byte_array_free(flow->offsets, TRUE);
+  g_free(flow);
+}
+
+capture_index_t *
+capture_index_new(int linktype, gboolean pcapng, gint64 header_len)
+{
+  capture_index_t *idx = g_malloc0(sizeof *idx);
+
+  idx->linktype = linktype;
+  idx->pcapng = pcapng;
+  idx->header_len = header_len;
+  /* the key is the first member of a flow */
+  idx->flows = g_hash_table_new_full(flow_hash, flow_equal, NULL, flow_free);
+  return idx;
+}
+
+/* Find the IP header of a packet; returns its offset, or -1 */
+static int
+find_ip_header(int linktype, const guint8 *pd, guint32 caplen)
+{
+  guint16 type;
+  int off;
+
+  switch (linktype) {
+
+  case LT_EN10MB:
+    off = 12;
+    for (;;) {
+      if (caplen < (guint32)off + 2)
+        return -1;
+      type = (pd[off] << 8) | pd[off + 1];
+      if (type != 0x8100 && type != 0x88a8 && type != 0x9100)
+        break;
+      off += 4;
+    }
+    off += 2;
+    break;
+
+  case LT_LINUX_SLL:
+    if (caplen < 16)
+      return -1;
+    type = (pd[14] << 8) | pd[15];
+    off = 16;
+    break;
+
+  case LT_NULL:
+  case LT_LOOP:
+    /* the address family is in host or network byte order; just look
+       at the IP version */
+    if (caplen < 5)
+      return -1;
+    type = ((pd[4] >> 4) == 6) ? 0x86dd : 0x0800;
+    off = 4;
+    break;
+
+  case LT_RAW_12:
+  case LT_RAW_14:
+  case LT_RAW:
+  case LT_IPV4:
+  case LT_IPV6:
+    if (caplen < 1)
+      return -1;
+    type = ((pd[0] >> 4) == 6) ? 0x86dd : 0x0800;
+    off = 0;
+    break;
+
+  default:
+    return -1;
+  }
+
+  if (type != 0x0800 && type != 0x86dd)
+    return -1;
+  return off;
+}
+
+/* Fill in the flow key of a packet; returns FALSE if it isn't IP */
+static gboolean
+packet_flow_key(int linktype, const guint8 *pd, guint32 caplen,
+                capture_index_flow_key_t *key)
+{
+  const guint8 *ip, *src, *dst;
+  guint32 len, hlen;
+  guint8 proto;
+  int off, addr_len, hops;
+  gboolean has_ports = TRUE;
+  guint16 sport = 0, dport = 0;
+
+  off = find_ip_header(linktype, pd, caplen);
+  if (off < 0)
+    return FALSE;
+  ip = pd + off;
+  len = caplen - off;
+
+  memset(key, 0, sizeof *key);
+  if (len >= 20 && (ip[0] >> 4) == 4) {
+    hlen = (ip[0] & 0x0f) * 4;
+    if (hlen < 20)
+      return FALSE;
+    key->family = 4;
+    proto = ip[9];
+    src = ip + 12;
+    dst = ip + 16;
+    addr_len = 4;
+    /* only the first fragment has the ports */
+    if ((((ip[6] & 0x1f) << 8) | ip[7]) != 0)
+      has_ports = FALSE;
+  } else if (len >= 40 && (ip[0] >> 4) == 6) {
+    key->family = 6;
+    proto = ip[6];
+    src = ip + 8;
+    dst = ip + 24;
+    addr_len = 16;
+    hlen = 40;
+    /* skip the extension headers */
+    for (hops = 0; hops < 8; hops++) {
+      if (proto != 0 && proto != 43 && proto != 44 && proto != 60)
+        break;
+      if (len < hlen + 8) {
+        has_ports = FALSE;
+        break;
+      }
+      if (proto == 44) {
+        /* fragment header; again, only the first fragment has ports */
+        if (((ip[hlen + 2] << 8) | (ip[hlen + 3] & 0xf8)) != 0)
+          has_ports = FALSE;
+        proto = ip[hlen];
+        hlen += 8;
+      } else {
+        proto = ip[hlen];
+        hlen += (ip[hlen + 1] + 1) * 8;
+      }
+    }
+  } else {
+    return FALSE;
+  }
+
+  if (has_ports && (proto == 6 || proto == 17 || proto == 132) &&
+      len >= hlen + 4) {
+    sport = (ip[hlen] << 8) | ip[hlen + 1];
+    dport = (ip[hlen + 2] << 8) | ip[hlen + 3];
+  }
+
+  /* both directions are one flow: put the lower endpoint first */
+  key->proto = proto;
+  if (memcmp(src, dst, addr_len) < 0 ||
+      (memcmp(src, dst, addr_len) == 0 && sport <= dport)) {
+    memcpy(key->addr_a, src, addr_len);
+    memcpy(key->addr_b, dst, addr_len);
+    key->port_a = sport;
+    key->port_b = dport;
+  } else {
+    memcpy(key->addr_a, dst, addr_len);
+    memcpy(key->addr_b, src, addr_len);
+    key->port_a = dport;
+    key->port_b = sport;
+  }
+  return TRUE;
+}
+
+void
+capture_index_add(capture_index_t *idx, gint64 offset, guint32 ts_sec,
+                  guint32 ts_usec, const guint8 *pd, guint32 caplen)
+{
+  capture_index_flow_key_t key;
+  index_flow_t *flow;
+  guint64 us = (guint64)ts_sec * 1000000 + ts_usec;
+  guint8 port[2];
+  int addr_len;
+
+  if (idx->packets == 0 || us < idx->first_us)
+    idx->first_us = us;
+  if (idx->packets == 0 || us > idx->last_us)
+    idx->last_us = us;
+  idx->packets++;
+
+  if (!packet_flow_key(idx->linktype, pd, caplen, &key))
+    return;
+
+  flow = g_hash_table_lookup(idx->flows, &key);
+  if (flow == NULL) {
+    flow = g_malloc0(sizeof *flow);
+    flow->key = key;
+    flow->first_us = us;
+    flow->offsets = g_byte_array_new();
+    g_hash_table_insert(idx->flows, &flow->key, flow);
+
+    /* a new flow is the only time new addresses or ports show up */
+    addr_len = key.family == 4 ? 4 : 16;
+    bloom_add(idx->bloom, key.family, key.addr_a, addr_len);
+    bloom_add(idx->bloom, key.family, key.addr_b, addr_len);
+    put_le16(port, key.port_a);
+    bloom_add(idx->bloom, 'p', port, 2);
+    put_le16(port, key.port_b);
+    bloom_add(idx->bloom, 'p', port, 2);
+  }
+  if (us < flow->first_us)
+    flow->first_us = us;
+  if (us > flow->last_us)
+    flow->last_us = us;
+  flow->packets++;
+  append_varint(flow->offsets, (guint64)(offset - flow->last_offset));
+  flow->last_offset = offset;
+}
+
+static void
+collect_flow(gpointer key _U_, gpointer value, gpointer user_data)
+{
+  g_ptr_array_add((GPtrArray *)user_data, value);
+}
+
+static gint
+flow_cmp(gconstpointer a, gconstpointer b)
+{
+  const index_flow_t *fa = *(const index_flow_t * const *)a;
+  const index_flow_t *fb = *(const index_flow_t * const *)b;
+
+  if (fa->first_us != fb->first_us)
+    return fa->first_us < fb->first_us ? -1 : 1;
+  return 0;
+}
+
+gboolean
+capture_index_write(capture_index_t *idx, const char *capture_file, int *err)
+{
+  gchar *filename;
+  FILE *fh;
+  GPtrArray *flows;
+  index_flow_t *flow;
+  guint8 hdr[INDEX_HEADER_LEN];
+  guint8 rec[INDEX_FLOW_LEN];
+  guint i;
+  gboolean ok;
+
+  filename = capture_index_filename(capture_file);
+  fh = ws_fopen(filename, "wb");
+  g_free(filename);
+  if (fh == NULL) {
+    *err = errno;
+    return FALSE;
+  }
+
+  /* flows in the order they started, which is the order they're most
+     likely to be asked for */
+  flows = g_ptr_array_new();
+  g_hash_table_foreach(idx->flows, collect_flow, flows);
+  g_ptr_array_sort(flows, flow_cmp);
+
+  memset(hdr, 0, sizeof hdr);
+  memcpy(hdr, INDEX_MAGIC, 4);
+  put_le32(hdr + 4, INDEX_VERSION);
+  put_le32(hdr + 8, (guint32)idx->linktype);
+  put_le32(hdr + 12, idx->pcapng ? INDEX_FLAG_PCAPNG : 0);
+  put_le64(hdr + 16, (guint64)idx->header_len);
+  put_le64(hdr + 24, idx->packets);
+  put_le64(hdr + 32, idx->first_us);
+  put_le64(hdr + 40, idx->last_us);
+  put_le32(hdr + 48, flows->len);
+  put_le32(hdr + 52, CAPTURE_INDEX_BLOOM_BITS);
+  put_le32(hdr + 56, CAPTURE_INDEX_BLOOM_HASHES);
+  ok = fwrite(hdr, 1, sizeof hdr, fh) == sizeof hdr &&
+       fwrite(idx->bloom, 1, BLOOM_BYTES, fh) == BLOOM_BYTES;
+
+  for (i = 0; ok && i < flows->len; i++) {
+    flow = g_ptr_array_index(flows, i);
+    memset(rec, 0, sizeof rec);
+    rec[0] = flow->key.family;
+    rec[1] = flow->key.proto;
+    put_le16(rec + 2, flow->key.port_a);
+    put_le16(rec + 4, flow->key.port_b);
+    memcpy(rec + 6, flow->key.addr_a, 16);
+    memcpy(rec + 22, flow->key.addr_b, 16);
+    put_le64(rec + 40, flow->first_us);
+    put_le64(rec + 48, flow->last_us);
+    put_le32(rec + 56, flow->packets);
+    put_le32(rec + 60, flow->offsets->len);
+    ok = fwrite(rec, 1, sizeof rec, fh) == sizeof rec &&
+         fwrite(flow->offsets->data, 1, flow->offsets->len, fh) == flow->offsets->len;
+  }
+  g_ptr_array_free(flows, TRUE);
+
+  if (!ok) {
+    *err = ferror(fh) ? errno : ENOSPC;
+    fclose(fh);
+    return FALSE;
+  }
+  if (fclose(fh) == EOF) {
+    *err = errno;
+    return FALSE;
+  }
+  return TRUE;
+}
+
+void
+capture_index_free(capture_index_t *idx)
+{
+  g_hash_table_destroy(idx->flows);
+  g_free(idx);
+}
+
+/*
+ * Reading.
+ */
+
+capture_index_reader_t *
+capture_index_open(const char *capture_file, int *err)
+{
+  capture_index_reader_t *r;
+  gchar *filename;
+  guint8 hdr[INDEX_HEADER_LEN];
+  FILE *fh;
+
+  filename = capture_index_filename(capture_file);
+  fh = ws_fopen(filename, "rb");
+  g_free(filename);
+  if (fh == NULL) {
+    *err = errno;
+    return NULL;
+  }
+
+  r = g_malloc0(sizeof *r);
+  r->fh = fh;
+  if (fread(hdr, 1, sizeof hdr, fh) != sizeof hdr ||
+      memcmp(hdr, INDEX_MAGIC, 4) != 0 ||
+      get_le32(hdr + 4) != INDEX_VERSION)
+    goto bad;
+
+  r->info.linktype = get_le32(hdr + 8);
+  r->info.pcapng = (get_le32(hdr + 12) & INDEX_FLAG_PCAPNG) != 0;
+  r->info.header_len = get_le64(hdr + 16);
+  r->info.packets = get_le64(hdr + 24);
+  r->info.first_us = get_le64(hdr + 32);
+  r->info.last_us = get_le64(hdr + 40);
+  r->info.flow_count = get_le32(hdr + 48);
+  r->bloom_bits = get_le32(hdr + 52);
+  r->bloom_hashes = get_le32(hdr + 56);
+  if (r->bloom_bits == 0 || r->bloom_bits % 8 != 0 ||
+      r->bloom_bits > 64 * 1024 * 1024 ||
+      r->bloom_hashes == 0 || r->bloom_hashes > MAX_BLOOM_HASHES)
+    goto bad;
+
+  r->bloom = g_malloc(r->bloom_bits / 8);
+  if (fread(r->bloom, 1, r->bloom_bits / 8, fh) != r->bloom_bits / 8)
+    goto bad;
+  return r;
+
+bad:
+  *err = ferror(fh) ? errno : CAPTURE_INDEX_ERR_FORMAT;
+  capture_index_close(r);
+  return NULL;
+}
+
+const capture_index_info_t *
+capture_index_info(capture_index_reader_t *r)
+{
+  return &r->info;
+}
+
+gboolean
+capture_index_may_have_addr(capture_index_reader_t *r, const guint8 *addr,
+                            int addr_len)
+{
+  return bloom_test(r->bloom, r->bloom_bits, r->bloom_hashes,
+                    addr_len == 4 ? 4 : 6, addr, addr_len);
+}
+
+gboolean
+capture_index_may_have_port(capture_index_reader_t *r, guint16 port)
+{
+  guint8 p[2];
+
+  put_le16(p, port);
+  return bloom_test(r->bloom, r->bloom_bits, r->bloom_hashes, 'p', p, 2);
+}
+
+gboolean
+capture_index_next_flow(capture_index_reader_t *r, capture_index_flow_t *flow,
+                        int *err)
+{
+  const guint8 *rec;
+  GByteArray *ba;
+  guint8 buf[64*1024];
+  size_t n;
+
+  *err = 0;
+  if (r->table == NULL) {
+    /* the flow table is only read if it's asked for */
+    ba = g_byte_array_new();
+    while ((n = fread(buf, 1, sizeof buf, r->fh)) != 0)
+      g_byte_array_append(ba, buf, (guint)n);
+    if (ferror(r->fh)) {
+      *err = errno;
+      g_byte_array_free(ba, TRUE);
+      return FALSE;
+    }
+    r->table_len = ba->len;
+    r->table = g_byte_array_free(ba, FALSE);
+    r->table_pos = 0;
+  }
+
+  if (r->flows_read == r->info.flow_count)
+    return FALSE;
+  if (r->table_len - r->table_pos < INDEX_FLOW_LEN)
+    goto bad;
+
+  rec = r->table + r->table_pos;
+  flow->key.family = rec[0];
+  flow->key.proto = rec[1];
+  flow->key.port_a = get_le16(rec + 2);
+  flow->key.port_b = get_le16(rec + 4);
+  memcpy(flow->key.addr_a, rec + 6, 16);
+  memcpy(flow->key.addr_b, rec + 22, 16);
+  flow->first_us = get_le64(rec + 40);
+  flow->last_us = get_le64(rec + 48);
+  flow->packets = get_le32(rec + 56);
+  flow->offsets_len = get_le32(rec + 60);
+  if (r->table_len - r->table_pos - INDEX_FLOW_LEN < flow->offsets_len)
+    goto bad;
+  /* callers allocate an offset per packet; each takes at least a byte */
+  if (flow->packets == 0 || flow->packets > flow->offsets_len ||
+      flow->packets > r->info.packets)
+    goto bad;
+  flow->offsets = rec + INDEX_FLOW_LEN;
+
+  r->table_pos += INDEX_FLOW_LEN + flow->offsets_len;
+  r->flows_read++;
+  return TRUE;
+
+bad:
+  *err = CAPTURE_INDEX_ERR_FORMAT;
+  return FALSE;
+}
+
+guint32
+capture_index_flow_offsets(const capture_index_flow_t *flow, gint64 *offsets)
+{
+  const guint8 *p = flow->offsets, *end = flow->offsets + flow->offsets_len;
+  guint64 v;
+  gint64 offset = 0;
+  guint32 n = 0;
+  int shift;
+
+  while (p < end && n < flow->packets) {
+    v = 0;
+    shift = 0;
+    do {
+      v |= (guint64)(*p & 0x7f) << shift;
+      shift += 7;
+    } while ((*p++ & 0x80) && p < end && shift < 64);
+    offset += (gint64)v;
+    offsets[n++] = offset;
+  }
+  return n;
+}
+
+void
+capture_index_close(capture_index_reader_t *r)
+{
+  fclose(r->fh);
+  g_free(r->bloom);
+  g_free(r->table);
+  g_free(r);
+}
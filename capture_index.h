@@ -0,0 +1,143 @@
+/* capture_index.h
+ * Definitions for the index files dumpcap can write next to capture files
+ *
+ * $Id$
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#ifndef __CAPTURE_INDEX_H__
+#define __CAPTURE_INDEX_H__
+
+/*
+ * An index describes one capture file written by dumpcap, and is kept
+ * in a file of the same name with CAPTURE_INDEX_SUFFIX appended.  It
+ * holds the time range of the file, a Bloom filter of the IP addresses
+ * and TCP/UDP/SCTP ports seen, and for every flow (protocol and both
+ * address and port pairs, in either direction) its time range and the
+ * file offsets of its packets.  That is enough to pass over files that
+ * can't hold what is looked for without opening them, and to seek to
+ * the records of the flows of interest in the others.
+ *
+ * All numbers in the index are little-endian; the record offsets are
+ * delta-encoded as base-128 varints.
+ */
+
+#define CAPTURE_INDEX_SUFFIX  ".idx"
+
+/* Bits of the Bloom filter, and the bits set for each value */
+#define CAPTURE_INDEX_BLOOM_BITS    (64*1024)
+#define CAPTURE_INDEX_BLOOM_HASHES  4
+
+typedef struct capture_index capture_index_t;
+
+typedef struct {
+  guint8  family;               /* 4 or 6 */
+  guint8  proto;                /* IP protocol */
+  guint16 port_a, port_b;       /* 0 if the protocol has none */
+  guint8  addr_a[16];           /* IPv4 addresses take the first 4 bytes */
+  guint8  addr_b[16];
+} capture_index_flow_key_t;
+
+typedef struct {
+  capture_index_flow_key_t key;
+  guint64 first_us, last_us;    /* time of the first and last packet */
+  guint32 packets;
+  guint32 offsets_len;          /* bytes of varints */
+  const guint8 *offsets;
+} capture_index_flow_t;
+
+typedef struct {
+  guint32 linktype;             /* as in the capture file header */
+  gboolean pcapng;              /* pcapng file, not libpcap */
+  guint64 header_len;           /* offset of the first packet */
+  guint64 packets;
+  guint64 first_us, last_us;    /* time range of the file */
+  guint32 flow_count;
+} capture_index_info_t;
+
+/* Returns the name of the index of a capture file; g_free() it. */
+extern gchar *
+capture_index_filename(const char *capture_file);
+
+/*
+ * Building an index, in the capture loop.
+ */
+
+/* "linktype" is the link-layer type of the capture file header;
+   "header_len" is where the first packet will go. */
+extern capture_index_t *
+capture_index_new(int linktype, gboolean pcapng, gint64 header_len);
+
+/* Add a packet that has been written at "offset". */
+extern void
+capture_index_add(capture_index_t *idx, gint64 offset, guint32 ts_sec,
+                  guint32 ts_usec, const guint8 *pd, guint32 caplen);
+
+/* Write the index of "capture_file"; returns FALSE and sets "*err" to an
+   errno value on failure. */
+extern gboolean
+capture_index_write(capture_index_t *idx, const char *capture_file,
+                    int *err);
+
+extern void
+capture_index_free(capture_index_t *idx);
+
+/*
+ * Reading an index.
+ */
+
+typedef struct capture_index_reader capture_index_reader_t;
+
+/* Open the index of "capture_file" and read its header and Bloom filter;
+   returns NULL and sets "*err" on failure (to CAPTURE_INDEX_ERR_FORMAT
+   if it isn't an index this code can read). */
+#define CAPTURE_INDEX_ERR_FORMAT  -1
+
+extern capture_index_reader_t *
+capture_index_open(const char *capture_file, int *err);
+
+extern const capture_index_info_t *
+capture_index_info(capture_index_reader_t *r);
+
+/* FALSE if there's certainly no packet to or from this address (4 or 16
+   bytes) or port in the file. */
+extern gboolean
+capture_index_may_have_addr(capture_index_reader_t *r, const guint8 *addr,
+                            int addr_len);
+extern gboolean
+capture_index_may_have_port(capture_index_reader_t *r, guint16 port);
+
+/* Get the next flow, reading the flow table on the first call; returns
+   FALSE at the end of the table or on error ("*err" is 0 at the end).
+   The flow is valid until the next call.  Its packet count is at least
+   1 and no more than its offsets_len or the packets of the file. */
+extern gboolean
+capture_index_next_flow(capture_index_reader_t *r, capture_index_flow_t *flow,
+                        int *err);
+
+/* Decode the record offsets of a flow into "offsets", which must have
+   room for flow->packets entries; returns the number decoded. */
+extern guint32
+capture_index_flow_offsets(const capture_index_flow_t *flow, gint64 *offsets);
+
+extern void
+capture_index_close(capture_index_reader_t *r);
+
+#endif /* __CAPTURE_INDEX_H__ */
@@ -1611,6 +1611,9 @@ sync_pipe_input_cb(gint source, gpointer user_data)
   case SP_DROPS:
     capture_input_drops(capture_opts, (guint32)strtoul(buffer, NULL, 10));
     break;
+  case SP_WRITE_STATS:
+    g_log(LOG_DOMAIN_CAPTURE, G_LOG_LEVEL_DEBUG, "sync_pipe_input_cb: write statistics %s", buffer);
+    break;
   default:
     g_assert_not_reached();
   }
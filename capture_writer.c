@@ -0,0 +1,516 @@
+/* capture_writer.c
+ * Routines for writing captured packets from a thread of their own
+ *
+ * $Id$
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#define _GNU_SOURCE /* Otherwise O_DIRECT won't be defined on Linux */
+
+#ifdef HAVE_LIBPCAP
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <pcap.h>
+
+#include <glib.h>
+
+#include "pcapio.h"
+#include "capture_writer.h"
+#include "wiretap/wtap.h"
+#include <wsutil/file_util.h>
+
+#ifdef G_THREADS_ENABLED
+
+/* O_DIRECT wants the memory, the file offset and the length of a write
+   aligned to the logical block size of the device; this is a multiple of
+   all the usual ones */
+#define DIRECT_ALIGN 4096
+
+typedef struct {
+  guint8       *mem;       /* as allocated */
+  guint8       *base;      /* mem, aligned to DIRECT_ALIGN */
+  guint8       *data;      /* the records start here */
+  size_t        len;
+  int           packets;
+  gboolean      partial;   /* handed over before it was full */
+  gboolean      ack;       /* give it back on ack_q once it's written */
+  gboolean      stop;      /* tells the writer thread to quit */
+} writer_block_t;
+
+struct capture_writer {
+  size_t          block_size;
+  int             fd;
+  writer_block_t  blocks[CAPTURE_WRITER_BLOCKS];
+  writer_block_t  stop_block;
+  GAsyncQueue    *free_q;       /* written blocks, for the capture loop */
+  GAsyncQueue    *full_q;       /* blocks to write, for the writer thread */
+  GAsyncQueue    *ack_q;        /* see capture_writer_flush() */
+  GThread        *thread;
+
+  /* capture loop only */
+  writer_block_t *cur;          /* the block being filled */
+  gint64          fill_offset;  /* file offset at which cur->data goes */
+  gboolean        aligned;      /* cur->data is placed for O_DIRECT */
+
+  /* shared, protected by mtx */
+  GMutex         *mtx;
+  gboolean        direct;
+  int             err;
+  int             packets_done;
+  capture_writer_stats_t stats;
+};
+
+/*
+ * Writer thread.
+ */
+
+static int
+write_out(int fd, const guint8 *p, size_t len, size_t *done)
+{
+  ssize_t n;
+
+  *done = 0;
+  while (*done < len) {
+    n = ws_write(fd, p + *done, (unsigned int)(len - *done));
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return errno;
+    }
+    if (n == 0)
+      return WTAP_ERR_SHORT_WRITE;
+    *done += n;
+  }
+  return 0;
+}
+
+#ifdef O_DIRECT
+static gboolean
+set_direct(int fd, gboolean on)
+{
+  int flags;
+
+  flags = fcntl(fd, F_GETFL);
+  if (flags == -1)
+    return FALSE;
+  flags = on ? (flags | O_DIRECT) : (flags & ~O_DIRECT);
+  return fcntl(fd, F_SETFL, flags) != -1;
+}
+#endif
+
+static int
+write_block(capture_writer_t *w, writer_block_t *b)
+{
+  size_t off = 0, done;
+#ifdef O_DIRECT
+  size_t head, mid;
+  int err;
+  gboolean direct;
+
+  g_mutex_lock(w->mtx);
+  direct = w->direct;
+  g_mutex_unlock(w->mtx);
+
+  if (direct) {
+    /* the capture loop placed the records so that memory and file are
+       aligned at the same points; the unaligned head and tail of the
+       block go through the page cache */
+    head = (DIRECT_ALIGN - (size_t)((gsize)b->data % DIRECT_ALIGN)) % DIRECT_ALIGN;
+    if (head > b->len)
+      head = b->len;
+    mid = (b->len - head) & ~(size_t)(DIRECT_ALIGN - 1);
+    if (mid != 0) {
+      err = write_out(w->fd, b->data, head, &done);
+      if (err != 0)
+        return err;
+      off = head;
+      if (set_direct(w->fd, TRUE)) {
+        err = write_out(w->fd, b->data + off, mid, &done);
+        set_direct(w->fd, FALSE);
+        off += done;
+      } else
+        err = EINVAL;
+      if (err == EINVAL) {
+        /* the file system won't do it; carry on without */
+        g_mutex_lock(w->mtx);
+        w->direct = FALSE;
+        g_mutex_unlock(w->mtx);
+      } else if (err != 0)
+        return err;
+    }
+  }
+#endif
+  return write_out(w->fd, b->data + off, b->len - off, &done);
+}
+
+static gpointer
+writer_thread(gpointer data)
+{
+  capture_writer_t *w = data;
+  writer_block_t *b;
+  GTimeVal start, end;
+  guint32 ms;
+  int err;
+
+  for (;;) {
+    b = g_async_queue_pop(w->full_q);
+    if (b->stop)
+      break;
+
+    if (b->len != 0) {
+      g_mutex_lock(w->mtx);
+      err = w->err;
+      g_mutex_unlock(w->mtx);
+
+      /* after an error the capture stops; just give the blocks back */
+      if (err == 0) {
+        g_get_current_time(&start);
+        err = write_block(w, b);
+        g_get_current_time(&end);
+        ms = (guint32)((end.tv_sec - start.tv_sec) * 1000 +
+                       (end.tv_usec - start.tv_usec) / 1000);
+
+        g_mutex_lock(w->mtx);
+        if (err != 0) {
+          w->err = err;
+        } else {
+          w->packets_done += b->packets;
+          w->stats.blocks++;
+          if (b->partial)
+            w->stats.partial++;
+          w->stats.bytes += b->len;
+          if (ms > w->stats.max_write_ms)
+            w->stats.max_write_ms = ms;
+        }
+        g_mutex_unlock(w->mtx);
+      }
+    }
+
+    g_async_queue_push(b->ack ? w->ack_q : w->free_q, b);
+  }
+  return NULL;
+}
+
+/*
+ * Capture loop.
+ */
+
+static void
+block_reset(capture_writer_t *w, writer_block_t *b)
+{
+  b->data = b->base;
+  if (w->aligned)
+    b->data += (size_t)(w->fill_offset % DIRECT_ALIGN);
+  b->len = 0;
+  b->packets = 0;
+  b->partial = FALSE;
+  b->ack = FALSE;
+}
+
+static void
+block_queue(capture_writer_t *w, writer_block_t *b)
+{
+  gint queued;
+
+  w->fill_offset += b->len;
+  g_async_queue_push(w->full_q, b);
+
+  queued = g_async_queue_length(w->full_q);
+  g_mutex_lock(w->mtx);
+  if (queued > 0 && (guint32)queued > w->stats.max_queued)
+    w->stats.max_queued = queued;
+  g_mutex_unlock(w->mtx);
+}
+
+static gboolean
+writer_check(capture_writer_t *w, int *err)
+{
+  int e;
+
+  g_mutex_lock(w->mtx);
+  e = w->err;
+  g_mutex_unlock(w->mtx);
+  if (e != 0) {
+    if (err != NULL)
+      *err = e;
+    return FALSE;
+  }
+  return TRUE;
+}
+
+capture_writer_t *
+capture_writer_new(size_t block_size, gboolean direct, int *err)
+{
+  capture_writer_t *w;
+  writer_block_t *b;
+  int i;
+
+  /* g_thread_init() is up to the program, before any other GLib call */
+  if (!g_thread_supported()) {
+    *err = ENOSYS;
+    return NULL;
+  }
+
+  if (block_size < CAPTURE_WRITER_MIN_BLOCK_SIZE)
+    block_size = CAPTURE_WRITER_MIN_BLOCK_SIZE;
+
+  w = g_malloc0(sizeof *w);
+  w->block_size = block_size;
+  w->fd = -1;
+#ifdef O_DIRECT
+  w->direct = direct;
+#endif
+  w->aligned = w->direct;
+
+  /* allocate and touch everything now, not while packets arrive */
+  for (i = 0; i < CAPTURE_WRITER_BLOCKS; i++) {
+    b = &w->blocks[i];
+    b->mem = g_try_malloc(block_size + 2 * DIRECT_ALIGN);
+    if (b->mem == NULL) {
+      *err = ENOMEM;
+      goto fail;
+    }
+    memset(b->mem, 0, block_size + 2 * DIRECT_ALIGN);
+    b->base = b->mem + (DIRECT_ALIGN - (size_t)((gsize)b->mem % DIRECT_ALIGN)) % DIRECT_ALIGN;
+  }
+  w->stop_block.stop = TRUE;
+
+  w->free_q = g_async_queue_new();
+  w->full_q = g_async_queue_new();
+  w->ack_q = g_async_queue_new();
+  w->mtx = g_mutex_new();
+
+  w->cur = &w->blocks[0];
+  block_reset(w, w->cur);
+  for (i = 1; i < CAPTURE_WRITER_BLOCKS; i++)
+    g_async_queue_push(w->free_q, &w->blocks[i]);
+
+  w->thread = g_thread_create(writer_thread, w, TRUE, NULL);
+  if (w->thread == NULL) {
+    *err = EAGAIN;
+    goto fail;
+  }
+  return w;
+
+fail:
+  capture_writer_free(w);
+  return NULL;
+}
+
+void
+capture_writer_start(capture_writer_t *w, int fd)
+{
+  gint64 offset;
+
+  g_assert(w->cur->len == 0);
+
+  offset = ws_lseek(fd, 0, SEEK_CUR);
+  if (offset == -1) {
+    /* a pipe; there's no O_DIRECT for those either */
+    offset = 0;
+    g_mutex_lock(w->mtx);
+    w->direct = FALSE;
+    g_mutex_unlock(w->mtx);
+  }
+
+  /* the writer thread is idle, as nothing has been queued since the
+     last capture_writer_flush() with "wait" set */
+  w->fd = fd;
+  w->fill_offset = offset;
+  block_reset(w, w->cur);
+}
+
+gboolean
+capture_writer_packet(capture_writer_t *w, const struct pcap_pkthdr *phdr,
+                      const u_char *pd, gboolean pcapng,
+                      gint64 *bytes_written, int *err)
+{
+  writer_block_t *b = w->cur;
+  size_t len;
+
+  len = pcapng ? libpcap_enhanced_packet_block_length(phdr)
+               : libpcap_packet_length(phdr);
+  g_assert(len <= w->block_size);
+
+  if (b->len + len > w->block_size) {
+    /* full; it's only if the writer thread has all the others that we
+       have to wait */
+    block_queue(w, b);
+    b = g_async_queue_try_pop(w->free_q);
+    if (b == NULL) {
+      g_mutex_lock(w->mtx);
+      w->stats.stalls++;
+      g_mutex_unlock(w->mtx);
+      b = g_async_queue_pop(w->free_q);
+    }
+    block_reset(w, b);
+    w->cur = b;
+    if (!writer_check(w, err))
+      return FALSE;
+  }
+
+  if (pcapng)
+    libpcap_format_enhanced_packet_block(b->data + b->len, phdr, 0, pd);
+  else
+    libpcap_format_packet(b->data + b->len, phdr, pd);
+  b->len += len;
+  b->packets++;
+  *bytes_written += (gint64)len;
+  return TRUE;
+}
+
+gboolean
+capture_writer_flush(capture_writer_t *w, gboolean wait, int *err)
+{
+  writer_block_t *b = w->cur;
+
+  if (wait) {
+    /* the writer thread takes the blocks in order, so once this one
+       comes back everything before it has been written as well */
+    b->partial = TRUE;
+    b->ack = TRUE;
+    block_queue(w, b);
+    b = g_async_queue_pop(w->ack_q);
+    block_reset(w, b);
+    w->cur = b;
+  } else if (b->len != 0) {
+    /* if there's no free block the writer thread is busy anyway, so
+       there's no point in waiting for one */
+    w->cur = g_async_queue_try_pop(w->free_q);
+    if (w->cur == NULL) {
+      w->cur = b;
+    } else {
+      b->partial = TRUE;
+      block_queue(w, b);
+      block_reset(w, w->cur);
+    }
+  }
+  return writer_check(w, err);
+}
+
+int
+capture_writer_packets_written(capture_writer_t *w)
+{
+  int packets;
+
+  g_mutex_lock(w->mtx);
+  packets = w->packets_done;
+  w->packets_done = 0;
+  g_mutex_unlock(w->mtx);
+  return packets;
+}
+
+void
+capture_writer_get_stats(capture_writer_t *w, capture_writer_stats_t *stats)
+{
+  g_mutex_lock(w->mtx);
+  *stats = w->stats;
+  stats->direct = w->direct;
+  g_mutex_unlock(w->mtx);
+}
+
+void
+capture_writer_free(capture_writer_t *w)
+{
+  int i;
+
+  if (w->thread != NULL) {
+    g_async_queue_push(w->full_q, &w->stop_block);
+    g_thread_join(w->thread);
+  }
+  if (w->free_q != NULL) {
+    g_async_queue_unref(w->free_q);
+    g_async_queue_unref(w->full_q);
+    g_async_queue_unref(w->ack_q);
+    g_mutex_free(w->mtx);
+  }
+  for (i = 0; i < CAPTURE_WRITER_BLOCKS; i++)
+    g_free(w->blocks[i].mem);
+  g_free(w);
+}
+
+#else /* G_THREADS_ENABLED */
+
+capture_writer_t *
+capture_writer_new(size_t block_size _U_, gboolean direct _U_, int *err)
+{
+  *err = ENOSYS;
+  return NULL;
+}
+
+void
+capture_writer_start(capture_writer_t *w _U_, int fd _U_)
+{
+  g_assert_not_reached();
+}
+
+gboolean
+capture_writer_packet(capture_writer_t *w _U_,
+                      const struct pcap_pkthdr *phdr _U_,
+                      const u_char *pd _U_, gboolean pcapng _U_,
+                      gint64 *bytes_written _U_, int *err _U_)
+{
+  g_assert_not_reached();
+  return FALSE;
+}
+
+gboolean
+capture_writer_flush(capture_writer_t *w _U_, gboolean wait _U_, int *err _U_)
+{
+  g_assert_not_reached();
+  return FALSE;
+}
+
+int
+capture_writer_packets_written(capture_writer_t *w _U_)
+{
+  return 0;
+}
+
+void
+capture_writer_get_stats(capture_writer_t *w _U_,
+                         capture_writer_stats_t *stats)
+{
+  memset(stats, 0, sizeof *stats);
+}
+
+void
+capture_writer_free(capture_writer_t *w _U_)
+{
+}
+
+#endif /* G_THREADS_ENABLED */
+
+#endif /* HAVE_LIBPCAP */
@@ -0,0 +1,96 @@
+/* capture_writer.h
+ * Definitions for writing captured packets from a thread of their own
+ *
+ * $Id$
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#ifndef __CAPTURE_WRITER_H__
+#define __CAPTURE_WRITER_H__
+
+/*
+ * The capture loop copies packet records into one of a few large blocks
+ * and hands every full block to a writer thread, which writes it to the
+ * capture file with a single write, so the capture loop never waits for
+ * the disk unless all the blocks are waiting to be written.
+ *
+ * The file and section headers are still written through the FILE * of
+ * pcapio.c; the writer is started on the file's descriptor after those
+ * have been flushed, and it must be flushed with "wait" set before the
+ * FILE * is used again (to write an interface statistics block, or to
+ * close the file).
+ */
+
+/* Number of blocks of a writer */
+#define CAPTURE_WRITER_BLOCKS         4
+/* Smallest and default block size; a block must hold the largest packet */
+#define CAPTURE_WRITER_MIN_BLOCK_SIZE (256*1024)
+#define CAPTURE_WRITER_BLOCK_SIZE     (8*1024*1024)
+
+typedef struct capture_writer capture_writer_t;
+
+typedef struct {
+  guint32 blocks;        /* blocks written */
+  guint32 partial;       /* of those, handed over before they were full */
+  guint64 bytes;         /* bytes written */
+  guint32 stalls;        /* times the capture loop waited for a free block */
+  guint32 max_queued;    /* most blocks waiting to be written at once */
+  guint32 max_write_ms;  /* longest time spent writing one block */
+  gboolean direct;       /* TRUE if blocks are written with O_DIRECT */
+} capture_writer_stats_t;
+
+/* Returns NULL, and sets "*err", if there's no writer thread on this
+   platform, the program hasn't called g_thread_init(), or the thread
+   can't be started.  If "direct" is set the aligned parts
+   of the blocks are written with O_DIRECT, where the file allows it. */
+extern capture_writer_t *
+capture_writer_new(size_t block_size, gboolean direct, int *err);
+
+/* Start writing to "fd", which must not be written to otherwise until
+   capture_writer_flush() with "wait" set has returned. */
+extern void
+capture_writer_start(capture_writer_t *w, int fd);
+
+/* Queue a libpcap record, or a pcapng enhanced packet block, for a packet;
+   the same as libpcap_write_packet() and
+   libpcap_write_enhanced_packet_block(). */
+extern gboolean
+capture_writer_packet(capture_writer_t *w, const struct pcap_pkthdr *phdr,
+                      const u_char *pd, gboolean pcapng,
+                      gint64 *bytes_written, int *err);
+
+/* Hand the block being filled to the writer thread, if there's a free one
+   to continue with; if "wait" is set, wait until everything queued so far
+   has been written. */
+extern gboolean
+capture_writer_flush(capture_writer_t *w, gboolean wait, int *err);
+
+/* Number of packets that have been written since the last call. */
+extern int
+capture_writer_packets_written(capture_writer_t *w);
+
+extern void
+capture_writer_get_stats(capture_writer_t *w, capture_writer_stats_t *stats);
+
+/* Stop the writer thread; anything not flushed is lost. */
+extern void
+capture_writer_free(capture_writer_t *w);
+
+#endif /* __CAPTURE_WRITER_H__ */
@@ -83,6 +83,8 @@
 #include "capture-pcap-util.h"
 
 #include "pcapio.h"
+#include "capture_writer.h"
+#include "capture_index.h"
 
 #ifdef _WIN32
 #include "capture-wpcap.h"
@@ -259,8 +261,10 @@ typedef struct _loop_data {
   int            linktype;
   int            file_snaplen;
   gint           wtap_linktype;
-  long           bytes_written;
+  gint64         bytes_written;
   guint32        autostop_files;
+  capture_writer_t *writer;             /* writer thread, or NULL to write from the capture loop */
+  capture_index_t *index;               /* index of the current file, or NULL */
 } loop_data;
 
 /*
@@ -315,6 +319,13 @@ console_log_handler(const char *log_domain, GLogLevelFlags log_level,
 static capture_options global_capture_opts;
 static gboolean quiet = FALSE;
 
+/* -W: block size of the writer thread (0 for none), and O_DIRECT */
+static size_t writer_block_size = 0;
+static gboolean writer_direct = FALSE;
+
+/* -x: write an index next to each capture file */
+static gboolean write_index = FALSE;
+
 static void capture_loop_packet_cb(u_char *user, const struct pcap_pkthdr *phdr,
   const u_char *pd);
 static void capture_loop_get_errmsg(char *errmsg, int errmsglen, const char *fname,
@@ -327,6 +338,7 @@ static void report_packet_count(int packet_count);
 static void report_packet_drops(guint32 drops);
 static void report_capture_error(const char *error_msg, const char *secondary_error_msg);
 static void report_cfilter_error(const char *cfilter, const char *errmsg);
+static void report_write_stats(capture_writer_t *writer);
 
 static void
 print_usage(gboolean print_ver) {
@@ -386,6 +398,9 @@ print_usage(gboolean print_ver) {
   fprintf(output, "                           filesize:NUM - switch to next file after NUM KB\n");
   fprintf(output, "                              files:NUM - ringbuffer: replace after NUM files\n");
   fprintf(output, "  -n                       use pcapng format instead of pcap\n");
+  fprintf(output, "  -x                       write an index next to each file, for capsearch\n");
+  fprintf(output, "  -W <block size>[,direct] write from a separate thread, in blocks of this\n");
+  fprintf(output, "                           many MB, with O_DIRECT if \"direct\" is given\n");
   /*fprintf(output, "\n");*/
   fprintf(output, "Miscellaneous:\n");
   fprintf(output, "  -q                       don't report packet capture counts\n");
@@ -2638,6 +2653,36 @@ capture_loop_open_output(capture_options *capture_opts, int *save_file_fd,
 #define TIME_GET() time(NULL)
 #endif
 
+/* With a writer thread, hand it the block being filled (and if "wait" is
+   set, wait until everything queued has been written), and count the
+   packets that have made it into the file as ready to be reported. */
+static void
+capture_loop_sync_writer(loop_data *ld, gboolean wait)
+{
+  if (!capture_writer_flush(ld->writer, wait, &ld->err))
+    ld->go = FALSE;
+  ld->inpkts_to_sync_pipe += capture_writer_packets_written(ld->writer);
+}
+
+/* Write the index of the file that has just been finished, and forget
+   about it.  A missing index only makes searching slower, so don't stop
+   the capture if it can't be written. */
+static void
+capture_loop_write_index(const char *save_file)
+{
+  int err;
+  gchar *errmsg;
+
+  if (!capture_index_write(global_ld.index, save_file, &err)) {
+    errmsg = g_strdup_printf("The index of the capture file \"%s\" couldn't be written: %s.",
+                             save_file, g_strerror(err));
+    report_capture_error(errmsg, "");
+    g_free(errmsg);
+  }
+  capture_index_free(global_ld.index);
+  global_ld.index = NULL;
+}
+
 /* Do the work of handling either the file size or file duration capture
    conditions being reached, and switching files or stopping. */
 static gboolean
@@ -2654,6 +2699,15 @@ do_file_switch_or_stop(capture_options *capture_opts,
       return FALSE;
     }
 
+    /* everything queued belongs into the file being closed */
+    if (global_ld.writer != NULL) {
+      capture_loop_sync_writer(&global_ld, TRUE);
+      if (!global_ld.go)
+        return FALSE;
+    }
+    if (global_ld.index != NULL)
+      capture_loop_write_index(capture_opts->save_file);
+
     /* Switch to the next ringbuffer file */
     if (ringbuf_switch_file(&global_ld.pdh, &capture_opts->save_file,
                             &global_ld.save_file_fd, &global_ld.err)) {
@@ -2685,6 +2739,12 @@ do_file_switch_or_stop(capture_options *capture_opts,
       if(cnd_file_duration)
         cnd_reset(cnd_file_duration);
       libpcap_dump_flush(global_ld.pdh, NULL);
+      if (global_ld.writer != NULL)
+        capture_writer_start(global_ld.writer, global_ld.save_file_fd);
+      if (write_index)
+        global_ld.index = capture_index_new(global_ld.linktype,
+                                            capture_opts->use_pcapng,
+                                            global_ld.bytes_written);
       if (!quiet)
         report_packet_count(global_ld.inpkts_to_sync_pipe);
       global_ld.inpkts_to_sync_pipe = 0;
@@ -2713,6 +2773,7 @@ capture_loop_start(capture_options *capture_opts, gboolean *stats_known, struct
 {
   time_t      upd_time, cur_time;
   time_t      start_time;
+  int         err;
   int         err_close;
   int         inpkts;
   condition  *cnd_file_duration = NULL;
@@ -2754,6 +2815,8 @@ capture_loop_start(capture_options *capture_opts, gboolean *stats_known, struct
   global_ld.pcap_fd             = 0;
 #endif
   global_ld.autostop_files      = 0;
+  global_ld.writer              = NULL;
+  global_ld.index               = NULL;
   global_ld.save_file_fd        = -1;
 
   /* We haven't yet gotten the capture statistics. */
@@ -2816,6 +2879,24 @@ capture_loop_start(capture_options *capture_opts, gboolean *stats_known, struct
        update its windows to indicate that we have a live capture in
        progress. */
     libpcap_dump_flush(global_ld.pdh, NULL);
+
+    /* the headers are out; from now on packets go through the writer
+       thread, if we're supposed to use one */
+    if (writer_block_size != 0) {
+      global_ld.writer = capture_writer_new(writer_block_size, writer_direct, &err);
+      if (global_ld.writer == NULL) {
+        g_snprintf(errmsg, sizeof(errmsg),
+                   "The writer thread couldn't be started: %s.",
+                   g_strerror(err));
+        goto error;
+      }
+      capture_writer_start(global_ld.writer, global_ld.save_file_fd);
+    }
+    /* (there's nowhere to put the index of the standard output) */
+    if (write_index && !capture_opts->output_to_pipe)
+      global_ld.index = capture_index_new(global_ld.linktype,
+                                          capture_opts->use_pcapng,
+                                          global_ld.bytes_written);
     report_new_capture_file(capture_opts->save_file);
   }
 
@@ -2869,7 +2950,9 @@ capture_loop_start(capture_options *capture_opts, gboolean *stats_known, struct
 #endif
 
     if (inpkts > 0) {
-      global_ld.inpkts_to_sync_pipe += inpkts;
+      /* with a writer thread only packets on the disk are reported */
+      if (global_ld.writer == NULL)
+        global_ld.inpkts_to_sync_pipe += inpkts;
 
       /* check capture size condition */
       if (cnd_autostop_size != NULL &&
@@ -2880,6 +2963,8 @@ capture_loop_start(capture_options *capture_opts, gboolean *stats_known, struct
           continue;
       } /* cnd_autostop_size */
       if (capture_opts->output_to_pipe) {
+        if (global_ld.writer != NULL)
+          capture_loop_sync_writer(&global_ld, FALSE);
         libpcap_dump_flush(global_ld.pdh, NULL);
       }
     } /* inpkts */
@@ -2900,6 +2985,8 @@ capture_loop_start(capture_options *capture_opts, gboolean *stats_known, struct
       }*/
 
       /* Let the parent process know. */
+      if (global_ld.writer != NULL)
+        capture_loop_sync_writer(&global_ld, FALSE);
       if (global_ld.inpkts_to_sync_pipe) {
         /* do sync here */
         libpcap_dump_flush(global_ld.pdh, NULL);
@@ -2932,6 +3019,11 @@ capture_loop_start(capture_options *capture_opts, gboolean *stats_known, struct
 
   g_log(LOG_DOMAIN_CAPTURE_CHILD, G_LOG_LEVEL_INFO, "Capture loop stopping ...");
 
+  /* get everything the writer thread has onto the disk before write
+     errors are looked at and the file is closed */
+  if (global_ld.writer != NULL)
+    capture_loop_sync_writer(&global_ld, TRUE);
+
   /* delete stop conditions */
   if (cnd_file_duration != NULL)
     cnd_delete(cnd_file_duration);
@@ -2987,6 +3079,9 @@ capture_loop_start(capture_options *capture_opts, gboolean *stats_known, struct
   if (capture_opts->saving_to_file) {
     /* close the wiretap (output) file */
     close_ok = capture_loop_close_output(capture_opts, &global_ld, &err_close);
+    /* (the ring buffer has only now set save_file to the last file) */
+    if (global_ld.index != NULL)
+      capture_loop_write_index(capture_opts->save_file);
   } else
     close_ok = TRUE;
 
@@ -2998,6 +3093,12 @@ capture_loop_start(capture_options *capture_opts, gboolean *stats_known, struct
     global_ld.inpkts_to_sync_pipe = 0;
   }
 
+  if (global_ld.writer != NULL) {
+    report_write_stats(global_ld.writer);
+    capture_writer_free(global_ld.writer);
+    global_ld.writer = NULL;
+  }
+
   /* If we've displayed a message about a write error, there's no point
      in displaying another message about an error on close. */
   if (!close_ok && write_ok) {
@@ -3151,6 +3252,7 @@ capture_loop_packet_cb(u_char *user, const struct pcap_pkthdr *phdr,
 {
   loop_data *ld = (loop_data *) (void *) user;
   int err;
+  gint64 offset;
 
   /* We may be called multiple times from pcap_dispatch(); if we've set
      the "stop capturing" flag, ignore this packet, as we're not
@@ -3163,7 +3265,10 @@ capture_loop_packet_cb(u_char *user, const struct pcap_pkthdr *phdr,
     /* We're supposed to write the packet to a file; do so.
        If this fails, set "ld->go" to FALSE, to stop the capture, and set
        "ld->err" to the error. */
-    if (global_capture_opts.use_pcapng) {
+    offset = ld->bytes_written;
+    if (ld->writer != NULL) {
+      successful = capture_writer_packet(ld->writer, phdr, pd, global_capture_opts.use_pcapng, &ld->bytes_written, &err);
+    } else if (global_capture_opts.use_pcapng) {
       successful = libpcap_write_enhanced_packet_block(ld->pdh, phdr, 0, pd, &ld->bytes_written, &err);
     } else {
       successful = libpcap_write_packet(ld->pdh, phdr, pd, &ld->bytes_written, &err);
@@ -3172,6 +3277,9 @@ capture_loop_packet_cb(u_char *user, const struct pcap_pkthdr *phdr,
       ld->go = FALSE;
       ld->err = err;
     } else {
+      if (ld->index != NULL)
+        capture_index_add(ld->index, offset, (guint32)phdr->ts.tv_sec,
+                          (guint32)phdr->ts.tv_usec, pd, phdr->caplen);
       ld->packet_count++;
       /* if the user told us to stop after x packets, do we already have enough? */
       if ((ld->packet_max > 0) && (ld->packet_count >= ld->packet_max))
@@ -3183,6 +3291,28 @@ capture_loop_packet_cb(u_char *user, const struct pcap_pkthdr *phdr,
 }
 
 
+/* parse the argument of -W: "<block size in MB>[,direct]" */
+static gboolean
+parse_writer_option(const char *optarg_str_p)
+{
+  char *p;
+  long size;
+
+  size = strtol(optarg_str_p, &p, 10);
+  if (p == optarg_str_p || size <= 0 || size > 1024)
+    return FALSE;
+  if (*p == ',') {
+    if (strcmp(p + 1, "direct") != 0)
+      return FALSE;
+    writer_direct = TRUE;
+  } else if (*p != '\0') {
+    return FALSE;
+  }
+  writer_block_size = (size_t)size * 1024 * 1024;
+  return TRUE;
+}
+
+
 /* And now our feature presentation... [ fade to music ] */
 int
 main(int argc, char *argv[])
@@ -3210,6 +3340,13 @@ main(int argc, char *argv[])
   struct utsname       osinfo;
 #endif
 
+#ifdef G_THREADS_ENABLED
+  /* Before any other GLib call; the pipe reader on Windows and the
+     capture file writer run in threads */
+  if (!g_thread_supported())
+    g_thread_init(NULL);
+#endif
+
 #ifdef _WIN32
   /*
    * Initialize our DLL search path. MUST be called before LoadLibrary
@@ -3246,7 +3383,7 @@ main(int argc, char *argv[])
 #define OPTSTRING_I ""
 #endif
 
-#define OPTSTRING "a:" OPTSTRING_A "b:" OPTSTRING_B "c:Df:hi:" OPTSTRING_I "L" OPTSTRING_m "Mnpq" OPTSTRING_r "Ss:" OPTSTRING_u "vw:y:Z:"
+#define OPTSTRING "a:" OPTSTRING_A "b:" OPTSTRING_B "c:Df:hi:" OPTSTRING_I "L" OPTSTRING_m "Mnpq" OPTSTRING_r "Ss:" OPTSTRING_u "vw:W:xy:Z:"
 
 #ifdef DEBUG_CHILD_DUMPCAP
   if ((debug_log = ws_fopen("dumpcap_debug_log.tmp","w")) == NULL) {
@@ -3358,8 +3495,6 @@ main(int argc, char *argv[])
   SetConsoleCtrlHandler(capture_cleanup_handler, TRUE);
 
   /* Prepare to read from a pipe */
-  if (!g_thread_supported ())
-    g_thread_init (NULL);
   cap_pipe_pending_q = g_async_queue_new();
   cap_pipe_done_q = g_async_queue_new();
   cap_pipe_read_mtx = g_mutex_new();
@@ -3569,6 +3704,17 @@ main(int argc, char *argv[])
         quiet = TRUE;
         break;
 
+      case 'x':        /* Write an index for each file */
+        write_index = TRUE;
+        break;
+
+      case 'W':        /* Write from a writer thread */
+        if (!parse_writer_option(optarg)) {
+          cmdarg_err("Invalid writer option: %s", optarg);
+          exit_main(1);
+        }
+        break;
+
       /*** all non capture option specific ***/
       case 'D':        /* Print a list of capture devices and exit */
         list_interfaces = TRUE;
@@ -3940,6 +4086,34 @@ report_packet_drops(guint32 drops)
     }
 }
 
+void
+report_write_stats(capture_writer_t *writer)
+{
+    capture_writer_stats_t stats;
+    char tmp[SP_MAX_MSG_LEN];
+
+    capture_writer_get_stats(writer, &stats);
+
+    if(capture_child) {
+        /* blocks, partial blocks, bytes, stalls, most queued,
+           longest write in ms, O_DIRECT */
+        g_snprintf(tmp, sizeof(tmp), "%u %u %" G_GINT64_MODIFIER "u %u %u %u %d",
+            stats.blocks, stats.partial, stats.bytes, stats.stalls,
+            stats.max_queued, stats.max_write_ms, stats.direct);
+        g_log(LOG_DOMAIN_CAPTURE_CHILD, G_LOG_LEVEL_DEBUG, "Write statistics: %s", tmp);
+        pipe_write_block(2, SP_WRITE_STATS, tmp);
+    } else {
+        fprintf(stderr,
+            "Blocks written: %u (%u partial), %" G_GINT64_MODIFIER "u bytes%s\n"
+            "Writer stalls: %u, most blocks queued: %u, longest write: %u ms\n",
+            stats.blocks, stats.partial, stats.bytes,
+            stats.direct ? " with O_DIRECT" : "",
+            stats.stalls, stats.max_queued, stats.max_write_ms);
+        /* stderr could be line buffered */
+        fflush(stderr);
+    }
+}
+
 
 /****************************************************************************************************************/
 /* signal_pipe handling */
@@ -82,19 +82,35 @@ struct select_item {
 
 /*
  * Duplicate frame detection
+ *
+ * Every distinct packet (length and hash) of the window has one entry
+ * in fd_hash[], counting how many of the packets in the window have it;
+ * the entries are chained from the buckets of fd_hash_buckets[].
+ * dup_ring[] has the entry of each of the last dup_window packets, so
+ * the packet that falls out of the window is found without a search.
  */
 typedef struct _fd_hash_t {
   md5_byte_t digest[16];
   guint32 len;
-  nstime_t time;
+  nstime_t time;                /* arrival time of the most recent one */
+  guint32 count;                /* number of them in the window */
+  gint32 next;                  /* next entry in the bucket, or free list */
 } fd_hash_t;
 
 #define DEFAULT_DUP_DEPTH 5     /* Used with -d */
-#define MAX_DUP_DEPTH 1000000   /* the maximum window (and actual size of fd_hash[]) for de-duplication */
-
-fd_hash_t fd_hash[MAX_DUP_DEPTH];
+#define MAX_DUP_DEPTH 1000000   /* the maximum window for de-duplication */
+
+static fd_hash_t *fd_hash;
+static gint32 *fd_hash_buckets;
+static guint32 fd_hash_mask;
+static gint32 fd_hash_free;
+static gint32 *dup_ring;
+static int dup_ring_size;
 int dup_window = DEFAULT_DUP_DEPTH;
 int cur_dup_entry = 0;
+static md5_byte_t cur_digest[16];
+static guint8 *dup_scratch;     /* copy of a packet with its hop fields cleared */
+static guint32 dup_scratch_len;
 
 #define ONE_MILLION 1000000
 #define ONE_BILLION 1000000000
@@ -133,6 +149,7 @@ static time_t stoptime = 0;
 static gboolean check_startstop = FALSE;
 static gboolean dup_detect = FALSE;
 static gboolean dup_detect_by_time = FALSE;
+static gboolean dup_ignore_hops = FALSE;
 
 static int do_strict_time_adjustment = FALSE;
 static struct time_adjustment strict_time_adj = {{0, 0}, 0}; /* strict time adjustment */
@@ -513,140 +530,310 @@ set_rel_time(char *optarg_str_p)
   relative_time_window.nsecs = val;
 }
 
-static gboolean
-is_duplicate(guint8* fd, guint32 len) {
+static void
+dup_table_init(int window)
+{
+  guint32 nbuckets;
   int i;
-  md5_state_t ms;
 
-  cur_dup_entry++;
-  if (cur_dup_entry >= dup_window)
-    cur_dup_entry = 0;
+  /* a window of 0 or 1 packets never has a duplicate, but still
+   * gets its hashes computed for -v */
+  dup_ring_size = window > 0 ? window : 1;
+
+  for (nbuckets = 16; nbuckets < (guint32)dup_ring_size * 2; nbuckets <<= 1)
+    ;
+  fd_hash_mask = nbuckets - 1;
+  fd_hash_buckets = g_malloc(nbuckets * sizeof(gint32));
+  for (i = 0; i < (int)nbuckets; i++)
+    fd_hash_buckets[i] = -1;
+
+  fd_hash = g_malloc(dup_ring_size * sizeof(fd_hash_t));
+  for (i = 0; i < dup_ring_size; i++)
+    fd_hash[i].next = i + 1 < dup_ring_size ? i + 1 : -1;
+  fd_hash_free = 0;
+
+  dup_ring = g_malloc(dup_ring_size * sizeof(gint32));
+  for (i = 0; i < dup_ring_size; i++)
+    dup_ring[i] = -1;
+  cur_dup_entry = dup_ring_size - 1;
+}
 
-  /* Calculate our digest */
-  md5_init(&ms);
-  md5_append(&ms, fd, len);
-  md5_finish(&ms, fd_hash[cur_dup_entry].digest);
+static guint32
+dup_bucket(const md5_byte_t *digest, guint32 len)
+{
+  guint32 h;
+
+  memcpy(&h, digest, sizeof h);
+  return (h ^ (len * 0x9e3779b1U)) & fd_hash_mask;
+}
 
-  fd_hash[cur_dup_entry].len = len;
+/* take the oldest packet out of the window */
+static void
+dup_evict(gint32 e)
+{
+  gint32 *prev;
 
-  /* Look for duplicates */
-  for (i = 0; i < dup_window; i++) {
-    if (i == cur_dup_entry)
-      continue;
+  if (--fd_hash[e].count > 0)
+    return;
 
-    if (fd_hash[i].len == fd_hash[cur_dup_entry].len &&
-        memcmp(fd_hash[i].digest, fd_hash[cur_dup_entry].digest, 16) == 0) {
-      return TRUE;
-    }
-  }
+  prev = &fd_hash_buckets[dup_bucket(fd_hash[e].digest, fd_hash[e].len)];
+  while (*prev != e)
+    prev = &fd_hash[*prev].next;
+  *prev = fd_hash[e].next;
 
-  return FALSE;
+  fd_hash[e].next = fd_hash_free;
+  fd_hash_free = e;
 }
 
-static gboolean
-is_duplicate_rel_time(guint8* fd, guint32 len, const nstime_t *current) {
-  int i;
-  md5_state_t ms;
+/*
+ * Add the packet with the hash in cur_digest to the window and return
+ * its entry; "seen" is set if one of the previous dup_window - 1 packets
+ * has the same length and hash.
+ */
+static fd_hash_t *
+dup_add(guint32 len, gboolean *seen)
+{
+  guint32 b;
+  gint32 e;
 
   cur_dup_entry++;
-  if (cur_dup_entry >= dup_window)
+  if (cur_dup_entry >= dup_ring_size)
     cur_dup_entry = 0;
+  if (dup_ring[cur_dup_entry] >= 0)
+    dup_evict(dup_ring[cur_dup_entry]);
 
-  /* Calculate our digest */
-  md5_init(&ms);
-  md5_append(&ms, fd, len);
-  md5_finish(&ms, fd_hash[cur_dup_entry].digest);
+  b = dup_bucket(cur_digest, len);
+  for (e = fd_hash_buckets[b]; e >= 0; e = fd_hash[e].next) {
+    if (fd_hash[e].len == len &&
+        memcmp(fd_hash[e].digest, cur_digest, 16) == 0)
+      break;
+  }
 
-  fd_hash[cur_dup_entry].len = len;
-  fd_hash[cur_dup_entry].time.secs = current->secs;
-  fd_hash[cur_dup_entry].time.nsecs = current->nsecs;
+  if (e >= 0) {
+    *seen = TRUE;
+  } else {
+    /* there is never more than one entry per packet in the window */
+    e = fd_hash_free;
+    fd_hash_free = fd_hash[e].next;
+    memcpy(fd_hash[e].digest, cur_digest, 16);
+    fd_hash[e].len = len;
+    fd_hash[e].count = 0;
+    nstime_set_unset(&fd_hash[e].time);
+    fd_hash[e].next = fd_hash_buckets[b];
+    fd_hash_buckets[b] = e;
+    *seen = FALSE;
+  }
 
-  /*
-   * Look for relative time related duplicates.
-   * This is hopefully a reasonably efficient mechanism for
-   * finding duplicates by rel time in the fd_hash[] cache.
-   * We check starting from the most recently added hash
-   * entries and work backwards towards older packets.
-   * This approach allows the dup test to be terminated
-   * when the relative time of a cached entry is found to
-   * be beyond the dup time window.
-   *
-   * Of course this assumes that the input trace file is
-   * "well-formed" in the sense that the packet timestamps are
-   * in strict chronologically increasing order (which is NOT
-   * always the case!!).
-   *
-   * The fd_hash[] table was deliberatly created large (1,000,000).
-   * Looking for time related duplicates in large trace files with
-   * non-fractional dup time window values can potentially take
-   * a long time to complete.
-   */
+  fd_hash[e].count++;
+  dup_ring[cur_dup_entry] = e;
+  return &fd_hash[e];
+}
 
-  for (i = cur_dup_entry - 1;; i--) {
-    nstime_t delta;
-    int cmp;
+/*
+ * MurmurHash3 (x64, 128 bits), by Austin Appleby, who placed it in the
+ * public domain.  It is a good deal faster than MD5 and just as good for
+ * telling packets apart, which is all the window needs.
+ */
+#define ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
 
-    if (i < 0) {
-      i = dup_window - 1;
-    }
+static guint64
+fmix64(guint64 k)
+{
+  k ^= k >> 33;
+  k *= G_GINT64_CONSTANT(0xff51afd7ed558ccdU);
+  k ^= k >> 33;
+  k *= G_GINT64_CONSTANT(0xc4ceb9fe1a85ec53U);
+  k ^= k >> 33;
+  return k;
+}
 
-    if (i == cur_dup_entry) {
-      /*
-       * We've decremented back to where we started.
-       * Check no more!
-       */
-      break;
-    }
+static void
+murmur3_128(const guint8 *data, guint32 len, md5_byte_t *digest)
+{
+  const guint64 c1 = G_GINT64_CONSTANT(0x87c37b91114253d5U);
+  const guint64 c2 = G_GINT64_CONSTANT(0x4cf5ad432745937fU);
+  guint64 h1 = 0, h2 = 0, k1, k2;
+  const guint8 *tail;
+  guint32 i, nblocks = len / 16;
+
+  for (i = 0; i < nblocks; i++) {
+    memcpy(&k1, data + i * 16, 8);
+    memcpy(&k2, data + i * 16 + 8, 8);
+    k1 = GUINT64_FROM_LE(k1);
+    k2 = GUINT64_FROM_LE(k2);
+
+    k1 *= c1; k1 = ROTL64(k1, 31); k1 *= c2; h1 ^= k1;
+    h1 = ROTL64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+    k2 *= c2; k2 = ROTL64(k2, 33); k2 *= c1; h2 ^= k2;
+    h2 = ROTL64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+  }
 
-    if (nstime_is_unset(&(fd_hash[i].time))) {
-      /*
-       * We've decremented to an unused fd_hash[] entry.
-       * Check no more!
-       */
-      break;
-    }
+  tail = data + nblocks * 16;
+  k1 = 0;
+  k2 = 0;
+  switch (len & 15) {
+  case 15: k2 ^= (guint64)tail[14] << 48;
+  case 14: k2 ^= (guint64)tail[13] << 40;
+  case 13: k2 ^= (guint64)tail[12] << 32;
+  case 12: k2 ^= (guint64)tail[11] << 24;
+  case 11: k2 ^= (guint64)tail[10] << 16;
+  case 10: k2 ^= (guint64)tail[9] << 8;
+  case  9: k2 ^= (guint64)tail[8];
+    k2 *= c2; k2 = ROTL64(k2, 33); k2 *= c1; h2 ^= k2;
+  case  8: k1 ^= (guint64)tail[7] << 56;
+  case  7: k1 ^= (guint64)tail[6] << 48;
+  case  6: k1 ^= (guint64)tail[5] << 40;
+  case  5: k1 ^= (guint64)tail[4] << 32;
+  case  4: k1 ^= (guint64)tail[3] << 24;
+  case  3: k1 ^= (guint64)tail[2] << 16;
+  case  2: k1 ^= (guint64)tail[1] << 8;
+  case  1: k1 ^= (guint64)tail[0];
+    k1 *= c1; k1 = ROTL64(k1, 31); k1 *= c2; h1 ^= k1;
+  }
 
-    nstime_delta(&delta, current, &fd_hash[i].time);
+  h1 ^= len;
+  h2 ^= len;
+  h1 += h2;
+  h2 += h1;
+  h1 = fmix64(h1);
+  h2 = fmix64(h2);
+  h1 += h2;
+  h2 += h1;
+
+  h1 = GUINT64_TO_LE(h1);
+  h2 = GUINT64_TO_LE(h2);
+  memcpy(digest, &h1, 8);
+  memcpy(digest + 8, &h2, 8);
+}
 
-    if(delta.secs < 0 || delta.nsecs < 0)
-    {
-      /*
-       * A negative delta implies that the current packet
-       * has an absolute timestamp less than the cached packet
-       * that it is being compared to.  This is NOT a normal
-       * situation since trace files usually have packets in
-       * chronological order (oldest to newest).
-       *
-       * There are several possible ways to deal with this:
-       * 1. 'continue' dup checking with the next cached frame.
-       * 2. 'break' from looking for a duplicate of the current frame.
-       * 3. Take the absolute value of the delta and see if that
-       * falls within the specifed dup time window.
-       *
-       * Currently this code does option 1.  But it would pretty
-       * easy to add yet-another-editcap-option to select one of
-       * the other behaviors for dealing with out-of-sequence
-       * packets.
-       */
-      continue;
+/*
+ * Offset of the IPv4 or IPv6 header of a packet, or -1 if there isn't
+ * one we know how to find.
+ */
+static int
+find_ip_header(const guint8 *fd, guint32 len, int encap)
+{
+  guint32 off;
+  guint16 type;
+
+  switch (encap) {
+
+  case WTAP_ENCAP_RAW_IP:
+    if (len < 1)
+      return -1;
+    type = (fd[0] >> 4) == 4 ? 0x0800 : (fd[0] >> 4) == 6 ? 0x86dd : 0;
+    off = 0;
+    break;
+
+  case WTAP_ENCAP_ETHERNET:
+    off = 12;
+    for (;;) {
+      if (len < off + 2)
+        return -1;
+      type = (fd[off] << 8) | fd[off + 1];
+      if (type != 0x8100 && type != 0x88a8 && type != 0x9100)
+        break;
+      off += 4;                 /* skip the VLAN tag */
     }
+    off += 2;
+    break;
+
+  case WTAP_ENCAP_SLL:
+    if (len < 16)
+      return -1;
+    type = (fd[14] << 8) | fd[15];
+    off = 16;
+    break;
+
+  default:
+    return -1;
+  }
 
-    cmp = nstime_cmp(&delta, &relative_time_window);
+  if (type == 0x0800 && len >= off + 20 && (fd[off] >> 4) == 4)
+    return off;
+  if (type == 0x86dd && len >= off + 40 && (fd[off] >> 4) == 6)
+    return off;
+  return -1;
+}
 
-    if(cmp > 0) {
-      /*
-       * The delta time indicates that we are now looking at
-       * cached packets beyond the specified dup time window.
-       * Check no more!
-       */
-      break;
-    } else if (fd_hash[i].len == fd_hash[cur_dup_entry].len &&
-          memcmp(fd_hash[i].digest, fd_hash[cur_dup_entry].digest, 16) == 0) {
-      return TRUE;
+/*
+ * Compute the hash of a packet into cur_digest and return the length
+ * to go with it.  With -I the link-layer header is left out and the
+ * TTL and header checksum of IPv4 or the hop limit of IPv6 are cleared
+ * first, so that the same packet captured on either side of a router
+ * matches.  With -v the hash is MD5, as it is printed.
+ */
+static guint32
+dup_digest(const guint8 *fd, guint32 len, int encap)
+{
+  md5_state_t ms;
+  int off;
+
+  if (dup_ignore_hops && (off = find_ip_header(fd, len, encap)) >= 0) {
+    len -= off;
+    if (len > dup_scratch_len) {
+      dup_scratch_len = len;
+      dup_scratch = g_realloc(dup_scratch, len);
+    }
+    memcpy(dup_scratch, fd + off, len);
+    if ((dup_scratch[0] >> 4) == 4) {
+      dup_scratch[8] = 0;       /* TTL */
+      dup_scratch[10] = 0;      /* header checksum */
+      dup_scratch[11] = 0;
+    } else {
+      dup_scratch[7] = 0;       /* hop limit */
     }
+    fd = dup_scratch;
   }
 
-  return FALSE;
+  if (verbose) {
+    md5_init(&ms);
+    md5_append(&ms, fd, len);
+    md5_finish(&ms, cur_digest);
+  } else {
+    murmur3_128(fd, len, cur_digest);
+  }
+  return len;
+}
+
+static gboolean
+is_duplicate(guint8* fd, guint32 len, int encap) {
+  gboolean seen;
+
+  len = dup_digest(fd, len, encap);
+  dup_add(len, &seen);
+  return seen;
+}
+
+static gboolean
+is_duplicate_rel_time(guint8* fd, guint32 len, int encap, const nstime_t *current) {
+  fd_hash_t *e;
+  gboolean seen, dup = FALSE;
+  nstime_t delta;
+
+  len = dup_digest(fd, len, encap);
+  e = dup_add(len, &seen);
+
+  /*
+   * Only the most recent of the earlier packets with the same hash
+   * needs looking at: if it isn't within the dup time window, the
+   * older ones aren't either.
+   *
+   * Of course this assumes that the input trace file is
+   * "well-formed" in the sense that the packet timestamps are
+   * in strict chronologically increasing order (which is NOT
+   * always the case!!).  A packet with a timestamp before that
+   * of the earlier one (a negative delta) isn't a duplicate.
+   */
+  if (seen && !nstime_is_unset(&e->time)) {
+    nstime_delta(&delta, current, &e->time);
+    if (delta.secs >= 0 && delta.nsecs >= 0 &&
+        nstime_cmp(&delta, &relative_time_window) <= 0)
+      dup = TRUE;
+  }
+
+  e->time = *current;
+  return dup;
 }
 
 static void
@@ -689,6 +876,10 @@ usage(gboolean is_error)
   fprintf(output, "                         LESS THAN <dup time window> prior to current packet.\n");
   fprintf(output, "                         A <dup time window> is specified in relative seconds\n");
   fprintf(output, "                         (e.g. 0.000001).\n");
+  fprintf(output, "  -I                     with -d, -D or -w, compare packets from their IP\n");
+  fprintf(output, "                         header on, ignoring the IPv4 TTL and header checksum\n");
+  fprintf(output, "                         and the IPv6 hop limit, so that copies of a packet\n");
+  fprintf(output, "                         captured on different hops match.\n");
   fprintf(output, "\n");
   fprintf(output, "           NOTE: The use of the 'Duplicate packet removal' options with\n");
   fprintf(output, "           other editcap options except -v may not always work as expected.\n");
@@ -804,6 +995,12 @@ main(int argc, char *argv[])
   char* init_progfile_dir_error;
 #endif
 
+#ifdef G_THREADS_ENABLED
+  /* Before any other GLib call; wiretap reads and writes in threads */
+  if (!g_thread_supported())
+    g_thread_init(NULL);
+#endif
+
   /*
    * Get credential information for later use.
    */
@@ -821,7 +1018,7 @@ main(int argc, char *argv[])
 #endif
 
   /* Process the options */
-  while ((opt = getopt(argc, argv, "A:B:c:C:dD:E:F:hrs:i:t:S:T:vw:")) !=-1) {
+  while ((opt = getopt(argc, argv, "A:B:c:C:dD:E:F:hIrs:i:t:S:T:vw:")) !=-1) {
 
     switch (opt) {
 
@@ -897,6 +1094,10 @@ main(int argc, char *argv[])
       set_rel_time(optarg);
       break;
 
+    case 'I':
+      dup_ignore_hops = TRUE;
+      break;
+
     case '?':              /* Bad options if GNU getopt */
       switch(optopt) {
       case'F':
@@ -1069,13 +1270,8 @@ main(int argc, char *argv[])
       if (add_selection(argv[i]) == FALSE)
         break;
 
-    if (dup_detect || dup_detect_by_time) {
-      for (i = 0; i < dup_window; i++) {
-        memset(&fd_hash[i].digest, 0, 16);
-        fd_hash[i].len = 0;
-        nstime_set_unset(&fd_hash[i].time);
-      }
-    }
+    if (dup_detect || dup_detect_by_time)
+      dup_table_init(dup_window);
 
     while (wtap_read(wth, &err, &err_info, &data_offset)) {
       phdr = wtap_phdr(wth);
@@ -1100,6 +1296,8 @@ main(int argc, char *argv[])
                   wtap_strerror(err));
           exit(2);
         }
+        /* write the file on a thread of its own */
+        wtap_dump_write_behind(pdh, 0);
       }
 
       g_assert(filename);
@@ -1131,6 +1329,7 @@ main(int argc, char *argv[])
               wtap_strerror(err));
             exit(2);
           }
+          wtap_dump_write_behind(pdh, 0);
         }
       }
 
@@ -1160,6 +1359,7 @@ main(int argc, char *argv[])
                 wtap_strerror(err));
             exit(2);
           }
+          wtap_dump_write_behind(pdh, 0);
         }
       }
 
@@ -1284,11 +1484,11 @@ main(int argc, char *argv[])
         /* suppress duplicates by packet window */
         if (dup_detect) {
           buf = wtap_buf_ptr(wth);
-          if (is_duplicate(buf, phdr->caplen)) {
+          if (is_duplicate(buf, phdr->caplen, phdr->pkt_encap)) {
             if (verbose) {
               fprintf(stdout, "Skipped: %u, Len: %u, MD5 Hash: ", count, phdr->caplen);
               for (i = 0; i < 16; i++) {
-                fprintf(stdout, "%02x", (unsigned char)fd_hash[cur_dup_entry].digest[i]);
+                fprintf(stdout, "%02x", (unsigned char)cur_digest[i]);
               }
               fprintf(stdout, "\n");
             }
@@ -1299,7 +1499,7 @@ main(int argc, char *argv[])
             if (verbose) {
               fprintf(stdout, "Packet: %u, Len: %u, MD5 Hash: ", count, phdr->caplen);
               for (i = 0; i < 16; i++) {
-                fprintf(stdout, "%02x", (unsigned char)fd_hash[cur_dup_entry].digest[i]);
+                fprintf(stdout, "%02x", (unsigned char)cur_digest[i]);
               }
               fprintf(stdout, "\n");
             }
@@ -1315,11 +1515,11 @@ main(int argc, char *argv[])
 
           buf = wtap_buf_ptr(wth);
 
-          if (is_duplicate_rel_time(buf, phdr->caplen, &current)) {
+          if (is_duplicate_rel_time(buf, phdr->caplen, phdr->pkt_encap, &current)) {
             if (verbose) {
               fprintf(stdout, "Skipped: %u, Len: %u, MD5 Hash: ", count, phdr->caplen);
               for (i = 0; i < 16; i++) {
-                fprintf(stdout, "%02x", (unsigned char)fd_hash[cur_dup_entry].digest[i]);
+                fprintf(stdout, "%02x", (unsigned char)cur_digest[i]);
               }
               fprintf(stdout, "\n");
             }
@@ -1330,7 +1530,7 @@ main(int argc, char *argv[])
             if (verbose) {
               fprintf(stdout, "Packet: %u, Len: %u, MD5 Hash: ", count, phdr->caplen);
               for (i = 0; i < 16; i++) {
-                fprintf(stdout, "%02x", (unsigned char)fd_hash[cur_dup_entry].digest[i]);
+                fprintf(stdout, "%02x", (unsigned char)cur_digest[i]);
               }
               fprintf(stdout, "\n");
             }
@@ -1396,6 +1596,14 @@ main(int argc, char *argv[])
         }
         written_count++;
       }
+      if (count == 1) {
+        /*
+         * The output encapsulation and file are set up now (the first
+         * packet is never a duplicate, so it gets here); decode the rest
+         * of the input on a thread of its own, while this one writes.
+         */
+        wtap_read_ahead(wth);
+      }
       count++;
     }
 
@@ -140,54 +140,67 @@
 
 #define MAXMANUFLEN         9  /* max vendor name length with ending '\0' */
 #define HASHETHSIZE      2048
-#define HASHHOSTSIZE     2048
 #define HASHIPXNETSIZE    256
 #define HASHMANUFSIZE     256
-#define HASHPORTSIZE      256
-#define SUBNETLENGTHSIZE   32  /*1-32 inc.*/
 
-/* hash table used for IPv4 lookup */
+/*
+ * The IPv4, IPv6, Ethernet and port tables are open-addressing tables of
+ * pointers to entries (see addr_table_lookup()); they start small and
+ * double whenever they get half full, so a capture with a million hosts
+ * costs about as much per lookup as one with ten.  The entries and the
+ * names they point to are carved out of one arena and are never freed,
+ * so a name handed out by any of the lookup functions stays valid.
+ */
+#define ADDR_TABLE_MIN_SIZE  256
+
+typedef struct addr_slot {
+  guint32   hash;
+  gpointer  entry;   /* NULL if the slot is free */
+} addr_slot_t;
 
-#define HASH_IPV4_ADDRESS(addr) (g_htonl(addr) & (HASHHOSTSIZE - 1))
+typedef struct addr_table {
+  addr_slot_t *slots;
+  guint32      mask;   /* number of slots - 1 */
+  guint32      count;
+} addr_table_t;
+
+/* hash table used for IPv4 lookup */
 
 typedef struct hashipv4 {
   guint             addr;
   gboolean          is_dummy_entry; /* name is IPv4 address in dot format */
   gboolean          resolve;        /* already tried to resolve it */
-  struct hashipv4   *next;
+  gchar            *name;           /* ip itself, or in the name arena */
   gchar             ip[16];
-  gchar             name[MAXNAMELEN];
 } hashipv4_t;
 
 /* hash table used for IPv6 lookup */
 
-#define HASH_IPV6_ADDRESS(addr) \
-    ((((addr).bytes[14] << 8)|((addr).bytes[15])) & (HASHHOSTSIZE - 1))
-
 typedef struct hashipv6 {
   struct e_in6_addr addr;
   gboolean          is_dummy_entry; /* name is IPv6 address in colon format */
   gboolean          resolve;        /* */
-  struct hashipv6   *next;
+  gchar            *name;           /* ip6 itself, or in the name arena */
   gchar             ip6[47];        /* XX */
-  gchar             name[MAXNAMELEN];
 } hashipv6_t;
 
-/* Array of entries of subnets of different lengths */
-typedef struct {
-  gsize        mask_length;      /*1-32*/
-  guint32      mask;             /* e.g. 255.255.255.*/
-  hashipv4_t** subnet_addresses; /* Hash table of subnet addresses */
-} subnet_length_entry_t;
+/* Node of a binary trie of subnets in which chains of nodes with a
+ * single child are collapsed into one node (a PATRICIA trie).  The subnets
+ * an address is in are on the path from the root towards the address;
+ * the last one with a name is the longest match.
+ */
+typedef struct subnet_node {
+  guint8              prefix[16];   /* network order, zero beyond length */
+  guint32             length;       /* prefix length in bits */
+  gchar              *name;         /* NULL for nodes that only branch */
+  struct subnet_node *child[2];     /* by the bit following the prefix */
+} subnet_node_t;
 
 /* hash table used for TCP/UDP/SCTP port lookup */
 
-#define HASH_PORT(port) ((port) & (HASHPORTSIZE - 1))
-
 typedef struct hashport {
   guint16          port;
-  struct hashport *next;
-  gchar            name[MAXNAMELEN];
+  gchar           *name;    /* in the name arena */
 } hashport_t;
 
 /* hash table used for IPX network lookup */
@@ -204,10 +217,6 @@ typedef struct hashipxnet {
 
 /* hash tables used for ethernet and manufacturer lookup */
 
-#define HASH_ETH_ADDRESS(addr) \
-    (((((addr)[2] << 8) | (addr)[3]) ^ (((addr)[4] << 8) | (addr)[5])) & \
-     (HASHETHSIZE - 1))
-
 #define HASH_ETH_MANUF(addr) (((int)(addr)[2]) & (HASHMANUFSIZE - 1))
 
 typedef struct hashmanuf {
@@ -221,11 +230,10 @@ typedef struct hashmanuf {
 #define HASHETHER_STATUS_RESOLVED_NAME  3
 
 typedef struct hashether {
-  struct hashether *next;
   guint             status;  /* (See above) */
   guint8            addr[6];
   char              hexaddr[6*3];
-  char              resolved_name[MAXNAMELEN];
+  char             *resolved_name;  /* hexaddr until resolved */
 } hashether_t;
 
 typedef struct hashwka {
@@ -250,23 +258,23 @@ typedef struct _ipxnet
   char              name[MAXNAMELEN];
 } ipxnet_t;
 
-static hashipv4_t   *ipv4_table[HASHHOSTSIZE];
-static hashipv6_t   *ipv6_table[HASHHOSTSIZE];
+static addr_table_t  ipv4_table;
+static addr_table_t  ipv6_table;
 
-static hashport_t   **cb_port_table;
+static addr_table_t *cb_port_table;
 static gchar        *cb_service;
 
-static hashport_t   *udp_port_table[HASHPORTSIZE];
-static hashport_t   *tcp_port_table[HASHPORTSIZE];
-static hashport_t   *sctp_port_table[HASHPORTSIZE];
-static hashport_t   *dccp_port_table[HASHPORTSIZE];
-static hashether_t  *eth_table[HASHETHSIZE];
+static addr_table_t  udp_port_table;
+static addr_table_t  tcp_port_table;
+static addr_table_t  sctp_port_table;
+static addr_table_t  dccp_port_table;
+static addr_table_t  eth_table;
 static hashmanuf_t  *manuf_table[HASHMANUFSIZE];
 static hashwka_t    *(*wka_table[48])[HASHETHSIZE];
 static hashipxnet_t *ipxnet_table[HASHIPXNETSIZE];
 
-static subnet_length_entry_t subnet_length_entries[SUBNETLENGTHSIZE]; /* Ordered array of entries */
-static gboolean have_subnet_entry = FALSE;
+static subnet_node_t *subnet_trie_ipv4 = NULL;
+static subnet_node_t *subnet_trie_ipv6 = NULL;
 
 static gboolean eth_resolution_initialized = FALSE;
 static int      ipxnet_resolution_initialized = 0;
@@ -378,12 +386,233 @@ add_async_dns_ipv4(int type, guint32 addr)
 
 #endif
 
+/* Resolver worker threads */
+#if defined(G_THREADS_ENABLED) && defined(HAVE_GETNAMEINFO)
+/*
+ * Reverse lookups that would otherwise call gethostbyaddr() in the middle
+ * of dissection are handed to a small pool of threads calling
+ * getnameinfo().  The workers never touch the host tables: a finished
+ * request goes back on resolv_results and is added to the tables by
+ * whoever owns them, in host_name_lookup_process() or
+ * host_name_lookup_wait().  Until then the address is shown the way an
+ * unresolved one is.
+ *
+ * If WIRESHARK_RESOLVER_FILE names a hosts-format file, the workers
+ * answer from that file alone and never ask the network, which makes
+ * the pipeline usable in tests.
+ */
+#define RESOLV_WORKERS
+#define RESOLV_MAX_WORKERS  16
+
+typedef struct _resolv_request
+{
+  int                 family;
+  union {
+    guint32           ip4;
+    struct e_in6_addr ip6;
+  } addr;
+  gboolean            resolved;
+  gchar               name[MAXNAMELEN];
+} resolv_request_t;
+
+static GThreadPool *resolv_pool = NULL;
+static GAsyncQueue *resolv_results = NULL;
+static guint        resolv_pending = 0;      /* pushed but not yet applied */
+static volatile gboolean resolv_stopping = FALSE; /* skip the lookups left */
+static GHashTable  *resolv_stand_in = NULL;  /* numeric address -> name */
+#endif /* G_THREADS_ENABLED && HAVE_GETNAMEINFO */
+
 typedef struct {
   guint32      mask;
   gsize        mask_length;
   const gchar* name; /* Shallow copy */
 } subnet_entry_t;
 
+/*
+ *  Entry and name arena
+ */
+
+#define RESOLV_ARENA_BLOCK  (64 * 1024)
+
+static guint8     *resolv_arena_ptr = NULL;
+static gsize       resolv_arena_left = 0;
+static GHashTable *resolv_names = NULL;   /* interned names */
+
+static gpointer
+resolv_arena_alloc(gsize size)
+{
+  gpointer p;
+
+  size = (size + 7) & ~(gsize)7;
+  if (size > resolv_arena_left) {
+    /* the rest of the old block is abandoned; blocks are never freed */
+    resolv_arena_left = MAX(size, RESOLV_ARENA_BLOCK);
+    resolv_arena_ptr = g_malloc(resolv_arena_left);
+  }
+  p = resolv_arena_ptr;
+  resolv_arena_ptr += size;
+  resolv_arena_left -= size;
+  return p;
+}
+
+/* Copy a name, cut to MAXNAMELEN - 1 characters, into the arena. */
+static gchar *
+resolv_name_copy(const gchar *name)
+{
+  gsize len = strlen(name);
+  gchar *copy;
+
+  if (len > MAXNAMELEN - 1)
+    len = MAXNAMELEN - 1;
+  copy = resolv_arena_alloc(len + 1);
+  memcpy(copy, name, len);
+  copy[len] = '\0';
+  return copy;
+}
+
+/* Like resolv_name_copy(), but names seen before are shared; used for
+ * names that come from files or the resolver, which often repeat (the
+ * same service on several transports, aliases), and not for names
+ * generated from an address, which never do. */
+static gchar *
+resolv_name_intern(const gchar *name)
+{
+  gchar buf[MAXNAMELEN];
+  gchar *interned;
+
+  if (resolv_names == NULL)
+    resolv_names = g_hash_table_new(g_str_hash, g_str_equal);
+
+  g_strlcpy(buf, name, MAXNAMELEN);
+  interned = g_hash_table_lookup(resolv_names, buf);
+  if (interned == NULL) {
+    interned = resolv_name_copy(buf);
+    g_hash_table_insert(resolv_names, interned, interned);
+  }
+  return interned;
+}
+
+/*
+ *  Open-addressing tables of entries
+ */
+
+/* final mix of MurmurHash3, so that every input bit affects the low bits
+ * used to pick a slot */
+static guint32
+addr_hash32(guint32 h)
+{
+  h ^= h >> 16;
+  h *= 0x85ebca6b;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35;
+  h ^= h >> 16;
+  return h;
+}
+
+static guint32
+addr_hash_bytes(const guint8 *p, gsize len)
+{
+  guint32 h = (guint32)len;
+  guint32 k;
+  gsize i;
+
+  for (i = 0; i + 4 <= len; i += 4) {
+    k = p[i] | (p[i+1] << 8) | (p[i+2] << 16) | ((guint32)p[i+3] << 24);
+    k *= 0xcc9e2d51;
+    k = (k << 15) | (k >> 17);
+    k *= 0x1b873593;
+    h ^= k;
+    h = (h << 13) | (h >> 19);
+    h = h * 5 + 0xe6546b64;
+  }
+  for (; i < len; i++)
+    h = (h ^ p[i]) * 0x01000193;
+  return addr_hash32(h);
+}
+
+typedef gboolean (*addr_match_func)(gconstpointer entry, gconstpointer key);
+
+/* Return the entry matching key, or NULL; either way *slotp is the index
+ * of the slot it is in or should go in. */
+static gpointer
+addr_table_lookup(addr_table_t *t, guint32 hash, addr_match_func match,
+                  gconstpointer key, guint32 *slotp)
+{
+  guint32 i;
+  addr_slot_t *slot;
+
+  if (t->slots == NULL) {
+    t->slots = g_malloc0(sizeof(addr_slot_t) * ADDR_TABLE_MIN_SIZE);
+    t->mask = ADDR_TABLE_MIN_SIZE - 1;
+    t->count = 0;
+  }
+
+  /* linear probing; the table is never more than half full */
+  for (i = hash & t->mask; ; i = (i + 1) & t->mask) {
+    slot = &t->slots[i];
+    if (slot->entry == NULL)
+      break;
+    if (slot->hash == hash && match(slot->entry, key)) {
+      *slotp = i;
+      return slot->entry;
+    }
+  }
+  *slotp = i;
+  return NULL;
+}
+
+/* Put entry in the free slot addr_table_lookup() returned. */
+static void
+addr_table_insert(addr_table_t *t, guint32 slot, guint32 hash, gpointer entry)
+{
+  addr_slot_t *old_slots;
+  guint32 old_size, i, j;
+
+  t->slots[slot].hash = hash;
+  t->slots[slot].entry = entry;
+  if (++t->count <= t->mask / 2)
+    return;
+
+  old_slots = t->slots;
+  old_size = t->mask + 1;
+  t->mask = old_size * 2 - 1;
+  t->slots = g_malloc0(sizeof(addr_slot_t) * (t->mask + 1));
+  for (i = 0; i < old_size; i++) {
+    if (old_slots[i].entry == NULL)
+      continue;
+    for (j = old_slots[i].hash & t->mask; t->slots[j].entry != NULL;
+         j = (j + 1) & t->mask)
+      ;
+    t->slots[j] = old_slots[i];
+  }
+  g_free(old_slots);
+}
+
+static gboolean
+ipv4_entry_match(gconstpointer entry, gconstpointer key)
+{
+  return ((const hashipv4_t *)entry)->addr == *(const guint *)key;
+}
+
+static gboolean
+ipv6_entry_match(gconstpointer entry, gconstpointer key)
+{
+  return memcmp(&((const hashipv6_t *)entry)->addr, key,
+                sizeof(struct e_in6_addr)) == 0;
+}
+
+static gboolean
+port_entry_match(gconstpointer entry, gconstpointer key)
+{
+  return ((const hashport_t *)entry)->port == *(const guint *)key;
+}
+
+static gboolean
+eth_entry_match(gconstpointer entry, gconstpointer key)
+{
+  return memcmp(((const hashether_t *)entry)->addr, key, 6) == 0;
+}
+
 /*
  *  Miscellaneous functions
  */
@@ -432,40 +661,27 @@ fgetline(char **buf, int *size, FILE *fp)
  *  Local function definitions
  */
 static subnet_entry_t subnet_lookup(const guint32 addr);
+static subnet_entry_t subnet_lookup6(const struct e_in6_addr *addr);
 static void subnet_entry_set(guint32 subnet_addr, const guint32 mask_length, const gchar* name);
+static void subnet_entry_set6(const struct e_in6_addr *subnet_addr, const guint32 mask_length, const gchar* name);
+static guint32 get_subnet_mask(const guint32 mask_length);
 
 
 static void
-add_service_name(hashport_t **proto_table, const guint port, const char *service_name)
+add_service_name(addr_table_t *proto_table, const guint port, const char *service_name)
 {
-  int hash_idx;
+  guint32 hash, slot;
   hashport_t *tp;
 
-
-  hash_idx = HASH_PORT(port);
-  tp = proto_table[hash_idx];
-
-  if( tp == NULL ) {
-    tp = proto_table[hash_idx] = (hashport_t *)g_malloc(sizeof(hashport_t));
-  } else {
-    while(1) {
-      if( tp->port == port ) {
-        return;
-      }
-      if (tp->next == NULL) {
-        tp->next = (hashport_t *)g_malloc(sizeof(hashport_t));
-        tp = tp->next;
-        break;
-      }
-      tp = tp->next;
-    }
-  }
+  hash = addr_hash32(port);
+  if (addr_table_lookup(proto_table, hash, port_entry_match, &port, &slot) != NULL)
+    return;
 
   /* fill in a new entry */
+  tp = resolv_arena_alloc(sizeof(hashport_t));
   tp->port = port;
-  tp->next = NULL;
-
-  g_strlcpy(tp->name, service_name, MAXNAMELEN);
+  tp->name = resolv_name_intern(service_name);
+  addr_table_insert(proto_table, slot, hash, tp);
 
   new_resolved_objects = TRUE;
 }
@@ -508,19 +724,19 @@ parse_service_line (char *line)
   /* seems we got all interesting things from the file */
   if(strcmp(cp, "tcp") == 0) {
     max_port = MAX_TCP_PORT;
-    cb_port_table = tcp_port_table;
+    cb_port_table = &tcp_port_table;
   }
   else if(strcmp(cp, "udp") == 0) {
     max_port = MAX_UDP_PORT;
-    cb_port_table = udp_port_table;
+    cb_port_table = &udp_port_table;
   }
   else if(strcmp(cp, "sctp") == 0) {
     max_port = MAX_SCTP_PORT;
-    cb_port_table = sctp_port_table;
+    cb_port_table = &sctp_port_table;
   }
   else if(strcmp(cp, "dccp") == 0) {
     max_port = MAX_DCCP_PORT;
-    cb_port_table = dccp_port_table;
+    cb_port_table = &dccp_port_table;
   } else {
     return;
   }
@@ -591,11 +807,12 @@ initialize_services(void)
 static gchar
 *serv_name_lookup(const guint port, const port_type proto)
 {
-  int hash_idx;
+  guint32 hash, slot;
   hashport_t *tp;
-  hashport_t **table;
+  addr_table_t *table;
   const char *serv_proto = NULL;
   struct servent *servp;
+  gchar buf[MAXNAMELEN];
 
 
   if (!service_resolution_initialized) {
@@ -605,19 +822,19 @@ static gchar
 
   switch(proto) {
   case PT_UDP:
-    table = udp_port_table;
+    table = &udp_port_table;
     serv_proto = "udp";
     break;
   case PT_TCP:
-    table = tcp_port_table;
+    table = &tcp_port_table;
     serv_proto = "tcp";
     break;
   case PT_SCTP:
-    table = sctp_port_table;
+    table = &sctp_port_table;
     serv_proto = "sctp";
     break;
   case PT_DCCP:
-    table = dccp_port_table;
+    table = &dccp_port_table;
     serv_proto = "dcp";
     break;
   default:
@@ -626,36 +843,24 @@ static gchar
     /*NOTREACHED*/
   } /* proto */
 
-  hash_idx = HASH_PORT(port);
-  tp = table[hash_idx];
-
-  if( tp == NULL ) {
-    tp = table[hash_idx] = (hashport_t *)g_malloc(sizeof(hashport_t));
-  } else {
-    while(1) {
-      if( tp->port == port ) {
-        return tp->name;
-      }
-      if (tp->next == NULL) {
-        tp->next = (hashport_t *)g_malloc(sizeof(hashport_t));
-        tp = tp->next;
-        break;
-      }
-      tp = tp->next;
-    }
-  }
+  hash = addr_hash32(port);
+  tp = addr_table_lookup(table, hash, port_entry_match, &port, &slot);
+  if (tp != NULL)
+    return tp->name;
 
   /* fill in a new entry */
+  tp = resolv_arena_alloc(sizeof(hashport_t));
   tp->port = port;
-  tp->next = NULL;
 
   if (!(g_resolv_flags & RESOLV_TRANSPORT) ||
       (servp = getservbyport(g_htons(port), serv_proto)) == NULL) {
-    /* unknown port */
-    guint32_to_str_buf(port, tp->name, MAXNAMELEN);
+    /* unknown port; the same number is shared by all transports */
+    guint32_to_str_buf(port, buf, MAXNAMELEN);
+    tp->name = resolv_name_intern(buf);
   } else {
-    g_strlcpy(tp->name, servp->s_name, MAXNAMELEN);
+    tp->name = resolv_name_intern(servp->s_name);
   }
+  addr_table_insert(table, slot, hash, tp);
 
   return (tp->name);
 
@@ -669,6 +874,7 @@ static void
 fill_dummy_ip4(const guint addr, hashipv4_t* volatile tp)
 {
   subnet_entry_t subnet_entry;
+  gchar name[MAXNAMELEN];
 
   if (tp->is_dummy_entry)
       return; /* already done */
@@ -703,9 +909,10 @@ fill_dummy_ip4(const guint addr, hashipv4_t* volatile tp)
     /* There are more efficient ways to do this, but this is safe if we
      * trust g_snprintf and MAXNAMELEN
      */
-    g_snprintf(tp->name, MAXNAMELEN, "%s%s", subnet_entry.name, paddr);
+    g_snprintf(name, MAXNAMELEN, "%s%s", subnet_entry.name, paddr);
+    tp->name = resolv_name_copy(name);
   } else {
-    ip_to_str_buf((guint8 *)&addr, tp->name, MAXNAMELEN);
+    tp->name = tp->ip;
   }
 }
 
@@ -743,50 +950,236 @@ c_ares_ghba_cb(void *arg, int status, int timeouts _U_, struct hostent *he) {
 }
 #endif /* HAVE_C_ARES */
 
+#ifdef RESOLV_WORKERS
+static GHashTable *
+read_resolver_file(const char *path)
+{
+  FILE *hf;
+  char *line = NULL;
+  int size = 0;
+  gchar *cp;
+  guint32 host_addr[4]; /* IPv4 or IPv6 */
+  gchar addr_str[sizeof ((hashipv6_t *)0)->ip6];
+  GHashTable *table;
+
+  if ((hf = ws_fopen(path, "r")) == NULL) {
+    report_open_failure(path, errno, FALSE);
+    return NULL;
+  }
+
+  table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  while (fgetline(&line, &size, hf) >= 0) {
+    if ((cp = strchr(line, '#')))
+      *cp = '\0';
+
+    if ((cp = strtok(line, " \t")) == NULL)
+      continue; /* no tokens in the line */
+
+    /* key on the same text the workers will produce */
+    if (inet_pton(AF_INET6, cp, &host_addr) == 1)
+      ip6_to_str_buf((struct e_in6_addr *)host_addr, addr_str);
+    else if (inet_pton(AF_INET, cp, &host_addr) == 1)
+      ip_to_str_buf((guint8 *)host_addr, addr_str, sizeof addr_str);
+    else
+      continue;
+
+    if ((cp = strtok(NULL, " \t")) == NULL)
+      continue; /* no host name */
+
+    g_hash_table_insert(table, g_strdup(addr_str), g_strdup(cp));
+  }
+  g_free(line);
+
+  fclose(hf);
+  return table;
+}
+
+/* Runs in a worker thread. */
+static void
+resolv_worker(gpointer data, gpointer user_data _U_)
+{
+  resolv_request_t *req = data;
+  gchar addr_str[sizeof ((hashipv6_t *)0)->ip6];
+  const gchar *name;
+  struct sockaddr_in sin;
+#ifdef INET6
+  struct sockaddr_in6 sin6;
+#endif
+
+  if (resolv_stopping) {
+    /* resolv_workers_cleanup() only wants the request back */
+  } else if (resolv_stand_in != NULL) {
+    if (req->family == AF_INET)
+      ip_to_str_buf((guint8 *)&req->addr.ip4, addr_str, sizeof addr_str);
+    else
+      ip6_to_str_buf(&req->addr.ip6, addr_str);
+    name = g_hash_table_lookup(resolv_stand_in, addr_str);
+    if (name != NULL) {
+      g_strlcpy(req->name, name, MAXNAMELEN);
+      req->resolved = TRUE;
+    }
+  } else if (req->family == AF_INET) {
+    memset(&sin, 0, sizeof sin);
+    sin.sin_family = AF_INET;
+    memcpy(&sin.sin_addr, &req->addr.ip4, sizeof req->addr.ip4);
+    req->resolved = getnameinfo((struct sockaddr *)&sin, sizeof sin,
+                                req->name, MAXNAMELEN, NULL, 0,
+                                NI_NAMEREQD) == 0;
+#ifdef INET6
+  } else {
+    memset(&sin6, 0, sizeof sin6);
+    sin6.sin6_family = AF_INET6;
+    memcpy(&sin6.sin6_addr, &req->addr.ip6, sizeof req->addr.ip6);
+    req->resolved = getnameinfo((struct sockaddr *)&sin6, sizeof sin6,
+                                req->name, MAXNAMELEN, NULL, 0,
+                                NI_NAMEREQD) == 0;
+#endif
+  }
+
+  g_async_queue_push(resolv_results, req);
+}
+
+/* Set up the pool for the first lookup, so that there's none unless
+ * network name resolution is on; returns FALSE if threads can't be used.
+ * g_thread_init() is up to the program, before any other GLib call. */
+static gboolean
+resolv_workers_init(void)
+{
+  const char *stand_in;
+
+  if (resolv_pool != NULL)
+    return TRUE;
+
+  if (!g_thread_supported())
+    return FALSE;
+
+  stand_in = getenv("WIRESHARK_RESOLVER_FILE");
+  if (stand_in != NULL && (resolv_stand_in = read_resolver_file(stand_in)) == NULL)
+    resolv_stand_in = g_hash_table_new(g_str_hash, g_str_equal);
+
+  resolv_results = g_async_queue_new();
+  resolv_stopping = FALSE;
+  /* Threads are only started once requests arrive. */
+  resolv_pool = g_thread_pool_new(resolv_worker, NULL, RESOLV_MAX_WORKERS,
+                                  FALSE, NULL);
+  return TRUE;
+}
+
+/* Hand an address to the workers; returns FALSE if there are none. */
+static gboolean
+resolv_workers_push(int family, const void *addr)
+{
+  resolv_request_t *req;
+
+  if (!resolv_workers_init())
+    return FALSE;
+
+  req = g_malloc0(sizeof(resolv_request_t));
+  req->family = family;
+  if (family == AF_INET)
+    memcpy(&req->addr.ip4, addr, sizeof req->addr.ip4);
+  else
+    memcpy(&req->addr.ip6, addr, sizeof req->addr.ip6);
+  resolv_pending++;
+  g_thread_pool_push(resolv_pool, req, NULL);
+  return TRUE;
+}
+
+/* Add finished requests to the host tables, optionally waiting for all
+ * outstanding ones. */
+static void
+resolv_workers_drain(gboolean wait)
+{
+  resolv_request_t *req;
+
+  while (resolv_pending > 0) {
+    if (wait)
+      req = g_async_queue_pop(resolv_results);
+    else if ((req = g_async_queue_try_pop(resolv_results)) == NULL)
+      break;
+    resolv_pending--;
+
+    if (req->resolved) {
+      if (req->family == AF_INET)
+        add_ipv4_name(req->addr.ip4, req->name);
+      else
+        add_ipv6_name(&req->addr.ip6, req->name);
+    }
+    g_free(req);
+  }
+}
+
+static void
+resolv_workers_cleanup(void)
+{
+  resolv_request_t *req;
+
+  if (resolv_pool == NULL)
+    return;
+
+  /* The pool doesn't hand back what hasn't started, so have the workers
+   * pass the rest straight back to be freed, and wait for them. */
+  resolv_stopping = TRUE;
+  g_thread_pool_free(resolv_pool, FALSE, TRUE);
+  resolv_pool = NULL;
+  while ((req = g_async_queue_try_pop(resolv_results)) != NULL)
+    g_free(req);
+  g_async_queue_unref(resolv_results);
+  resolv_results = NULL;
+  resolv_pending = 0;
+
+  if (resolv_stand_in != NULL) {
+    g_hash_table_destroy(resolv_stand_in);
+    resolv_stand_in = NULL;
+  }
+}
+#endif /* RESOLV_WORKERS */
+
 /* --------------- */
 static hashipv4_t *
 new_ipv4(const guint addr)
 {
-  hashipv4_t *tp = g_malloc(sizeof(hashipv4_t));
+  hashipv4_t *tp = resolv_arena_alloc(sizeof(hashipv4_t));
   tp->addr = addr;
-  tp->next = NULL;
   tp->resolve = FALSE;
   tp->is_dummy_entry = FALSE;
   ip_to_str_buf((guint8 *)&addr, tp->ip, sizeof(tp->ip));
+  tp->name = tp->ip;
+  return tp;
+}
+
+/* The entry for an IPv4 address, created if there isn't one yet; *is_new
+ * tells which. */
+static hashipv4_t *
+ipv4_entry(const guint addr, gboolean *is_new)
+{
+  guint32 hash, slot;
+  hashipv4_t *tp;
+
+  hash = addr_hash32(addr);
+  tp = addr_table_lookup(&ipv4_table, hash, ipv4_entry_match, &addr, &slot);
+  *is_new = (tp == NULL);
+  if (tp == NULL) {
+    tp = new_ipv4(addr);
+    addr_table_insert(&ipv4_table, slot, hash, tp);
+  }
   return tp;
 }
 
 static hashipv4_t *
 host_lookup(const guint addr, const gboolean resolve, gboolean *found)
 {
-  int hash_idx;
   hashipv4_t * volatile tp;
   struct hostent *hostp;
+  gboolean is_new;
 
   *found = TRUE;
 
-  hash_idx = HASH_IPV4_ADDRESS(addr);
-
-  tp = ipv4_table[hash_idx];
-
-  if( tp == NULL ) {
-    tp = ipv4_table[hash_idx] = new_ipv4(addr);
-  } else {
-    while(1) {
-      if( tp->addr == addr ) {
-        if (tp->is_dummy_entry && !tp->resolve)
-          break;
-        if (tp->is_dummy_entry)
-          *found = FALSE;
-        return tp;
-      }
-      if (tp->next == NULL) {
-        tp->next = new_ipv4(addr);
-        tp = tp->next;
-        break;
-      }
-      tp = tp->next;
-    }
+  tp = ipv4_entry(addr, &is_new);
+  if (!is_new && !(tp->is_dummy_entry && !tp->resolve)) {
+    if (tp->is_dummy_entry)
+      *found = FALSE;
+    return tp;
   }
 
   if (resolve) {
@@ -815,10 +1208,18 @@ host_lookup(const guint addr, const gboolean resolve, gboolean *found)
        * else call gethostbyaddr and hope for the best
        */
 
+#ifdef RESOLV_WORKERS
+      if (resolv_workers_push(AF_INET, &addr)) {
+        *found = FALSE;
+        fill_dummy_ip4(addr, tp);
+        return tp;
+      }
+#endif /* RESOLV_WORKERS */
+
       hostp = gethostbyaddr((char *)&addr, 4, AF_INET);
 
       if (hostp != NULL) {
-        g_strlcpy(tp->name, hostp->h_name, MAXNAMELEN);
+        tp->name = resolv_name_intern(hostp->h_name);
         tp->is_dummy_entry = FALSE;
         return tp;
       }
@@ -844,16 +1245,75 @@ host_name_lookup(const guint addr, gboolean *found)
 }
 
 
+/* Fill in an IP6 structure with info from subnets file or just with the
+ * string form of the address.
+ */
+static void
+fill_dummy_ip6(hashipv6_t* volatile tp)
+{
+  subnet_entry_t subnet_entry;
+  gchar name[MAXNAMELEN];
+
+  if (tp->is_dummy_entry)
+      return; /* already done */
+
+  tp->is_dummy_entry = TRUE; /* Overwrite if we get async DNS reply */
+
+  /* Do we have a subnet for this address? */
+  subnet_entry = subnet_lookup6(&tp->addr);
+  if(0 != subnet_entry.mask_length) {
+    /* Print name, then the address with the subnet prefix cleared,
+     * e.g. "name::1"
+     */
+    struct e_in6_addr host_addr;
+    gchar buffer[sizeof tp->ip6];
+    gsize i;
+
+    host_addr = tp->addr;
+    for (i = 0; i < sizeof host_addr.bytes; i++) {
+      if (8 * (i + 1) <= subnet_entry.mask_length)
+        host_addr.bytes[i] = 0;
+      else if (8 * i < subnet_entry.mask_length)
+        host_addr.bytes[i] &= 0xff >> (subnet_entry.mask_length - 8 * i);
+    }
+    ip6_to_str_buf(&host_addr, buffer);
+
+    g_snprintf(name, MAXNAMELEN, "%s%s%s", subnet_entry.name,
+               buffer[0] == ':' ? "" : ":", buffer);
+    tp->name = resolv_name_copy(name);
+  } else {
+    tp->name = tp->ip6;
+  }
+}
+
 /* --------------- */
 static hashipv6_t *
 new_ipv6(const struct e_in6_addr *addr)
 {
-  hashipv6_t *tp = g_malloc(sizeof(hashipv6_t));
+  hashipv6_t *tp = resolv_arena_alloc(sizeof(hashipv6_t));
   tp->addr = *addr;
-  tp->next = NULL;
   tp->resolve = FALSE;
   tp->is_dummy_entry = FALSE;
   ip6_to_str_buf(addr, tp->ip6);
+  tp->name = tp->ip6;
+  return tp;
+}
+
+/* The entry for an IPv6 address, created if there isn't one yet; *is_new
+ * tells which. */
+static hashipv6_t *
+ipv6_entry(const struct e_in6_addr *addr, gboolean *is_new)
+{
+  guint32 hash, slot;
+  hashipv6_t *tp;
+
+  hash = addr_hash_bytes(addr->bytes, sizeof addr->bytes);
+  tp = addr_table_lookup(&ipv6_table, hash, ipv6_entry_match, addr, &slot);
+  *is_new = (tp == NULL);
+  if (tp == NULL) {
+    tp = new_ipv6(addr);
+    addr_table_insert(&ipv6_table, slot, hash, tp);
+  }
   return tp;
 }
 
@@ -861,8 +1321,8 @@ new_ipv6(const struct e_in6_addr *addr)
 static hashipv6_t *
 host_lookup6(const struct e_in6_addr *addr, const gboolean resolve, gboolean *found)
 {
-  int hash_idx;
   hashipv6_t * volatile tp;
+  gboolean is_new;
 #ifdef INET6
 #ifdef HAVE_C_ARES
   async_dns_queue_msg_t *caqm;
@@ -872,28 +1332,11 @@ host_lookup6(const struct e_in6_addr *addr, const gboolean resolve, gboolean *fo
 
   *found = TRUE;
 
-  hash_idx = HASH_IPV6_ADDRESS(*addr);
-
-  tp = ipv6_table[hash_idx];
-
-  if( tp == NULL ) {
-    tp = ipv6_table[hash_idx] = new_ipv6(addr);
-  } else {
-    while(1) {
-      if( memcmp(&tp->addr, addr, sizeof (struct e_in6_addr)) == 0 ) {
-        if (tp->is_dummy_entry && !tp->resolve)
-          break;
-        if (tp->is_dummy_entry)
-          *found = FALSE;
-        return tp;
-      }
-      if (tp->next == NULL) {
-        tp->next = new_ipv6(addr);
-        tp = tp->next;
-        break;
-      }
-      tp = tp->next;
-    }
+  tp = ipv6_entry(addr, &is_new);
+  if (!is_new && !(tp->is_dummy_entry && !tp->resolve)) {
+    if (tp->is_dummy_entry)
+      *found = FALSE;
+    return tp;
   }
 
   if (resolve) {
@@ -912,20 +1355,24 @@ host_lookup6(const struct e_in6_addr *addr, const gboolean resolve, gboolean *fo
     /* XXX found is set to TRUE, which seems a bit odd, but I'm not
      * going to risk changing the semantics.
      */
-    if (!tp->is_dummy_entry) {
-      g_strlcpy(tp->name, tp->ip6, MAXNAMELEN);
-      ip6_to_str_buf(addr, tp->name);
-      tp->is_dummy_entry = TRUE;
-    }
+    fill_dummy_ip6(tp);
     return tp;
   }
 #endif /* HAVE_C_ARES */
 
+#ifdef RESOLV_WORKERS
+  if (resolv_workers_push(AF_INET6, addr)) {
+    fill_dummy_ip6(tp);
+    *found = FALSE;
+    return tp;
+  }
+#endif /* RESOLV_WORKERS */
+
   /* Quick hack to avoid DNS/YP timeout */
   hostp = gethostbyaddr((char *)addr, sizeof(*addr), AF_INET6);
 
   if (hostp != NULL) {
-    g_strlcpy(tp->name, hostp->h_name, MAXNAMELEN);
+    tp->name = resolv_name_intern(hostp->h_name);
     tp->is_dummy_entry = FALSE;
     return tp;
   }
@@ -933,10 +1380,7 @@ host_lookup6(const struct e_in6_addr *addr, const gboolean resolve, gboolean *fo
   }
 
   /* unknown host or DNS timeout */
-  if (!tp->is_dummy_entry) {
-    tp->is_dummy_entry = TRUE;
-    g_strlcpy(tp->name, tp->ip6, MAXNAMELEN);
-  }
+  fill_dummy_ip6(tp);
   *found = FALSE;
   return tp;
 
@@ -1504,9 +1948,10 @@ static hashether_t *
 eth_addr_resolve(hashether_t *tp) {
   ether_t      *eth;
   const guint8 *addr = tp->addr;
+  gchar         buf[MAXNAMELEN];
 
   if ( (eth = get_ethbyaddr(addr)) != NULL) {
-    g_strlcpy(tp->resolved_name, eth->name, MAXNAMELEN);
+    tp->resolved_name = resolv_name_intern(eth->name);
     tp->status = HASHETHER_STATUS_RESOLVED_NAME;
     return tp;
   } else {
@@ -1520,8 +1965,9 @@ eth_addr_resolve(hashether_t *tp) {
     for (;;) {
       /* Only the topmost 5 bytes participate fully */
       if ((wtp = wka_name_lookup(addr, mask+40)) != NULL) {
-        g_snprintf(tp->resolved_name, MAXNAMELEN, "%s_%02x",
+        g_snprintf(buf, MAXNAMELEN, "%s_%02x",
                    wtp->name, addr[5] & (0xFF >> mask));
+        tp->resolved_name = resolv_name_copy(buf);
         tp->status = HASHETHER_STATUS_RESOLVED_DUMMY;
         return tp;
       }
@@ -1534,8 +1980,9 @@ eth_addr_resolve(hashether_t *tp) {
     for (;;) {
       /* Only the topmost 4 bytes participate fully */
       if ((wtp = wka_name_lookup(addr, mask+32)) != NULL) {
-        g_snprintf(tp->resolved_name, MAXNAMELEN, "%s_%02x:%02x",
+        g_snprintf(buf, MAXNAMELEN, "%s_%02x:%02x",
                    wtp->name, addr[4] & (0xFF >> mask), addr[5]);
+        tp->resolved_name = resolv_name_copy(buf);
         tp->status = HASHETHER_STATUS_RESOLVED_DUMMY;
         return tp;
       }
@@ -1548,8 +1995,9 @@ eth_addr_resolve(hashether_t *tp) {
     for (;;) {
       /* Only the topmost 3 bytes participate fully */
       if ((wtp = wka_name_lookup(addr, mask+24)) != NULL) {
-        g_snprintf(tp->resolved_name, MAXNAMELEN, "%s_%02x:%02x:%02x",
+        g_snprintf(buf, MAXNAMELEN, "%s_%02x:%02x:%02x",
                    wtp->name, addr[3] & (0xFF >> mask), addr[4], addr[5]);
+        tp->resolved_name = resolv_name_copy(buf);
         tp->status = HASHETHER_STATUS_RESOLVED_DUMMY;
         return tp;
       }
@@ -1560,8 +2008,9 @@ eth_addr_resolve(hashether_t *tp) {
 
     /* Now try looking in the manufacturer table. */
     if ((mtp = manuf_name_lookup(addr)) != NULL) {
-      g_snprintf(tp->resolved_name, MAXNAMELEN, "%s_%02x:%02x:%02x",
+      g_snprintf(buf, MAXNAMELEN, "%s_%02x:%02x:%02x",
                  mtp->name, addr[3], addr[4], addr[5]);
+      tp->resolved_name = resolv_name_copy(buf);
       tp->status = HASHETHER_STATUS_RESOLVED_DUMMY;
       return tp;
     }
@@ -1572,9 +2021,10 @@ eth_addr_resolve(hashether_t *tp) {
     for (;;) {
       /* Only the topmost 2 bytes participate fully */
       if ((wtp = wka_name_lookup(addr, mask+16)) != NULL) {
-        g_snprintf(tp->resolved_name, MAXNAMELEN, "%s_%02x:%02x:%02x:%02x",
+        g_snprintf(buf, MAXNAMELEN, "%s_%02x:%02x:%02x:%02x",
                    wtp->name, addr[2] & (0xFF >> mask), addr[3], addr[4],
                    addr[5]);
+        tp->resolved_name = resolv_name_copy(buf);
         tp->status = HASHETHER_STATUS_RESOLVED_DUMMY;
         return tp;
       }
@@ -1587,9 +2037,10 @@ eth_addr_resolve(hashether_t *tp) {
     for (;;) {
       /* Only the topmost byte participates fully */
       if ((wtp = wka_name_lookup(addr, mask+8)) != NULL) {
-        g_snprintf(tp->resolved_name, MAXNAMELEN, "%s_%02x:%02x:%02x:%02x:%02x",
+        g_snprintf(buf, MAXNAMELEN, "%s_%02x:%02x:%02x:%02x:%02x",
                    wtp->name, addr[1] & (0xFF >> mask), addr[2], addr[3],
                    addr[4], addr[5]);
+        tp->resolved_name = resolv_name_copy(buf);
         tp->status = HASHETHER_STATUS_RESOLVED_DUMMY;
         return tp;
       }
@@ -1601,16 +2052,18 @@ eth_addr_resolve(hashether_t *tp) {
     for (mask = 7; mask > 0; mask--) {
       /* Not even the topmost byte participates fully */
       if ((wtp = wka_name_lookup(addr, mask)) != NULL) {
-        g_snprintf(tp->resolved_name, MAXNAMELEN, "%s_%02x:%02x:%02x:%02x:%02x:%02x",
+        g_snprintf(buf, MAXNAMELEN, "%s_%02x:%02x:%02x:%02x:%02x:%02x",
                    wtp->name, addr[0] & (0xFF >> mask), addr[1], addr[2],
                    addr[3], addr[4], addr[5]);
+        tp->resolved_name = resolv_name_copy(buf);
         tp->status = HASHETHER_STATUS_RESOLVED_DUMMY;
         return tp;
       }
     }
 
     /* No match whatsoever. */
-    g_snprintf(tp->resolved_name, MAXNAMELEN, "%s", ether_to_str(addr));
+    g_snprintf(buf, MAXNAMELEN, "%s", ether_to_str(addr));
+    tp->resolved_name = resolv_name_copy(buf);
     tp->status = HASHETHER_STATUS_RESOLVED_DUMMY;
     return tp;
   }
@@ -1621,12 +2074,11 @@ static hashether_t *
 eth_hash_new_entry(const guint8 *addr, const gboolean resolve) {
   hashether_t *tp;
 
-  tp = (hashether_t *)g_malloc(sizeof(hashether_t));
+  tp = resolv_arena_alloc(sizeof(hashether_t));
   memcpy(tp->addr, addr, sizeof(tp->addr));
   tp->status = HASHETHER_STATUS_UNRESOLVED;
   g_strlcpy(tp->hexaddr, bytestring_to_str(addr, sizeof(tp->addr), ':'), sizeof(tp->hexaddr));
-  tp->resolved_name[0] = '\0';
-  tp->next = NULL;
+  tp->resolved_name = tp->hexaddr;
 
   if (resolve)
     eth_addr_resolve(tp);
@@ -1637,31 +2089,19 @@ eth_hash_new_entry(const guint8 *addr, const gboolean resolve) {
 static hashether_t *
 add_eth_name(const guint8 *addr, const gchar *name)
 {
-  gint         hash_idx;
+  guint32      hash, slot;
   hashether_t *tp;
 
-  hash_idx = HASH_ETH_ADDRESS(addr);
-
-  tp = eth_table[hash_idx];
-  if( tp == NULL ) {
-    tp = eth_table[hash_idx] = eth_hash_new_entry(addr, FALSE);
-  } else {
-    while(TRUE) {
-      if (memcmp(tp->addr, addr, sizeof(tp->addr)) == 0) {
-        /* address already known */
-        if (tp->status == HASHETHER_STATUS_RESOLVED_NAME)
-          return tp; /* Entry with a name already in table; ignore attempted replacement */
-        break;       /* Update name of existing entry */
-        }
-      if (tp->next == NULL) {
-        tp = tp->next = eth_hash_new_entry(addr, FALSE);
-        break;
-      }
-      tp = tp->next;
-    }
+  hash = addr_hash_bytes(addr, 6);
+  tp = addr_table_lookup(&eth_table, hash, eth_entry_match, addr, &slot);
+  if (tp == NULL) {
+    tp = eth_hash_new_entry(addr, FALSE);
+    addr_table_insert(&eth_table, slot, hash, tp);
+  } else if (tp->status == HASHETHER_STATUS_RESOLVED_NAME) {
+    return tp; /* Entry with a name already in table; ignore attempted replacement */
   }
 
-  g_strlcpy(tp->resolved_name, name, MAXNAMELEN);
+  tp->resolved_name = resolv_name_intern(name);
   tp->status = HASHETHER_STATUS_RESOLVED_NAME;
   new_resolved_objects = TRUE;
 
@@ -1670,29 +2110,18 @@ add_eth_name(const guint8 *addr, const gchar *name)
 
 static hashether_t *
 eth_name_lookup(const guint8 *addr, const gboolean resolve) {
-  gint          hash_idx;
+  guint32       hash, slot;
   hashether_t  *tp;
 
-  hash_idx = HASH_ETH_ADDRESS(addr);
-
-  tp = eth_table[hash_idx];
-  if( tp == NULL ) {
-    tp = eth_table[hash_idx] = eth_hash_new_entry(addr, resolve);
-    return tp;
-  } else {
-    while(TRUE) {
-      if (memcmp(tp->addr, addr, sizeof(tp->addr)) == 0) {
-        if (resolve && (tp->status == HASHETHER_STATUS_UNRESOLVED))
-          eth_addr_resolve(tp); /* Found but needs to be resolved */
-        return tp;
-      }
-      if (tp->next == NULL) {
-        tp->next = eth_hash_new_entry(addr, resolve);
-        return tp->next;
-      }
-      tp = tp->next;
-    }
+  hash = addr_hash_bytes(addr, 6);
+  tp = addr_table_lookup(&eth_table, hash, eth_entry_match, addr, &slot);
+  if (tp == NULL) {
+    tp = eth_hash_new_entry(addr, resolve);
+    addr_table_insert(&eth_table, slot, hash, tp);
+  } else if (resolve && (tp->status == HASHETHER_STATUS_UNRESOLVED)) {
+    eth_addr_resolve(tp); /* Found but needs to be resolved */
   }
+  return tp;
 } /* eth_name_lookup */
 
 static guint8 *
@@ -1700,16 +2129,15 @@ eth_addr_lookup(const gchar *name)
 {
   ether_t      *eth;
   hashether_t  *tp;
-  hashether_t **table = eth_table;
-  gint          i;
+  guint32       i;
 
   /* to be optimized (hash table from name to addr) */
-  for (i = 0; i < HASHETHSIZE; i++) {
-    tp = table[i];
-    while (tp) {
-      if (strcmp(tp->resolved_name, name) == 0)
+  if (eth_table.slots != NULL) {
+    for (i = 0; i <= eth_table.mask; i++) {
+      tp = eth_table.slots[i].entry;
+      if (tp != NULL && tp->status != HASHETHER_STATUS_UNRESOLVED &&
+          strcmp(tp->resolved_name, name) == 0)
         return tp->addr;
-      tp = tp->next;
     }
   }
 
@@ -2106,15 +2534,16 @@ add_ip_name_from_string (const char *addr, const char *name)
  * <line> = <comment> | <entry> | <whitespace>
  * <comment> = <whitespace>#<any>
  * <entry> = <subnet_definition> <whitespace> <subnet_name> [<comment>|<whitespace><any>]
- * <subnet_definition> = <ipv4_address> / <subnet_mask_length>
+ * <subnet_definition> = <ipv4_address> / <subnet_mask_length> |
+ *                       <ipv6_address> / <subnet_prefix_length>
  * <ipv4_address> is a full address; it will be masked to get the subnet-ID.
  * <subnet_mask_length> is a decimal 1-31
+ * <ipv6_address> is a full address, masked in the same way.
+ * <subnet_prefix_length> is a decimal 1-127
  * <subnet_name> is a string containing no whitespace.
  * <whitespace> = (space | tab)+
  * Any malformed entries are ignored.
  * Any trailing data after the subnet_name is ignored.
- *
- * XXX Support IPv6
  */
 static gboolean
 read_subnets_file (const char *subnetspath)
@@ -2123,7 +2552,9 @@ read_subnets_file (const char *subnetspath)
   char *line = NULL;
   int size = 0;
   gchar *cp, *cp2;
-  guint32 host_addr; /* IPv4 ONLY */
+  guint32 host_addr;
+  struct e_in6_addr host_addr6;
+  gboolean is_ipv6;
   int mask_length;
 
   if ((hf = ws_fopen(subnetspath, "r")) == NULL)
@@ -2137,7 +2568,7 @@ read_subnets_file (const char *subnetspath)
       continue; /* no tokens in the line */
 
 
-    /* Expected format is <IP4 address>/<subnet length> */
+    /* Expected format is <IP4 or IP6 address>/<subnet length> */
     cp2 = strchr(cp, '/');
     if(NULL == cp2) {
         /* No length */
@@ -2146,20 +2577,28 @@ read_subnets_file (const char *subnetspath)
     *cp2 = '\0'; /* Cut token */
     ++cp2    ;
 
-    /* Check if this is a valid IPv4 address */
-    if (inet_pton(AF_INET, cp, &host_addr) != 1) {
+    /* Check if this is a valid IPv6 or IPv4 address */
+    is_ipv6 = (strchr(cp, ':') != NULL);
+    if (is_ipv6) {
+        if (inet_pton(AF_INET6, cp, &host_addr6) != 1) {
+            continue; /* no */
+        }
+    } else if (inet_pton(AF_INET, cp, &host_addr) != 1) {
         continue; /* no */
     }
 
     mask_length = atoi(cp2);
-    if(0 >= mask_length || mask_length > 31) {
+    if(0 >= mask_length || mask_length > (is_ipv6 ? 127 : 31)) {
         continue; /* invalid mask length */
     }
 
     if ((cp = strtok(NULL, " \t")) == NULL)
       continue; /* no subnet name */
 
-    subnet_entry_set(host_addr, (guint32)mask_length, cp);
+    if (is_ipv6)
+      subnet_entry_set6(&host_addr6, (guint32)mask_length, cp);
+    else
+      subnet_entry_set(host_addr, (guint32)mask_length, cp);
   }
   g_free(line);
 
@@ -2167,45 +2606,121 @@ read_subnets_file (const char *subnetspath)
   return TRUE;
 } /* read_subnets_file */
 
-static subnet_entry_t
-subnet_lookup(const guint32 addr)
-{
-  subnet_entry_t subnet_entry;
-  guint32 i;
+#define SUBNET_BIT(a, i) (((a)[(i) >> 3] >> (7 - ((i) & 7))) & 1)
 
-  /* Search mask lengths linearly, longest first */
-
-  i = SUBNETLENGTHSIZE;
-  while(have_subnet_entry && i > 0) {
-    guint32 masked_addr;
-    subnet_length_entry_t* length_entry;
+/* Do the first "length" bits of addr match those of prefix? */
+static gboolean
+subnet_prefix_matches(const guint8 *prefix, const guint8 *addr, const guint32 length)
+{
+  guint32 bytes = length >> 3;
 
-    /* Note that we run from 31 (length 32)  to 0 (length 1)  */
-    --i;
-    g_assert(i < SUBNETLENGTHSIZE);
+  if (memcmp(prefix, addr, bytes) != 0)
+    return FALSE;
+  if (length & 7)
+    return ((prefix[bytes] ^ addr[bytes]) & (0xff << (8 - (length & 7))) & 0xff) == 0;
+  return TRUE;
+}
 
+/* The number of leading bits, up to max, that a and b have in common */
+static guint32
+subnet_common_length(const guint8 *a, const guint8 *b, const guint32 max)
+{
+  guint32 i = 0;
 
-    length_entry = &subnet_length_entries[i];
+  while (i + 8 <= max && a[i >> 3] == b[i >> 3])
+    i += 8;
+  while (i < max && SUBNET_BIT(a, i) == SUBNET_BIT(b, i))
+    i++;
+  return i;
+}
 
-    if(NULL != length_entry->subnet_addresses) {
-      hashipv4_t * tp;
-      guint32 hash_idx;
+static subnet_node_t *
+subnet_node_new(const guint8 *addr, const guint32 length, const gchar *name)
+{
+  subnet_node_t *node = g_new0(subnet_node_t, 1);
 
-      masked_addr = addr & length_entry->mask;
-      hash_idx = HASH_IPV4_ADDRESS(masked_addr);
+  memcpy(node->prefix, addr, (length + 7) / 8);
+  if (length & 7)
+    node->prefix[length >> 3] &= 0xff << (8 - (length & 7));
+  node->length = length;
+  node->name = name ? g_strdup(name) : NULL;
+  return node;
+}
 
-      tp = length_entry->subnet_addresses[hash_idx];
-      while(tp != NULL && tp->addr != masked_addr) {
-        tp = tp->next;
-      }
+/* Add the subnet made of the first "length" bits of addr to the trie */
+static void
+subnet_trie_insert(subnet_node_t **np, const guint8 *addr, const guint32 length,
+                   const gchar *name)
+{
+  subnet_node_t *node, *split;
+  guint32 common;
 
-      if(NULL != tp) {
-        subnet_entry.mask = length_entry->mask;
-        subnet_entry.mask_length = i + 1; /* Length is offset + 1 */
-        subnet_entry.name = tp->name;
-        return subnet_entry;
+  while ((node = *np) != NULL) {
+    common = subnet_common_length(node->prefix, addr, MIN(node->length, length));
+    if (common < node->length) {
+      /* The new subnet branches off within this node's prefix (or is a
+       * prefix of it): put a node for the common part above it.
+       */
+      split = subnet_node_new(addr, common, NULL);
+      split->child[SUBNET_BIT(node->prefix, common)] = node;
+      *np = split;
+      if (common == length) {
+        split->name = g_strdup(name);
+      } else {
+        split->child[SUBNET_BIT(addr, common)] = subnet_node_new(addr, length, name);
       }
+      return;
+    }
+    if (node->length == length) {
+      if (node->name == NULL)
+        node->name = g_strdup(name);
+      return;    /* XXX provide warning that an address was repeated? */
     }
+    np = &node->child[SUBNET_BIT(addr, node->length)];
+  }
+  *np = subnet_node_new(addr, length, name);
+}
+
+/* Find the longest subnet in the trie that addr, of addr_length bits, is in */
+static const subnet_node_t *
+subnet_trie_lookup(const subnet_node_t *node, const guint8 *addr, const guint32 addr_length)
+{
+  const subnet_node_t *best = NULL;
+
+  while (node != NULL && node->length <= addr_length &&
+         subnet_prefix_matches(node->prefix, addr, node->length)) {
+    if (node->name != NULL)
+      best = node;
+    if (node->length == addr_length)
+      break;
+    node = node->child[SUBNET_BIT(addr, node->length)];
+  }
+  return best;
+}
+
+static void
+subnet_trie_free(subnet_node_t *node)
+{
+  if (node != NULL) {
+    subnet_trie_free(node->child[0]);
+    subnet_trie_free(node->child[1]);
+    g_free(node->name);
+    g_free(node);
+  }
+}
+
+static subnet_entry_t
+subnet_lookup(const guint32 addr)
+{
+  subnet_entry_t subnet_entry;
+  const subnet_node_t *node;
+
+  node = subnet_trie_lookup(subnet_trie_ipv4, (const guint8 *)&addr, 32);
+  if (node != NULL) {
+    subnet_entry.mask = get_subnet_mask(node->length);
+    subnet_entry.mask_length = node->length;
+    subnet_entry.name = node->name;
+    return subnet_entry;
   }
 
   subnet_entry.mask = 0;
@@ -2215,6 +2730,21 @@ subnet_lookup(const guint32 addr)
   return subnet_entry;
 }
 
+static subnet_entry_t
+subnet_lookup6(const struct e_in6_addr *addr)
+{
+  subnet_entry_t subnet_entry;
+  const subnet_node_t *node;
+
+  node = subnet_trie_lookup(subnet_trie_ipv6, (const guint8 *)addr, 128);
+
+  subnet_entry.mask = 0; /* IPv4 only */
+  subnet_entry.mask_length = node ? node->length : 0;
+  subnet_entry.name = node ? node->name : NULL;
+
+  return subnet_entry;
+}
+
 /* Add a subnet-definition - name pair to the set.
  * The definition is taken by masking the address passed in with the mask of the
  * given length.
@@ -2222,45 +2752,23 @@ subnet_lookup(const guint32 addr)
 static void
 subnet_entry_set(guint32 subnet_addr, const guint32 mask_length, const gchar* name)
 {
-  subnet_length_entry_t* entry;
-  hashipv4_t * tp;
-  gsize hash_idx;
-
   g_assert(mask_length > 0 && mask_length <= 32);
 
-  entry = &subnet_length_entries[mask_length - 1];
-
-  subnet_addr &= entry->mask;
-
-  hash_idx = HASH_IPV4_ADDRESS(subnet_addr);
-
-  if(NULL == entry->subnet_addresses) {
-    entry->subnet_addresses = g_new0(hashipv4_t*,HASHHOSTSIZE);
-  }
+  subnet_trie_insert(&subnet_trie_ipv4, (const guint8 *)&subnet_addr, mask_length, name);
+}
 
-  if(NULL != (tp = entry->subnet_addresses[hash_idx])) {
-    if(tp->addr == subnet_addr) {
-      return;    /* XXX provide warning that an address was repeated? */
-    } else {
-      hashipv4_t * new_tp = g_new(hashipv4_t,1);
-      tp->next = new_tp;
-      tp = new_tp;
-    }
-  } else {
-    tp = entry->subnet_addresses[hash_idx] = g_new(hashipv4_t,1);
-  }
+static void
+subnet_entry_set6(const struct e_in6_addr *subnet_addr, const guint32 mask_length, const gchar* name)
+{
+  g_assert(mask_length > 0 && mask_length <= 128);
 
-  tp->next = NULL;
-  tp->addr = subnet_addr;
-  tp->is_dummy_entry = FALSE; /*Never used again...*/
-  g_strlcpy(tp->name, name, MAXNAMELEN); /* This is longer than subnet names can actually be */
-  have_subnet_entry = TRUE;
+  subnet_trie_insert(&subnet_trie_ipv6, (const guint8 *)subnet_addr, mask_length, name);
 }
 
 static guint32
 get_subnet_mask(const guint32 mask_length) {
 
-  static guint32 masks[SUBNETLENGTHSIZE];
+  static guint32 masks[32];
   static gboolean initialised = FALSE;
 
   if(!initialised) {
@@ -2310,7 +2818,7 @@ get_subnet_mask(const guint32 mask_length) {
     inet_pton(AF_INET, "255.255.255.255", &masks[31]);
   }
 
-  if(mask_length == 0 || mask_length > SUBNETLENGTHSIZE) {
+  if(mask_length == 0 || mask_length > 32) {
     g_assert_not_reached();
     return 0;
   } else {
@@ -2322,15 +2830,11 @@ static void
 subnet_name_lookup_init(void)
 {
   gchar* subnetspath;
-  guint32 i;
 
-  for(i = 0; i < SUBNETLENGTHSIZE; ++i) {
-    guint32 length = i + 1;
-
-    subnet_length_entries[i].subnet_addresses  = NULL;
-    subnet_length_entries[i].mask_length  = length;
-    subnet_length_entries[i].mask = get_subnet_mask(length);
-  }
+  subnet_trie_free(subnet_trie_ipv4);
+  subnet_trie_ipv4 = NULL;
+  subnet_trie_free(subnet_trie_ipv6);
+  subnet_trie_ipv6 = NULL;
 
   subnetspath = get_persconffile_path(ENAME_SUBNETS, FALSE, FALSE);
   if (!read_subnets_file(subnetspath) && errno != ENOENT) {
@@ -2451,8 +2955,12 @@ host_name_lookup_process(gpointer data _U_) {
   struct timeval tv = { 0, 0 };
   int nfds;
   fd_set rfds, wfds;
-  gboolean nro = new_resolved_objects;
+  gboolean nro;
 
+#ifdef RESOLV_WORKERS
+  resolv_workers_drain(FALSE);
+#endif
+  nro = new_resolved_objects;
   new_resolved_objects = FALSE;
 
   if (!async_dns_initialized)
@@ -2491,6 +2999,10 @@ void
 host_name_lookup_cleanup(void) {
   GList *cur;
 
+#ifdef RESOLV_WORKERS
+  resolv_workers_cleanup();
+#endif
+
   cur = g_list_first(async_dns_queue_head);
   while (cur) {
     g_free(cur->data);
@@ -2523,8 +3035,12 @@ host_name_lookup_process(gpointer data _U_) {
   adns_answer *ans;
   int ret;
   gboolean dequeue;
-  gboolean nro = new_resolved_objects;
+  gboolean nro;
 
+#ifdef RESOLV_WORKERS
+  resolv_workers_drain(FALSE);
+#endif
+  nro = new_resolved_objects;
   new_resolved_objects = FALSE;
   async_dns_queue_head = g_list_first(async_dns_queue_head);
 
@@ -2572,6 +3088,10 @@ void
 host_name_lookup_cleanup(void) {
   void *qdata;
 
+#ifdef RESOLV_WORKERS
+  resolv_workers_cleanup();
+#endif
+
   async_dns_queue_head = g_list_first(async_dns_queue_head);
   while (async_dns_queue_head) {
     qdata = async_dns_queue_head->data;
@@ -2588,8 +3108,12 @@ host_name_lookup_cleanup(void) {
 
 gboolean
 host_name_lookup_process(gpointer data _U_) {
-  gboolean nro = new_resolved_objects;
+  gboolean nro;
 
+#ifdef RESOLV_WORKERS
+  resolv_workers_drain(FALSE);
+#endif
+  nro = new_resolved_objects;
   new_resolved_objects = FALSE;
 
   return nro;
@@ -2597,10 +3121,52 @@ host_name_lookup_process(gpointer data _U_) {
 
 void
 host_name_lookup_cleanup(void) {
+#ifdef RESOLV_WORKERS
+  resolv_workers_cleanup();
+#endif
 }
 
 #endif /* HAVE_C_ARES */
 
+void
+host_name_lookup_queue(const address *addr)
+{
+  gboolean found;
+  guint32 ip4;
+  struct e_in6_addr ip6;
+
+  if (!(g_resolv_flags & RESOLV_NETWORK))
+    return;
+
+  switch (addr->type) {
+  case AT_IPv4:
+    memcpy(&ip4, addr->data, sizeof ip4);
+    host_lookup(ip4, TRUE, &found);
+    break;
+  case AT_IPv6:
+    memcpy(&ip6, addr->data, sizeof ip6);
+    host_lookup6(&ip6, TRUE, &found);
+    break;
+  default:
+    break;
+  }
+}
+
+void
+host_name_lookup_wait(void)
+{
+#ifdef ASYNC_DNS
+  while (async_dns_initialized &&
+         (async_dns_queue_head != NULL || async_dns_in_flight > 0)) {
+    host_name_lookup_process(NULL);
+    g_usleep(1000);
+  }
+#endif /* ASYNC_DNS */
+#ifdef RESOLV_WORKERS
+  resolv_workers_drain(TRUE);
+#endif
+}
+
 extern const gchar *
 get_hostname(const guint addr)
 {
@@ -2633,35 +3199,16 @@ get_hostname6(const struct e_in6_addr *addr)
 extern void
 add_ipv4_name(const guint addr, const gchar *name)
 {
-  int hash_idx;
   hashipv4_t *tp;
+  gboolean is_new;
 
-  hash_idx = HASH_IPV4_ADDRESS(addr);
-
-  tp = ipv4_table[hash_idx];
+  tp = ipv4_entry(addr, &is_new);
+  /* an address already known by a real name keeps it; a dummy entry
+   * is replaced */
+  if (!is_new && !tp->is_dummy_entry)
+    return;
 
-  if( tp == NULL ) {
-    tp = ipv4_table[hash_idx] = new_ipv4(addr);
-  } else {
-    while(1) {
-      if (tp->addr == addr) {
-        /* address already known */
-        if (!tp->is_dummy_entry) {
-          return;
-        } else {
-          /* replace this dummy entry with the new one */
-          break;
-        }
-      }
-      if (tp->next == NULL) {
-        tp->next = new_ipv4(addr);
-        tp = tp->next;
-        break;
-      }
-      tp = tp->next;
-    }
-  }
-  g_strlcpy(tp->name, name, MAXNAMELEN);
+  tp->name = resolv_name_intern(name);
   tp->resolve = TRUE;
   new_resolved_objects = TRUE;
 } /* add_ipv4_name */
@@ -2670,36 +3217,16 @@ add_ipv4_name(const guint addr, const gchar *name)
 extern void
 add_ipv6_name(const struct e_in6_addr *addrp, const gchar *name)
 {
-  int hash_idx;
   hashipv6_t *tp;
+  gboolean is_new;
 
-  hash_idx = HASH_IPV6_ADDRESS(*addrp);
-
-  tp = ipv6_table[hash_idx];
-
-  if( tp == NULL ) {
-    tp = ipv6_table[hash_idx] = new_ipv6(addrp);
-  } else {
-    while(1) {
-      if (memcmp(&tp->addr, addrp, sizeof (struct e_in6_addr)) == 0) {
-        /* address already known */
-        if (!tp->is_dummy_entry) {
-          return;
-        } else {
-          /* replace this dummy entry with the new one */
-          break;
-        }
-      }
-      if (tp->next == NULL) {
-        tp->next = new_ipv6(addrp);
-        tp = tp->next;
-        break;
-      }
-      tp = tp->next;
-    }
-  }
+  tp = ipv6_entry(addrp, &is_new);
+  /* an address already known by a real name keeps it; a dummy entry
+   * is replaced */
+  if (!is_new && !tp->is_dummy_entry)
+    return;
 
-  g_strlcpy(tp->name, name, MAXNAMELEN);
+  tp->name = resolv_name_intern(name);
   tp->resolve = TRUE;
   new_resolved_objects = TRUE;
 
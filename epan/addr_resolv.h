@@ -137,6 +137,17 @@ extern gboolean host_name_lookup_process(gpointer data);
 /* host_name_lookup_cleanup cleans up an ADNS socket if we're using ADNS */
 extern void host_name_lookup_cleanup(void);
 
+/** Start looking up the name of an IPv4 or IPv6 address, if network name
+ *  resolution is on, without waiting for the answer.  Other address types
+ *  are ignored.
+ */
+extern void host_name_lookup_queue(const address *addr);
+
+/** Wait until every lookup started so far has been answered or has
+ *  failed, and add the names found to the host tables.
+ */
+extern void host_name_lookup_wait(void);
+
 /* get_hostname returns the host name or "%d.%d.%d.%d" if not found */
 extern const gchar *get_hostname(const guint addr);
 
@@ -0,0 +1,400 @@
+/* Standalone micro-benchmark for the IPv4 and IPv6 name caches in
+ * addr_resolv.c
+ *
+ * For each address pattern it adds names for COUNT distinct addresses,
+ * looks every one of them up again, and then looks up COUNT addresses
+ * that have no name (which is what rendering the address columns of an
+ * unresolved capture does).  Every answer is checked, so a wrong name
+ * makes the program fail.
+ *
+ * With -o the IPv4 runs are repeated against a copy of the fixed-size
+ * chained table the caches used to be, for comparison; that table
+ * degrades badly with many hosts, so expect it to take minutes for the
+ * default count.
+ *
+ * Usage: addr_resolv_bench [-o] [count]
+ *
+ * $Id$
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include <epan/emem.h>
+#include <epan/ipv6-utils.h>
+#include <epan/addr_resolv.h>
+#include <epan/filesystem.h>
+#include <epan/range.h>
+#include <epan/report_err.h>
+#include <epan/prefs.h>
+#include <epan/to_str.h>
+#include <epan/value_string.h>
+#include <epan/dissectors/packet-mtp3.h>
+
+#define DEFAULT_COUNT 1000000
+
+static int failure = 0;
+
+static void
+check_name(const gchar *expected, const gchar *actual)
+{
+    if (strcmp(expected, actual) == 0)
+        return;
+
+    fprintf(stderr, "Expected \"%s\", got \"%s\"\n", expected, actual);
+    failure = 1;
+    exit(1);
+}
+
+static void
+report(const char *what, guint count, GTimer *timer)
+{
+    gdouble secs = g_timer_elapsed(timer, NULL);
+
+    printf("  %-28s %8.3f s  %7.1f ns/op\n", what, secs,
+           count ? secs * 1e9 / count : 0.0);
+}
+
+/*
+ * Address patterns.  Each takes an index below the count and a pattern
+ * never gives two indices the same address, nor an address another
+ * pattern gives.
+ */
+
+/* 10.0.0.0/8 in order, the way a scan or a busy subnet looks */
+static guint
+ipv4_subnet(guint i)
+{
+    return g_htonl(0x0a000000 | (i & 0x00ffffff));
+}
+
+/* spread over 11.0.0.0 - 127.255.255.255; multiplying by an odd
+ * number is a bijection of the low 24 bits */
+static guint
+ipv4_scattered(guint i)
+{
+    guint32 low = (i * 2654435761U) & 0x00ffffff;
+
+    return g_htonl(((11 + (i >> 24)) << 24) | low);
+}
+
+/* 172.16.0.0 and up, for the addresses that never get a name */
+static guint
+ipv4_unnamed(guint i)
+{
+    return g_htonl(0xac100000 + i);
+}
+
+static void
+ipv6_scattered(guint i, struct e_in6_addr *addr, gboolean named)
+{
+    guint32 mix = i * 2654435761U;
+
+    memset(addr, 0, sizeof *addr);
+    addr->bytes[0] = 0x20;
+    addr->bytes[1] = 0x01;
+    addr->bytes[2] = 0x0d;
+    addr->bytes[3] = 0xb8;
+    addr->bytes[4] = named ? 1 : 2;
+    /* interface identifier */
+    addr->bytes[8] = mix >> 24;
+    addr->bytes[9] = mix >> 16;
+    addr->bytes[10] = mix >> 8;
+    addr->bytes[11] = mix;
+    addr->bytes[12] = i >> 24;
+    addr->bytes[13] = i >> 16;
+    addr->bytes[14] = i >> 8;
+    addr->bytes[15] = i;
+}
+
+/*
+ * The caches in addr_resolv.c
+ */
+static void
+bench_ipv4(const char *label, guint (*pattern)(guint), guint count)
+{
+    GTimer *timer = g_timer_new();
+    gchar name[32], ip[MAX_IP_STR_LEN];
+    guint i, addr;
+
+    printf("IPv4, %s, %u addresses\n", label, count);
+
+    g_timer_start(timer);
+    for (i = 0; i < count; i++) {
+        g_snprintf(name, sizeof name, "%s-%u.example", label, i);
+        add_ipv4_name(pattern(i), name);
+    }
+    g_timer_stop(timer);
+    report("add names", count, timer);
+
+    g_resolv_flags = RESOLV_NETWORK;
+    g_timer_start(timer);
+    for (i = 0; i < count; i++) {
+        /* known names are answered from the cache, never the network */
+        g_snprintf(name, sizeof name, "%s-%u.example", label, i);
+        check_name(name, get_hostname(pattern(i)));
+    }
+    g_timer_stop(timer);
+    report("look up named", count, timer);
+
+    g_resolv_flags = 0;
+    g_timer_start(timer);
+    for (i = 0; i < count; i++) {
+        addr = ipv4_unnamed(i);
+        ip_to_str_buf((guint8 *)&addr, ip, sizeof ip);
+        check_name(ip, get_hostname(addr));
+    }
+    g_timer_stop(timer);
+    report("look up unnamed", count, timer);
+    g_timer_start(timer);
+    for (i = 0; i < count; i++) {
+        addr = ipv4_unnamed(i);
+        ip_to_str_buf((guint8 *)&addr, ip, sizeof ip);
+        check_name(ip, get_hostname(addr));
+    }
+    g_timer_stop(timer);
+    report("look up unnamed again", count, timer);
+
+    g_timer_destroy(timer);
+}
+
+static void
+bench_ipv6(guint count)
+{
+    GTimer *timer = g_timer_new();
+    struct e_in6_addr addr;
+    gchar name[32], ip[47];
+    guint i;
+
+    printf("IPv6, scattered, %u addresses\n", count);
+
+    g_timer_start(timer);
+    for (i = 0; i < count; i++) {
+        ipv6_scattered(i, &addr, TRUE);
+        g_snprintf(name, sizeof name, "v6-%u.example", i);
+        add_ipv6_name(&addr, name);
+    }
+    g_timer_stop(timer);
+    report("add names", count, timer);
+
+    g_resolv_flags = RESOLV_NETWORK;
+    g_timer_start(timer);
+    for (i = 0; i < count; i++) {
+        ipv6_scattered(i, &addr, TRUE);
+        g_snprintf(name, sizeof name, "v6-%u.example", i);
+        check_name(name, get_hostname6(&addr));
+    }
+    g_timer_stop(timer);
+    report("look up named", count, timer);
+
+    g_resolv_flags = 0;
+    g_timer_start(timer);
+    for (i = 0; i < count; i++) {
+        ipv6_scattered(i, &addr, FALSE);
+        ip6_to_str_buf(&addr, ip);
+        check_name(ip, get_hostname6(&addr));
+    }
+    g_timer_stop(timer);
+    report("look up unnamed", count, timer);
+
+    g_timer_destroy(timer);
+}
+
+/*
+ * The chained IPv4 table as it was: 2048 buckets picked by the low
+ * bits of the address, one g_malloc()ed entry per address.
+ */
+#define OLD_HASHHOSTSIZE     2048
+#define OLD_HASH_IPV4_ADDRESS(addr) (g_htonl(addr) & (OLD_HASHHOSTSIZE - 1))
+
+typedef struct old_hashipv4 {
+    guint                addr;
+    gboolean             is_dummy_entry;
+    gboolean             resolve;
+    struct old_hashipv4 *next;
+    gchar                ip[16];
+    gchar                name[MAXNAMELEN];
+} old_hashipv4_t;
+
+static old_hashipv4_t *old_ipv4_table[OLD_HASHHOSTSIZE];
+
+static old_hashipv4_t *
+old_new_ipv4(const guint addr)
+{
+    old_hashipv4_t *tp = g_malloc(sizeof(old_hashipv4_t));
+    tp->addr = addr;
+    tp->next = NULL;
+    tp->resolve = FALSE;
+    tp->is_dummy_entry = FALSE;
+    ip_to_str_buf((const guint8 *)&addr, tp->ip, sizeof(tp->ip));
+    return tp;
+}
+
+/* the lookup half of the old host_lookup() and add_ipv4_name() */
+static old_hashipv4_t *
+old_ipv4_entry(const guint addr, gboolean *is_new)
+{
+    int hash_idx = OLD_HASH_IPV4_ADDRESS(addr);
+    old_hashipv4_t *tp = old_ipv4_table[hash_idx];
+
+    *is_new = FALSE;
+    if (tp == NULL) {
+        *is_new = TRUE;
+        return old_ipv4_table[hash_idx] = old_new_ipv4(addr);
+    }
+    while (1) {
+        if (tp->addr == addr)
+            return tp;
+        if (tp->next == NULL) {
+            *is_new = TRUE;
+            return tp->next = old_new_ipv4(addr);
+        }
+        tp = tp->next;
+    }
+}
+
+static void
+old_bench_ipv4(const char *label, guint (*pattern)(guint), guint count)
+{
+    GTimer *timer = g_timer_new();
+    old_hashipv4_t *tp;
+    gboolean is_new;
+    gchar name[32];
+    guint i;
+
+    printf("IPv4, %s, %u addresses, old chained table\n", label, count);
+
+    g_timer_start(timer);
+    for (i = 0; i < count; i++) {
+        g_snprintf(name, sizeof name, "%s-%u.example", label, i);
+        tp = old_ipv4_entry(pattern(i), &is_new);
+        g_strlcpy(tp->name, name, MAXNAMELEN);
+        tp->resolve = TRUE;
+    }
+    g_timer_stop(timer);
+    report("add names", count, timer);
+
+    g_timer_start(timer);
+    for (i = 0; i < count; i++) {
+        g_snprintf(name, sizeof name, "%s-%u.example", label, i);
+        tp = old_ipv4_entry(pattern(i), &is_new);
+        check_name(name, tp->name);
+    }
+    g_timer_stop(timer);
+    report("look up named", count, timer);
+
+    g_timer_destroy(timer);
+}
+
+int
+main(int argc, char **argv)
+{
+    gboolean old = FALSE;
+    guint count = DEFAULT_COUNT;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0)
+            old = TRUE;
+        else if ((count = (guint)strtoul(argv[i], NULL, 10)) == 0 ||
+                 count > 0x01000000) {
+            fprintf(stderr, "Usage: addr_resolv_bench [-o] [count]\n"
+                            "count is 1 to 16777216, default %u\n",
+                    DEFAULT_COUNT);
+            return 2;
+        }
+    }
+
+    emem_init();
+    host_name_lookup_init();
+
+    bench_ipv4("subnet", ipv4_subnet, count);
+    bench_ipv4("scattered", ipv4_scattered, count);
+    bench_ipv6(count);
+
+    if (old) {
+        old_bench_ipv4("subnet", ipv4_subnet, count);
+        old_bench_ipv4("scattered", ipv4_scattered, count);
+    }
+
+    host_name_lookup_cleanup();
+
+    printf(failure?"FAILURE\n":"SUCCESS\n");
+    return failure;
+}
+
+
+/* stubs */
+e_prefs prefs;
+
+char *
+get_persconffile_path(const char *filename _U_, gboolean from_profile _U_,
+                      gboolean for_writing _U_)
+{
+    /* no personal hosts, ethers, ... files */
+    return g_strdup("/nonexistent/addr_resolv_bench");
+}
+
+char *
+get_datafile_path(const char *filename _U_)
+{
+    return g_strdup("/nonexistent/addr_resolv_bench");
+}
+
+const char *
+get_systemfile_dir(void)
+{
+    return "/nonexistent";
+}
+
+void
+report_open_failure(const char *filename, int err,
+                    gboolean for_writing _U_)
+{
+    fprintf(stderr, "Can't open \"%s\": %s\n", filename, g_strerror(err));
+}
+
+convert_ret_t
+range_convert_str(range_t **range _U_, const gchar *es _U_,
+                  guint32 max_value _U_)
+{
+    return CVT_SYNTAX_ERROR;
+}
+
+void
+range_foreach(range_t *range _U_, void (*callback)(guint32 val) _U_)
+{
+}
+
+void
+mtp3_addr_to_str_buf(const mtp3_addr_pc_t *addr_pc_p _U_, gchar *buf,
+                     int buf_len)
+{
+    g_strlcpy(buf, "", buf_len);
+}
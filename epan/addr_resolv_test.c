@@ -0,0 +1,259 @@
+/* Standalone program to test the threaded name resolver in addr_resolv.c
+ *
+ * The lookups are answered from a hosts-format file named by
+ * WIRESHARK_RESOLVER_FILE, so the network is never asked.  The program
+ * checks that names come back through the worker pool, that addresses
+ * the file doesn't know stay numeric, and that the pool can be shut
+ * down while requests are still queued and started again afterwards.
+ *
+ * $Id$
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include <glib.h>
+
+#include <epan/emem.h>
+#include <epan/ipv6-utils.h>
+#include <epan/addr_resolv.h>
+#include <epan/filesystem.h>
+#include <epan/range.h>
+#include <epan/report_err.h>
+#include <epan/prefs.h>
+#include <wsutil/file_util.h>
+
+#include <epan/value_string.h>
+#include <epan/dissectors/packet-mtp3.h>
+
+#define ASSERT(b) do_test((b),"Assertion failed at line %i: %s\n", __LINE__, #b)
+#define ASSERT_STR(exp,act) do_test(strcmp((exp),(act))==0,"Assertion failed at line %i: %s==%s (\"%s\"==\"%s\")\n", __LINE__, #exp, #act, exp, act)
+
+/* Addresses 10.1.x.y, for the first NAMED of which the file has a name */
+#define NAMED       1000
+#define LOOKED_UP   1200
+/* Enough that most of them are still queued when the pool is stopped */
+#define QUEUED      20000
+
+static int failure = 0;
+
+static void
+do_test(gboolean condition, const char *format, ...)
+{
+    va_list ap;
+
+    if (condition)
+        return;
+
+    va_start(ap, format);
+    vfprintf(stderr, format, ap);
+    va_end(ap);
+    failure = 1;
+    exit(1);
+}
+
+static guint
+test_addr(guint8 net, guint n)
+{
+    return g_htonl((10U << 24) | ((guint)net << 16) | (n & 0xffff));
+}
+
+static char *
+write_resolver_file(void)
+{
+    GError *err = NULL;
+    gchar *path;
+    FILE *fp;
+    guint i;
+    int fd;
+
+    fd = g_file_open_tmp("addr_resolv_testXXXXXX", &path, &err);
+    ASSERT(fd != -1);
+    fp = fdopen(fd, "w");
+    ASSERT(fp != NULL);
+
+    fprintf(fp, "# stand-in for the DNS\n");
+    for (i = 0; i < NAMED; i++)
+        fprintf(fp, "10.1.%u.%u\thost-%u.example # comment\n", i >> 8, i & 0xff, i);
+    fprintf(fp, "not-an-address\tbogus.example\n");
+    fprintf(fp, "10.2.0.1\n");
+    fprintf(fp, "10.3.0.1 after-restart.example\n");
+    fprintf(fp, "2001:db8::1 v6-host.example\n");
+    fclose(fp);
+
+    return path;
+}
+
+/* Everything goes through the pool and comes back after a wait. */
+static void
+test_lookups(void)
+{
+    /* 2001:db8::1 */
+    struct e_in6_addr ip6 = { { 0x20, 0x01, 0x0d, 0xb8, 0, 0, 0, 0,
+                                0, 0, 0, 0, 0, 0, 0, 0x01 } };
+    gchar name[32];
+    guint i;
+
+    printf("Starting test test_lookups\n");
+
+    for (i = 0; i < LOOKED_UP; i++) {
+        /* the numeric form until the worker has answered */
+        get_hostname(test_addr(1, i));
+    }
+    get_hostname6(&ip6);
+    get_hostname(test_addr(2, 1));
+
+    host_name_lookup_wait();
+
+    for (i = 0; i < LOOKED_UP; i++) {
+        if (i < NAMED) {
+            g_snprintf(name, sizeof name, "host-%u.example", i);
+            ASSERT_STR(name, get_hostname(test_addr(1, i)));
+        } else {
+            g_snprintf(name, sizeof name, "10.1.%u.%u", i >> 8, i & 0xff);
+            ASSERT_STR(name, get_hostname(test_addr(1, i)));
+        }
+    }
+    ASSERT_STR("v6-host.example", get_hostname6(&ip6));
+    /* a line without a name doesn't give the address one */
+    ASSERT_STR("10.2.0.1", get_hostname(test_addr(2, 1)));
+
+    /* nothing left over for a second wait */
+    host_name_lookup_wait();
+}
+
+/* Stop the pool with most of a burst still queued, then start over. */
+static void
+test_shutdown_queued(void)
+{
+    guint i;
+
+    printf("Starting test test_shutdown_queued\n");
+
+    for (i = 0; i < QUEUED; i++)
+        get_hostname(test_addr(4, i));
+
+    /* must neither hang nor apply the requests it drops */
+    host_name_lookup_cleanup();
+    host_name_lookup_cleanup();
+
+    /* the names already in the tables survive */
+    ASSERT_STR("host-0.example", get_hostname(test_addr(1, 0)));
+
+    /* a fresh pool is set up for the next lookup */
+    host_name_lookup_init();
+    get_hostname(test_addr(3, 1));
+    host_name_lookup_wait();
+    ASSERT_STR("after-restart.example", get_hostname(test_addr(3, 1)));
+
+    host_name_lookup_cleanup();
+}
+
+int
+main(int argc _U_, char **argv _U_)
+{
+    char *path;
+
+#if defined(G_THREADS_ENABLED) && defined(HAVE_GETNAMEINFO)
+    if (!g_thread_supported())
+        g_thread_init(NULL);
+#else
+    printf("No threaded resolver in this build; skipped\n");
+    return 0;
+#endif
+
+    emem_init();
+
+    path = write_resolver_file();
+    ASSERT(g_setenv("WIRESHARK_RESOLVER_FILE", path, TRUE));
+
+    g_resolv_flags = RESOLV_NETWORK;
+    host_name_lookup_init();
+
+    test_lookups();
+    test_shutdown_queued();
+
+    ws_unlink(path);
+    g_free(path);
+
+    printf(failure?"FAILURE\n":"SUCCESS\n");
+    return failure;
+}
+
+
+/* stubs */
+e_prefs prefs;
+
+char *
+get_persconffile_path(const char *filename _U_, gboolean from_profile _U_,
+                      gboolean for_writing _U_)
+{
+    /* no personal hosts, ethers, ... files */
+    return g_strdup("/nonexistent/addr_resolv_test");
+}
+
+char *
+get_datafile_path(const char *filename _U_)
+{
+    return g_strdup("/nonexistent/addr_resolv_test");
+}
+
+const char *
+get_systemfile_dir(void)
+{
+    return "/nonexistent";
+}
+
+void
+report_open_failure(const char *filename, int err,
+                    gboolean for_writing _U_)
+{
+    fprintf(stderr, "Can't open \"%s\": %s\n", filename, g_strerror(err));
+}
+
+convert_ret_t
+range_convert_str(range_t **range _U_, const gchar *es _U_,
+                  guint32 max_value _U_)
+{
+    return CVT_SYNTAX_ERROR;
+}
+
+void
+range_foreach(range_t *range _U_, void (*callback)(guint32 val) _U_)
+{
+}
+
+void
+mtp3_addr_to_str_buf(const mtp3_addr_pc_t *addr_pc_p _U_, gchar *buf,
+                     int buf_len)
+{
+    g_strlcpy(buf, "", buf_len);
+}
@@ -34,6 +34,7 @@
 #include "sna-utils.h"
 #include "atalk-utils.h"
 #include "to_str.h"
+#include "time_fmt.h"
 #include "packet_info.h"
 #include "pint.h"
 #include "addr_resolv.h"
@@ -66,6 +67,8 @@ col_setup(column_info *cinfo, const gint num_cols)
   cinfo->col_fence  = g_new(int, num_cols);
   cinfo->col_expr.col_expr = (const gchar **) g_new(gchar*, num_cols + 1);
   cinfo->col_expr.col_expr_val = g_new(gchar*, num_cols + 1);
+  cinfo->col_value  = g_new0(col_value_t, num_cols);
+  cinfo->text_on_demand = FALSE;
 
   for (i = 0; i < NUM_COL_FMTS; i++) {
     cinfo->col_first[i] = -1;
@@ -88,6 +91,7 @@ col_init(column_info *cinfo)
     cinfo->col_fence[i] = 0;
     cinfo->col_expr.col_expr[i] = "";
     cinfo->col_expr.col_expr_val[i][0] = '\0';
+    cinfo->col_value[i].type = COL_VAL_NONE;
   }
   cinfo->writable = TRUE;
 }
@@ -252,6 +256,9 @@ col_custom_prime_edt(epan_dissect_t *edt, column_info *cinfo)
   }
 }
 
+static void col_do_append_str(column_info *cinfo, const gint el,
+    const gchar* separator, const gchar* str);
+
 /*  Appends a vararg list to a packet info string.
  *  This function's code is duplicated in col_append_sep_fstr() below because
  *  the for() loop below requires us to call va_start/va_end so intermediate
@@ -262,11 +269,30 @@ col_append_fstr(column_info *cinfo, const gint el, const gchar *format, ...)
 {
   int  i;
   int  len, max_len;
+  const gchar *str;
   va_list ap;
 
   if (!CHECK_COL(cinfo, el))
     return;
 
+  /*
+   * Many callers pass text without conversions, or a lone "%s"; neither
+   * needs to go through g_vsnprintf().
+   */
+  if (strchr(format, '%') == NULL) {
+    col_do_append_str(cinfo, el, NULL, format);
+    return;
+  }
+  if (strcmp(format, "%s") == 0) {
+    va_start(ap, format);
+    str = va_arg(ap, const gchar *);
+    va_end(ap);
+    if (str != NULL) {
+      col_do_append_str(cinfo, el, NULL, str);
+      return;
+    }
+  }
+
   if (el == COL_INFO)
     max_len = COL_MAX_INFO_LEN;
   else
@@ -616,84 +642,51 @@ col_has_time_fmt(column_info *cinfo, const gint col)
           (cinfo->fmt_matx[col][COL_DELTA_TIME_DIS]));
 }
 
+/* Number of digits after the decimal point for the time precision */
+static guint
+ts_prec_digits(void)
+{
+  switch (timestamp_get_precision()) {
+  case TS_PREC_FIXED_SEC:
+  case TS_PREC_AUTO_SEC:
+    return 0;
+  case TS_PREC_FIXED_DSEC:
+  case TS_PREC_AUTO_DSEC:
+    return 1;
+  case TS_PREC_FIXED_CSEC:
+  case TS_PREC_AUTO_CSEC:
+    return 2;
+  case TS_PREC_FIXED_MSEC:
+  case TS_PREC_AUTO_MSEC:
+    return 3;
+  case TS_PREC_FIXED_USEC:
+  case TS_PREC_AUTO_USEC:
+    return 6;
+  case TS_PREC_FIXED_NSEC:
+  case TS_PREC_AUTO_NSEC:
+    return 9;
+  default:
+    g_assert_not_reached();
+    return 0;
+  }
+}
+
 static gint
 set_abs_date_time(const frame_data *fd, gchar *buf)
 {
-  struct tm *tmp;
-  time_t then;
+  const struct tm *tmp;
+  guint digits;
+  gchar *p;
 
-  then = fd->abs_ts.secs;
-  tmp = localtime(&then);
+  tmp = time_fmt_localtime(fd->abs_ts.secs);
   if (tmp != NULL) {
-      switch(timestamp_get_precision()) {
-      case TS_PREC_FIXED_SEC:
-      case TS_PREC_AUTO_SEC:
-          g_snprintf(buf, COL_MAX_LEN,"%04d-%02d-%02d %02d:%02d:%02d",
-             tmp->tm_year + 1900,
-             tmp->tm_mon + 1,
-             tmp->tm_mday,
-             tmp->tm_hour,
-             tmp->tm_min,
-             tmp->tm_sec);
-          break;
-      case TS_PREC_FIXED_DSEC:
-      case TS_PREC_AUTO_DSEC:
-          g_snprintf(buf, COL_MAX_LEN,"%04d-%02d-%02d %02d:%02d:%02d.%01ld",
-             tmp->tm_year + 1900,
-             tmp->tm_mon + 1,
-             tmp->tm_mday,
-             tmp->tm_hour,
-             tmp->tm_min,
-             tmp->tm_sec,
-             (long)fd->abs_ts.nsecs / 100000000);
-          break;
-      case TS_PREC_FIXED_CSEC:
-      case TS_PREC_AUTO_CSEC:
-          g_snprintf(buf, COL_MAX_LEN,"%04d-%02d-%02d %02d:%02d:%02d.%02ld",
-             tmp->tm_year + 1900,
-             tmp->tm_mon + 1,
-             tmp->tm_mday,
-             tmp->tm_hour,
-             tmp->tm_min,
-             tmp->tm_sec,
-             (long)fd->abs_ts.nsecs / 10000000);
-          break;
-      case TS_PREC_FIXED_MSEC:
-      case TS_PREC_AUTO_MSEC:
-          g_snprintf(buf, COL_MAX_LEN, "%04d-%02d-%02d %02d:%02d:%02d.%03ld",
-             tmp->tm_year + 1900,
-             tmp->tm_mon + 1,
-             tmp->tm_mday,
-             tmp->tm_hour,
-             tmp->tm_min,
-             tmp->tm_sec,
-             (long)fd->abs_ts.nsecs / 1000000);
-          break;
-      case TS_PREC_FIXED_USEC:
-      case TS_PREC_AUTO_USEC:
-          g_snprintf(buf, COL_MAX_LEN, "%04d-%02d-%02d %02d:%02d:%02d.%06ld",
-             tmp->tm_year + 1900,
-             tmp->tm_mon + 1,
-             tmp->tm_mday,
-             tmp->tm_hour,
-             tmp->tm_min,
-             tmp->tm_sec,
-             (long)fd->abs_ts.nsecs / 1000);
-          break;
-      case TS_PREC_FIXED_NSEC:
-      case TS_PREC_AUTO_NSEC:
-          g_snprintf(buf, COL_MAX_LEN, "%04d-%02d-%02d %02d:%02d:%02d.%09ld",
-             tmp->tm_year + 1900,
-             tmp->tm_mon + 1,
-             tmp->tm_mday,
-             tmp->tm_hour,
-             tmp->tm_min,
-             tmp->tm_sec,
-             (long)fd->abs_ts.nsecs);
-          break;
-      default:
-          g_assert_not_reached();
-      }
+    /* "%04d-%02d-%02d %02d:%02d:%02d.%0*ld" */
+    digits = ts_prec_digits();
+    p = time_fmt_ymd(buf, tmp);
+    *p++ = ' ';
+    p = time_fmt_hms(p, tmp);
+    p = time_fmt_frac(p, time_fmt_scale_nsecs(fd->abs_ts.nsecs, digits), digits);
+    *p = '\0';
   } else {
     buf[0] = '\0';
   }
@@ -713,49 +706,31 @@ col_set_abs_date_time(const frame_data *fd, column_info *cinfo, const int col)
 static gint
 set_time_seconds(const nstime_t *ts, gchar *buf)
 {
-  switch(timestamp_get_precision()) {
-      case TS_PREC_FIXED_SEC:
-      case TS_PREC_AUTO_SEC:
-          display_signed_time(buf, COL_MAX_LEN,
-            (gint32) ts->secs, ts->nsecs / 1000000000, TO_STR_TIME_RES_T_SECS);
-          break;
-      case TS_PREC_FIXED_DSEC:
-      case TS_PREC_AUTO_DSEC:
-          display_signed_time(buf, COL_MAX_LEN,
-            (gint32) ts->secs, ts->nsecs / 100000000, TO_STR_TIME_RES_T_DSECS);
-          break;
-      case TS_PREC_FIXED_CSEC:
-      case TS_PREC_AUTO_CSEC:
-          display_signed_time(buf, COL_MAX_LEN,
-            (gint32) ts->secs, ts->nsecs / 10000000, TO_STR_TIME_RES_T_CSECS);
-          break;
-      case TS_PREC_FIXED_MSEC:
-      case TS_PREC_AUTO_MSEC:
-          display_signed_time(buf, COL_MAX_LEN,
-            (gint32) ts->secs, ts->nsecs / 1000000, TO_STR_TIME_RES_T_MSECS);
-          break;
-      case TS_PREC_FIXED_USEC:
-      case TS_PREC_AUTO_USEC:
-          display_signed_time(buf, COL_MAX_LEN,
-            (gint32) ts->secs, ts->nsecs / 1000, TO_STR_TIME_RES_T_USECS);
-          break;
-      case TS_PREC_FIXED_NSEC:
-      case TS_PREC_AUTO_NSEC:
-          display_signed_time(buf, COL_MAX_LEN,
-            (gint32) ts->secs, ts->nsecs, TO_STR_TIME_RES_T_NSECS);
-          break;
-      default:
-          g_assert_not_reached();
-  }
+  guint digits = ts_prec_digits();
+
+  /* as display_signed_time() */
+  *time_fmt_signed(buf, (gint32) ts->secs,
+                   time_fmt_scale_nsecs(ts->nsecs, digits), digits) = '\0';
   return 1;
 }
 
+/* "%2d" for 0 to 99 */
+static gchar *
+put_2digits_sp(gchar *p, gint32 v)
+{
+  if (v < 10)
+    *p++ = ' ';
+  return time_fmt_uint(p, v, 1);
+}
+
 static gint
 set_time_hour_min_sec(const nstime_t *ts, gchar *buf)
 {
   time_t secs = ts->secs;
   long nsecs = (long) ts->nsecs;
   gboolean negative = FALSE;
+  guint digits;
+  gchar *p;
 
   if (secs < 0) {
     secs = -secs;
@@ -766,139 +741,32 @@ set_time_hour_min_sec(const nstime_t *ts, gchar *buf)
     negative = TRUE;
   }
 
-  switch(timestamp_get_precision()) {
-  case TS_PREC_FIXED_SEC:
-  case TS_PREC_AUTO_SEC:
-    if (secs >= (60*60)) {
-      g_snprintf(buf, COL_MAX_LEN, "%s%dh %2dm %2ds",
-		 negative ? "- " : "",
-		 (gint32) secs / (60 * 60),
-		 (gint32) (secs / 60) % 60,
-		 (gint32) secs % 60);
-    } else if (secs >= 60) {
-      g_snprintf(buf, COL_MAX_LEN, "%s%dm %2ds",
-		 negative ? "- " : "",
-		 (gint32) secs / 60,
-		 (gint32) secs % 60);
-    } else {
-      g_snprintf(buf, COL_MAX_LEN, "%s%ds",
-		 negative ? "- " : "",
-		 (gint32) secs);
-    }
-    break;
-  case TS_PREC_FIXED_DSEC:
-  case TS_PREC_AUTO_DSEC:
-    if (secs >= (60*60)) {
-      g_snprintf(buf, COL_MAX_LEN, "%s%dh %2dm %2d.%01lds",
-		 negative ? "- " : "",
-		 (gint32) secs / (60 * 60),
-		 (gint32) (secs / 60) % 60,
-		 (gint32) secs % 60,
-		 nsecs / 100000000);
-    } else if (secs >= 60) {
-      g_snprintf(buf, COL_MAX_LEN, "%s%dm %2d.%01lds",
-		 negative ? "- " : "",
-		 (gint32) secs / 60,
-		 (gint32) secs % 60,
-		 nsecs / 100000000);
-    } else {
-      g_snprintf(buf, COL_MAX_LEN, "%s%d.%01lds",
-		 negative ? "- " : "",
-		 (gint32) secs,
-		 nsecs / 100000000);
-    }
-    break;
-  case TS_PREC_FIXED_CSEC:
-  case TS_PREC_AUTO_CSEC:
-    if (secs >= (60*60)) {
-      g_snprintf(buf, COL_MAX_LEN, "%s%dh %2dm %2d.%02lds",
-		 negative ? "- " : "",
-		 (gint32) secs / (60 * 60),
-		 (gint32) (secs / 60) % 60,
-		 (gint32) secs % 60,
-		 nsecs / 10000000);
-    } else if (secs >= 60) {
-      g_snprintf(buf, COL_MAX_LEN, "%s%dm %2d.%02lds",
-		 negative ? "- " : "",
-		 (gint32) secs / 60,
-		 (gint32) secs % 60,
-		 nsecs / 10000000);
-    } else {
-      g_snprintf(buf, COL_MAX_LEN, "%s%d.%02lds",
-		 negative ? "- " : "",
-		 (gint32) secs,
-		 nsecs / 10000000);
-    }
-    break;
-  case TS_PREC_FIXED_MSEC:
-  case TS_PREC_AUTO_MSEC:
-    if (secs >= (60*60)) {
-      g_snprintf(buf, COL_MAX_LEN, "%s%dh %2dm %2d.%03lds",
-		 negative ? "- " : "",
-		 (gint32) secs / (60 * 60),
-		 (gint32) (secs / 60) % 60,
-		 (gint32) secs % 60,
-		 nsecs / 1000000);
-    } else if (secs >= 60) {
-      g_snprintf(buf, COL_MAX_LEN, "%s%dm %2d.%03lds",
-		 negative ? "- " : "",
-		 (gint32) secs / 60,
-		 (gint32) secs % 60,
-		 nsecs / 1000000);
-    } else {
-      g_snprintf(buf, COL_MAX_LEN, "%s%d.%03lds",
-		 negative ? "- " : "",
-		 (gint32) secs,
-		 nsecs / 1000000);
-    }
-    break;
-  case TS_PREC_FIXED_USEC:
-  case TS_PREC_AUTO_USEC:
-    if (secs >= (60*60)) {
-      g_snprintf(buf, COL_MAX_LEN, "%s%dh %2dm %2d.%06lds",
-		 negative ? "- " : "",
-		 (gint32) secs / (60 * 60),
-		 (gint32) (secs / 60) % 60,
-		 (gint32) secs % 60,
-		 nsecs / 1000);
-    } else if (secs >= 60) {
-      g_snprintf(buf, COL_MAX_LEN, "%s%dm %2d.%06lds",
-		 negative ? "- " : "",
-		 (gint32) secs / 60,
-		 (gint32) secs % 60,
-		 nsecs / 1000);
-    } else {
-      g_snprintf(buf, COL_MAX_LEN, "%s%d.%06lds",
-		 negative ? "- " : "",
-		 (gint32) secs,
-		 nsecs / 1000);
-    }
-    break;
-  case TS_PREC_FIXED_NSEC:
-  case TS_PREC_AUTO_NSEC:
-    if (secs >= (60*60)) {
-      g_snprintf(buf, COL_MAX_LEN, "%s%dh %2dm %2d.%09lds",
-		 negative ? "- " : "",
-		 (gint32) secs / (60 * 60),
-		 (gint32) (secs / 60) % 60,
-		 (gint32) secs % 60,
-		 nsecs);
-    } else if (secs >= 60) {
-      g_snprintf(buf, COL_MAX_LEN, "%s%dm %2d.%09lds",
-		 negative ? "- " : "",
-		 (gint32) secs / 60,
-		 (gint32) secs % 60,
-		 nsecs);
-    } else {
-      g_snprintf(buf, COL_MAX_LEN, "%s%d.%09lds",
-		 negative ? "- " : "",
-		 (gint32) secs,
-		 nsecs);
-    }
-    break;
-  default:
-    g_assert_not_reached();
+  /* "%s%dh %2dm %2d.%0*lds", "%s%dm %2d.%0*lds" or "%s%d.%0*lds" */
+  digits = ts_prec_digits();
+  p = buf;
+  if (negative) {
+    *p++ = '-';
+    *p++ = ' ';
   }
+  if (secs >= (60*60)) {
+    p = time_fmt_int(p, (gint32) secs / (60 * 60));
+    *p++ = 'h';
+    *p++ = ' ';
+    p = put_2digits_sp(p, (gint32) (secs / 60) % 60);
+    *p++ = 'm';
+    *p++ = ' ';
+    p = put_2digits_sp(p, (gint32) secs % 60);
+  } else if (secs >= 60) {
+    p = time_fmt_int(p, (gint32) secs / 60);
+    *p++ = 'm';
+    *p++ = ' ';
+    p = put_2digits_sp(p, (gint32) secs % 60);
+  } else {
+    p = time_fmt_int(p, (gint32) secs);
+  }
+  p = time_fmt_frac(p, time_fmt_scale_nsecs((gint32) nsecs, digits), digits);
+  *p++ = 's';
+  *p = '\0';
 
   return 1;
 }
@@ -974,64 +842,17 @@ col_set_delta_time_dis(const frame_data *fd, column_info *cinfo, const int col)
 static gint
 set_abs_time(const frame_data *fd, gchar *buf)
 {
-  struct tm *tmp;
-  time_t then;
+  const struct tm *tmp;
+  guint digits;
+  gchar *p;
 
-  then = fd->abs_ts.secs;
-  tmp = localtime(&then);
+  tmp = time_fmt_localtime(fd->abs_ts.secs);
   if (tmp != NULL) {
-      switch(timestamp_get_precision()) {
-      case TS_PREC_FIXED_SEC:
-      case TS_PREC_AUTO_SEC:
-          g_snprintf(buf, COL_MAX_LEN,"%02d:%02d:%02d",
-             tmp->tm_hour,
-             tmp->tm_min,
-             tmp->tm_sec);
-          break;
-      case TS_PREC_FIXED_DSEC:
-      case TS_PREC_AUTO_DSEC:
-          g_snprintf(buf, COL_MAX_LEN,"%02d:%02d:%02d.%01ld",
-             tmp->tm_hour,
-             tmp->tm_min,
-             tmp->tm_sec,
-             (long)fd->abs_ts.nsecs / 100000000);
-          break;
-      case TS_PREC_FIXED_CSEC:
-      case TS_PREC_AUTO_CSEC:
-          g_snprintf(buf, COL_MAX_LEN,"%02d:%02d:%02d.%02ld",
-             tmp->tm_hour,
-             tmp->tm_min,
-             tmp->tm_sec,
-             (long)fd->abs_ts.nsecs / 10000000);
-          break;
-      case TS_PREC_FIXED_MSEC:
-      case TS_PREC_AUTO_MSEC:
-          g_snprintf(buf, COL_MAX_LEN,"%02d:%02d:%02d.%03ld",
-             tmp->tm_hour,
-             tmp->tm_min,
-             tmp->tm_sec,
-             (long)fd->abs_ts.nsecs / 1000000);
-          break;
-      case TS_PREC_FIXED_USEC:
-      case TS_PREC_AUTO_USEC:
-          g_snprintf(buf, COL_MAX_LEN,"%02d:%02d:%02d.%06ld",
-             tmp->tm_hour,
-             tmp->tm_min,
-             tmp->tm_sec,
-             (long)fd->abs_ts.nsecs / 1000);
-          break;
-      case TS_PREC_FIXED_NSEC:
-      case TS_PREC_AUTO_NSEC:
-          g_snprintf(buf, COL_MAX_LEN, "%02d:%02d:%02d.%09ld",
-             tmp->tm_hour,
-             tmp->tm_min,
-             tmp->tm_sec,
-             (long)fd->abs_ts.nsecs);
-          break;
-      default:
-          g_assert_not_reached();
-      }
-
+    /* "%02d:%02d:%02d.%0*ld" */
+    digits = ts_prec_digits();
+    p = time_fmt_hms(buf, tmp);
+    p = time_fmt_frac(p, time_fmt_scale_nsecs(fd->abs_ts.nsecs, digits), digits);
+    *p = '\0';
   } else {
     *buf = '\0';
   }
@@ -1051,40 +872,11 @@ col_set_abs_time(const frame_data *fd, column_info *cinfo, const int col)
 static gint
 set_epoch_time(const frame_data *fd, gchar *buf)
 {
-  switch(timestamp_get_precision()) {
-      case TS_PREC_FIXED_SEC:
-      case TS_PREC_AUTO_SEC:
-          display_epoch_time(buf, COL_MAX_LEN,
-            fd->abs_ts.secs, fd->abs_ts.nsecs / 1000000000, TO_STR_TIME_RES_T_SECS);
-          break;
-      case TS_PREC_FIXED_DSEC:
-      case TS_PREC_AUTO_DSEC:
-          display_epoch_time(buf, COL_MAX_LEN,
-            fd->abs_ts.secs, fd->abs_ts.nsecs / 100000000, TO_STR_TIME_RES_T_DSECS);
-          break;
-      case TS_PREC_FIXED_CSEC:
-      case TS_PREC_AUTO_CSEC:
-          display_epoch_time(buf, COL_MAX_LEN,
-            fd->abs_ts.secs, fd->abs_ts.nsecs / 10000000, TO_STR_TIME_RES_T_CSECS);
-          break;
-      case TS_PREC_FIXED_MSEC:
-      case TS_PREC_AUTO_MSEC:
-          display_epoch_time(buf, COL_MAX_LEN,
-            fd->abs_ts.secs, fd->abs_ts.nsecs / 1000000, TO_STR_TIME_RES_T_MSECS);
-          break;
-      case TS_PREC_FIXED_USEC:
-      case TS_PREC_AUTO_USEC:
-          display_epoch_time(buf, COL_MAX_LEN,
-            fd->abs_ts.secs, fd->abs_ts.nsecs / 1000, TO_STR_TIME_RES_T_USECS);
-          break;
-      case TS_PREC_FIXED_NSEC:
-      case TS_PREC_AUTO_NSEC:
-          display_epoch_time(buf, COL_MAX_LEN,
-            fd->abs_ts.secs, fd->abs_ts.nsecs, TO_STR_TIME_RES_T_NSECS);
-          break;
-      default:
-          g_assert_not_reached();
-  }
+  guint digits = ts_prec_digits();
+
+  /* as display_epoch_time() */
+  *time_fmt_signed(buf, (gint64) fd->abs_ts.secs,
+                   time_fmt_scale_nsecs(fd->abs_ts.nsecs, digits), digits) = '\0';
   return 1;
 }
 
@@ -1278,6 +1070,33 @@ col_set_time(column_info *cinfo, const gint el, const nstime_t *ts, char *fieldn
   }
 }
 
+/* Keep the raw value of an address column, if its text depends on name
+ * resolution. */
+static gboolean
+col_keep_addr(column_info *cinfo, const int col, const address *addr)
+{
+  col_value_t *val = &cinfo->col_value[col];
+
+  switch (addr->type) {
+
+  case AT_ETHER:
+  case AT_IPv4:
+  case AT_IPv6:
+    if (addr->len > (int) sizeof val->v.addr)
+      return FALSE;
+    break;
+
+  default:
+    return FALSE;
+  }
+
+  val->type = COL_VAL_ADDR;
+  val->subtype = addr->type;
+  val->len = addr->len;
+  memcpy(val->v.addr, addr->data, addr->len);
+  return TRUE;
+}
+
 static void
 col_set_addr(packet_info *pinfo, const int col, const address *addr, const gboolean is_src, const gboolean fill_col_exprs)
 {
@@ -1286,6 +1105,13 @@ col_set_addr(packet_info *pinfo, const int col, const address *addr, const gbool
     return;
   }
 
+  if (col_keep_addr(pinfo->cinfo, col, addr) && pinfo->cinfo->text_on_demand &&
+      !fill_col_exprs) {
+    /* col_get_text() will make the text if the row is ever shown */
+    pinfo->cinfo->col_data[col] = "";
+    return;
+  }
+
 #ifdef NEW_PACKET_LIST
   pinfo->cinfo->col_data[col] = se_get_addr_name(addr);
 #else
@@ -1353,15 +1179,28 @@ col_set_addr(packet_info *pinfo, const int col, const address *addr, const gbool
 
 /* ------------------------ */
 static void
-col_set_port(packet_info *pinfo, const int col, const gboolean is_res, const gboolean is_src, const gboolean fill_col_exprs _U_)
+col_set_port(packet_info *pinfo, const int col, const gboolean is_res, const gboolean is_src, const gboolean fill_col_exprs)
 {
   guint32 port;
+  col_value_t *val;
 
   if (is_src)
     port = pinfo->srcport;
   else
     port = pinfo->destport;
 
+  if (pinfo->ptype == PT_SCTP || pinfo->ptype == PT_TCP || pinfo->ptype == PT_UDP) {
+    val = &pinfo->cinfo->col_value[col];
+    val->type = COL_VAL_PORT;
+    val->subtype = pinfo->ptype;
+    val->v.port = port;
+    if (pinfo->cinfo->text_on_demand && !fill_col_exprs) {
+      /* col_get_text() will make the text if the row is ever shown */
+      pinfo->cinfo->col_data[col] = "";
+      return;
+    }
+  }
+
   /* TODO: Use fill_col_exprs */
 
   switch (pinfo->ptype) {
@@ -1648,271 +1487,60 @@ col_fill_in(packet_info *pinfo, const gboolean fill_col_exprs, const gboolean fi
   }
 }
 
-#if 0
-XXX this needs more rework?
-/* --------------------------- */
-
-static  gchar *
-set_addr(address *addr, gboolean is_res)
+#ifdef NEW_PACKET_LIST
+/* Move the raw value of a column, if it has one, from cinfo to the frame;
+ * FALSE if there is none, and the column text has to be kept instead. */
+gboolean
+col_keep_value(frame_data *fd, const column_info *cinfo, const gint col)
 {
-  if (addr->type == AT_NONE)
-    return "";  /* no address, nothing to do */
+  if (cinfo->col_value[col].type == COL_VAL_NONE)
+    return FALSE;
 
-  if (is_res) {
-    return se_get_addr_name(addr /*, COL_MAX_LEN*/);
-  }
-  return se_address_to_str(addr);
+  if (fd->col_values == NULL)
+    fd->col_values = se_alloc0(sizeof(col_value_t) * cinfo->num_cols);
+  fd->col_values[col] = cinfo->col_value[col];
+  return TRUE;
 }
 
-/* Fills col_text in the frame data structure */
-void
-col_fill_fdata(packet_info *pinfo)
+/* The text of a column of a frame in the packet list: fd->col_text or,
+ * for a column kept with col_keep_value(), the raw value formatted into
+ * buf, which must hold COL_MAX_LEN characters, with the name resolution
+ * settings of the moment. */
+const gchar *
+col_get_text(const frame_data *fd, const column_info *cinfo, const gint col, gchar *buf)
 {
-  int i;
-  frame_data *fdata;
-  gboolean res;
+  const col_value_t *val;
+  address addr;
+  gboolean is_res;
 
-  if (!pinfo->cinfo)
-    return;
+  if (fd->col_values == NULL || fd->col_values[col].type == COL_VAL_NONE)
+    return fd->col_text[col];
 
-  fdata = pinfo->fd;
-
-  res =FALSE;
-
-  for (i = 0; i < pinfo->cinfo->num_cols; i++) {
-
-    switch (pinfo->cinfo->col_fmt[i]) {
-    case COL_NUMBER:           /* frame number */
-    case COL_PACKET_LENGTH:    /* fd->pkt_len */
-    case COL_CUMULATIVE_BYTES: /* fd->cum_bytes */
-    case COL_CLS_TIME:
-    case COL_ABS_TIME:
-    case COL_ABS_DATE_TIME:    /* from fd structures */
-    case COL_REL_TIME:
-    case COL_DELTA_TIME:
-    case COL_DELTA_TIME_DIS:
-      break;
-
-    case COL_DEF_SRC:
-    case COL_RES_SRC:   /* COL_DEF_SRC is currently just like COL_RES_SRC */
-      res = TRUE;
-    case COL_UNRES_SRC:
-      fdata->col_text[i] = set_addr(&pinfo->src, res);
-      break;
-
-    case COL_DEF_DL_SRC:
-    case COL_RES_DL_SRC:
-      res = TRUE;
-    case COL_UNRES_DL_SRC:
-      fdata->col_text[i] = set_addr (&pinfo->dl_src, res);
-      break;
+  val = &fd->col_values[col];
+  switch (val->type) {
 
-    case COL_DEF_NET_SRC:
-    case COL_RES_NET_SRC:
-      res = TRUE;
-    case COL_UNRES_NET_SRC:
-      fdata->col_text[i] = set_addr (&pinfo->net_src, res);
-      break;
-
-    case COL_DEF_DST:
-    case COL_RES_DST:   /* COL_DEF_DST is currently just like COL_RES_DST */
-      res = TRUE;
-    case COL_UNRES_DST:
-      fdata->col_text[i] = set_addr (&pinfo->dst, res);
-      break;
-
-    case COL_DEF_DL_DST:
-    case COL_RES_DL_DST:
-      res = TRUE;
-    case COL_UNRES_DL_DST:
-      fdata->col_text[i] = set_addr (&pinfo->dl_dst, res);
-      break;
-
-    case COL_DEF_NET_DST:
-    case COL_RES_NET_DST:
-      res = TRUE;
-    case COL_UNRES_NET_DST:
-      fdata->col_text[i] = set_addr (&pinfo->net_dst, res);
-      break;
-
-    case COL_DEF_SRC_PORT:
-    case COL_RES_SRC_PORT:  /* COL_DEF_SRC_PORT is currently just like COL_RES_SRC_PORT */
-      fdata->col_text[i] = set_port(pinfo, TRUE, pinfo->srcport);
-      break;
-    case COL_UNRES_SRC_PORT:
-      fdata->col_text[i] = set_port(pinfo, FALSE, pinfo->srcport);
-      break;
-
-    case COL_DEF_DST_PORT:
-    case COL_RES_DST_PORT:  /* COL_DEF_DST_PORT is currently just like COL_RES_DST_PORT */
-      fdata->col_text[i] = set_port(pinfo, TRUE, pinfo->destport);
-      break;
-
-    case COL_UNRES_DST_PORT:
-      fdata->col_text[i] = set_port(pinfo, FALSE, pinfo->destport);
-      break;
+  case COL_VAL_ADDR:
+    SET_ADDRESS(&addr, val->subtype, val->len, val->v.addr);
+    get_addr_name_buf(&addr, buf, COL_MAX_LEN);
+    break;
 
-    case COL_IF_DIR:    /* currently done by dissectors */
-    case COL_PROTOCOL:
-    case COL_INFO:
-    case COL_HPUX_SUBSYS:
-    case COL_HPUX_DEVID:
-    case COL_DCE_CALL:
-    case COL_8021Q_VLAN_ID:
-    case COL_DSCP_VALUE:
-    case COL_COS_VALUE:
-    case COL_FR_DLCI:
-    case COL_BSSGP_TLLI:
-    case COL_EXPERT:
-    case COL_CUSTOM:
-    case COL_FREQ_CHAN:
-      if (pinfo->cinfo->col_data[i] != pinfo->cinfo->col_buf[i]) {
-         /* XXX assume it's a constant */
-         fdata->col_text[i] = (gchar *)pinfo->cinfo->col_data[i];
-      }
-      else {
-         /* copy */
-         fdata->col_text[i] = se_strdup(pinfo->cinfo->col_data[i]);
-      }
-      break;
-    case COL_OXID:
-      fdata->col_text[i] = (gchar *)(GUINT_TO_POINTER((guint)pinfo->oxid));
-      break;
-    case COL_RXID:
-      fdata->col_text[i] = (gchar *)(GUINT_TO_POINTER((guint)pinfo->rxid));
-      break;
-    case COL_CIRCUIT_ID:
-      set_circuit_id(pinfo);
-      break;
-    case COL_SRCIDX:
-      fdata->col_text[i] = (gchar *)(GUINT_TO_POINTER((guint)pinfo->src_idx));
-      break;
-    case COL_DSTIDX:
-      fdata->col_text[i] = (gchar *)(GUINT_TO_POINTER((guint)pinfo->dst_idx));
-      break;
-    case COL_VSAN:
-      fdata->col_text[i] = (gchar *)(GUINT_TO_POINTER((guint)pinfo->vsan));
-      break;
+  case COL_VAL_PORT:
+    is_res = cinfo->col_fmt[col] != COL_UNRES_SRC_PORT &&
+             cinfo->col_fmt[col] != COL_UNRES_DST_PORT;
+    if (!is_res)
+      guint32_to_str_buf(val->v.port, buf, COL_MAX_LEN);
+    else if (val->subtype == PT_SCTP)
+      g_strlcpy(buf, get_sctp_port(val->v.port), COL_MAX_LEN);
+    else if (val->subtype == PT_TCP)
+      g_strlcpy(buf, get_tcp_port(val->v.port), COL_MAX_LEN);
+    else
+      g_strlcpy(buf, get_udp_port(val->v.port), COL_MAX_LEN);
+    break;
 
-    case NUM_COL_FMTS:  /* keep compiler happy - shouldn't get here */
-      g_assert_not_reached();
-      break;
-    }
+  default:
+    g_assert_not_reached();
+    break;
   }
-}
-
-/* XXX Gets/creates the text from col_text in frame data */
-/* --------------------- */
-gchar *
-col_get_text(frame_data *fd, column_info *cinfo, gint col)
-{
-static gchar fmtbuf[3][COL_MAX_LEN];
-static int idx;
-gchar  *buf;
-gchar  *ptr;
-
-    idx = (idx + 1) % 3;
-    buf = fmtbuf[idx];
-    *buf = 0;
-    ptr = buf;
-
-    switch (cinfo->col_fmt[col]) {
-    case COL_NUMBER: /* frame number */
-      guint32_to_str_buf(fd->num, buf, COL_MAX_LEN);
-      break;
-
-    case COL_CLS_TIME:
-      set_cls_time(fd, buf);
-      break;
-    case COL_ABS_TIME:
-      set_abs_time(fd, buf);
-      break;
-    case COL_ABS_DATE_TIME:
-      set_abs_date_time(fd, buf);
-      break;
-    case COL_REL_TIME:
-      set_rel_time(fd, buf);
-      break;
-    case COL_DELTA_TIME:
-      set_delta_time(fd, buf);
-      break;
-    case COL_DELTA_TIME_DIS:
-      set_delta_time_dis(fd, buf);
-      break;
-
-    case COL_PACKET_LENGTH: /* fd->pkt_len */
-      guint32_to_str_buf(fd->pkt_len, buf, COL_MAX_LEN);
-      break;
-
-    case COL_CUMULATIVE_BYTES: /* fd->cum_bytes */
-      guint32_to_str_buf(fd->cum_bytes, buf, COL_MAX_LEN);
-      break;
-
-    case COL_DEF_SRC:
-    case COL_RES_SRC:   /* network address */
-    case COL_UNRES_SRC:
-    case COL_DEF_DL_SRC:
-    case COL_RES_DL_SRC:
-    case COL_UNRES_DL_SRC:
-    case COL_DEF_NET_SRC:
-    case COL_RES_NET_SRC:
-    case COL_UNRES_NET_SRC:
-    case COL_DEF_DST:
-    case COL_RES_DST:
-    case COL_UNRES_DST:
-    case COL_DEF_DL_DST:
-    case COL_RES_DL_DST:
-    case COL_UNRES_DL_DST:
-    case COL_DEF_NET_DST:
-    case COL_RES_NET_DST:
-    case COL_UNRES_NET_DST:
-
-    case COL_IF_DIR:
-    case COL_CIRCUIT_ID:
-    case COL_PROTOCOL:
-    case COL_INFO:
-    case COL_HPUX_SUBSYS:
-    case COL_HPUX_DEVID:
-    case COL_DCE_CALL:
-    case COL_8021Q_VLAN_ID:
-    case COL_DSCP_VALUE:
-    case COL_COS_VALUE:
-    case COL_FR_DLCI:
-    case COL_BSSGP_TLLI:
-    case COL_EXPERT:
-    case COL_CUSTOM:
-    case COL_FREQ_CHAN:
-      ptr = fd->col_text[col];
-      break;
-
-    case COL_DEF_SRC_PORT:
-    case COL_RES_SRC_PORT:
-    case COL_UNRES_SRC_PORT:
-    case COL_DEF_DST_PORT:
-    case COL_RES_DST_PORT:
-    case COL_UNRES_DST_PORT:
-      /* hack */
-      if (GPOINTER_TO_UINT(fd->col_text[col]) <= 65536)
-          guint32_to_str_buf(GPOINTER_TO_UINT(fd->col_text[col], buf, COL_MAX_LEN));
-      else
-          ptr = fd->col_text[col];
-      break;
-
-    case COL_OXID:
-    case COL_RXID:
-    case COL_SRCIDX:
-    case COL_DSTIDX:
-      g_snprintf(buf, COL_MAX_LEN, "0x%x", GPOINTER_TO_UINT(fd->col_text[col]));
-      break;
-
-    case COL_VSAN:
-      guint32_to_str_buf(GPOINTER_TO_UINT(fd->col_text[col]), buf, COL_MAX_LEN);
-      break;
-
-    case NUM_COL_FMTS:  /* keep compiler happy - shouldn't get here */
-      g_assert_not_reached();
-      break;
-    }
-    return ptr;
+  return buf;
 }
 #endif
@@ -159,6 +159,14 @@ gboolean have_custom_cols(column_info *cinfo);
 gboolean col_has_time_fmt(column_info *cinfo, const gint col);
 gboolean col_based_on_frame_data(column_info *cinfo, const gint col);
 
+#ifdef NEW_PACKET_LIST
+/* For internal Wireshark use only.  Not to be called from dissectors. */
+gboolean col_keep_value(frame_data *fd, const column_info *cinfo, const gint col);
+
+/* For internal Wireshark use only.  Not to be called from dissectors. */
+const gchar *col_get_text(const frame_data *fd, const column_info *cinfo, const gint col, gchar *buf);
+#endif
+
 /** Append the given text to a column element, the text will be copied.
  *
  * @param cinfo the current packet row
@@ -39,6 +39,28 @@ typedef struct {
   gchar      **col_expr_val; /* Value for filter expression */
 } col_expr_t;
 
+/*
+ * The raw value of a column whose text depends on settings that can change
+ * while a capture is shown (name resolution).  A packet list that keeps
+ * these instead of the text can make the text again for just the rows
+ * that are drawn, without dissecting the frames again; see col_get_text().
+ */
+enum {
+  COL_VAL_NONE,       /* No raw value, the column text is all there is */
+  COL_VAL_ADDR,       /* An Ethernet, IPv4 or IPv6 address */
+  COL_VAL_PORT        /* A TCP, UDP or SCTP port */
+};
+
+typedef struct _col_value_t {
+  guint8    type;     /* COL_VAL_... */
+  guint8    subtype;  /* address_type or port_type */
+  guint8    len;      /* Length of the address */
+  union {
+    guint8  addr[16];
+    guint32 port;
+  } v;
+} col_value_t;
+
 typedef struct _column_info {
   gint                num_cols;             /* Number of columns */
   gint               *col_fmt;              /* Format of column */
@@ -53,6 +75,8 @@ typedef struct _column_info {
   gchar             **col_buf;              /* Buffer into which to copy data for column */
   int                *col_fence;            /* Stuff in column buffer before this index is immutable */
   col_expr_t          col_expr;             /* Column expressions and values */
+  col_value_t        *col_value;            /* Raw value of a column, if it has one */
+  gboolean            text_on_demand;       /* Leave the text of columns with a raw value to col_get_text() */
   gboolean            writable;             /* Are we still writing to the columns? */
   gboolean            columns_changed;      /* Have the columns been changed in the prefs? */
 } column_info;
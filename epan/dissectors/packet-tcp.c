@@ -229,6 +229,118 @@ static SLAB_FREE_LIST_DEFINE(tcp_unacked_t)
 #define TCP_UNACKED_FREE(fi)                    \
     SLAB_FREE(fi, tcp_unacked_t)
 
+/* The segments not yet ACKed in each direction are kept in a treap (a
+ * binary search tree that is also a heap on a pseudo-random priority),
+ * ordered on nextseq, compared the way sequence numbers are so that they
+ * can wrap around, and then on frame number.  ACKs remove segments from
+ * the low end of the tree, and every node remembers the lowest seq in its
+ * subtree so that the bytes in flight are found without visiting all the
+ * segments.
+ */
+static guint32
+tcp_unacked_priority(guint32 frame)
+{
+    /* any well mixed function of the frame number will do */
+    frame ^= frame >> 16;
+    frame *= 0x45d9f3b;
+    frame ^= frame >> 16;
+    return frame;
+}
+
+static gboolean
+tcp_unacked_before(const tcp_unacked_t *a, const tcp_unacked_t *b)
+{
+    if (a->nextseq != b->nextseq)
+        return LT_SEQ(a->nextseq, b->nextseq);
+    return a->frame < b->frame;
+}
+
+static void
+tcp_unacked_update(tcp_unacked_t *ual)
+{
+    ual->min_seq = ual->seq;
+    if (ual->left && LT_SEQ(ual->left->min_seq, ual->min_seq))
+        ual->min_seq = ual->left->min_seq;
+    if (ual->right && LT_SEQ(ual->right->min_seq, ual->min_seq))
+        ual->min_seq = ual->right->min_seq;
+}
+
+/* insert ual into the tree at root and return the new root */
+static tcp_unacked_t *
+tcp_unacked_insert(tcp_unacked_t *root, tcp_unacked_t *ual)
+{
+    tcp_unacked_t *child;
+
+    if (!root) {
+        ual->left = NULL;
+        ual->right = NULL;
+        tcp_unacked_update(ual);
+        return ual;
+    }
+
+    if (tcp_unacked_before(ual, root)) {
+        child = tcp_unacked_insert(root->left, ual);
+        root->left = child;
+        if (tcp_unacked_priority(child->frame) > tcp_unacked_priority(root->frame)) {
+            root->left = child->right;
+            child->right = root;
+            tcp_unacked_update(root);
+            tcp_unacked_update(child);
+            return child;
+        }
+    } else {
+        child = tcp_unacked_insert(root->right, ual);
+        root->right = child;
+        if (tcp_unacked_priority(child->frame) > tcp_unacked_priority(root->frame)) {
+            root->right = child->left;
+            child->left = root;
+            tcp_unacked_update(root);
+            tcp_unacked_update(child);
+            return child;
+        }
+    }
+    tcp_unacked_update(root);
+    return root;
+}
+
+/* the segment with the lowest nextseq, or NULL if the tree is empty */
+static tcp_unacked_t *
+tcp_unacked_first(tcp_unacked_t *root)
+{
+    if (root) {
+        while (root->left)
+            root = root->left;
+    }
+    return root;
+}
+
+/* the segment with the highest nextseq, or NULL if the tree is empty */
+static tcp_unacked_t *
+tcp_unacked_last(tcp_unacked_t *root)
+{
+    if (root) {
+        while (root->right)
+            root = root->right;
+    }
+    return root;
+}
+
+/* unlink the segment with the lowest nextseq from a non-empty tree */
+static tcp_unacked_t *
+tcp_unacked_remove_first(tcp_unacked_t **root)
+{
+    tcp_unacked_t *ual;
+
+    if ((*root)->left) {
+        ual = tcp_unacked_remove_first(&(*root)->left);
+        tcp_unacked_update(*root);
+        return ual;
+    }
+    ual = *root;
+    *root = ual->right;
+    return ual;
+}
+
 
 #define TCP_A_RETRANSMISSION        0x0001
 #define TCP_A_LOST_PACKET           0x0002
@@ -424,17 +536,95 @@ print_pdu_tracking_data(packet_info *pinfo, tvbuff_t *tvb, proto_tree *tcp_tree,
     PROTO_ITEM_SET_GENERATED(item);
 }
 
+/* Segments mostly arrive in order, so nearly all lookups of multisegment
+ * PDUs are for the ones with the highest sequence numbers seen so far.
+ * Each flow keeps the last few of those in msp_cache, in front of its
+ * multisegment_pdus tree; these functions answer from the cache whenever
+ * the answer is certain to be in it and go to the tree otherwise.  They
+ * compare sequence numbers the way the tree does, i.e. without wrapping.
+ */
+static void
+tcp_msp_cache_insert(tcp_flow_t *flow, struct tcp_multisegment_pdu *msp)
+{
+    guint i, n = flow->msp_cache_count;
+
+    /* find the first cached pdu with a sequence number >= msp's */
+    for (i = 0; i < n && flow->msp_cache[i]->seq < msp->seq; i++)
+        ;
+
+    if (i < n && flow->msp_cache[i]->seq == msp->seq) {
+        /* the tree replaced that one */
+        flow->msp_cache[i] = msp;
+        return;
+    }
+    if (i == 0 && n == TCP_MSP_CACHE_LEN) {
+        /* lower than all the cached ones, which stay the highest */
+        return;
+    }
+
+    if (n == TCP_MSP_CACHE_LEN) {
+        /* make room by dropping the lowest one */
+        memmove(&flow->msp_cache[0], &flow->msp_cache[1],
+            (i - 1) * sizeof flow->msp_cache[0]);
+        i--;
+    } else {
+        memmove(&flow->msp_cache[i + 1], &flow->msp_cache[i],
+            (n - i) * sizeof flow->msp_cache[0]);
+        flow->msp_cache_count++;
+    }
+    flow->msp_cache[i] = msp;
+}
+
+/* the pdu with the highest sequence number <= seq, like se_tree_lookup32_le() */
+static struct tcp_multisegment_pdu *
+tcp_msp_lookup_le(tcp_flow_t *flow, guint32 seq)
+{
+    guint i = flow->msp_cache_count;
+
+    if (i == 0 || seq < flow->msp_cache[0]->seq) {
+        if (flow->msp_cache_count < TCP_MSP_CACHE_LEN)
+            return NULL;    /* the cache holds the whole tree */
+        return se_tree_lookup32_le(flow->multisegment_pdus, seq);
+    }
+    while (flow->msp_cache[i - 1]->seq > seq)
+        i--;
+    return flow->msp_cache[i - 1];
+}
+
+/* the pdu starting at seq, like se_tree_lookup32() */
+static struct tcp_multisegment_pdu *
+tcp_msp_lookup(tcp_flow_t *flow, guint32 seq)
+{
+    struct tcp_multisegment_pdu *msp;
+
+    msp = tcp_msp_lookup_le(flow, seq);
+    if (msp && msp->seq != seq)
+        return NULL;
+    return msp;
+}
+
+static struct tcp_multisegment_pdu *
+tcp_store_sequencenumber_of_next_pdu(packet_info *pinfo, guint32 seq, guint32 nxtpdu, tcp_flow_t *flow)
+{
+    struct tcp_multisegment_pdu *msp;
+
+    msp = pdu_store_sequencenumber_of_next_pdu(pinfo, seq, nxtpdu,
+        flow->multisegment_pdus);
+    tcp_msp_cache_insert(flow, msp);
+    return msp;
+}
+
 /* if we know that a PDU starts inside this segment, return the adjusted
    offset to where that PDU starts or just return offset back
    and let TCP try to find out what it can about this segment
 */
 static int
-scan_for_next_pdu(tvbuff_t *tvb, proto_tree *tcp_tree, packet_info *pinfo, int offset, guint32 seq, guint32 nxtseq, emem_tree_t *multisegment_pdus)
+scan_for_next_pdu(tvbuff_t *tvb, proto_tree *tcp_tree, packet_info *pinfo, int offset, guint32 seq, guint32 nxtseq, tcp_flow_t *flow)
 {
     struct tcp_multisegment_pdu *msp=NULL;
 
     if(!pinfo->fd->flags.visited){
-        msp=se_tree_lookup32_le(multisegment_pdus, seq-1);
+        msp=tcp_msp_lookup_le(flow, seq-1);
         if(msp){
             /* If this is a continuation of a PDU started in a
              * previous segment we need to update the last_frame
@@ -469,7 +659,7 @@ scan_for_next_pdu(tvbuff_t *tvb, proto_tree *tcp_tree, packet_info *pinfo, int o
          * this segment we also verify that the found PDU does span
          * beyond the end of this segment.
          */
-        msp=se_tree_lookup32_le(multisegment_pdus, nxtseq-1);
+        msp=tcp_msp_lookup_le(flow, nxtseq-1);
         if(msp){
             if( (pinfo->fd->num==msp->first_frame)
             ){
@@ -489,7 +679,7 @@ scan_for_next_pdu(tvbuff_t *tvb, proto_tree *tcp_tree, packet_info *pinfo, int o
         /* Second we check if this segment is part of a PDU started
          * prior to the segment (seq-1)
          */
-        msp=se_tree_lookup32_le(multisegment_pdus, seq-1);
+        msp=tcp_msp_lookup_le(flow, seq-1);
         if(msp){
             /* If this segment is completely within a previous PDU
              * then we just skip this packet
@@ -582,26 +772,26 @@ tcp_analyze_get_acked_struct(guint32 frame, gboolean createflag, struct tcp_anal
 }
 
 
-/* fwd contains a list of all segments processed but not yet ACKed in the
+/* fwd contains all segments processed but not yet ACKed in the
  *     same direction as the current segment.
- * rev contains a list of all segments received but not yet ACKed in the
+ * rev contains all segments received but not yet ACKed in the
  *     opposite direction to the current segment.
  *
- * New segments are always added to the head of the fwd/rev lists.
+ * See tcp_unacked_insert() for how they are kept.
  *
  */
 static void
 tcp_analyze_sequence_number(packet_info *pinfo, guint32 seq, guint32 ack, guint32 seglen, guint16 flags, guint32 window, struct tcp_analysis *tcpd)
 {
     tcp_unacked_t *ual=NULL;
-    tcp_unacked_t *prevual=NULL;
     guint32 nextseq;
     int ackcount;
+    gboolean acked;
 
 #ifdef REMOVED
 printf("analyze_sequence numbers   frame:%u  direction:%s\n",pinfo->fd->num,direction>=0?"FWD":"REW");
-printf("FWD list lastflags:0x%04x base_seq:0x%08x:\n",tcpd->fwd->lastsegmentflags,tcpd->fwd->base_seq);for(ual=tcpd->fwd->segments;ual;ual=ual->next)printf("Frame:%d Seq:%d Nextseq:%d\n",ual->frame,ual->seq,ual->nextseq);
-printf("REV list lastflags:0x%04x base_seq:0x%08x:\n",tcpd->rev->lastsegmentflags,tcpd->rev->base_seq);for(ual=tcpd->rev->segments;ual;ual=ual->next)printf("Frame:%d Seq:%d Nextseq:%d\n",ual->frame,ual->seq,ual->nextseq);
+printf("FWD lastflags:0x%04x base_seq:0x%08x\n",tcpd->fwd->lastsegmentflags,tcpd->fwd->base_seq);
+printf("REV lastflags:0x%04x base_seq:0x%08x\n",tcpd->rev->lastsegmentflags,tcpd->rev->base_seq);
 #endif
 
     if (!tcpd) {
@@ -894,10 +1084,8 @@ finished_checking_retransmission_type:
 
         nextseq = seq+seglen;
         if (seglen || flags&(TH_SYN|TH_FIN)) {
-        /* add this new sequence number to the fwd list */
+        /* add this new sequence number to the fwd tree */
         TCP_UNACKED_NEW(ual);
-        ual->next=tcpd->fwd->segments;
-        tcpd->fwd->segments=ual;
         ual->frame=pinfo->fd->num;
         ual->seq=seq;
         ual->ts=pinfo->fd->abs_ts;
@@ -907,6 +1095,7 @@ finished_checking_retransmission_type:
         nextseq+=1;
             }
             ual->nextseq=nextseq;
+            tcpd->fwd->segments=tcp_unacked_insert(tcpd->fwd->segments, ual);
         }
 
     /* Store the highest number seen so far for nextseq so we can detect
@@ -944,27 +1133,26 @@ finished_checking_retransmission_type:
     /* remove all segments this ACKs and we dont need to keep around any more
      */
     ackcount=0;
-    prevual = NULL;
-    ual = tcpd->rev->segments;
-    while(ual){
-        tcp_unacked_t *tmpual;
+    acked=FALSE;
+    while((ual=tcp_unacked_first(tcpd->rev->segments))){
+        /* If this acknowledges only segments prior to this one, we're done */
+        if (GT_SEQ(ual->nextseq,ack)){
+            break;
+        }
 
-        /* If this ack matches the segment, process accordingly */
-        if(ack==ual->nextseq){
+        /* This segment is old, or an exact match.  Delete the segment from the tree */
+        ual=tcp_unacked_remove_first(&tcpd->rev->segments);
+        ackcount++;
+
+        /* If this ack matches the segment, process accordingly.
+         * The oldest of several matching segments is the one acked.
+         */
+        if(ack==ual->nextseq && !acked){
             tcp_analyze_get_acked_struct(pinfo->fd->num, TRUE, tcpd);
             tcpd->ta->frame_acked=ual->frame;
             nstime_delta(&tcpd->ta->ts, &pinfo->fd->abs_ts, &ual->ts);
+            acked=TRUE;
         }
-        /* If this acknowledges a segment prior to this one, leave this segment alone and move on */
-        else if (GT_SEQ(ual->nextseq,ack)){
-            prevual = ual;
-            ual = ual->next;
-            continue;
-        }
-
-        /* This segment is old, or an exact match.  Delete the segment from the list */
-        ackcount++;
-        tmpual=ual->next;
 
         if (tcpd->rev->scps_capable) {
           /* Track largest segment successfully sent for SNACK analysis*/
@@ -973,16 +1161,7 @@ finished_checking_retransmission_type:
           }
         }
 
-        if (!prevual){
-            tcpd->rev->segments = tmpual;
-            TCP_UNACKED_FREE(ual);
-            ual = tmpual;
-        }
-        else{
-            prevual->next = tmpual;
-            TCP_UNACKED_FREE(ual);
-            ual = tmpual;
-        }
+        TCP_UNACKED_FREE(ual);
     }
 
     /* how many bytes of data are there in flight after this frame
@@ -992,17 +1171,8 @@ finished_checking_retransmission_type:
     if (tcp_track_bytes_in_flight && seglen!=0 && ual && tcpd->fwd->valid_bif) {
         guint32 first_seq, last_seq, in_flight;
 
-        first_seq = ual->seq - tcpd->fwd->base_seq;
-        last_seq = ual->nextseq - tcpd->fwd->base_seq;
-        while (ual) {
-            if ((ual->nextseq-tcpd->fwd->base_seq)>last_seq) {
-                last_seq = ual->nextseq-tcpd->fwd->base_seq;
-            }
-            if ((ual->seq-tcpd->fwd->base_seq)<first_seq) {
-                first_seq = ual->seq-tcpd->fwd->base_seq;
-            }
-            ual = ual->next;
-        }
+        first_seq = ual->min_seq - tcpd->fwd->base_seq;
+        last_seq = tcp_unacked_last(ual)->nextseq - tcpd->fwd->base_seq;
         in_flight = last_seq-first_seq;
 
         if (in_flight>0 && in_flight<2000000000) {
@@ -1499,6 +1669,21 @@ tcp_fragment_init(void)
 /* functions to trace tcp segments */
 /* Enable desegmenting of TCP streams */
 static gboolean tcp_desegment = TRUE;
+/* Build desegmented PDUs as composite tvbuffs over the segments' data
+ * instead of copying them into one contiguous buffer */
+static gboolean tcp_desegment_composite = TRUE;
+
+static fragment_data *
+tcp_fragment_add(tvbuff_t *tvb, int offset, packet_info *pinfo,
+        guint32 id, guint32 frag_offset, guint32 frag_data_len,
+        gboolean more_frags)
+{
+    if (tcp_desegment_composite)
+        return fragment_add_composite(tvb, offset, pinfo, id,
+            tcp_fragment_table, frag_offset, frag_data_len, more_frags);
+    return fragment_add(tvb, offset, pinfo, id,
+        tcp_fragment_table, frag_offset, frag_data_len, more_frags);
+}
 
 static void
 desegment_tcp(tvbuff_t *tvb, packet_info *pinfo, int offset,
@@ -1552,7 +1737,7 @@ again:
 	 * dissection of the desegmented pdu if we'd already seen the end of
 	 * the pdu).
 	 */
-	if ((msp = se_tree_lookup32(tcpd->fwd->multisegment_pdus, seq))) {
+	if ((msp = tcp_msp_lookup(tcpd->fwd, seq))) {
 	    const char* str;
 
 	    if (msp->first_frame == PINFO_FD_NUM(pinfo)) {
@@ -1571,7 +1756,7 @@ again:
 	}
 
 	/* Else, find the most previous PDU starting before this sequence number */
-        msp = se_tree_lookup32_le(tcpd->fwd->multisegment_pdus, seq-1);
+        msp = tcp_msp_lookup_le(tcpd->fwd, seq-1);
     }
 
     if(msp && msp->seq<=seq && msp->nxtpdu>seq){
@@ -1593,8 +1778,8 @@ again:
         }
         last_fragment_len = len;
 
-        ipfd_head = fragment_add(tvb, offset, pinfo, msp->first_frame,
-				 tcp_fragment_table, seq - msp->seq, len,
+        ipfd_head = tcp_fragment_add(tvb, offset, pinfo, msp->first_frame,
+            seq - msp->seq, len,
             (LT_SEQ (nxtseq,msp->nxtpdu)) );
 
         if(msp->flags&MSP_FLAGS_REASSEMBLE_ENTIRE_SEGMENT){
@@ -1678,9 +1863,7 @@ again:
             int old_len;
 
             /* create a new TVB structure for desegmented data */
-            next_tvb = tvb_new_child_real_data(tvb, ipfd_head->data,
-					       ipfd_head->datalen,
-					       ipfd_head->datalen);
+            next_tvb = fragment_new_reassembled_tvb(tvb, ipfd_head);
 
 
             /* add desegmented data to the data source list */
@@ -1851,17 +2034,17 @@ again:
              * but set this msp flag so we can pick it up
              * above.
              */
-            msp = pdu_store_sequencenumber_of_next_pdu(pinfo,
-                deseg_seq, nxtseq+1, tcpd->fwd->multisegment_pdus);
+            msp = tcp_store_sequencenumber_of_next_pdu(pinfo,
+                deseg_seq, nxtseq+1, tcpd->fwd);
             msp->flags|=MSP_FLAGS_REASSEMBLE_ENTIRE_SEGMENT;
         } else {
-            msp = pdu_store_sequencenumber_of_next_pdu(pinfo,
-                deseg_seq, nxtseq+pinfo->desegment_len, tcpd->fwd->multisegment_pdus);
+            msp = tcp_store_sequencenumber_of_next_pdu(pinfo,
+                deseg_seq, nxtseq+pinfo->desegment_len, tcpd->fwd);
         }
 
         /* add this segment as the first one for this new pdu */
-        fragment_add(tvb, deseg_offset, pinfo, msp->first_frame,
-			 tcp_fragment_table, 0, nxtseq - deseg_seq,
+        tcp_fragment_add(tvb, deseg_offset, pinfo, msp->first_frame,
+            0, nxtseq - deseg_seq,
             LT_SEQ(nxtseq, msp->nxtpdu));
         }
     }
@@ -2892,7 +3075,7 @@ process_tcp_payload(tvbuff_t *tvb, volatile int offset, packet_info *pinfo,
             if(tcpd && tcp_analyze_seq && (!tcp_desegment)){
                 if(seq || nxtseq){
                     offset=scan_for_next_pdu(tvb, tcp_tree, pinfo, offset,
-                        seq, nxtseq, tcpd->fwd->multisegment_pdus);
+                        seq, nxtseq, tcpd->fwd);
                 }
             }
         }
@@ -2915,11 +3098,11 @@ process_tcp_payload(tvbuff_t *tvb, volatile int offset, packet_info *pinfo,
                 if(tcpd && (!pinfo->fd->flags.visited) &&
                     tcp_analyze_seq && pinfo->want_pdu_tracking){
                     if(seq || nxtseq){
-                        pdu_store_sequencenumber_of_next_pdu(
+                        tcp_store_sequencenumber_of_next_pdu(
                             pinfo,
                             seq,
                             nxtseq+pinfo->bytes_until_next_pdu,
-                            tcpd->fwd->multisegment_pdus);
+                            tcpd->fwd);
                     }
                 }
             }
@@ -2945,10 +3128,10 @@ process_tcp_payload(tvbuff_t *tvb, volatile int offset, packet_info *pinfo,
              */
             if(tcpd && (!pinfo->fd->flags.visited) && tcp_analyze_seq && pinfo->want_pdu_tracking){
                 if(seq || nxtseq){
-                    pdu_store_sequencenumber_of_next_pdu(pinfo,
+                    tcp_store_sequencenumber_of_next_pdu(pinfo,
                         seq,
                         nxtseq+pinfo->bytes_until_next_pdu,
-                        tcpd->fwd->multisegment_pdus);
+                        tcpd->fwd);
                 }
             }
         }
@@ -3556,12 +3739,11 @@ dissect_tcp(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree)
         struct tcp_multisegment_pdu *msp;
 
         /* find the most previous PDU starting before this sequence number */
-        msp=se_tree_lookup32_le(tcpd->fwd->multisegment_pdus, tcph->th_seq-1);
+        msp=tcp_msp_lookup_le(tcpd->fwd, tcph->th_seq-1);
         if(msp){
             fragment_data *ipfd_head;
 
-            ipfd_head = fragment_add(tvb, offset, pinfo, msp->first_frame,
-                                     tcp_fragment_table,
+            ipfd_head = tcp_fragment_add(tvb, offset, pinfo, msp->first_frame,
                                      tcph->th_seq - msp->seq,
                                      tcph->th_seglen,
                                      FALSE );
@@ -3571,7 +3753,7 @@ dissect_tcp(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree)
                 /* create a new TVB structure for desegmented data
                  * datalen-1 to strip the dummy FIN byte off
                  */
-                next_tvb = tvb_new_child_real_data(tvb, ipfd_head->data, ipfd_head->datalen, ipfd_head->datalen);
+                next_tvb = fragment_new_reassembled_tvb(tvb, ipfd_head);
 
                 /* add desegmented data to the data source list */
                 add_new_data_source(pinfo, next_tvb, "Reassembled TCP");
@@ -4139,6 +4321,11 @@ proto_register_tcp(void)
         "Allow subdissector to reassemble TCP streams",
         "Whether subdissector can request TCP streams to be reassembled",
         &tcp_desegment);
+    prefs_register_bool_preference(tcp_module, "desegment_composite",
+        "Reassemble TCP PDUs without copying",
+        "Whether reassembled TCP PDUs should refer to the data of the segments they were built from "
+        "instead of copying it into one contiguous buffer",
+        &tcp_desegment_composite);
     prefs_register_bool_preference(tcp_module, "analyze_sequence_numbers",
         "Analyze TCP sequence numbers",
         "Make the TCP dissector analyze TCP sequence numbers to find and flag segment retransmissions, missing segments and RTT",
@@ -103,10 +103,12 @@ extern struct tcp_multisegment_pdu *
 pdu_store_sequencenumber_of_next_pdu(packet_info *pinfo, guint32 seq, guint32 nxtpdu, emem_tree_t *multisegment_pdus);
 
 typedef struct _tcp_unacked_t {
-	struct _tcp_unacked_t *next;
+	struct _tcp_unacked_t *left;	/* segments ordered before this one */
+	struct _tcp_unacked_t *right;	/* segments ordered after this one */
 	guint32 frame;
 	guint32	seq;
 	guint32	nextseq;
+	guint32 min_seq;	/* lowest seq in this subtree */
 	nstime_t ts;
 } tcp_unacked_t;
 
@@ -136,11 +138,17 @@ struct tcp_multisegment_pdu {
 #define MSP_FLAGS_REASSEMBLE_ENTIRE_SEGMENT	0x00000001
 };
 
+/* Number of multisegment PDUs with the highest sequence numbers that
+ * each flow keeps at hand in front of its multisegment_pdus tree.
+ */
+#define TCP_MSP_CACHE_LEN	4
+
 typedef struct _tcp_flow_t {
 	guint32 base_seq;		/* base seq number (used by relative sequence numbers)
 							 * or 0 if not yet known.
 							 */
-	tcp_unacked_t *segments;
+	tcp_unacked_t *segments;	/* root of the tree of segments not
+					 * yet ACKed */
 	guint32 lastack;		/* last seen ack */
 	nstime_t lastacktime;	/* Time of the last ack packet */
 	guint32 lastnondupack;	/* frame number of last seen non dupack */
@@ -170,6 +178,12 @@ typedef struct _tcp_flow_t {
 	 * all pdus spanning multiple segments for this flow.
 	 */
 	emem_tree_t *multisegment_pdus;
+	/* The pdus with the TCP_MSP_CACHE_LEN highest sequence numbers in
+	 * the tree, lowest first; if there are fewer than that, these are
+	 * all the pdus in the tree.
+	 */
+	struct tcp_multisegment_pdu *msp_cache[TCP_MSP_CACHE_LEN];
+	guint msp_cache_count;
 
 	/* Process info, currently discovered via IPFIX */
 	guint32 process_uid;    /* UID of local process */
@@ -212,6 +212,7 @@ frame_data_init(frame_data *fdata, guint32 num,
 #ifdef NEW_PACKET_LIST
   fdata->col_text_len = NULL;
   fdata->col_text = NULL;
+  fdata->col_values = NULL;
 #endif
 }
 
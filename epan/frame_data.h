@@ -69,6 +69,7 @@ typedef struct _frame_data {
 #ifdef NEW_PACKET_LIST
   gchar        **col_text;    /* The column text for some columns, see colum_utils */
   guint        *col_text_len; /* The length of the column text strings in 'col_text' */
+  struct _col_value_t *col_values; /* Raw values of some columns, instead of col_text; NULL if none */
 #endif
 } frame_data;
 
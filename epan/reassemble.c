@@ -70,6 +70,103 @@ static void LINK_FRAG(fragment_data *fd_head,fragment_data *fd)
 	fd_i->next=fd;
 }
 
+/*
+ * fragment_add_work() keeps, next to the sorted list of fragments, an array
+ * of the same fragments in the same order.  Finding where a new fragment
+ * goes is then a binary search instead of a walk down the list, and the
+ * end of the data available from offset 0 without a gap is kept up to
+ * date as fragments arrive, so that telling whether the datagram is
+ * complete doesn't rescan the list either.
+ */
+struct _fragment_index {
+	GPtrArray *frags;	/* the fragments, in list order */
+	guint32 contiguous;	/* end of the gapless data from offset 0 */
+	guint frontier;		/* first fragment not counted in "contiguous" */
+};
+
+/* count the fragments from the frontier on that now join the gapless data */
+static void
+fragment_index_advance(struct _fragment_index *idx)
+{
+	fragment_data *fd_i;
+
+	while (idx->frontier < idx->frags->len) {
+		fd_i = g_ptr_array_index(idx->frags, idx->frontier);
+		if (fd_i->offset > idx->contiguous)
+			break;
+		idx->contiguous = MAX(idx->contiguous, fd_i->offset+fd_i->len);
+		idx->frontier++;
+	}
+}
+
+static struct _fragment_index *
+fragment_index_get(fragment_data *fd_head)
+{
+	struct _fragment_index *idx;
+	fragment_data *fd_i;
+
+	if (fd_head->frag_index == NULL) {
+		idx = g_malloc(sizeof(struct _fragment_index));
+		idx->frags = g_ptr_array_new();
+		idx->contiguous = 0;
+		idx->frontier = 0;
+		for (fd_i=fd_head->next; fd_i; fd_i=fd_i->next)
+			g_ptr_array_add(idx->frags, fd_i);
+		fragment_index_advance(idx);
+		fd_head->frag_index = idx;
+	}
+	return fd_head->frag_index;
+}
+
+static void
+fragment_index_free(fragment_data *fd_head)
+{
+	if (fd_head->frag_index != NULL) {
+		g_ptr_array_free(fd_head->frag_index->frags, TRUE);
+		g_free(fd_head->frag_index);
+		fd_head->frag_index = NULL;
+	}
+}
+
+/* The same as LINK_FRAG(), using and updating the index of fd_head */
+static void
+fragment_index_link(fragment_data *fd_head, fragment_data *fd)
+{
+	struct _fragment_index *idx = fragment_index_get(fd_head);
+	fragment_data *fd_i;
+	guint lo, hi, mid;
+
+	/* find the first fragment with a higher offset */
+	lo = 0;
+	hi = idx->frags->len;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		fd_i = g_ptr_array_index(idx->frags, mid);
+		if (fd->offset < fd_i->offset)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	fd_i = lo ? g_ptr_array_index(idx->frags, lo-1) : fd_head;
+	fd->next = fd_i->next;
+	fd_i->next = fd;
+
+	g_ptr_array_add(idx->frags, fd);
+	if (lo < idx->frags->len-1) {
+		memmove(&idx->frags->pdata[lo+1], &idx->frags->pdata[lo],
+			(idx->frags->len-1-lo) * sizeof(gpointer));
+		idx->frags->pdata[lo] = fd;
+	}
+
+	if (lo < idx->frontier) {
+		/* it starts within the gapless data */
+		idx->frontier++;
+		idx->contiguous = MAX(idx->contiguous, fd->offset+fd->len);
+	}
+	fragment_index_advance(idx);
+}
+
 /* copy a fragment key to heap store to insert in the hash */
 static void *fragment_key_copy(const void *k)
 {
@@ -247,6 +344,7 @@ free_all_fragments(gpointer key_arg _U_, gpointer value, gpointer user_data _U_)
 	g_free((gpointer)key->src.data);
 	g_free((gpointer)key->dst.data);
 #endif
+	fragment_index_free(value);
 	for (fd_head = value; fd_head != NULL; fd_head = tmp_fd) {
 		tmp_fd=fd_head->next;
 
@@ -289,6 +387,7 @@ free_all_reassembled_fragments(gpointer key_arg _U_, gpointer value,
 {
 	fragment_data *fd_head;
 
+	fragment_index_free(value);
 	for (fd_head = value; fd_head != NULL; fd_head = fd_head->next) {
 		if(fd_head->data && !(fd_head->flags&FD_NOT_MALLOCED)) {
 			g_free(fd_head->data);
@@ -504,6 +603,7 @@ fragment_delete(const packet_info *pinfo, const guint32 id, GHashTable *fragment
 	}
 
 	data=fd_head->data;
+	fragment_index_free(fd_head);
 	/* loop over all partial fragments and free any buffers */
 	for(fd=fd_head->next;fd;){
 		fragment_data *tmp_fd;
@@ -739,6 +839,61 @@ fragment_reassembled(fragment_data *fd_head, const packet_info *pinfo,
 	fd_head->reassembled_in = pinfo->fd->num;
 }
 
+/*
+ * For a FD_COMPOSITE datagram, check whether "data" differs from what
+ * any of the fragments preceding "stop" (or all of them, if "stop" is
+ * NULL) hold for the bytes at frag_offset..frag_offset+len-1.
+ */
+static gboolean
+fragment_composite_differs(fragment_data *fd_head, fragment_data *stop,
+		 const guint32 frag_offset, const unsigned char *data,
+		 const guint32 len)
+{
+	fragment_data *fd_i;
+	guint32 start, end;
+
+	for (fd_i=fd_head->next; fd_i && fd_i != stop; fd_i=fd_i->next) {
+		if (!fd_i->data || !fd_i->len)
+			continue;
+		start = MAX(frag_offset, fd_i->offset);
+		end = MIN(frag_offset+len, fd_i->offset+fd_i->len);
+		if (start < end && memcmp(fd_i->data+(start-fd_i->offset),
+				data+(start-frag_offset), end-start))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/*
+ * The FD_COMPOSITE counterpart of the defragmentation loop in
+ * fragment_add_work(): flag the fragments overlapping the ones before
+ * them, without copying anything.
+ */
+static void
+fragment_composite_check_overlaps(fragment_data *fd_head, const guint32 max)
+{
+	fragment_data *fd_i;
+	guint32 dfpos;
+
+	for (dfpos=0,fd_i=fd_head->next;fd_i;fd_i=fd_i->next) {
+		if (!fd_i->len)
+			continue;
+		if (fd_i->offset < dfpos && fd_i->offset+fd_i->len > dfpos &&
+		    fd_i->offset+fd_i->len <= max) {
+			fd_i->flags    |= FD_OVERLAP;
+			fd_head->flags |= FD_OVERLAP;
+			if (fragment_composite_differs(fd_head, fd_i,
+					fd_i->offset, fd_i->data,
+					dfpos-fd_i->offset)) {
+				fd_i->flags    |= FD_OVERLAPCONFLICT;
+				fd_head->flags |= FD_OVERLAPCONFLICT;
+			}
+		}
+		dfpos=MAX(dfpos,(fd_i->offset+fd_i->len));
+	}
+}
+
 /*
  * This function adds a new fragment to the fragment hash table.
  * If this is the first fragment seen for this datagram, a new entry
@@ -779,6 +934,7 @@ fragment_add_work(fragment_data *fd_head, tvbuff_t *tvb, const int offset,
 	fd->next = NULL;
 	fd->flags = 0;
 	fd->frame = pinfo->fd->num;
+	fd->frag_index = NULL;
 	if (fd->frame > fd_head->frame)
 		fd_head->frame = fd->frame;
 	fd->offset = frag_offset;
@@ -788,11 +944,12 @@ fragment_add_work(fragment_data *fd_head, tvbuff_t *tvb, const int offset,
 	/*
 	 * If it was already defragmented and this new fragment goes beyond
 	 * data limits, set flag in already empty fds & point old fds to malloc'ed data.
+	 * (FD_COMPOSITE fragments still hold their own data.)
 	 */
 	if(fd_head->flags & FD_DEFRAGMENTED && (frag_offset+frag_data_len) >= fd_head->datalen &&
 		fd_head->flags & FD_PARTIAL_REASSEMBLY){
 		for(fd_i=fd_head->next; fd_i; fd_i=fd_i->next){
-			if( !fd_i->data ) {
+			if( !fd_i->data && !(fd_head->flags & FD_COMPOSITE) ) {
 				fd_i->data = fd_head->data + fd_i->offset;
 				fd_i->flags |= FD_NOT_MALLOCED;
 			}
@@ -846,13 +1003,20 @@ fragment_add_work(fragment_data *fd_head, tvbuff_t *tvb, const int offset,
 			fd_head->flags |= FD_TOOLONGFRAGMENT;
 		}
 		/* make sure it doesn't conflict with previous data */
+		else if (fd_head->flags & FD_COMPOSITE) {
+			if (fragment_composite_differs(fd_head, NULL, fd->offset,
+				tvb_get_ptr(tvb,offset,fd->len), fd->len)) {
+				fd->flags	   |= FD_OVERLAPCONFLICT;
+				fd_head->flags |= FD_OVERLAPCONFLICT;
+			}
+		}
 		else if ( memcmp(fd_head->data+fd->offset,
 			tvb_get_ptr(tvb,offset,fd->len),fd->len) ){
 			fd->flags	   |= FD_OVERLAPCONFLICT;
 			fd_head->flags |= FD_OVERLAPCONFLICT;
 		}
 		/* it was just an overlap, link it and return */
-		LINK_FRAG(fd_head,fd);
+		fragment_index_link(fd_head,fd);
 		return TRUE;
 	}
 
@@ -865,7 +1029,7 @@ fragment_add_work(fragment_data *fd_head, tvbuff_t *tvb, const int offset,
 	 */
 	fd->data = g_malloc(fd->len);
 	tvb_memcpy(tvb, fd->data, offset, fd->len);
-	LINK_FRAG(fd_head,fd);
+	fragment_index_link(fd_head,fd);
 
 
 	if( !(fd_head->flags & FD_DATALEN_SET) ){
@@ -878,21 +1042,11 @@ fragment_add_work(fragment_data *fd_head, tvbuff_t *tvb, const int offset,
 
 	/*
 	 * Check if we have received the entire fragment.
-	 * This is easy since the list is sorted and the head is faked.
-	 *
-	 * First, we compute the amount of contiguous data that's
-	 * available.  (The check for fd_i->offset <= max rules out
-	 * fragments that don't start before or at the end of the
-	 * previous fragment, i.e. fragments that have a gap between
-	 * them and the previous fragment.)
+	 * The index keeps track of the amount of contiguous data
+	 * that's available, i.e. up to the first fragment that has
+	 * a gap between it and the previous fragment.
 	 */
-	max = 0;
-	for (fd_i=fd_head->next;fd_i;fd_i=fd_i->next) {
-		if ( ((fd_i->offset)<=max) &&
-			((fd_i->offset+fd_i->len)>max) ){
-			max = fd_i->offset+fd_i->len;
-		}
-	}
+	max = fragment_index_get(fd_head)->contiguous;
 
 	if (max < (fd_head->datalen)) {
 		/*
@@ -912,6 +1066,14 @@ fragment_add_work(fragment_data *fd_head, tvbuff_t *tvb, const int offset,
 		fd_head->flags |= FD_TOOLONGFRAGMENT;
 	}
 
+	if (fd_head->flags & FD_COMPOSITE) {
+		/* the fragments keep their data; just check the overlaps */
+		fragment_composite_check_overlaps(fd_head, max);
+		fd_head->flags |= FD_DEFRAGMENTED;
+		fd_head->reassembled_in=pinfo->fd->num;
+		return TRUE;
+	}
+
 	/* we have received an entire packet, defragment it and
 		 * free all fragments
 		 */
@@ -991,7 +1153,7 @@ static fragment_data *
 fragment_add_common(tvbuff_t *tvb, const int offset, const packet_info *pinfo, const guint32 id,
 		 GHashTable *fragment_table, const guint32 frag_offset,
 		 const guint32 frag_data_len, const gboolean more_frags,
-		 const gboolean check_already_added)
+		 const gboolean check_already_added, const guint32 head_flags)
 {
 	fragment_key key, *new_key;
 	fragment_data *fd_head;
@@ -1068,7 +1230,7 @@ fragment_add_common(tvbuff_t *tvb, const int offset, const packet_info *pinfo, c
 		/* not found, this must be the first snooped fragment for this
 				 * packet. Create list-head.
 		 */
-		fd_head = new_head(0);
+		fd_head = new_head(head_flags);
 
 		/*
 		 * We're going to use the key to insert the fragment,
@@ -1107,7 +1269,56 @@ fragment_add(tvbuff_t *tvb, const int offset, const packet_info *pinfo, const gu
 		 const guint32 frag_data_len, const gboolean more_frags)
 {
 	return fragment_add_common(tvb, offset, pinfo, id, fragment_table,
-		frag_offset, frag_data_len, more_frags, TRUE);
+		frag_offset, frag_data_len, more_frags, TRUE, 0);
+}
+
+fragment_data *
+fragment_add_composite(tvbuff_t *tvb, const int offset, const packet_info *pinfo,
+		 const guint32 id, GHashTable *fragment_table,
+		 const guint32 frag_offset, const guint32 frag_data_len,
+		 const gboolean more_frags)
+{
+	return fragment_add_common(tvb, offset, pinfo, id, fragment_table,
+		frag_offset, frag_data_len, more_frags, TRUE, FD_COMPOSITE);
+}
+
+tvbuff_t *
+fragment_new_reassembled_tvb(tvbuff_t *parent, fragment_data *fd_head)
+{
+	tvbuff_t *next_tvb, *member_tvb;
+	fragment_data *fd_i;
+	guint32 dfpos, len;
+
+	if (!(fd_head->flags & FD_COMPOSITE)) {
+		return tvb_new_child_real_data(parent, fd_head->data,
+			fd_head->datalen, fd_head->datalen);
+	}
+
+	/*
+	 * Stitch the fragments together in the same way as the
+	 * defragmentation loop in fragment_add_work() would copy them:
+	 * each byte comes from the first fragment that covers it.
+	 */
+	next_tvb = tvb_new_composite();
+	for (dfpos=0,fd_i=fd_head->next;fd_i && dfpos<fd_head->datalen;fd_i=fd_i->next) {
+		if (!fd_i->data || fd_i->offset+fd_i->len <= dfpos)
+			continue;
+		if (fd_i->offset > dfpos)
+			break;	/* a gap; can't happen for a complete datagram */
+
+		len = MIN(fd_i->offset+fd_i->len, fd_head->datalen) - dfpos;
+		member_tvb = tvb_new_real_data(fd_i->data+(dfpos-fd_i->offset),
+			len, len);
+		tvb_composite_append(next_tvb, member_tvb);
+		/* the composite now holds the only reference */
+		tvb_decrement_usage_count(member_tvb, 1);
+		dfpos += len;
+	}
+	tvb_composite_finalize(next_tvb);
+
+	tvb_set_child_real_data_tvbuff(parent, next_tvb);
+
+	return next_tvb;
 }
 
 /*
@@ -1121,7 +1332,7 @@ fragment_add_multiple_ok(tvbuff_t *tvb, const int offset, const packet_info *pin
 			 const gboolean more_frags)
 {
 	return fragment_add_common(tvb, offset, pinfo, id, fragment_table,
-		frag_offset, frag_data_len, more_frags, FALSE);
+		frag_offset, frag_data_len, more_frags, FALSE, 0);
 }
 
 fragment_data *
@@ -1207,6 +1418,8 @@ fragment_add_check(tvbuff_t *tvb, const int offset, const packet_info *pinfo,
 		 */
 		old_key = orig_key;
 		fragment_unhash(fragment_table, old_key);
+		/* nothing more gets added to it */
+		fragment_index_free(fd_head);
 
 		/*
 		 * Add this item to the table of reassembled packets.
@@ -1342,6 +1555,7 @@ fragment_add_seq_work(fragment_data *fd_head, tvbuff_t *tvb, const int offset,
 	fd->next = NULL;
 	fd->flags = 0;
 	fd->frame = pinfo->fd->num;
+	fd->frag_index = NULL;
 	fd->offset = frag_number;
 	fd->len  = frag_data_len;
 	fd->data = NULL;
@@ -1867,6 +2081,7 @@ fragment_start_seq_check(const packet_info *pinfo, const guint32 id, GHashTable
 		fd_head->flags = FD_BLOCKSEQUENCE|FD_DATALEN_SET;
 		fd_head->data = NULL;
 		fd_head->reassembled_in = 0;
+		fd_head->frag_index = NULL;
 		/*
 		 * We're going to use the key to insert the fragment,
 		 * so copy it to a long-term store.
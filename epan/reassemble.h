@@ -64,6 +64,13 @@
  */
 #define FD_DATALEN_SET		0x0400
 
+/* This flag is set in (only) fd_head when the fragments were added with
+ * fragment_add_composite(): every fragment keeps its own copy of its
+ * payload and the reassembled data is never copied into fd_head->data.
+ * Use fragment_new_reassembled_tvb() to get at the reassembled data.
+ */
+#define FD_COMPOSITE		0x0800
+
 typedef struct _fragment_data {
 	struct _fragment_data *next;
 	guint32 frame;
@@ -78,6 +85,9 @@ typedef struct _fragment_data {
 				   and when FD_DEFRAGMENTED is set*/
 	guint32 flags;
 	unsigned char *data;
+	struct _fragment_index *frag_index; /* private to reassemble.c; only
+					      used in the first item of
+					      the list */
 } fragment_data;
 
 
@@ -139,6 +149,32 @@ extern fragment_data *fragment_add_multiple_ok(tvbuff_t *tvb, const int offset,
     const packet_info *pinfo, const guint32 id, GHashTable *fragment_table,
     const guint32 frag_offset, const guint32 frag_data_len, const gboolean more_frags);
 
+/*
+ * Same as fragment_add(), but if this fragment starts a new datagram the
+ * datagram is reassembled without flattening (FD_COMPOSITE): each fragment
+ * payload is copied once when it is added, and completing or extending
+ * (FD_PARTIAL_REASSEMBLY) the datagram never copies the data again.
+ * This is meant for large PDUs built from many fragments, such as TCP
+ * desegmentation of storage protocols.
+ *
+ * fd_head->data is NULL for such datagrams; use
+ * fragment_new_reassembled_tvb() to get a tvbuff with the reassembled data.
+ */
+extern fragment_data *fragment_add_composite(tvbuff_t *tvb, const int offset,
+    const packet_info *pinfo, const guint32 id, GHashTable *fragment_table,
+    const guint32 frag_offset, const guint32 frag_data_len, const gboolean more_frags);
+
+/*
+ * Returns a new tvbuff holding the first fd_head->datalen bytes of a
+ * datagram reassembled with fragment_add() or fragment_add_composite();
+ * the tvbuff is added to the chain of "parent" so that it is freed with it.
+ *
+ * For FD_COMPOSITE datagrams this is a composite tvbuff referring to the
+ * data kept by the fragments; otherwise it refers to fd_head->data.
+ */
+extern tvbuff_t *fragment_new_reassembled_tvb(tvbuff_t *parent,
+    fragment_data *fd_head);
+
 /*
  * This routine extends fragment_add to use a "reassembled_table".
  *
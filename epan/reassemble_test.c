@@ -1005,6 +1005,167 @@ test_missing_data_fragment_add_seq_next_3(void)
 }
 
 
+/**********************************************************************************
+ *
+ * fragment_add_composite
+ *
+ *********************************************************************************/
+
+/* This tests reassembly without flattening (FD_COMPOSITE).
+ *
+ * We add a sequence of fragments thus:
+ *    frame  offset  frag_offset   len   more_frags
+ *    -----  ------  -----------   ---   ----------
+ *      1      10         0         50     true
+ *      2      80        70         30     false
+ *      3      55        45         30     true   (overlaps both neighbours)
+ *      4     110       100         20     false  (after partial reassembly)
+ *      5       0         0         10     true   (conflicting overlap)
+ */
+static void
+test_fragment_add_composite(void)
+{
+    fragment_data *fd_head;
+    tvbuff_t *next_tvb;
+    guint8 *buf;
+
+    printf("Starting test test_fragment_add_composite\n");
+
+    pinfo.fd->num = 1;
+    fd_head=fragment_add_composite(tvb, 10, &pinfo, 12, fragment_table,
+                                   0, 50, TRUE);
+    ASSERT_EQ(1,g_hash_table_size(fragment_table));
+    ASSERT_EQ(NULL,fd_head);
+
+    pinfo.fd->num = 2;
+    fd_head=fragment_add_composite(tvb, 80, &pinfo, 12, fragment_table,
+                                   70, 30, FALSE);
+    ASSERT_EQ(NULL,fd_head);
+
+    pinfo.fd->num = 3;
+    fd_head=fragment_add_composite(tvb, 55, &pinfo, 12, fragment_table,
+                                   45, 30, TRUE);
+    ASSERT_NE(NULL,fd_head);
+
+    /* check the contents of the structure */
+    ASSERT_EQ(100,fd_head->datalen);
+    ASSERT_EQ(3,fd_head->reassembled_in);
+    ASSERT_EQ(FD_DEFRAGMENTED|FD_DATALEN_SET|FD_COMPOSITE|FD_OVERLAP,fd_head->flags);
+    ASSERT_EQ(NULL,fd_head->data);
+
+    /* the fragments keep their own data, sorted by offset */
+    ASSERT_EQ(1,fd_head->next->frame);
+    ASSERT_NE(NULL,fd_head->next->data);
+    ASSERT_EQ(0,fd_head->next->flags);
+    ASSERT_EQ(3,fd_head->next->next->frame);
+    ASSERT_EQ(FD_OVERLAP,fd_head->next->next->flags);
+    ASSERT_EQ(2,fd_head->next->next->next->frame);
+    ASSERT_EQ(FD_OVERLAP,fd_head->next->next->next->flags);
+    ASSERT_EQ(NULL,fd_head->next->next->next->next);
+
+    /* test the actual reassembly */
+    next_tvb = fragment_new_reassembled_tvb(tvb, fd_head);
+    ASSERT_EQ(100,tvb_length(next_tvb));
+    ASSERT_EQ(100,tvb_reported_length(next_tvb));
+    /* data within one fragment is not copied */
+    ASSERT(tvb_get_ptr(next_tvb, 0, 50) == fd_head->next->data);
+    ASSERT(tvb_get_ptr(next_tvb, 50, 25) == fd_head->next->next->data+5);
+    buf = tvb_memdup(next_tvb, 0, 100);
+    ASSERT(!memcmp(buf,data+10,100));
+    g_free(buf);
+    ASSERT_EQ(0x3f3e3d3c,tvb_get_letohl(next_tvb, 50));
+    ASSERT_EQ(73,tvb_find_guint8(next_tvb, 40, -1, 83));
+    /* a pointer spanning fragments flattens the tvbuff */
+    ASSERT(!memcmp(tvb_get_ptr(next_tvb, 45, 10),data+55,10));
+    ASSERT(!memcmp(tvb_get_ptr(next_tvb, 0, 100),data+10,100));
+
+    /* extend the datagram */
+    fragment_set_partial_reassembly(&pinfo, 12, fragment_table);
+    pinfo.fd->num = 4;
+    fd_head=fragment_add_composite(tvb, 110, &pinfo, 12, fragment_table,
+                                   100, 20, FALSE);
+    ASSERT_NE(NULL,fd_head);
+    ASSERT_EQ(120,fd_head->datalen);
+    ASSERT_EQ(4,fd_head->reassembled_in);
+    ASSERT_EQ(FD_DEFRAGMENTED|FD_DATALEN_SET|FD_COMPOSITE|FD_OVERLAP,fd_head->flags);
+    ASSERT_EQ(NULL,fd_head->data);
+
+    next_tvb = fragment_new_reassembled_tvb(tvb, fd_head);
+    ASSERT_EQ(120,tvb_length(next_tvb));
+    buf = tvb_memdup(next_tvb, 0, 120);
+    ASSERT(!memcmp(buf,data+10,120));
+    g_free(buf);
+
+    /* an overlap with different data is flagged */
+    pinfo.fd->num = 5;
+    fd_head=fragment_add_composite(tvb, 0, &pinfo, 12, fragment_table,
+                                   0, 10, TRUE);
+    ASSERT_NE(NULL,fd_head);
+    ASSERT_EQ(FD_DEFRAGMENTED|FD_DATALEN_SET|FD_COMPOSITE|FD_OVERLAP|FD_OVERLAPCONFLICT,fd_head->flags);
+    ASSERT_EQ(1,fd_head->next->frame);
+    ASSERT_EQ(5,fd_head->next->next->frame);
+    ASSERT_EQ(FD_OVERLAP|FD_OVERLAPCONFLICT,fd_head->next->next->flags);
+}
+
+/**********************************************************************************
+ *
+ * fragment_add out of order
+ *
+ *********************************************************************************/
+
+/* Adds 32 fragments of 8 bytes in a scrambled order, retransmitting every
+ * fourth one in the same frame, and checks that the datagram is complete
+ * only once the last gap is filled and that the fragment list is kept
+ * sorted.
+ */
+static void
+test_fragment_add_out_of_order(void)
+{
+    fragment_data *fd_head, *fd;
+    guint32 i, n, prev_offset;
+
+    printf("Starting test test_fragment_add_out_of_order\n");
+
+    for(i = 0; i < 32; i++) {
+        /* 13 is coprime to 32, so this visits every fragment once */
+        n = (i * 13 + 5) % 32;
+
+        pinfo.fd->num = i + 1;
+        fd_head=fragment_add(tvb, n*8, &pinfo, 12, fragment_table,
+                             n*8, 8, n != 31);
+        if(i < 31) {
+            ASSERT_EQ(NULL,fd_head);
+        }
+
+        if(n % 4 == 0 && i < 31) {
+            fd_head=fragment_add_multiple_ok(tvb, n*8, &pinfo, 12,
+                                             fragment_table, n*8, 8, TRUE);
+            ASSERT_EQ(NULL,fd_head);
+        }
+    }
+
+    ASSERT_NE(NULL,fd_head);
+    ASSERT_EQ(256,fd_head->datalen);
+    ASSERT_EQ(32,fd_head->reassembled_in);
+    /* exact duplicates don't count as overlaps */
+    ASSERT_EQ(FD_DEFRAGMENTED|FD_DATALEN_SET,fd_head->flags);
+    ASSERT(!memcmp(fd_head->data,data,256));
+
+    /* check the list is sorted */
+    n = 0;
+    prev_offset = 0;
+    for(fd = fd_head->next; fd; fd = fd->next) {
+        ASSERT(fd->offset >= prev_offset);
+        ASSERT_EQ(8,fd->len);
+        ASSERT_EQ(0,fd->flags);
+        ASSERT_EQ(NULL,fd->data);
+        prev_offset = fd->offset;
+        n++;
+    }
+    /* fragment 24 comes last and isn't retransmitted */
+    ASSERT_EQ(32+7,n);
+}
+
 /**********************************************************************************
  *
  * main
@@ -1028,7 +1189,9 @@ main(int argc _U_, char **argv _U_)
         test_simple_fragment_add_seq_next,
         test_missing_data_fragment_add_seq_next,
         test_missing_data_fragment_add_seq_next_2,
-        test_missing_data_fragment_add_seq_next_3
+        test_missing_data_fragment_add_seq_next_3,
+        test_fragment_add_composite,
+        test_fragment_add_out_of_order
     };
 
     /* initialise stuff */
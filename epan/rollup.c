@@ -0,0 +1,387 @@
+/* rollup.c
+ * Fixed-memory multi-resolution time-series rollups for statistics taps
+ *
+ * $Id$
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <string.h>
+#include <math.h>
+
+#include <glib.h>
+
+#include "rollup.h"
+
+typedef struct _rollup_level_t {
+	guint64 interval;
+	guint slots;
+	gboolean stream;
+	guint64 cur;		/* bucket number of the open bucket */
+	guint64 oldest;		/* bucket number of the oldest retained bucket */
+	rollup_agg_t *aggs;	/* slots * num_columns, bucket n at n % slots */
+	guint32 *sketches;
+} rollup_level_t;
+
+struct _rollup_t {
+	guint num_columns;
+	gboolean *sketch_cols;
+	guint num_sketch_cols;
+	GArray *levels;
+	gboolean started;
+	guint64 now;
+	rollup_row_cb row_cb;
+	void *row_data;
+	rollup_agg_t *empty;	/* num_columns empty buckets, for gaps */
+	guint64 dropped;
+};
+
+#define LEVEL(r, l)	(&g_array_index((r)->levels, rollup_level_t, (l)))
+#define SLOT(r, lv, n)	(&(lv)->aggs[((n) % (lv)->slots) * (r)->num_columns])
+
+rollup_t *
+rollup_new(guint num_columns)
+{
+	rollup_t *r = g_malloc0(sizeof(rollup_t));
+
+	r->num_columns = num_columns;
+	r->sketch_cols = g_malloc0(sizeof(gboolean) * num_columns);
+	r->levels = g_array_new(FALSE, TRUE, sizeof(rollup_level_t));
+	r->empty = g_malloc0(sizeof(rollup_agg_t) * num_columns);
+
+	return r;
+}
+
+void
+rollup_enable_sketch(rollup_t *r, guint column)
+{
+	g_assert(!r->started && column < r->num_columns);
+
+	if (!r->sketch_cols[column]) {
+		r->sketch_cols[column] = TRUE;
+		r->num_sketch_cols++;
+	}
+}
+
+guint
+rollup_add_level(rollup_t *r, guint64 interval, guint slots, gboolean stream)
+{
+	rollup_level_t lv;
+
+	g_assert(!r->started && interval > 0 && slots > 0);
+
+	memset(&lv, 0, sizeof(lv));
+	lv.interval = interval;
+	lv.slots = slots;
+	lv.stream = stream;
+	g_array_append_val(r->levels, lv);
+
+	return r->levels->len - 1;
+}
+
+void
+rollup_set_row_cb(rollup_t *r, rollup_row_cb cb, void *user_data)
+{
+	r->row_cb = cb;
+	r->row_data = user_data;
+}
+
+static void
+agg_reset(rollup_agg_t *a)
+{
+	/* most buckets of a fine level never see a value; leave them be */
+	if (a->frames == 0 && a->count == 0)
+		return;
+
+	a->frames = 0;
+	a->count = 0;
+	a->sum = 0;
+	a->min = 0;
+	a->max = 0;
+	if (a->sketch)
+		memset(a->sketch, 0, sizeof(guint32) * ROLLUP_SKETCH_BUCKETS);
+}
+
+/* all the buckets of a level live in one allocation, as do their
+ * sketches; nothing is allocated per bucket afterwards */
+static void
+level_alloc(rollup_t *r, rollup_level_t *lv)
+{
+	guint s, c;
+	guint32 *sk;
+
+	lv->aggs = g_malloc0(sizeof(rollup_agg_t) * lv->slots * r->num_columns);
+	if (r->num_sketch_cols == 0)
+		return;
+
+	lv->sketches = g_malloc0(sizeof(guint32) * ROLLUP_SKETCH_BUCKETS
+				 * lv->slots * r->num_sketch_cols);
+	sk = lv->sketches;
+	for (s = 0; s < lv->slots; s++) {
+		for (c = 0; c < r->num_columns; c++) {
+			if (r->sketch_cols[c]) {
+				lv->aggs[s * r->num_columns + c].sketch = sk;
+				sk += ROLLUP_SKETCH_BUCKETS;
+			}
+		}
+	}
+}
+
+static void
+rollup_start(rollup_t *r, guint64 t)
+{
+	guint l;
+	rollup_level_t *lv;
+
+	for (l = 0; l < r->levels->len; l++) {
+		lv = LEVEL(r, l);
+		level_alloc(r, lv);
+		lv->cur = t / lv->interval;
+		lv->oldest = lv->cur;
+	}
+	r->now = t;
+	r->started = TRUE;
+}
+
+static void
+slots_reset(rollup_t *r, rollup_agg_t *aggs)
+{
+	guint c;
+
+	for (c = 0; c < r->num_columns; c++)
+		agg_reset(&aggs[c]);
+}
+
+/* close every bucket of the level before bucket number n */
+static void
+level_advance(rollup_t *r, guint l, guint64 n)
+{
+	rollup_level_t *lv = LEVEL(r, l);
+	guint64 i;
+
+	if (n <= lv->cur)
+		return;
+
+	if (lv->stream && r->row_cb) {
+		r->row_cb(r, l, lv->cur * lv->interval, lv->interval,
+			  SLOT(r, lv, lv->cur), r->row_data);
+		for (i = lv->cur + 1; i < n; i++)
+			r->row_cb(r, l, i * lv->interval, lv->interval,
+				  r->empty, r->row_data);
+	}
+
+	/* the buckets between the old and the new one are empty; no more
+	 * than a full turn of the ring needs clearing */
+	i = (n - lv->cur > lv->slots) ? n - lv->slots + 1 : lv->cur + 1;
+	for (; i <= n; i++)
+		slots_reset(r, SLOT(r, lv, i));
+
+	lv->cur = n;
+	if (n - lv->oldest >= lv->slots)
+		lv->oldest = n - lv->slots + 1;
+}
+
+void
+rollup_advance(rollup_t *r, guint64 t)
+{
+	guint l;
+
+	if (!r->started) {
+		rollup_start(r, t);
+		return;
+	}
+	if (t <= r->now)
+		return;
+
+	for (l = 0; l < r->levels->len; l++)
+		level_advance(r, l, t / LEVEL(r, l)->interval);
+	r->now = t;
+}
+
+/* the bucket for time t on a level, or NULL if it has been closed */
+static rollup_agg_t *
+level_bucket(rollup_t *r, rollup_level_t *lv, guint column, guint64 t)
+{
+	guint64 n = t / lv->interval;
+
+	if (n < lv->oldest || (lv->stream && n < lv->cur))
+		return NULL;
+	return &SLOT(r, lv, n)[column];
+}
+
+void
+rollup_add_frame(rollup_t *r, guint column, guint64 t)
+{
+	guint l;
+	rollup_agg_t *a;
+
+	rollup_advance(r, t);
+	for (l = 0; l < r->levels->len; l++) {
+		a = level_bucket(r, LEVEL(r, l), column, t);
+		if (a)
+			a->frames++;
+	}
+}
+
+/* bucket 0 and 1 hold the values 0 and 1 (and anything negative), after
+ * that every power of two is split into a lower and an upper half */
+static guint
+sketch_bucket(gint64 val)
+{
+	guint64 v;
+	guint bits;
+
+	if (val < 2)
+		return val < 0 ? 0 : (guint)val;
+
+	v = (guint64)val;
+	for (bits = 2; bits < 64 && (v >> bits) != 0; bits++)
+		;
+	return 2 + (bits - 2) * 2 + (guint)((v >> (bits - 2)) & 1);
+}
+
+static void
+sketch_bounds(guint b, gint64 *lo, gint64 *hi)
+{
+	guint bits;
+
+	if (b < 2) {
+		*lo = *hi = b;
+		return;
+	}
+	bits = (b - 2) / 2 + 2;
+	*lo = (gint64)(((guint64)1 << (bits - 1)) | ((guint64)((b - 2) & 1) << (bits - 2)));
+	*hi = *lo + (gint64)(((guint64)1 << (bits - 2)) - 1);
+}
+
+static void
+agg_add(rollup_agg_t *a, gint64 val)
+{
+	if (a->count == 0 || val < a->min)
+		a->min = val;
+	if (a->count == 0 || val > a->max)
+		a->max = val;
+	a->count++;
+	a->sum += val;
+	if (a->sketch)
+		a->sketch[sketch_bucket(val)]++;
+}
+
+void
+rollup_add_value(rollup_t *r, guint column, guint64 t, gint64 val)
+{
+	guint l;
+	rollup_agg_t *a;
+
+	rollup_advance(r, t);
+	for (l = 0; l < r->levels->len; l++) {
+		a = level_bucket(r, LEVEL(r, l), column, t);
+		if (a)
+			agg_add(a, val);
+		else
+			r->dropped++;
+	}
+}
+
+void
+rollup_flush(rollup_t *r)
+{
+	guint l;
+
+	if (!r->started)
+		return;
+
+	for (l = 0; l < r->levels->len; l++) {
+		if (LEVEL(r, l)->stream)
+			level_advance(r, l, LEVEL(r, l)->cur + 1);
+	}
+}
+
+void
+rollup_foreach(rollup_t *r, guint level, rollup_row_cb cb, void *user_data)
+{
+	rollup_level_t *lv;
+	guint64 n;
+
+	if (!r->started || level >= r->levels->len)
+		return;
+
+	lv = LEVEL(r, level);
+	for (n = lv->oldest; n <= lv->cur; n++)
+		cb(r, level, n * lv->interval, lv->interval, SLOT(r, lv, n), user_data);
+}
+
+guint64
+rollup_dropped(const rollup_t *r)
+{
+	return r->dropped;
+}
+
+gint64
+rollup_agg_percentile(const rollup_agg_t *a, double pct)
+{
+	guint64 rank, seen;
+	gint64 lo, hi, est;
+	guint b;
+
+	if (!a->sketch || a->count == 0)
+		return 0;
+
+	rank = (guint64)ceil(pct / 100.0 * (double)a->count);
+	if (rank < 1)
+		rank = 1;
+	if (rank > a->count)
+		rank = a->count;
+
+	seen = 0;
+	for (b = 0; b < ROLLUP_SKETCH_BUCKETS; b++) {
+		if (a->sketch[b] == 0 || seen + a->sketch[b] < rank) {
+			seen += a->sketch[b];
+			continue;
+		}
+		/* interpolate within the bucket and never leave [min, max] */
+		sketch_bounds(b, &lo, &hi);
+		est = lo + (gint64)((double)(hi - lo) * (double)(rank - seen) / (double)a->sketch[b]);
+		if (est < a->min)
+			est = a->min;
+		if (est > a->max)
+			est = a->max;
+		return est;
+	}
+	return a->max;
+}
+
+void
+rollup_free(rollup_t *r)
+{
+	guint l;
+
+	for (l = 0; l < r->levels->len; l++) {
+		g_free(LEVEL(r, l)->aggs);
+		g_free(LEVEL(r, l)->sketches);
+	}
+	g_array_free(r->levels, TRUE);
+	g_free(r->sketch_cols);
+	g_free(r->empty);
+	g_free(r);
+}
@@ -0,0 +1,103 @@
+/* rollup.h
+ * Fixed-memory multi-resolution time-series rollups for statistics taps
+ *
+ * $Id$
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#ifndef __ROLLUP_H__
+#define __ROLLUP_H__
+
+#include <glib.h>
+
+/*
+ * A rollup keeps a number of columns of aggregates over time.  Every
+ * value is added to each of its levels; a level is a ring of equally
+ * wide buckets, so a level of "slots" buckets of width "interval" only
+ * remembers the most recent slots*interval time units and its memory
+ * use is fixed when it is created.  A typical setup is 1 ms buckets for
+ * the last minute, 1 s buckets for the last day and a streamed 1 min
+ * level for everything else.
+ *
+ * Buckets of a streamed level are handed to the row callback as soon
+ * as time moves past them, including empty buckets for gaps, and are
+ * then forgotten.  Buckets of the other levels can be walked at any
+ * time with rollup_foreach().
+ *
+ * Time is a monotonic unsigned count in whatever unit the caller
+ * picks (the io,rollup tap uses milliseconds).  Values added for a
+ * time already closed on a level are dropped on that level.
+ */
+
+/* number of buckets of the percentile sketch, two per power of two */
+#define ROLLUP_SKETCH_BUCKETS	128
+
+typedef struct _rollup_agg_t {
+	guint64 frames;		/* frames counted with rollup_add_frame() */
+	guint64 count;		/* values added with rollup_add_value() */
+	gint64 sum;
+	gint64 min;		/* only meaningful when count != 0 */
+	gint64 max;
+	guint32 *sketch;	/* log histogram, NULL unless enabled */
+} rollup_agg_t;
+
+typedef struct _rollup_t rollup_t;
+
+/* called for every closed bucket of a streamed level; aggs has one
+ * entry per column */
+typedef void (*rollup_row_cb)(rollup_t *r, guint level, guint64 start,
+			      guint64 interval, const rollup_agg_t *aggs,
+			      void *user_data);
+
+extern rollup_t *rollup_new(guint num_columns);
+
+/* keep a percentile sketch for a column; must be called before the
+ * first value is added */
+extern void rollup_enable_sketch(rollup_t *r, guint column);
+
+/* add a level of "slots" buckets "interval" wide and return its
+ * number; must be called before the first value is added */
+extern guint rollup_add_level(rollup_t *r, guint64 interval, guint slots,
+			      gboolean stream);
+
+extern void rollup_set_row_cb(rollup_t *r, rollup_row_cb cb, void *user_data);
+
+/* move the clock forward, closing buckets on every level */
+extern void rollup_advance(rollup_t *r, guint64 t);
+
+extern void rollup_add_frame(rollup_t *r, guint column, guint64 t);
+extern void rollup_add_value(rollup_t *r, guint column, guint64 t, gint64 val);
+
+/* close the open bucket of every streamed level; call once, at the end */
+extern void rollup_flush(rollup_t *r);
+
+/* walk the retained buckets of a level, oldest first */
+extern void rollup_foreach(rollup_t *r, guint level, rollup_row_cb cb,
+			   void *user_data);
+
+/* number of values dropped on some level because they arrived too late */
+extern guint64 rollup_dropped(const rollup_t *r);
+
+/* estimate the pct-th percentile (0..100) of a bucket from its sketch */
+extern gint64 rollup_agg_percentile(const rollup_agg_t *a, double pct);
+
+extern void rollup_free(rollup_t *r);
+
+#endif /* __ROLLUP_H__ */
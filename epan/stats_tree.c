@@ -228,6 +228,7 @@ stats_tree_reset(void *p)
     
 	st->start = -1.0;
 	st->elapsed = 0.0;
+	st->merged_elapsed = 0.0;
     
 	reset_stat_node(&st->root);
 	
@@ -324,14 +325,17 @@ stats_tree_new(stats_tree_cfg *cfg, tree_pres *pr, const char *filter)
 	
 	st->start = -1.0;
 	st->elapsed = 0.0;
+	st->merged_elapsed = 0.0;
 
 	st->root.counter = 0;
 	st->root.name = g_strdup(cfg->name);
+	st->root.id = 0;
 	st->root.st = st;
 	st->root.parent = NULL;
 	st->root.children = NULL;
 	st->root.next = NULL;
 	st->root.hash = NULL;
+	st->root.rng = NULL;
 	st->root.pr = NULL;
 	
 	g_ptr_array_add(st->parents,&st->root);
@@ -348,7 +352,7 @@ stats_tree_packet(void *p, packet_info *pinfo, epan_dissect_t *edt, const void *
 	
 	if (st->start < 0.0) st->start = now;
 	
-	st->elapsed = now - st->start;
+	st->elapsed = st->merged_elapsed + (now - st->start);
 	
 	if (st->cfg->packet)
 		return st->cfg->packet(st,pinfo,edt,pri);
@@ -758,3 +762,331 @@ stats_tree_tick_pivot(stats_tree *st, int pivot_id, const gchar *pivot_value)
 	return pivot_id;
 }
 
+
+/*
+ * Merging of stats_trees.
+ *
+ * Nodes are matched by name under the same parent; the counters of
+ * matched nodes are added up, and nodes only present in the source are
+ * created in the destination with the same kind (with or without a
+ * hash of children, parent node or not, range).  Counters set with
+ * MN_SET are added up too.  The elapsed times are added up, as partial
+ * results come from consecutive captures, and kept in merged_elapsed so
+ * that the time of packets read afterwards is added to them.
+ */
+
+/* finds or creates the child named name under parent, and adds counter to it */
+static stat_node*
+merge_child(stat_node *parent, const gchar *name, gint counter,
+	    gboolean with_hash, gboolean as_parent_node, const range_pair_t *rng)
+{
+	stat_node *node = NULL;
+
+	if (parent->hash) {
+		node = g_hash_table_lookup(parent->hash,name);
+	} else {
+		for (node = parent->children; node; node = node->next) {
+			if (strcmp(node->name,name) == 0)
+				break;
+		}
+	}
+
+	if (node == NULL) {
+		if (parent->id < 0) {
+			/* it had no children in this tree yet */
+			g_hash_table_insert(parent->st->names,parent->name,parent);
+			g_ptr_array_add(parent->st->parents,parent);
+			parent->id = parent->st->parents->len - 1;
+		}
+		node = new_stat_node(parent->st,name,parent->id,with_hash,as_parent_node);
+		if (rng) {
+			node->rng = g_memdup(rng,sizeof(range_pair_t));
+		}
+	}
+
+	node->counter += counter;
+
+	return node;
+}
+
+static void
+merge_stat_node(stat_node *dst, const stat_node *src)
+{
+	stat_node *child;
+	stat_node *node;
+
+	for (child = src->children; child; child = child->next) {
+		node = merge_child(dst, child->name, child->counter,
+				   child->hash != NULL,
+				   child->id >= 0 || child->children != NULL,
+				   child->rng);
+		merge_stat_node(node, child);
+	}
+}
+
+/* adds the counters of src to dst, both being instances of the same stats_tree */
+extern void
+stats_tree_merge(stats_tree *dst, const stats_tree *src)
+{
+	g_assert(dst->cfg == src->cfg);
+
+	dst->merged_elapsed += src->elapsed;
+	dst->elapsed += src->elapsed;
+	dst->root.counter += src->root.counter;
+
+	merge_stat_node(&dst->root, &src->root);
+}
+
+
+/*
+ * Serialised form of a stats_tree, all integers little-endian:
+ *
+ *   "STT\1"
+ *   guint16 length, abbr
+ *   guint16 length, filter ("" if none)
+ *   guint64 elapsed time in ms, IEEE 754 double
+ *   root node
+ *
+ * and each node:
+ *
+ *   guint8 flags (ST_SER_xxx)
+ *   gint32 counter
+ *   gint32 floor, gint32 ceil, if ST_SER_RANGE
+ *   guint16 length, name
+ *   guint32 number of children, followed by the children
+ */
+#define ST_SER_MAGIC "STT\1"
+#define ST_SER_MAGIC_LEN 4
+#define ST_SER_HASH	0x01
+#define ST_SER_PARENT	0x02
+#define ST_SER_RANGE	0x04
+#define ST_SER_MAX_DEPTH 256
+
+static void
+ser_put(GByteArray *buf, guint64 val, guint len)
+{
+	guint8 bytes[8];
+	guint i;
+
+	for (i = 0; i < len; i++) {
+		bytes[i] = (guint8)val;
+		val >>= 8;
+	}
+	g_byte_array_append(buf,bytes,len);
+}
+
+static void
+ser_put_str(GByteArray *buf, const gchar *str)
+{
+	gsize len = str ? strlen(str) : 0;
+
+	if (len > G_MAXUINT16)
+		len = G_MAXUINT16;
+	ser_put(buf,len,2);
+	g_byte_array_append(buf,(const guint8 *)str,(guint)len);
+}
+
+static void
+serialize_stat_node(GByteArray *buf, const stat_node *node)
+{
+	const stat_node *child;
+	guint8 flags = 0;
+	guint32 n = 0;
+
+	if (node->hash) flags |= ST_SER_HASH;
+	if (node->id >= 0 || node->children) flags |= ST_SER_PARENT;
+	if (node->rng) flags |= ST_SER_RANGE;
+
+	ser_put(buf,flags,1);
+	ser_put(buf,(guint32)node->counter,4);
+	if (node->rng) {
+		ser_put(buf,(guint32)node->rng->floor,4);
+		ser_put(buf,(guint32)node->rng->ceil,4);
+	}
+	ser_put_str(buf,node->name);
+
+	for (child = node->children; child; child = child->next)
+		n++;
+	ser_put(buf,n,4);
+	for (child = node->children; child; child = child->next)
+		serialize_stat_node(buf,child);
+}
+
+/* appends the serialised form of st to buf */
+extern void
+stats_tree_serialize(const stats_tree *st, GByteArray *buf)
+{
+	guint64 elapsed;
+
+	g_byte_array_append(buf,(const guint8 *)ST_SER_MAGIC,ST_SER_MAGIC_LEN);
+	ser_put_str(buf,st->cfg->abbr);
+	ser_put_str(buf,st->filter ? st->filter : "");
+	memcpy(&elapsed,&st->elapsed,sizeof elapsed);
+	ser_put(buf,elapsed,8);
+	serialize_stat_node(buf,&st->root);
+}
+
+typedef struct {
+	const guint8 *p;
+	const guint8 *end;
+} ser_reader_t;
+
+static gboolean
+ser_get(ser_reader_t *r, guint64 *val, guint len)
+{
+	guint i;
+
+	if ((gsize)(r->end - r->p) < len)
+		return FALSE;
+	*val = 0;
+	for (i = len; i > 0; i--)
+		*val = (*val << 8) | r->p[i-1];
+	r->p += len;
+	return TRUE;
+}
+
+/* returns a newly allocated copy of the next string */
+static gchar*
+ser_get_str(ser_reader_t *r)
+{
+	guint64 len;
+	gchar *str;
+
+	if (!ser_get(r,&len,2) || (guint64)(r->end - r->p) < len)
+		return NULL;
+	str = g_strndup((const gchar *)r->p,(gsize)len);
+	r->p += len;
+	return str;
+}
+
+/* reads a node and its children, merging them as children of dst
+ * (or of the root itself if is_root), or only checking them if dst is NULL */
+static gboolean
+merge_serialized_node(ser_reader_t *r, stat_node *dst, gboolean is_root, guint depth)
+{
+	guint64 flags, counter, floor = 0, ceil = 0, n;
+	range_pair_t rng;
+	stat_node *node = NULL;
+	gchar *name;
+
+	if (depth > ST_SER_MAX_DEPTH)
+		return FALSE;
+	if (!ser_get(r,&flags,1) || !ser_get(r,&counter,4))
+		return FALSE;
+	if (flags & ST_SER_RANGE) {
+		if (!ser_get(r,&floor,4) || !ser_get(r,&ceil,4))
+			return FALSE;
+	}
+	if ((name = ser_get_str(r)) == NULL)
+		return FALSE;
+
+	if (dst) {
+		if (is_root) {
+			node = dst;
+			node->counter += (gint)(guint32)counter;
+		} else {
+			rng.floor = (gint)(guint32)floor;
+			rng.ceil = (gint)(guint32)ceil;
+			node = merge_child(dst, name, (gint)(guint32)counter,
+					   (flags & ST_SER_HASH) != 0,
+					   (flags & ST_SER_PARENT) != 0,
+					   (flags & ST_SER_RANGE) ? &rng : NULL);
+		}
+	}
+	g_free(name);
+
+	if (!ser_get(r,&n,4))
+		return FALSE;
+	while (n-- > 0) {
+		if (!merge_serialized_node(r,node,FALSE,depth+1))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/* reads the header of a serialised stats_tree; abbr and filter are
+ * newly allocated, filter is NULL if there is none */
+static const gchar*
+read_serialized_header(ser_reader_t *r, gchar **abbr, gchar **filter, double *elapsed)
+{
+	guint64 bits;
+
+	*abbr = NULL;
+	*filter = NULL;
+
+	if ((gsize)(r->end - r->p) < ST_SER_MAGIC_LEN ||
+	    memcmp(r->p,ST_SER_MAGIC,ST_SER_MAGIC_LEN) != 0)
+		return "not a serialised stats_tree";
+	r->p += ST_SER_MAGIC_LEN;
+
+	if ((*abbr = ser_get_str(r)) == NULL ||
+	    (*filter = ser_get_str(r)) == NULL ||
+	    !ser_get(r,&bits,8)) {
+		g_free(*abbr);
+		g_free(*filter);
+		*abbr = *filter = NULL;
+		return "truncated stats_tree";
+	}
+	memcpy(elapsed,&bits,sizeof *elapsed);
+
+	if (**filter == '\0') {
+		g_free(*filter);
+		*filter = NULL;
+	}
+	return NULL;
+}
+
+/* returns the abbr and filter of a serialised stats_tree (newly allocated,
+ * filter is NULL if there is none), or an error message */
+extern const gchar*
+stats_tree_serialized_info(const guint8 *data, gsize len, gchar **abbr, gchar **filter)
+{
+	ser_reader_t r;
+	double elapsed;
+
+	r.p = data;
+	r.end = data + len;
+	return read_serialized_header(&r,abbr,filter,&elapsed);
+}
+
+/* adds the counters of a serialised stats_tree to st;
+ * returns NULL, or an error message if it was not merged at all */
+extern const gchar*
+stats_tree_merge_serialized(stats_tree *st, const guint8 *data, gsize len)
+{
+	ser_reader_t r;
+	const gchar *err;
+	gchar *abbr, *filter;
+	double elapsed;
+	gboolean same;
+	const guint8 *nodes;
+
+	r.p = data;
+	r.end = data + len;
+	if ((err = read_serialized_header(&r,&abbr,&filter,&elapsed)) != NULL)
+		return err;
+
+	same = strcmp(abbr,st->cfg->abbr) == 0;
+	g_free(abbr);
+	if (!same) {
+		g_free(filter);
+		return "stats_tree of another statistic";
+	}
+	same = (filter == NULL && st->filter == NULL) ||
+	    (filter != NULL && st->filter != NULL && strcmp(filter,st->filter) == 0);
+	g_free(filter);
+	if (!same)
+		return "stats_tree with another filter";
+
+	/* check it all before touching the tree */
+	nodes = r.p;
+	if (!merge_serialized_node(&r,NULL,TRUE,0) || r.p != r.end)
+		return "corrupt stats_tree";
+
+	r.p = nodes;
+	merge_serialized_node(&r,&st->root,TRUE,0);
+	st->merged_elapsed += elapsed;
+	st->elapsed += elapsed;
+
+	return NULL;
+}
@@ -86,6 +86,8 @@ struct _stats_tree {
 	/* times */
 	double			start;
 	double			elapsed;
+	/* the part of elapsed that comes from merged trees */
+	double			merged_elapsed;
 
    /* used to lookup named parents:
 	*    key: parent node name
@@ -203,4 +205,23 @@ extern guint stats_tree_branch_max_namelen(const stat_node *node, guint indent);
 extern gchar *stats_tree_node_to_str(const stat_node *node,
 				     gchar *buffer, guint len);
 
+/* adds the counters of src to dst, creating the nodes dst lacks;
+   both must be instances of the same stats_tree_cfg */
+extern void stats_tree_merge(stats_tree *dst, const stats_tree *src);
+
+/* appends a compact serialised form of st to buf */
+extern void stats_tree_serialize(const stats_tree *st, GByteArray *buf);
+
+/* obtains the abbr and filter of a serialised stats_tree as newly
+   allocated strings (filter is NULL if there is none),
+   returns an error message if data is not a serialised stats_tree */
+extern const gchar *stats_tree_serialized_info(const guint8 *data, gsize len,
+					       gchar **abbr, gchar **filter);
+
+/* like stats_tree_merge() for a serialised stats_tree, which must have
+   the same abbr and filter as st; returns an error message, in which
+   case st is left untouched */
+extern const gchar *stats_tree_merge_serialized(stats_tree *st,
+						const guint8 *data, gsize len);
+
 #endif /* __STATS_TREE_PRIV_H */
@@ -55,6 +55,8 @@ static tap_dissector_t *tap_dissector_list=NULL;
  * in order to be as fast as possible as we need to build and tear down the
  * queued list at least once for each packet we see, thus we must be able
  * to build and tear it down as fast as possible.
+ * The array only ever grows, so after the first few packets queueing
+ * a tapped packet never allocates.
  */
 typedef struct _tap_packet_t {
 	int tap_id;
@@ -62,16 +64,33 @@ typedef struct _tap_packet_t {
 	const void *tap_specific_data;
 } tap_packet_t;
 
-#define TAP_PACKET_QUEUE_LEN 100
-static tap_packet_t tap_packet_array[TAP_PACKET_QUEUE_LEN];
+#define TAP_PACKET_QUEUE_INITIAL_LEN 100
+static tap_packet_t *tap_packet_array=NULL;
+static guint tap_packet_array_len=0;
 static guint tap_packet_index;
 
+/*
+ * Listeners with the same filter string share one compiled filter, and
+ * the filter is only applied once per packet; the result is kept until
+ * tap_queue_init() starts the next packet.
+ */
+typedef struct _tap_filter_t {
+	struct _tap_filter_t *next;
+	char *fstring;
+	dfilter_t *code;
+	guint refcount;
+	guint passed_generation;	/* tap_generation "passed" is valid for */
+	gboolean passed;
+} tap_filter_t;
+static tap_filter_t *tap_filter_list=NULL;
+static guint tap_generation=1;
+
 typedef struct _tap_listener_t {
 	struct _tap_listener_t *next;
 	int tap_id;
 	gboolean needs_redraw;
 	guint flags;
-	dfilter_t *code;
+	tap_filter_t *filter;
 	void *tapdata;
 	tap_reset_cb reset;
 	tap_packet_cb packet;
@@ -79,6 +98,19 @@ typedef struct _tap_listener_t {
 } tap_listener_t;
 static volatile tap_listener_t *tap_listener_queue=NULL;
 
+/* The listeners of each tap, by tap_id: the listeners of tap "id" are
+   listeners[first[id]] up to a NULL, in the order of tap_listener_queue.
+   A changed index is built aside and then swapped in, so that whoever
+   is walking the index never sees it half rebuilt; the index it replaced
+   is only freed at the next change. */
+typedef struct _tap_listener_index_t {
+	int len;			/* tap ids below len */
+	guint *first;
+	tap_listener_t **listeners;
+} tap_listener_index_t;
+static tap_listener_index_t * volatile tap_listener_index=NULL;
+static tap_listener_index_t *tap_listener_index_old=NULL;
+
 /* **********************************************************************
  * Init routine only called from epan at application startup
  * ********************************************************************** */
@@ -93,6 +125,128 @@ tap_init(void)
 	return;
 }
 
+static void
+free_tap_listener_index(tap_listener_index_t *idx)
+{
+	if(idx){
+		g_free(idx->first);
+		g_free(idx->listeners);
+		g_free(idx);
+	}
+}
+
+/* Rebuild tap_listener_index after tap_listener_queue has changed. */
+static void
+rebuild_tap_listener_index(void)
+{
+	tap_listener_index_t *idx;
+	tap_listener_t *tl;
+	int max_id=0;
+	guint count=0;
+	guint n;
+	int i;
+
+	for(tl=(tap_listener_t *)tap_listener_queue;tl;tl=tl->next){
+		if(tl->tap_id>max_id){
+			max_id=tl->tap_id;
+		}
+		count++;
+	}
+
+	idx=g_malloc(sizeof(tap_listener_index_t));
+	idx->len=max_id+1;
+	idx->first=g_malloc(idx->len*sizeof(guint));
+	idx->listeners=g_malloc((count+idx->len)*sizeof(tap_listener_t *));
+
+	/* Keep the order of tap_listener_queue; walking the queue once
+	   per tap id is fine, listeners change rarely. */
+	n=0;
+	for(i=0;i<idx->len;i++){
+		idx->first[i]=n;
+		for(tl=(tap_listener_t *)tap_listener_queue;tl;tl=tl->next){
+			if(tl->tap_id==i){
+				idx->listeners[n++]=tl;
+			}
+		}
+		idx->listeners[n++]=NULL;
+	}
+
+	free_tap_listener_index(tap_listener_index_old);
+	tap_listener_index_old=tap_listener_index;
+	tap_listener_index=idx;
+}
+
+/* Return the shared compiled filter for fstring, compiling it if no
+   other listener uses it yet.  Returns FALSE if it does not compile. */
+static gboolean
+tap_filter_get(const char *fstring, tap_filter_t **filterp)
+{
+	tap_filter_t *tf;
+	dfilter_t *code;
+
+	for(tf=tap_filter_list;tf;tf=tf->next){
+		if(!strcmp(tf->fstring, fstring)){
+			tf->refcount++;
+			*filterp=tf;
+			return TRUE;
+		}
+	}
+
+	if(!dfilter_compile(fstring, &code)){
+		return FALSE;
+	}
+	if(!code){
+		/* Empty filter string, matches everything */
+		*filterp=NULL;
+		return TRUE;
+	}
+
+	tf=g_malloc(sizeof(tap_filter_t));
+	tf->fstring=g_strdup(fstring);
+	tf->code=code;
+	tf->refcount=1;
+	tf->passed_generation=0;
+	tf->passed=FALSE;
+	tf->next=tap_filter_list;
+	tap_filter_list=tf;
+
+	*filterp=tf;
+	return TRUE;
+}
+
+static void
+tap_filter_release(tap_filter_t *filter)
+{
+	tap_filter_t **tfp;
+
+	if(!filter || --filter->refcount){
+		return;
+	}
+	for(tfp=&tap_filter_list;*tfp;tfp=&(*tfp)->next){
+		if(*tfp==filter){
+			*tfp=filter->next;
+			break;
+		}
+	}
+	dfilter_free(filter->code);
+	g_free(filter->fstring);
+	g_free(filter);
+}
+
+/* Apply a shared filter to the current packet, at most once */
+static gboolean
+tap_filter_passed(tap_filter_t *filter, epan_dissect_t *edt)
+{
+	if(!filter){
+		return TRUE;
+	}
+	if(filter->passed_generation!=tap_generation){
+		filter->passed=dfilter_apply_edt(filter->code, edt);
+		filter->passed_generation=tap_generation;
+	}
+	return filter->passed;
+}
+
 /* **********************************************************************
  * Functions called from dissector when made tappable
  * ********************************************************************** */
@@ -169,13 +323,11 @@ tap_queue_packet(int tap_id, packet_info *pinfo, const void *tap_specific_data)
 	if(!tapping_is_active){
 		return;
 	}
-	/*
-	 * XXX - should we allocate this with an ep_allocator,
-	 * rather than having a fixed maximum number of entries?
-	 */
-	if(tap_packet_index >= TAP_PACKET_QUEUE_LEN){
-		g_warning("Too many taps queued");
-		return;
+	if(tap_packet_index >= tap_packet_array_len){
+		tap_packet_array_len = tap_packet_array_len ?
+		    2*tap_packet_array_len : TAP_PACKET_QUEUE_INITIAL_LEN;
+		tap_packet_array=g_realloc(tap_packet_array,
+		    tap_packet_array_len*sizeof(tap_packet_t));
 	}
 
 	tpt=&tap_packet_array[tap_packet_index];
@@ -195,19 +347,17 @@ tap_queue_packet(int tap_id, packet_info *pinfo, const void *tap_specific_data)
 
 void tap_build_interesting (epan_dissect_t *edt)
 {
-	tap_listener_t *tl;
+	tap_filter_t *tf;
 
 	/* nothing to do, just return */
 	if(!tap_listener_queue){
 		return;
 	}
 
-	/* loop over all tap listeners and build the list of all
+	/* loop over all tap listener filters and build the list of all
 	   interesting hf_fields */
-	for(tl=(tap_listener_t *)tap_listener_queue;tl;tl=tl->next){
-		if(tl->code){
-			epan_dissect_prime_dfilter(edt, tl->code);
-		}
+	for(tf=tap_filter_list;tf;tf=tf->next){
+		epan_dissect_prime_dfilter(edt, tf->code);
 	}
 }
 
@@ -227,6 +377,11 @@ tap_queue_init(epan_dissect_t *edt)
 
 	tap_packet_index=0;
 
+	/* forget the filter results of the previous packet */
+	if(++tap_generation==0){
+		tap_generation=1;
+	}
+
 	tap_build_interesting (edt);
 }
 
@@ -237,7 +392,9 @@ void
 tap_push_tapped_queue(epan_dissect_t *edt)
 {
 	tap_packet_t *tp;
+	tap_listener_index_t *idx;
 	tap_listener_t *tl;
+	tap_listener_t **tlp;
 	guint i;
 
 	/* nothing to do, just return */
@@ -252,19 +409,17 @@ tap_push_tapped_queue(epan_dissect_t *edt)
 		return;
 	}
 
-	/* loop over all tap listeners and call the listener callback
-	   for all packets that match the filter. */
+	/* loop over all tapped packets and call the callback of each
+	   listener on that tap for the packets that match its filter. */
+	idx=tap_listener_index;
 	for(i=0;i<tap_packet_index;i++){
-		for(tl=(tap_listener_t *)tap_listener_queue;tl;tl=tl->next){
-			tp=&tap_packet_array[i];
-			if(tp->tap_id==tl->tap_id){
-				gboolean passed=TRUE;
-				if(tl->code){
-					passed=dfilter_apply_edt(tl->code, edt);
-				}
-				if(passed && tl->packet){
-					tl->needs_redraw|=tl->packet(tl->tapdata, tp->pinfo, edt, tp->tap_specific_data);
-				}
+		tp=&tap_packet_array[i];
+		if(!idx || tp->tap_id<0 || tp->tap_id>=idx->len){
+			continue;
+		}
+		for(tlp=&idx->listeners[idx->first[tp->tap_id]];(tl=*tlp)!=NULL;tlp++){
+			if(tl->packet && tap_filter_passed(tl->filter, edt)){
+				tl->needs_redraw|=tl->packet(tl->tapdata, tp->pinfo, edt, tp->tap_specific_data);
 			}
 		}
 	}
@@ -402,11 +557,11 @@ register_tap_listener(const char *tapname, void *tapdata, const char *fstring,
 	}
 
 	tl=g_malloc(sizeof(tap_listener_t));
-	tl->code=NULL;
+	tl->filter=NULL;
 	tl->needs_redraw=TRUE;
 	tl->flags=flags;
 	if(fstring){
-		if(!dfilter_compile(fstring, &tl->code)){
+		if(!tap_filter_get(fstring, &tl->filter)){
 			error_string = g_string_new("");
 			g_string_printf(error_string,
 			    "Filter \"%s\" is invalid - %s",
@@ -424,6 +579,7 @@ register_tap_listener(const char *tapname, void *tapdata, const char *fstring,
 	tl->next=(tap_listener_t *)tap_listener_queue;
 
 	tap_listener_queue=tl;
+	rebuild_tap_listener_index();
 
 	return NULL;
 }
@@ -453,13 +609,11 @@ set_tap_dfilter(void *tapdata, const char *fstring)
 	}
 
 	if(tl){
-		if(tl->code){
-			dfilter_free(tl->code);
-			tl->code=NULL;
-		}
+		tap_filter_release(tl->filter);
+		tl->filter=NULL;
 		tl->needs_redraw=TRUE;
 		if(fstring){
-			if(!dfilter_compile(fstring, &tl->code)){
+			if(!tap_filter_get(fstring, &tl->filter)){
 				error_string = g_string_new("");
 				g_string_printf(error_string,
 						 "Filter \"%s\" is invalid - %s",
@@ -498,10 +652,9 @@ remove_tap_listener(void *tapdata)
 	}
 
 	if(tl){
-		if(tl->code){
-			dfilter_free(tl->code);
-		}
+		tap_filter_release(tl->filter);
 		g_free(tl);
+		rebuild_tap_listener_index();
 	}
 
 	return;
@@ -520,16 +673,12 @@ have_tap_listeners(void)
 gboolean
 have_tap_listener(int tap_id)
 {
-	volatile tap_listener_t *tap_queue = tap_listener_queue;
+	tap_listener_index_t *idx=tap_listener_index;
 
-	while(tap_queue) {
-		if(tap_queue->tap_id == tap_id)
-			return TRUE;
-
-		tap_queue = tap_queue->next;
-	}
+	if(!idx || tap_id <= 0 || tap_id >= idx->len)
+		return FALSE;
 
-	return FALSE;
+	return idx->listeners[idx->first[tap_id]] != NULL;
 }
 
 /*
@@ -538,13 +687,7 @@ have_tap_listener(int tap_id)
 gboolean
 have_filtering_tap_listeners(void)
 {
-	tap_listener_t *tl;
-
-	for(tl=(tap_listener_t *)tap_listener_queue;tl;tl=tl->next){
-		if(tl->code)
-			return TRUE;
-	}
-	return FALSE;
+	return tap_filter_list != NULL;
 }
 
 /*
@@ -0,0 +1,243 @@
+/* time_fmt.c
+ * Routines for formatting time stamps quickly
+ *
+ * $Id$
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <string.h>
+#include <time.h>
+
+#include <glib.h>
+
+#include "time_fmt.h"
+
+/*
+ * Packets come in time order, so most of them fall into the same minute
+ * as the one before.  Within a minute only the seconds change, so the
+ * broken-down time of one second of it is kept and the others are
+ * worked out from it.
+ *
+ * That relies on the UTC offset being a whole number of minutes, so
+ * that time zone changes, which happen on whole minutes of UTC, fall
+ * between cached minutes.  Some old offsets have seconds in them (Moscow
+ * was 4:31:19 ahead of UTC until 1919); a minute in those is only cached
+ * for the second that was looked up.  A leap second isn't cached.
+ */
+typedef struct {
+	gboolean	valid;
+	time_t		first;		/* first second of the cached span */
+	time_t		last;		/* and the last one */
+	struct tm	tm;		/* broken-down time of first */
+	struct tm	result;
+} tm_cache_t;
+
+static tm_cache_t local_cache;
+static tm_cache_t utc_cache;
+
+static const struct tm *
+tm_cache_lookup(tm_cache_t *c, time_t t, gboolean local)
+{
+	struct tm *tmp;
+
+	if (!c->valid || t < c->first || t > c->last) {
+		tmp = local ? localtime(&t) : gmtime(&t);
+		if (tmp == NULL) {
+			c->valid = FALSE;
+			return NULL;
+		}
+		if (tmp->tm_sec > 59) {
+			c->valid = FALSE;
+			c->result = *tmp;
+			return &c->result;
+		}
+		c->tm = *tmp;
+		if ((t - tmp->tm_sec) % 60 == 0) {
+			/* the minute starts on a minute of UTC */
+			c->first = t - tmp->tm_sec;
+			c->last = c->first + 59;
+			c->tm.tm_sec = 0;
+		} else {
+			c->first = c->last = t;
+		}
+		c->valid = TRUE;
+	}
+	c->result = c->tm;
+	c->result.tm_sec += (int)(t - c->first);
+	return &c->result;
+}
+
+const struct tm *
+time_fmt_localtime(time_t t)
+{
+	return tm_cache_lookup(&local_cache, t, TRUE);
+}
+
+const struct tm *
+time_fmt_gmtime(time_t t)
+{
+	return tm_cache_lookup(&utc_cache, t, FALSE);
+}
+
+static const gint32 frac_pow10[10] = {
+	1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000,
+	1000000000
+};
+
+guint
+time_fmt_res_digits(to_str_time_res_t res)
+{
+	switch (res) {
+
+	case TO_STR_TIME_RES_T_SECS:
+		return 0;
+	case TO_STR_TIME_RES_T_DSECS:
+		return 1;
+	case TO_STR_TIME_RES_T_CSECS:
+		return 2;
+	case TO_STR_TIME_RES_T_MSECS:
+		return 3;
+	case TO_STR_TIME_RES_T_USECS:
+		return 6;
+	case TO_STR_TIME_RES_T_NSECS:
+		return 9;
+	}
+	g_assert_not_reached();
+	return 0;
+}
+
+gint32
+time_fmt_scale_nsecs(gint32 nsecs, guint digits)
+{
+	return nsecs / frac_pow10[9 - digits];
+}
+
+/* "00" to "99", so that digits go out two at a time */
+static const char digit_pairs[201] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+gchar *
+time_fmt_uint(gchar *p, guint64 v, guint width)
+{
+	gchar tmp[24];
+	gchar *q = tmp + sizeof tmp;
+	guint n;
+
+	while (v >= 100) {
+		q -= 2;
+		memcpy(q, &digit_pairs[(v % 100) * 2], 2);
+		v /= 100;
+	}
+	if (v >= 10) {
+		q -= 2;
+		memcpy(q, &digit_pairs[v * 2], 2);
+	} else {
+		*--q = (gchar)('0' + v);
+	}
+
+	n = (guint)(tmp + sizeof tmp - q);
+	for (; n < width; n++)
+		*p++ = '0';
+	n = (guint)(tmp + sizeof tmp - q);
+	memcpy(p, q, n);
+	return p + n;
+}
+
+gchar *
+time_fmt_int(gchar *p, gint64 v)
+{
+	if (v < 0) {
+		*p++ = '-';
+		return time_fmt_uint(p, (guint64)0 - (guint64)v, 0);
+	}
+	return time_fmt_uint(p, (guint64)v, 0);
+}
+
+gchar *
+time_fmt_frac(gchar *p, gint32 frac, guint digits)
+{
+	if (digits == 0)
+		return p;
+
+	*p++ = '.';
+	if (frac < 0 || frac >= frac_pow10[digits]) {
+		/* not a proper fraction; show it as printf() would */
+		return p + g_snprintf(p, 16, "%0*d", digits, frac);
+	}
+	return time_fmt_uint(p, (guint64)frac, digits);
+}
+
+/* two digits for the fields of a struct tm, which are always 0 to 99
+ * except for the year */
+#define PUT_2DIGITS(p, v) \
+	(memcpy((p), &digit_pairs[(v) * 2], 2), (p) + 2)
+
+gchar *
+time_fmt_ymd(gchar *p, const struct tm *tm)
+{
+	gint year = tm->tm_year + 1900;
+
+	if (year < 0) {
+		/* "%04d" */
+		*p++ = '-';
+		p = time_fmt_uint(p, (guint64)(-(gint64)year), 3);
+	} else {
+		p = time_fmt_uint(p, (guint64)year, 4);
+	}
+	*p++ = '-';
+	p = PUT_2DIGITS(p, tm->tm_mon + 1);
+	*p++ = '-';
+	return PUT_2DIGITS(p, tm->tm_mday);
+}
+
+gchar *
+time_fmt_hms(gchar *p, const struct tm *tm)
+{
+	p = PUT_2DIGITS(p, tm->tm_hour);
+	*p++ = ':';
+	p = PUT_2DIGITS(p, tm->tm_min);
+	*p++ = ':';
+	return PUT_2DIGITS(p, tm->tm_sec);
+}
+
+gchar *
+time_fmt_signed(gchar *p, gint64 sec, gint32 frac, guint digits)
+{
+	if (frac < 0) {
+		frac = -frac;
+		if (sec >= 0)
+			*p++ = '-';
+	}
+	p = time_fmt_int(p, sec);
+	return time_fmt_frac(p, frac, digits);
+}
@@ -25,6 +25,10 @@
 #ifndef __TIME_FMT_H__
 #define __TIME_FMT_H__
 
+#include <time.h>
+
+#include <glib.h>
+
 /*
  * Resolution of a time stamp.
  */
@@ -47,4 +51,41 @@ typedef enum {
 	ABSOLUTE_TIME_DOY_UTC	/* UTC, with 1-origin day-of-year */
 } absolute_time_display_e;
 
+/*
+ * Pieces for formatting a time stamp for every packet without going
+ * through localtime() and printf() each time.  The writers put their text
+ * at p and return the position after it, without a terminating '\0';
+ * TIME_FMT_MAX_LEN bytes hold any date and time they can make up.
+ */
+#define TIME_FMT_MAX_LEN	64
+
+/* Like localtime() and gmtime(), but answered from a copy of the last
+ * minute looked up whenever possible (see time_fmt.c for when it isn't);
+ * the result is overwritten by the next call, and is NULL if the time
+ * can't be represented. */
+extern const struct tm *time_fmt_localtime(time_t t);
+extern const struct tm *time_fmt_gmtime(time_t t);
+
+/* Number of digits after the decimal point for a resolution */
+extern guint time_fmt_res_digits(to_str_time_res_t res);
+
+/* nsecs cut (not rounded) to digits digits after the decimal point */
+extern gint32 time_fmt_scale_nsecs(gint32 nsecs, guint digits);
+
+/* v in decimal, with leading zeroes up to width digits */
+extern gchar *time_fmt_uint(gchar *p, guint64 v, guint width);
+extern gchar *time_fmt_int(gchar *p, gint64 v);
+
+/* "." and frac as digits digits, or nothing if digits is 0; frac is
+ * already scaled, e.g. with time_fmt_scale_nsecs() */
+extern gchar *time_fmt_frac(gchar *p, gint32 frac, guint digits);
+
+/* YYYY-MM-DD and HH:MM:SS */
+extern gchar *time_fmt_ymd(gchar *p, const struct tm *tm);
+extern gchar *time_fmt_hms(gchar *p, const struct tm *tm);
+
+/* sec and frac as display_signed_time() shows them: a negative fraction
+ * is shown without its sign, and a "-" goes in front unless sec has one */
+extern gchar *time_fmt_signed(gchar *p, gint64 sec, gint32 frac, guint digits);
+
 #endif /* __TIME_FMT_H__  */
@@ -0,0 +1,617 @@
+/* Standalone program to check and time the time stamp formatting done
+ * with time_fmt.c
+ *
+ * For each time stamp type and precision, a stream of packet times is
+ * put in a time column by the column code and by a copy of the
+ * localtime() and printf() code it replaced; the text has to be the
+ * same, and the time each of them took is printed.  abs_time_to_str()
+ * is compared with its old code the same way.
+ *
+ * time_fmt_localtime() is also checked against localtime(), second by
+ * second, around some time zone changes, including ones from and to
+ * UTC offsets that aren't a whole number of minutes.  Without the time
+ * zone database those zones are all UTC and the check is a weak one.
+ *
+ * Usage: time_fmt_test [packets]
+ *
+ * $Id$
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <glib.h>
+
+#include <epan/emem.h>
+#include <epan/packet_info.h>
+#include <epan/column_info.h>
+#include <epan/column-utils.h>
+#include <epan/timestamp.h>
+#include <epan/time_fmt.h>
+#include <epan/to_str.h>
+#include <epan/addr_resolv.h>
+#include <epan/epan.h>
+#include <epan/proto.h>
+
+#define DEFAULT_PACKETS 200000
+
+static int failure = 0;
+
+static void
+check_text(const char *what, const nstime_t *ts, const gchar *expected,
+           const gchar *actual)
+{
+    if (strcmp(expected, actual) == 0)
+        return;
+
+    fprintf(stderr, "%s of %ld.%09d: expected \"%s\", got \"%s\"\n",
+            what, (long)ts->secs, ts->nsecs, expected, actual);
+    failure = 1;
+    exit(1);
+}
+
+static const gint32 frac_pow10[10] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000,
+    1000000000
+};
+
+/*
+ * The code time_fmt.c replaced, with the six cases for the precisions
+ * of each format folded into a "%0*" conversion.
+ */
+static void
+old_abs_time(const frame_data *fd, gchar *buf, guint digits,
+             gboolean with_date)
+{
+    struct tm *tmp;
+    time_t then;
+
+    then = fd->abs_ts.secs;
+    tmp = localtime(&then);
+    if (tmp == NULL)
+        buf[0] = '\0';
+    else if (with_date && digits == 0)
+        g_snprintf(buf, COL_MAX_LEN,"%04d-%02d-%02d %02d:%02d:%02d",
+                   tmp->tm_year + 1900, tmp->tm_mon + 1, tmp->tm_mday,
+                   tmp->tm_hour, tmp->tm_min, tmp->tm_sec);
+    else if (with_date)
+        g_snprintf(buf, COL_MAX_LEN,"%04d-%02d-%02d %02d:%02d:%02d.%0*ld",
+                   tmp->tm_year + 1900, tmp->tm_mon + 1, tmp->tm_mday,
+                   tmp->tm_hour, tmp->tm_min, tmp->tm_sec,
+                   digits, (long)fd->abs_ts.nsecs / frac_pow10[9 - digits]);
+    else if (digits == 0)
+        g_snprintf(buf, COL_MAX_LEN,"%02d:%02d:%02d",
+                   tmp->tm_hour, tmp->tm_min, tmp->tm_sec);
+    else
+        g_snprintf(buf, COL_MAX_LEN,"%02d:%02d:%02d.%0*ld",
+                   tmp->tm_hour, tmp->tm_min, tmp->tm_sec,
+                   digits, (long)fd->abs_ts.nsecs / frac_pow10[9 - digits]);
+}
+
+/* display_signed_time() */
+static void
+old_signed_time(gchar *buf, int buflen, const gint32 sec, gint32 frac,
+                guint digits)
+{
+    if (frac < 0) {
+        frac = -frac;
+        if (sec >= 0) {
+            buf[0] = '-';
+            buf++;
+            buflen--;
+        }
+    }
+    if (digits == 0)
+        g_snprintf(buf, buflen, "%d", sec);
+    else
+        g_snprintf(buf, buflen, "%d.%0*d", sec, digits, frac);
+}
+
+/* display_epoch_time() */
+static void
+old_epoch_time(gchar *buf, int buflen, const time_t sec, gint32 frac,
+               guint digits)
+{
+    double elapsed_secs;
+
+    elapsed_secs = difftime(sec,(time_t)0);
+    if (frac < 0) {
+        frac = -frac;
+        if (elapsed_secs >= 0) {
+            buf[0] = '-';
+            buf++;
+            buflen--;
+        }
+    }
+    if (digits == 0)
+        g_snprintf(buf, buflen, "%0.0f", elapsed_secs);
+    else
+        g_snprintf(buf, buflen, "%0.0f.%0*d", elapsed_secs, digits, frac);
+}
+
+static void
+old_hour_min_sec(const nstime_t *ts, gchar *buf, guint digits)
+{
+    time_t secs = ts->secs;
+    long nsecs = (long) ts->nsecs;
+    gboolean negative = FALSE;
+
+    if (secs < 0) {
+        secs = -secs;
+        negative = TRUE;
+    }
+    if (nsecs < 0) {
+        nsecs = -nsecs;
+        negative = TRUE;
+    }
+
+    if (digits == 0) {
+        if (secs >= (60*60))
+            g_snprintf(buf, COL_MAX_LEN, "%s%dh %2dm %2ds",
+                       negative ? "- " : "",
+                       (gint32) secs / (60 * 60),
+                       (gint32) (secs / 60) % 60,
+                       (gint32) secs % 60);
+        else if (secs >= 60)
+            g_snprintf(buf, COL_MAX_LEN, "%s%dm %2ds",
+                       negative ? "- " : "",
+                       (gint32) secs / 60,
+                       (gint32) secs % 60);
+        else
+            g_snprintf(buf, COL_MAX_LEN, "%s%ds",
+                       negative ? "- " : "",
+                       (gint32) secs);
+    } else {
+        nsecs /= frac_pow10[9 - digits];
+        if (secs >= (60*60))
+            g_snprintf(buf, COL_MAX_LEN, "%s%dh %2dm %2d.%0*lds",
+                       negative ? "- " : "",
+                       (gint32) secs / (60 * 60),
+                       (gint32) (secs / 60) % 60,
+                       (gint32) secs % 60,
+                       digits, nsecs);
+        else if (secs >= 60)
+            g_snprintf(buf, COL_MAX_LEN, "%s%dm %2d.%0*lds",
+                       negative ? "- " : "",
+                       (gint32) secs / 60,
+                       (gint32) secs % 60,
+                       digits, nsecs);
+        else
+            g_snprintf(buf, COL_MAX_LEN, "%s%d.%0*lds",
+                       negative ? "- " : "",
+                       (gint32) secs,
+                       digits, nsecs);
+    }
+}
+
+static void
+old_time_seconds(const nstime_t *ts, gchar *buf, guint digits)
+{
+    if (timestamp_get_seconds_type() == TS_SECONDS_HOUR_MIN_SEC)
+        old_hour_min_sec(ts, buf, digits);
+    else
+        old_signed_time(buf, COL_MAX_LEN, (gint32) ts->secs,
+                        ts->nsecs / frac_pow10[9 - digits], digits);
+}
+
+/* the command line time column, as col_set_cls_time() */
+static void
+old_cls_time(const frame_data *fd, gchar *buf, guint digits)
+{
+    switch (timestamp_get_type()) {
+    case TS_ABSOLUTE:
+        old_abs_time(fd, buf, digits, FALSE);
+        break;
+    case TS_ABSOLUTE_WITH_DATE:
+        old_abs_time(fd, buf, digits, TRUE);
+        break;
+    case TS_RELATIVE:
+        old_time_seconds(&fd->rel_ts, buf, digits);
+        break;
+    case TS_DELTA:
+        old_time_seconds(&fd->del_cap_ts, buf, digits);
+        break;
+    case TS_DELTA_DIS:
+        old_time_seconds(&fd->del_dis_ts, buf, digits);
+        break;
+    case TS_EPOCH:
+        old_epoch_time(buf, COL_MAX_LEN, fd->abs_ts.secs,
+                       fd->abs_ts.nsecs / frac_pow10[9 - digits], digits);
+        break;
+    default:
+        g_assert_not_reached();
+    }
+}
+
+static const char *mon_names[12] = {
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+};
+
+/* abs_time_to_str() without a zone, or with "UTC" */
+static void
+old_abs_time_to_str(const nstime_t *abs_time,
+                    const absolute_time_display_e fmt, gchar *buf)
+{
+    struct tm *tmp;
+
+    tmp = fmt == ABSOLUTE_TIME_LOCAL ? localtime(&abs_time->secs)
+                                     : gmtime(&abs_time->secs);
+    if (tmp == NULL)
+        g_strlcpy(buf, "Not representable", COL_MAX_LEN);
+    else if (fmt == ABSOLUTE_TIME_DOY_UTC)
+        g_snprintf(buf, COL_MAX_LEN, "%04d/%03d:%02d:%02d:%02d.%09ld UTC",
+                   tmp->tm_year + 1900, tmp->tm_yday + 1,
+                   tmp->tm_hour, tmp->tm_min, tmp->tm_sec,
+                   (long)abs_time->nsecs);
+    else if (fmt == ABSOLUTE_TIME_UTC)
+        g_snprintf(buf, COL_MAX_LEN, "%s %2d, %d %02d:%02d:%02d.%09ld UTC",
+                   mon_names[tmp->tm_mon], tmp->tm_mday, tmp->tm_year + 1900,
+                   tmp->tm_hour, tmp->tm_min, tmp->tm_sec,
+                   (long)abs_time->nsecs);
+    else
+        g_snprintf(buf, COL_MAX_LEN, "%s %2d, %d %02d:%02d:%02d.%09ld",
+                   mon_names[tmp->tm_mon], tmp->tm_mday, tmp->tm_year + 1900,
+                   tmp->tm_hour, tmp->tm_min, tmp->tm_sec,
+                   (long)abs_time->nsecs);
+}
+
+/*
+ * Packet times
+ */
+static nstime_t *abs_ts;
+static guint n_ts;
+static guint n_stream;  /* the first n_stream of them are a capture */
+
+/* Mostly gaps of up to 0.4 ms, now and then a jump of up to an hour, so
+ * that the stream crosses minutes, days and, in Europe, the change to
+ * summer time on 2010-03-28.  Then some times that exercise the signs. */
+static void
+make_times(guint packets)
+{
+    static const nstime_t edges[] = {
+        { 0, 0 }, { 0, 1 }, { 0, -1 }, { 0, -500000000 }, { 0, 999999999 },
+        { -1, 0 }, { -1, -1 }, { 59, 999999999 }, { 60, 0 }, { 3599, 5 },
+        { 3600, 0 }, { -3661, -123456789 }, { 86400 * 400, 1 },
+        { -86400 * 3, -999999999 }
+    };
+    guint32 rnd = 12345;
+    time_t secs = 1269733000; /* 2010-03-27 23:36:40 UTC */
+    gint32 nsecs = 0;
+    guint i;
+
+    n_stream = packets;
+    n_ts = packets + (guint)G_N_ELEMENTS(edges);
+    abs_ts = g_new(nstime_t, n_ts);
+    for (i = 0; i < packets; i++) {
+        rnd = rnd * 1103515245 + 12345;
+        nsecs += (rnd >> 8) % 400000;
+        if ((rnd >> 4) % 4096 == 0)
+            secs += (rnd >> 16) % 3600;
+        secs += nsecs / 1000000000;
+        nsecs %= 1000000000;
+        abs_ts[i].secs = secs;
+        abs_ts[i].nsecs = nsecs;
+    }
+    for (i = 0; i < G_N_ELEMENTS(edges); i++)
+        abs_ts[packets + i] = edges[i];
+}
+
+/* the frame for the i'th time; an edge time is used as it is for all of
+ * them */
+static void
+set_frame(frame_data *fd, guint i)
+{
+    fd->abs_ts = abs_ts[i];
+    if (i == 0) {
+        fd->rel_ts.secs = 0;
+        fd->rel_ts.nsecs = 0;
+        fd->del_cap_ts = fd->rel_ts;
+    } else if (i >= n_stream) {
+        fd->rel_ts = abs_ts[i];
+        fd->del_cap_ts = abs_ts[i];
+    } else {
+        fd->rel_ts.secs = abs_ts[i].secs - abs_ts[0].secs;
+        fd->rel_ts.nsecs = abs_ts[i].nsecs - abs_ts[0].nsecs;
+        if (fd->rel_ts.nsecs < 0) {
+            fd->rel_ts.secs--;
+            fd->rel_ts.nsecs += 1000000000;
+        }
+        fd->del_cap_ts.secs = abs_ts[i].secs - abs_ts[i - 1].secs;
+        fd->del_cap_ts.nsecs = abs_ts[i].nsecs - abs_ts[i - 1].nsecs;
+        if (fd->del_cap_ts.nsecs < 0) {
+            fd->del_cap_ts.secs--;
+            fd->del_cap_ts.nsecs += 1000000000;
+        }
+    }
+    fd->del_dis_ts = fd->del_cap_ts;
+}
+
+static const struct {
+    const char     *name;
+    ts_type         type;
+    ts_seconds_type seconds_type;
+} ts_types[] = {
+    { "ad",     TS_ABSOLUTE_WITH_DATE, TS_SECONDS_DEFAULT },
+    { "a",      TS_ABSOLUTE,           TS_SECONDS_DEFAULT },
+    { "r",      TS_RELATIVE,           TS_SECONDS_DEFAULT },
+    { "r hms",  TS_RELATIVE,           TS_SECONDS_HOUR_MIN_SEC },
+    { "d",      TS_DELTA,              TS_SECONDS_DEFAULT },
+    { "d hms",  TS_DELTA,              TS_SECONDS_HOUR_MIN_SEC },
+    { "dd",     TS_DELTA_DIS,          TS_SECONDS_DEFAULT },
+    { "e",      TS_EPOCH,              TS_SECONDS_DEFAULT }
+};
+
+static const struct {
+    int   prec;
+    guint digits;
+} ts_precs[] = {
+    { TS_PREC_FIXED_SEC, 0 }, { TS_PREC_FIXED_DSEC, 1 },
+    { TS_PREC_FIXED_CSEC, 2 }, { TS_PREC_FIXED_MSEC, 3 },
+    { TS_PREC_FIXED_USEC, 6 }, { TS_PREC_FIXED_NSEC, 9 }
+};
+
+static void
+test_columns(void)
+{
+    column_info cinfo;
+    frame_data fd;
+    gchar buf[COL_MAX_LEN];
+    GTimer *timer = g_timer_new();
+    gdouble old_secs, new_secs;
+    guint t, p, i;
+
+    printf("Time column, ns/packet old -> new\n");
+
+    memset(&fd, 0, sizeof fd);
+    col_setup(&cinfo, 1);
+    cinfo.col_fmt[0] = COL_CLS_TIME;
+    cinfo.col_buf[0] = g_malloc(COL_MAX_LEN);
+    cinfo.col_expr.col_expr_val[0] = g_malloc(COL_MAX_LEN);
+    col_init(&cinfo);
+
+    for (t = 0; t < G_N_ELEMENTS(ts_types); t++) {
+        timestamp_set_type(ts_types[t].type);
+        timestamp_set_seconds_type(ts_types[t].seconds_type);
+        printf("  -t %-6s", ts_types[t].name);
+        for (p = 0; p < G_N_ELEMENTS(ts_precs); p++) {
+            timestamp_set_precision(ts_precs[p].prec);
+
+            for (i = 0; i < n_ts; i++) {
+                set_frame(&fd, i);
+                old_cls_time(&fd, buf, ts_precs[p].digits);
+                col_set_fmt_time(&fd, &cinfo, COL_CLS_TIME, 0);
+                check_text(ts_types[t].name, &abs_ts[i], buf,
+                           cinfo.col_data[0]);
+            }
+
+            g_timer_start(timer);
+            for (i = 0; i < n_ts; i++) {
+                set_frame(&fd, i);
+                old_cls_time(&fd, buf, ts_precs[p].digits);
+            }
+            g_timer_stop(timer);
+            old_secs = g_timer_elapsed(timer, NULL);
+
+            g_timer_start(timer);
+            for (i = 0; i < n_ts; i++) {
+                set_frame(&fd, i);
+                col_set_fmt_time(&fd, &cinfo, COL_CLS_TIME, 0);
+            }
+            g_timer_stop(timer);
+            new_secs = g_timer_elapsed(timer, NULL);
+
+            printf("  %u: %4.0f -> %3.0f", ts_precs[p].digits,
+                   old_secs * 1e9 / n_ts, new_secs * 1e9 / n_ts);
+        }
+        printf("\n");
+    }
+
+    g_timer_destroy(timer);
+}
+
+static void
+test_abs_time_to_str(void)
+{
+    static const struct {
+        const char               *name;
+        absolute_time_display_e   fmt;
+    } fmts[] = {
+        { "local",      ABSOLUTE_TIME_LOCAL },
+        { "UTC",        ABSOLUTE_TIME_UTC },
+        { "UTC, day",   ABSOLUTE_TIME_DOY_UTC }
+    };
+    gchar buf[COL_MAX_LEN];
+    GTimer *timer = g_timer_new();
+    gdouble old_secs, new_secs;
+    guint f, i;
+
+    printf("abs_time_to_str(), ns/packet old -> new\n");
+
+    for (f = 0; f < G_N_ELEMENTS(fmts); f++) {
+        for (i = 0; i < n_ts; i++) {
+            old_abs_time_to_str(&abs_ts[i], fmts[f].fmt, buf);
+            check_text(fmts[f].name, &abs_ts[i], buf,
+                       abs_time_to_str(&abs_ts[i], fmts[f].fmt,
+                                       fmts[f].fmt != ABSOLUTE_TIME_LOCAL));
+            ep_free_all();
+        }
+
+        g_timer_start(timer);
+        for (i = 0; i < n_ts; i++)
+            old_abs_time_to_str(&abs_ts[i], fmts[f].fmt, buf);
+        g_timer_stop(timer);
+        old_secs = g_timer_elapsed(timer, NULL);
+
+        g_timer_start(timer);
+        for (i = 0; i < n_ts; i++) {
+            abs_time_to_str(&abs_ts[i], fmts[f].fmt,
+                            fmts[f].fmt != ABSOLUTE_TIME_LOCAL);
+            if (i % 1024 == 0)
+                ep_free_all();
+        }
+        g_timer_stop(timer);
+        new_secs = g_timer_elapsed(timer, NULL);
+        ep_free_all();
+
+        printf("  %-10s %4.0f -> %3.0f\n", fmts[f].name,
+               old_secs * 1e9 / n_ts, new_secs * 1e9 / n_ts);
+    }
+
+    g_timer_destroy(timer);
+}
+
+static void
+tm_to_str(const struct tm *tmp, gchar *buf)
+{
+    if (tmp == NULL)
+        g_strlcpy(buf, "NULL", COL_MAX_LEN);
+    else
+        g_snprintf(buf, COL_MAX_LEN, "%04d-%02d-%02d %02d:%02d:%02d%s",
+                   tmp->tm_year + 1900, tmp->tm_mon + 1, tmp->tm_mday,
+                   tmp->tm_hour, tmp->tm_min, tmp->tm_sec,
+                   tmp->tm_isdst > 0 ? " DST" : "");
+}
+
+/* Look up every second from 5 minutes before to 5 minutes after a change
+ * of UTC offset, in order, as a capture would. */
+static void
+test_zone_change(const char *zone, time_t change)
+{
+    gchar expected[COL_MAX_LEN], actual[COL_MAX_LEN];
+    nstime_t ts;
+    time_t t;
+
+    g_setenv("TZ", zone, TRUE);
+    tzset();
+
+    ts.nsecs = 0;
+    for (t = change - 300; t < change + 300; t++) {
+        ts.secs = t;
+        tm_to_str(time_fmt_localtime(t), actual);
+        tm_to_str(localtime(&t), expected);
+        check_text(zone, &ts, expected, actual);
+    }
+}
+
+static void
+test_zones(void)
+{
+    printf("Time zone changes\n");
+
+    /* summer time */
+    test_zone_change("Europe/Amsterdam", 1269738000);
+    test_zone_change("America/New_York", 1289109600);
+    /* 0:19:32 to 0:20 ahead of UTC */
+    test_zone_change("Europe/Amsterdam", -1025745572);
+    /* 4:31:19 to 4:00, at a whole minute of UTC */
+    test_zone_change("Europe/Moscow", -1593820800);
+    /* 0:44:30 behind UTC to UTC */
+    test_zone_change("Africa/Monrovia", 63593070);
+    /* 5:41:16 to 5:45 */
+    test_zone_change("Asia/Kathmandu", -1577943676);
+    test_zone_change("Asia/Kathmandu", 504901800);
+}
+
+int
+main(int argc, char **argv)
+{
+    guint packets = DEFAULT_PACKETS;
+
+    if (argc > 1 && (packets = (guint)strtoul(argv[1], NULL, 10)) == 0) {
+        fprintf(stderr, "Usage: time_fmt_test [packets]\n");
+        return 2;
+    }
+
+    emem_init();
+
+    /* the zone of the checked-in results, with summer time */
+    g_setenv("TZ", "Europe/Amsterdam", TRUE);
+    tzset();
+
+    make_times(packets);
+    test_columns();
+    test_abs_time_to_str();
+    test_zones();
+
+    g_free(abs_ts);
+
+    printf(failure?"FAILURE\n":"SUCCESS\n");
+    return failure;
+}
+
+
+/* stubs */
+void
+address_to_str_buf(const address *addr _U_, gchar *buf, int buf_len)
+{
+    g_strlcpy(buf, "", buf_len);
+}
+
+void
+get_addr_name_buf(const address *addr _U_, gchar *buf, gsize size)
+{
+    g_strlcpy(buf, "", size);
+}
+
+gchar *
+get_tcp_port(guint port _U_)
+{
+    return "";
+}
+
+gchar *
+get_udp_port(guint port _U_)
+{
+    return "";
+}
+
+gchar *
+get_sctp_port(guint port _U_)
+{
+    return "";
+}
+
+const gchar *
+epan_custom_set(epan_dissect_t *edt _U_, int id _U_, gchar *result _U_,
+                gchar *expr _U_, const int size _U_)
+{
+    return NULL;
+}
+
+void
+epan_dissect_prime_dfilter(epan_dissect_t *edt _U_,
+                           const dfilter_t *dfcode _U_)
+{
+}
+
+header_field_info *
+proto_registrar_get_byname(const char *field_name _U_)
+{
+    return NULL;
+}
@@ -499,7 +499,7 @@ static const char *mon_names[12] = {
 	"Dec"
 };
 
-static gchar *get_zonename(struct tm *tmp) {
+static const gchar *get_zonename(const struct tm *tmp) {
 #if defined(HAVE_TM_ZONE)
 	return tmp->tm_zone;
 #else
@@ -546,13 +546,64 @@ static gchar *get_zonename(struct tm *tmp) {
 #endif
 }
 
+/* Write a broken-down time in one of the absolute_time_display_e formats,
+ * with the fraction of a second if digits isn't 0, into memory that lasts
+ * until the next packet. */
+static gchar *
+abs_tm_to_str(const struct tm *tmp, const absolute_time_display_e fmt,
+    gint32 nsecs, guint digits, const char *zonename)
+{
+	gchar *buf, *p;
+
+	buf = ep_alloc(TIME_FMT_MAX_LEN + (zonename ? strlen(zonename) + 1 : 0));
+	p = buf;
+
+	switch (fmt) {
+
+	case ABSOLUTE_TIME_DOY_UTC:
+		/* "%04d/%03d:%02d:%02d:%02d" */
+		if (tmp->tm_year + 1900 < 0) {
+			*p++ = '-';
+			p = time_fmt_uint(p, -(tmp->tm_year + 1900), 3);
+		} else
+			p = time_fmt_uint(p, tmp->tm_year + 1900, 4);
+		*p++ = '/';
+		p = time_fmt_uint(p, tmp->tm_yday + 1, 3);
+		*p++ = ':';
+		p = time_fmt_hms(p, tmp);
+		break;
+
+	case ABSOLUTE_TIME_UTC:
+	case ABSOLUTE_TIME_LOCAL:
+		/* "%s %2d, %d %02d:%02d:%02d" */
+		memcpy(p, mon_names[tmp->tm_mon], 3);
+		p += 3;
+		*p++ = ' ';
+		if (tmp->tm_mday < 10)
+			*p++ = ' ';
+		p = time_fmt_uint(p, tmp->tm_mday, 1);
+		*p++ = ',';
+		*p++ = ' ';
+		p = time_fmt_int(p, tmp->tm_year + 1900);
+		*p++ = ' ';
+		p = time_fmt_hms(p, tmp);
+		break;
+	}
+	p = time_fmt_frac(p, nsecs, digits);
+	if (zonename) {
+		*p++ = ' ';
+		strcpy(p, zonename);
+	} else
+		*p = '\0';
+	return buf;
+}
+
 gchar *
 abs_time_to_str(const nstime_t *abs_time, const absolute_time_display_e fmt,
    gboolean show_zone)
 {
-        struct tm *tmp = NULL;
+        const struct tm *tmp = NULL;
         const char *zonename = "???";
-        gchar *buf = NULL;
 
 #ifdef _MSC_VER
         /* calling localtime() on MSVC 2005 with huge values causes it to crash */
@@ -566,77 +617,29 @@ abs_time_to_str(const nstime_t *abs_time, const absolute_time_display_e fmt,
 
         case ABSOLUTE_TIME_UTC:
         case ABSOLUTE_TIME_DOY_UTC:
-                tmp = gmtime(&abs_time->secs);
+                tmp = time_fmt_gmtime(abs_time->secs);
                 zonename = "UTC";
                 break;
 
 	case ABSOLUTE_TIME_LOCAL:
-                tmp = localtime(&abs_time->secs);
+                tmp = time_fmt_localtime(abs_time->secs);
                 if (tmp) {
 			zonename = get_zonename(tmp);
                 }
                 break;
         }
-        if (tmp) {
-                switch (fmt) {
-
-                case ABSOLUTE_TIME_DOY_UTC:
-                	if (show_zone) {
-	                        buf = ep_strdup_printf("%04d/%03d:%02d:%02d:%02d.%09ld %s",
-        	                    tmp->tm_year + 1900,
-                	            tmp->tm_yday + 1,
-                        	    tmp->tm_hour,
-	                            tmp->tm_min,
-        	                    tmp->tm_sec,
-                	            (long)abs_time->nsecs,
-                        	    zonename);
-                        } else {
-	                        buf = ep_strdup_printf("%04d/%03d:%02d:%02d:%02d.%09ld",
-        	                    tmp->tm_year + 1900,
-                	            tmp->tm_yday + 1,
-                        	    tmp->tm_hour,
-	                            tmp->tm_min,
-        	                    tmp->tm_sec,
-                	            (long)abs_time->nsecs);
-                        }
-                        break;
-
-                case ABSOLUTE_TIME_UTC:
-                case ABSOLUTE_TIME_LOCAL:
-                	if (show_zone) {
-	                        buf = ep_strdup_printf("%s %2d, %d %02d:%02d:%02d.%09ld %s",
-        	                    mon_names[tmp->tm_mon],
-                	            tmp->tm_mday,
-                        	    tmp->tm_year + 1900,
-	                            tmp->tm_hour,
-        	                    tmp->tm_min,
-                	            tmp->tm_sec,
-                        	    (long)abs_time->nsecs,
-	                            zonename);
-	                } else {
-	                        buf = ep_strdup_printf("%s %2d, %d %02d:%02d:%02d.%09ld",
-        	                    mon_names[tmp->tm_mon],
-                	            tmp->tm_mday,
-                        	    tmp->tm_year + 1900,
-	                            tmp->tm_hour,
-        	                    tmp->tm_min,
-                	            tmp->tm_sec,
-                        	    (long)abs_time->nsecs);
-	                }
-                        break;
-                }
-        } else
-                buf = ep_strdup("Not representable");
-        return buf;
+        if (tmp)
+                return abs_tm_to_str(tmp, fmt, abs_time->nsecs, 9,
+                    show_zone ? zonename : NULL);
+        return ep_strdup("Not representable");
 }
 
 gchar *
 abs_time_secs_to_str(const time_t abs_time, const absolute_time_display_e fmt,
     gboolean show_zone)
 {
-        struct tm *tmp = NULL;
+        const struct tm *tmp = NULL;
         const char *zonename = "???";
-        gchar *buf = NULL;
 
 #ifdef _MSC_VER
         /* calling localtime() on MSVC 2005 with huge values causes it to crash */
@@ -650,111 +653,35 @@ abs_time_secs_to_str(const time_t abs_time, const absolute_time_display_e fmt,
 
         case ABSOLUTE_TIME_UTC:
         case ABSOLUTE_TIME_DOY_UTC:
-                tmp = gmtime(&abs_time);
+                tmp = time_fmt_gmtime(abs_time);
                 zonename = "UTC";
                 break;
 
 	case ABSOLUTE_TIME_LOCAL:
-                tmp = localtime(&abs_time);
+                tmp = time_fmt_localtime(abs_time);
                 if (tmp) {
 			zonename = get_zonename(tmp);
                 }
                 break;
         }
-        if (tmp) {
-                switch (fmt) {
-
-                case ABSOLUTE_TIME_DOY_UTC:
-                	if (show_zone) {
-	                        buf = ep_strdup_printf("%04d/%03d:%02d:%02d:%02d %s",
-        	                    tmp->tm_year + 1900,
-                	            tmp->tm_yday + 1,
-                        	    tmp->tm_hour,
-	                            tmp->tm_min,
-        	                    tmp->tm_sec,
-                	            zonename);
-                	} else {
-	                        buf = ep_strdup_printf("%04d/%03d:%02d:%02d:%02d",
-        	                    tmp->tm_year + 1900,
-                	            tmp->tm_yday + 1,
-                        	    tmp->tm_hour,
-	                            tmp->tm_min,
-        	                    tmp->tm_sec);
-                	}
-                        break;
-
-                case ABSOLUTE_TIME_UTC:
-                case ABSOLUTE_TIME_LOCAL:
-                	if (show_zone) {
-	                        buf = ep_strdup_printf("%s %2d, %d %02d:%02d:%02d %s",
-        	                    mon_names[tmp->tm_mon],
-                	            tmp->tm_mday,
-                        	    tmp->tm_year + 1900,
-	                            tmp->tm_hour,
-        	                    tmp->tm_min,
-                	            tmp->tm_sec,
-                        	    zonename);
-                        } else {
-	                        buf = ep_strdup_printf("%s %2d, %d %02d:%02d:%02d",
-        	                    mon_names[tmp->tm_mon],
-                	            tmp->tm_mday,
-                        	    tmp->tm_year + 1900,
-	                            tmp->tm_hour,
-        	                    tmp->tm_min,
-                	            tmp->tm_sec);
-                        }
-                        break;
-                }
-        } else
-                buf = ep_strdup("Not representable");
-        return buf;
+        if (tmp)
+                return abs_tm_to_str(tmp, fmt, 0, 0,
+                    show_zone ? zonename : NULL);
+        return ep_strdup("Not representable");
 }
 
 void
 display_signed_time(gchar *buf, int buflen, const gint32 sec, gint32 frac,
     const to_str_time_res_t units)
 {
+	gchar tmp[TIME_FMT_MAX_LEN];
+
 	/* If the fractional part of the time stamp is negative,
 	   print its absolute value and, if the seconds part isn't
 	   (the seconds part should be zero in that case), stick
 	   a "-" in front of the entire time stamp. */
-	if (frac < 0) {
-		frac = -frac;
-		if (sec >= 0) {
-			if (buflen < 1) {
-			  return;
-			}
-			buf[0] = '-';
-			buf++;
-			buflen--;
-		}
-	}
-	switch (units) {
-
-	case TO_STR_TIME_RES_T_SECS:
-		g_snprintf(buf, buflen, "%d", sec);
-		break;
-
-	case TO_STR_TIME_RES_T_DSECS:
-		g_snprintf(buf, buflen, "%d.%01d", sec, frac);
-		break;
-
-	case TO_STR_TIME_RES_T_CSECS:
-		g_snprintf(buf, buflen, "%d.%02d", sec, frac);
-		break;
-
-	case TO_STR_TIME_RES_T_MSECS:
-		g_snprintf(buf, buflen, "%d.%03d", sec, frac);
-		break;
-
-	case TO_STR_TIME_RES_T_USECS:
-		g_snprintf(buf, buflen, "%d.%06d", sec, frac);
-		break;
-
-	case TO_STR_TIME_RES_T_NSECS:
-		g_snprintf(buf, buflen, "%d.%09d", sec, frac);
-		break;
-	}
+	*time_fmt_signed(tmp, sec, frac, time_fmt_res_digits(units)) = '\0';
+	g_strlcpy(buf, tmp, buflen);
 }
 
 
@@ -762,53 +689,12 @@ void
 display_epoch_time(gchar *buf, int buflen, const time_t sec, gint32 frac,
     const to_str_time_res_t units)
 {
-	double elapsed_secs;
-
-	elapsed_secs = difftime(sec,(time_t)0);
-
-	/* This code copied from display_signed_time; keep it in case anyone
-	   is looking at captures from before 1970 (???).
-	   If the fractional part of the time stamp is negative,
-	   print its absolute value and, if the seconds part isn't
-	   (the seconds part should be zero in that case), stick
-	   a "-" in front of the entire time stamp. */
-	if (frac < 0) {
-		frac = -frac;
-		if (elapsed_secs >= 0) {
-			if (buflen < 1) {
-			  return;
-			}
-			buf[0] = '-';
-			buf++;
-			buflen--;
-		}
-	}
-	switch (units) {
+	gchar tmp[TIME_FMT_MAX_LEN];
 
-	case TO_STR_TIME_RES_T_SECS:
-		g_snprintf(buf, buflen, "%0.0f", elapsed_secs);
-		break;
-
-	case TO_STR_TIME_RES_T_DSECS:
-		g_snprintf(buf, buflen, "%0.0f.%01d", elapsed_secs, frac);
-		break;
-
-	case TO_STR_TIME_RES_T_CSECS:
-		g_snprintf(buf, buflen, "%0.0f.%02d", elapsed_secs, frac);
-		break;
-
-	case TO_STR_TIME_RES_T_MSECS:
-		g_snprintf(buf, buflen, "%0.0f.%03d", elapsed_secs, frac);
-		break;
-
-	case TO_STR_TIME_RES_T_USECS:
-		g_snprintf(buf, buflen, "%0.0f.%06d", elapsed_secs, frac);
-		break;
-
-	case TO_STR_TIME_RES_T_NSECS:
-		g_snprintf(buf, buflen, "%0.0f.%09d", elapsed_secs, frac);
-		break;
-	}
+	/* Same as display_signed_time; keep the sign handling in case
+	   anyone is looking at captures from before 1970 (???). */
+	*time_fmt_signed(tmp, (gint64)sec, frac, time_fmt_res_digits(units)) = '\0';
+	g_strlcpy(buf, tmp, buflen);
 }
 
 /*
@@ -246,6 +246,63 @@ test(tvbuff_t *tvb, gchar* name,
 
 
 
+/* Tests tvb_find_guint8() and tvb_pbrk_guint8() against the expected
+ * pattern, from every offset and for every value in it; a composite with
+ * several members must not be flattened by searching it. */
+gboolean
+test_find(tvbuff_t *tvb, gchar* name,
+		guint8* expected_data, guint expected_length)
+{
+	guint		offset, i;
+	gint		found, expected;
+	const guint8	*p;
+	guint8		needles[3];
+	guchar		found_needle;
+
+	for (offset = 0; offset < expected_length; offset++) {
+		for (i = 0; i < expected_length; i++) {
+			p = memchr(expected_data + offset, expected_data[i],
+					expected_length - offset);
+			expected = p ? (gint) (p - expected_data) : -1;
+			found = tvb_find_guint8(tvb, offset, -1, expected_data[i]);
+			if (found != expected) {
+				printf("30: Failed TVB=%s tvb_find_guint8(%u, 0x%02x)=%d"
+						" while expected %d\n", name, offset,
+						expected_data[i], found, expected);
+				failed = TRUE;
+				return FALSE;
+			}
+
+			/* the needles are NUL-terminated */
+			if (expected_data[i] == '\0')
+				continue;
+			needles[0] = 0xff;
+			needles[1] = expected_data[i];
+			needles[2] = '\0';
+			found_needle = 0;
+			found = tvb_pbrk_guint8(tvb, offset, -1, needles, &found_needle);
+			if (found != expected ||
+			    (found != -1 && found_needle != expected_data[i])) {
+				printf("31: Failed TVB=%s tvb_pbrk_guint8(%u, 0x%02x)=%d"
+						" while expected %d\n", name, offset,
+						expected_data[i], found, expected);
+				failed = TRUE;
+				return FALSE;
+			}
+		}
+	}
+
+	if (tvb->type == TVBUFF_COMPOSITE &&
+	    tvb->tvbuffs.composite.num_members > 1 && tvb->real_data != NULL) {
+		printf("32: Failed TVB=%s searching flattened the composite\n", name);
+		failed = TRUE;
+		return FALSE;
+	}
+
+	printf("Passed TVB=%s find\n", name);
+	return TRUE;
+}
+
 void
 run_tests(void)
 {
@@ -259,12 +316,10 @@ run_tests(void)
 	guint8		*subset[6];
 	guint		subset_length[6];
 	guint8		temp;
-#if 0
 	guint8		*comp[6];
 	tvbuff_t	*tvb_comp[6];
 	guint		comp_length[6];
 	int		len;
-#endif
 	
 	for (i = 0; i < 3; i++) {
 		small[i] = g_new(guint8, 16);
@@ -329,10 +384,6 @@ run_tests(void)
 	test(tvb_subset[4], "Subset 4", subset[4], subset_length[4]);
 	test(tvb_subset[5], "Subset 5", subset[5], subset_length[5]);
 
-#if 0
-	/* Composite tvbuffs don't work at the moment -- tests commented out until
-	 * they do. */
-	
 	/* One Real */
 	printf("Making Composite 0\n");
 	tvb_comp[0]		= tvb_new_composite();
@@ -406,6 +457,15 @@ run_tests(void)
 	tvb_composite_append(tvb_comp[5], tvb_comp[3]);
 	tvb_composite_finalize(tvb_comp[5]);
 
+	/* Test searching the TVBUFF_COMPOSITE objects, before anything
+	 * else has a chance to flatten them. */
+	test_find(tvb_comp[5], "Composite 5", comp[5], comp_length[5]);
+	test_find(tvb_comp[0], "Composite 0", comp[0], comp_length[0]);
+	test_find(tvb_comp[1], "Composite 1", comp[1], comp_length[1]);
+	test_find(tvb_comp[2], "Composite 2", comp[2], comp_length[2]);
+	test_find(tvb_comp[3], "Composite 3", comp[3], comp_length[3]);
+	test_find(tvb_comp[4], "Composite 4", comp[4], comp_length[4]);
+
 	/* Test the TVBUFF_COMPOSITE objects. */
 	test(tvb_comp[0], "Composite 0", comp[0], comp_length[0]);
 	test(tvb_comp[1], "Composite 1", comp[1], comp_length[1]);
@@ -413,7 +473,6 @@ run_tests(void)
 	test(tvb_comp[3], "Composite 3", comp[3], comp_length[3]);
 	test(tvb_comp[4], "Composite 4", comp[4], comp_length[4]);
 	test(tvb_comp[5], "Composite 5", comp[5], comp_length[5]);
-#endif
 }
 
 int
@@ -118,6 +118,8 @@ tvb_init(tvbuff_t *tvb, const tvbuff_type type)
 		case TVBUFF_COMPOSITE:
 			composite = &tvb->tvbuffs.composite;
 			composite->tvbs			= NULL;
+			composite->members		= NULL;
+			composite->num_members		= 0;
 			composite->start_offsets	= NULL;
 			composite->end_offsets		= NULL;
 			break;
@@ -192,6 +194,7 @@ tvb_free(tvbuff_t* tvb)
 
 			g_slist_free(composite->tvbs);
 
+			g_free(composite->members);
 			g_free(composite->start_offsets);
 			g_free(composite->end_offsets);
 			if (tvb->real_data) {
@@ -276,7 +279,8 @@ tvb_set_child_real_data_tvbuff(tvbuff_t* parent, tvbuff_t* child)
 	DISSECTOR_ASSERT(parent && child);
 	DISSECTOR_ASSERT(parent->initialized);
 	DISSECTOR_ASSERT(child->initialized);
-	DISSECTOR_ASSERT(child->type == TVBUFF_REAL_DATA);
+	DISSECTOR_ASSERT(child->type == TVBUFF_REAL_DATA ||
+			 child->type == TVBUFF_COMPOSITE);
 	add_to_used_in_list(parent, child);
 }
 
@@ -571,7 +575,7 @@ tvb_composite_append(tvbuff_t* tvb, tvbuff_t* member)
 	DISSECTOR_ASSERT(tvb->type == TVBUFF_COMPOSITE);
 	composite = &tvb->tvbuffs.composite;
 	composite->tvbs = g_slist_append( composite->tvbs, member );
-	add_to_used_in_list(tvb, member);
+	add_to_used_in_list(member, tvb);
 }
 
 void
@@ -583,7 +587,7 @@ tvb_composite_prepend(tvbuff_t* tvb, tvbuff_t* member)
 	DISSECTOR_ASSERT(tvb->type == TVBUFF_COMPOSITE);
 	composite = &tvb->tvbuffs.composite;
 	composite->tvbs = g_slist_prepend( composite->tvbs, member );
-	add_to_used_in_list(tvb, member);
+	add_to_used_in_list(member, tvb);
 }
 
 tvbuff_t*
@@ -597,9 +601,9 @@ tvb_composite_finalize(tvbuff_t* tvb)
 {
 	GSList		*slist;
 	guint		num_members;
-	tvbuff_t	*member_tvb;
+	tvbuff_t	*member_tvb = NULL;
 	tvb_comp_t	*composite;
-	int		i = 0;
+	guint		i = 0;
 
 	DISSECTOR_ASSERT(tvb && !tvb->initialized);
 	DISSECTOR_ASSERT(tvb->type == TVBUFF_COMPOSITE);
@@ -608,18 +612,39 @@ tvb_composite_finalize(tvbuff_t* tvb)
 	composite = &tvb->tvbuffs.composite;
 	num_members = g_slist_length(composite->tvbs);
 
+	composite->members = g_new(tvbuff_t *, num_members);
 	composite->start_offsets = g_new(guint, num_members);
 	composite->end_offsets = g_new(guint, num_members);
 
 	for (slist = composite->tvbs; slist != NULL; slist = slist->next) {
-		DISSECTOR_ASSERT((guint) i < num_members);
 		member_tvb = slist->data;
+		DISSECTOR_ASSERT(member_tvb->initialized);
+
+		/* Empty members can't hold any offset; leave them out of
+		 * the lookup arrays so that end_offsets stays sorted. */
+		if (member_tvb->length == 0)
+			continue;
+
+		DISSECTOR_ASSERT(i < num_members);
+		composite->members[i] = member_tvb;
 		composite->start_offsets[i] = tvb->length;
 		tvb->length += member_tvb->length;
 		composite->end_offsets[i] = tvb->length - 1;
 		i++;
 	}
+	composite->num_members = i;
+
+	/*
+	 * Only the last member can be cut short by the snapshot
+	 * length; anything it is missing is missing from the end of
+	 * the composite as well.
+	 */
+	tvb->reported_length = tvb->length;
+	if (member_tvb != NULL && member_tvb->reported_length > member_tvb->length)
+		tvb->reported_length += member_tvb->reported_length - member_tvb->length;
 
+	/* The composite is a new data source of its own. */
+	tvb->ds_tvb = tvb;
 	tvb->initialized = TRUE;
 }
 
@@ -818,7 +843,9 @@ offset_from_real_beginning(const tvbuff_t *tvb, const guint counter)
 			member = tvb->tvbuffs.subset.tvb;
 			return offset_from_real_beginning(member, counter + tvb->tvbuffs.subset.offset);
 		case TVBUFF_COMPOSITE:
-			member = tvb->tvbuffs.composite.tvbs->data;
+			if (tvb->tvbuffs.composite.num_members == 0)
+				return counter;
+			member = tvb->tvbuffs.composite.members[0];
 			return offset_from_real_beginning(member, counter);
 	}
 
@@ -832,48 +859,63 @@ tvb_offset_from_real_beginning(const tvbuff_t *tvb)
 	return offset_from_real_beginning(tvb, 0);
 }
 
+/* Returns the index of the member of a composite holding abs_offset,
+ * or -1 if abs_offset is past the end of the composite. */
+static gint
+composite_find_member(const tvb_comp_t *composite, const guint abs_offset)
+{
+	guint	low, high, mid;
+
+	low = 0;
+	high = composite->num_members;
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		if (abs_offset > composite->end_offsets[mid])
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	if (low == composite->num_members)
+		return -1;
+	return (gint) low;
+}
+
 static const guint8*
 composite_ensure_contiguous_no_exception(tvbuff_t *tvb, const guint abs_offset,
 		const guint abs_length)
 {
-	guint		i, num_members;
+	gint		i;
 	tvb_comp_t	*composite;
-	tvbuff_t	*member_tvb = NULL;
+	tvbuff_t	*member_tvb;
 	guint		member_offset, member_length;
-	GSList		*slist;
 
 	DISSECTOR_ASSERT(tvb->type == TVBUFF_COMPOSITE);
 
 	/* Maybe the range specified by offset/length
 	 * is contiguous inside one of the member tvbuffs */
 	composite = &tvb->tvbuffs.composite;
-	num_members = g_slist_length(composite->tvbs);
+	i = composite_find_member(composite, abs_offset);
 
-	for (i = 0; i < num_members; i++) {
-		if (abs_offset <= composite->end_offsets[i]) {
-			slist = g_slist_nth(composite->tvbs, i);
-			member_tvb = slist->data;
-			break;
+	if (i >= 0) {
+		member_tvb = composite->members[i];
+		if (check_offset_length_no_exception(member_tvb->length, member_tvb->reported_length,
+					abs_offset - composite->start_offsets[i],
+					abs_length, &member_offset, &member_length, NULL)) {
+			/*
+			 * The range is, in fact, contiguous within member_tvb.
+			 */
+			DISSECTOR_ASSERT(!tvb->real_data);
+			return ensure_contiguous_no_exception(member_tvb, member_offset, member_length, NULL);
 		}
 	}
-	DISSECTOR_ASSERT(member_tvb);
 
-	if (check_offset_length_no_exception(member_tvb->length, member_tvb->reported_length, abs_offset - composite->start_offsets[i],
-				abs_length, &member_offset, &member_length, NULL)) {
-
-		/*
-		 * The range is, in fact, contiguous within member_tvb.
-		 */
-		DISSECTOR_ASSERT(!tvb->real_data);
-		return ensure_contiguous_no_exception(member_tvb, member_offset, member_length, NULL);
-	}
-	else {
-		tvb->real_data = tvb_memdup(tvb, 0, -1);
-		return tvb->real_data + abs_offset;
-	}
-
-	DISSECTOR_ASSERT_NOT_REACHED();
-	return NULL;
+	/*
+	 * The range spans members; flatten the composite once, after
+	 * which all accesses are served from the flat copy.
+	 */
+	tvb->real_data = tvb_memdup(tvb, 0, -1);
+	return tvb->real_data + abs_offset;
 }
 
 static const guint8*
@@ -980,62 +1022,39 @@ guint8_pbrk(const guint8* haystack, size_t haystacklen, const guint8 *needles, g
 
 /************** ACCESSORS **************/
 
-static void*
+static void
 composite_memcpy(tvbuff_t *tvb, guint8* target, guint abs_offset, size_t abs_length)
 {
-	guint		i, num_members;
+	gint		i;
 	tvb_comp_t	*composite;
-	tvbuff_t	*member_tvb = NULL;
+	tvbuff_t	*member_tvb;
 	guint		member_offset, member_length;
-	gboolean	retval;
-	GSList		*slist;
 
 	DISSECTOR_ASSERT(tvb->type == TVBUFF_COMPOSITE);
 
-	/* Maybe the range specified by offset/length
-	 * is contiguous inside one of the member tvbuffs */
 	composite = &tvb->tvbuffs.composite;
-	num_members = g_slist_length(composite->tvbs);
-
-	for (i = 0; i < num_members; i++) {
-		if (abs_offset <= composite->end_offsets[i]) {
-			slist = g_slist_nth(composite->tvbs, i);
-			member_tvb = slist->data;
-			break;
-		}
-	}
-	DISSECTOR_ASSERT(member_tvb);
-
-	if (check_offset_length_no_exception(member_tvb->length, member_tvb->reported_length, abs_offset - composite->start_offsets[i],
-				(gint) abs_length, &member_offset, &member_length, NULL)) {
+	i = composite_find_member(composite, abs_offset);
+	DISSECTOR_ASSERT(i >= 0 || abs_length == 0);
 
-		DISSECTOR_ASSERT(!tvb->real_data);
-		return tvb_memcpy(member_tvb, target, member_offset, member_length);
-	}
-	else {
-		/* The requested data is non-contiguous inside
-		 * the member tvb. We have to memcpy() the part that's in the member tvb,
-		 * then iterate across the other member tvb's, copying their portions
-		 * until we have copied all data.
-		 */
-		retval = compute_offset_length(member_tvb->length, member_tvb->reported_length, abs_offset - composite->start_offsets[i], -1,
-				&member_offset, &member_length, NULL);
-		DISSECTOR_ASSERT(retval);
+	/*
+	 * Copy the part that's in the first member, then walk the
+	 * following members, copying their portions until we have
+	 * copied all the data.
+	 */
+	while (abs_length > 0) {
+		DISSECTOR_ASSERT((guint) i < composite->num_members);
+		member_tvb = composite->members[i];
+		member_offset = abs_offset - composite->start_offsets[i];
+		member_length = member_tvb->length - member_offset;
+		if (member_length > abs_length)
+			member_length = (guint) abs_length;
 
 		tvb_memcpy(member_tvb, target, member_offset, member_length);
+		target		+= member_length;
 		abs_offset	+= member_length;
 		abs_length	-= member_length;
-
-		/* Recurse */
-		if (abs_length > 0) {
-			composite_memcpy(tvb, target + member_length, abs_offset, abs_length);
-		}
-
-		return target;
+		i++;
 	}
-
-	DISSECTOR_ASSERT_NOT_REACHED();
-	return NULL;
 }
 
 void*
@@ -1073,7 +1092,8 @@ tvb_memcpy(tvbuff_t *tvb, void* target, const gint offset, size_t length)
 					abs_length);
 
 		case TVBUFF_COMPOSITE:
-			return composite_memcpy(tvb, target, offset, length);
+			composite_memcpy(tvb, target, abs_offset, abs_length);
+			return target;
 	}
 
 	DISSECTOR_ASSERT_NOT_REACHED();
@@ -1783,6 +1803,44 @@ tvb_get_bits(tvbuff_t *tvb, const gint bit_offset, const gint no_of_bits, const
 	return tvb_get_bits8(tvb, bit_offset, no_of_bits);
 }
 
+/* Search the members of a composite in turn, from abs_offset for at most
+ * limit bytes, for needle or, if needles isn't NULL, for any of needles,
+ * without flattening the composite. */
+static gint
+composite_find_guint8(tvbuff_t *tvb, guint abs_offset, guint limit,
+		const guint8 needle, const guint8 *needles, guchar *found_needle)
+{
+	gint		i, result;
+	tvb_comp_t	*composite;
+	tvbuff_t	*member_tvb;
+	guint		member_offset, member_length;
+
+	composite = &tvb->tvbuffs.composite;
+	i = composite_find_member(composite, abs_offset);
+
+	while (limit > 0 && i >= 0 && (guint) i < composite->num_members) {
+		member_tvb = composite->members[i];
+		member_offset = abs_offset - composite->start_offsets[i];
+		member_length = member_tvb->length - member_offset;
+		if (member_length > limit)
+			member_length = limit;
+
+		if (needles != NULL)
+			result = tvb_pbrk_guint8(member_tvb, member_offset,
+					member_length, needles, found_needle);
+		else
+			result = tvb_find_guint8(member_tvb, member_offset,
+					member_length, needle);
+		if (result != -1)
+			return (gint) composite->start_offsets[i] + result;
+
+		abs_offset	+= member_length;
+		limit		-= member_length;
+		i++;
+	}
+	return -1;
+}
+
 /* Find first occurence of needle in tvbuff, starting at offset. Searches
  * at most maxlength number of bytes; if maxlength is -1, searches to
  * end of tvbuff.
@@ -1840,8 +1898,8 @@ tvb_find_guint8(tvbuff_t *tvb, const gint offset, const gint maxlength, const gu
 					limit, needle);
 
 		case TVBUFF_COMPOSITE:
-			DISSECTOR_ASSERT_NOT_REACHED();
-			/* XXX - return composite_find_guint8(tvb, offset, limit, needle); */
+			return composite_find_guint8(tvb, abs_offset, limit,
+					needle, NULL, NULL);
 	}
 
 	DISSECTOR_ASSERT_NOT_REACHED();
@@ -1905,8 +1963,8 @@ tvb_pbrk_guint8(tvbuff_t *tvb, const gint offset, const gint maxlength, const gu
 					limit, needles, found_needle);
 
 		case TVBUFF_COMPOSITE:
-			DISSECTOR_ASSERT_NOT_REACHED();
-			/* XXX - return composite_pbrk_guint8(tvb, offset, limit, needle); */
+			return composite_find_guint8(tvb, abs_offset, limit,
+					0, needles, found_needle);
 	}
 
 	DISSECTOR_ASSERT_NOT_REACHED();
@@ -71,6 +71,12 @@ typedef struct {
 typedef struct {
 	GSList		*tvbs;
 
+	/* The non-empty members in order, built by
+	 * tvb_composite_finalize() so that the member holding
+	 * a given offset can be found with a binary search. */
+	struct tvbuff	**members;
+	guint		num_members;
+
 	/* Used for quick testing to see if this
 	 * is the tvbuff that a COMPOSITE is
 	 * interested in. */
@@ -197,7 +203,8 @@ extern guint tvb_decrement_usage_count(tvbuff_t*, const guint count);
 extern void tvb_set_free_cb(tvbuff_t*, const tvbuff_free_cb_t);
 
 
-/** Attach a TVBUFF_REAL_DATA tvbuff to a parent tvbuff. This connection
+/** Attach a TVBUFF_REAL_DATA or a finalized TVBUFF_COMPOSITE tvbuff to a
+ * parent tvbuff. This connection
  * is used during a tvb_free_chain()... the "child" TVBUFF_REAL_DATA acts
  * as if is part of the chain-of-creation of the parent tvbuff, although it
  * isn't. This is useful if you need to take the data from some tvbuff,
@@ -248,7 +255,10 @@ extern tvbuff_t* tvb_new_subset_remaining(tvbuff_t* backing,
 
 /** Both tvb_composite_append and tvb_composite_prepend can throw
  * BoundsError if member_offset/member_length goes beyond bounds of
- * the 'member' tvbuff. */
+ * the 'member' tvbuff.
+ *
+ * The composite takes a reference on each member; the member is
+ * released when the composite is freed. */
 
 /** Append to the list of tvbuffs that make up this composite tvbuff */
 extern void tvb_composite_append(tvbuff_t* tvb, tvbuff_t* member);
@@ -261,7 +271,12 @@ extern void tvb_composite_prepend(tvbuff_t* tvb, tvbuff_t* member);
 extern tvbuff_t* tvb_new_composite(void);
 
 /** Mark a composite tvbuff as initialized. No further appends or prepends
- * occur, data access can finally happen after this finalization. */
+ * occur, data access can finally happen after this finalization.
+ *
+ * Accesses that fall within a single member are served from that member
+ * without copying; the first access that needs a contiguous pointer
+ * spanning several members flattens the composite into a private copy.
+ * A finalized composite is its own data source. */
 extern void tvb_composite_finalize(tvbuff_t* tvb);
 
 
@@ -1450,7 +1450,7 @@ cf_merge_files(char **out_filenamep, int in_file_count,
   gint64            progbar_quantum;
 
   /* open the input files */
-  if (!merge_open_in_files(in_file_count, in_filenames, &in_files,
+  if (!merge_open_in_files(in_file_count, in_filenames, &in_files, 0,
                            &open_err, &err_info, &err_fileno)) {
     g_free(in_files);
     cf_open_failure_alert_box(in_filenames[err_fileno], open_err, err_info,
@@ -1976,6 +1976,7 @@ rescan_packets(capture_file *cf, const char *action, const char *action_item,
        */
         fdata->col_text_len = se_alloc0(sizeof(fdata->col_text_len) * (cf->cinfo.num_cols));
         fdata->col_text = se_alloc0(sizeof(fdata->col_text) * (cf->cinfo.num_cols));
+        fdata->col_values = NULL;
     }
 
     if (!cf_read_frame(cf, fdata))
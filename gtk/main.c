@@ -2097,6 +2097,12 @@ main(int argc, char *argv[])
 
   static const char optstring[] = OPTSTRING;
 
+#ifdef G_THREADS_ENABLED
+  /* Before any other GLib call; name resolution uses threads */
+  if (!g_thread_supported())
+    g_thread_init(NULL);
+#endif
+
   /* Set the C-language locale to the native environment. */
   setlocale(LC_ALL, "");
 #ifdef _WIN32
@@ -2416,7 +2422,8 @@ main(int argc, char *argv[])
 #if !defined(_WIN32) && defined(G_THREADS_ENABLED) && defined USE_THREADS
   {
       GThread *ut;
-      g_thread_init(NULL);
+      if (!g_thread_supported())
+          g_thread_init(NULL);
       gdk_threads_init();
       ut=g_thread_create(update_thread, NULL, FALSE, NULL);
       g_thread_set_priority(ut, G_THREAD_PRIORITY_LOW);
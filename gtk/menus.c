@@ -2303,6 +2303,10 @@ name_resolution_cb(GtkWidget *w, gpointer d _U_, gint action)
     } else {
         g_resolv_flags &= ~action;
     }
+#ifdef NEW_PACKET_LIST
+    /* Address and port columns are formatted when drawn */
+    new_packet_list_queue_draw();
+#endif
 }
 
 #ifdef HAVE_LIBPCAP
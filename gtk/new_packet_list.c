@@ -1116,6 +1116,7 @@ show_cell_data_func(GtkTreeViewColumn *col _U_, GtkCellRenderer *renderer,
 	guint col_num = GPOINTER_TO_INT(data);
 	frame_data *fdata;
 	const gchar *cell_text;
+	gchar buf[COL_MAX_LEN];
 	PacketListRecord *record;
 
 	record = new_packet_list_get_record(model, iter);
@@ -1133,7 +1134,7 @@ show_cell_data_func(GtkTreeViewColumn *col _U_, GtkCellRenderer *renderer,
 		col_fill_in_frame_data(fdata, &cfile.cinfo, col_num, FALSE);
 		cell_text = cfile.cinfo.col_data[col_num];
 	}else
-		cell_text = fdata->col_text[col_num];
+		cell_text = col_get_text(fdata, &cfile.cinfo, col_num, buf);
 
 	g_assert(cell_text);
 
@@ -1361,12 +1362,13 @@ static gboolean
 get_col_text_from_record( PacketListRecord *record, gint col_num, gchar** cell_text)
 {
 	gint col_id = new_packet_list_get_column_id (col_num);
+	gchar buf[COL_MAX_LEN];
 
 	if (col_based_on_frame_data(&cfile.cinfo, col_id)) {
 		col_fill_in_frame_data(record->fdata, &cfile.cinfo, col_id, FALSE);
 		*cell_text = g_strdup(cfile.cinfo.col_data[col_id]);
 	}else
-		*cell_text = g_strdup(record->fdata->col_text[col_id]);
+		*cell_text = g_strdup(col_get_text(record->fdata, &cfile.cinfo, col_id, buf));
 
 	return TRUE;
 }
@@ -356,6 +356,7 @@ packet_list_get_value(GtkTreeModel *tree_model, GtkTreeIter *iter, gint column,
 	PacketListRecord *record;
 	PacketList *packet_list;
 	GType type;
+	gchar buf[COL_MAX_LEN];
 
 	g_return_if_fail(PACKETLIST_IS_LIST(tree_model));
 	g_return_if_fail(iter != NULL);
@@ -382,7 +383,7 @@ packet_list_get_value(GtkTreeModel *tree_model, GtkTreeIter *iter, gint column,
 			break;
 		case G_TYPE_STRING:
 			g_return_if_fail(record->fdata->col_text);
-			g_value_set_string(value, record->fdata->col_text[column]);
+			g_value_set_string(value, col_get_text(record->fdata, &cfile.cinfo, column, buf));
 			break;
 		default:
 			g_warning (G_STRLOC ": Unsupported type (%s) retrieved.", g_type_name (value->g_type));
@@ -684,6 +685,12 @@ packet_list_change_record(PacketList *packet_list, guint row, gint col, column_i
 		/* TODO: Column already contains a value. Bail out */
 		return;
 
+	if (col_keep_value(record->fdata, cinfo, col))
+		/* Addresses and ports are kept raw and only made into text
+		 * when drawn (see col_get_text()), so that they can follow
+		 * name resolution without a redissection. */
+		return;
+
 	switch (cfile.cinfo.col_fmt[col]) {
 		case COL_DEF_SRC:
 		case COL_RES_SRC:	/* COL_DEF_SRC is currently just like COL_RES_SRC */
@@ -972,21 +979,27 @@ static gint
 packet_list_compare_records(gint sort_id, PacketListRecord *a,
 				PacketListRecord *b)
 {
+	gchar buf_a[COL_MAX_LEN], buf_b[COL_MAX_LEN];
+	const gchar *text_a, *text_b;
+
 	if (col_based_on_frame_data(&cfile.cinfo, sort_id))
 		return frame_data_compare(a->fdata, b->fdata, cfile.cinfo.col_fmt[sort_id]);
 
 	g_assert(a->fdata->col_text);
 	g_assert(b->fdata->col_text);
-	g_assert(a->fdata->col_text[sort_id]);
-	g_assert(b->fdata->col_text[sort_id]);
 
-	if(a->fdata->col_text[sort_id] == b->fdata->col_text[sort_id])
+	text_a = col_get_text(a->fdata, &cfile.cinfo, sort_id, buf_a);
+	text_b = col_get_text(b->fdata, &cfile.cinfo, sort_id, buf_b);
+	g_assert(text_a);
+	g_assert(text_b);
+
+	if(text_a == text_b)
 		return 0; /* no need to call strcmp() */
 
 	if (cfile.cinfo.col_fmt[sort_id] == COL_CUSTOM) {
 		return packet_list_compare_custom (sort_id, a, b);
 	}
-	return strcmp(a->fdata->col_text[sort_id], b->fdata->col_text[sort_id]);
+	return strcmp(text_a, text_b);
 }
 
 static gint
@@ -1144,8 +1157,11 @@ packet_list_dissect_and_cache_record(PacketList *packet_list, PacketListRecord *
 		fdata->color_filter = color_filters_colorize_packet(&edt);
 
 	if (dissect_columns) {
-		/* "Stringify" non frame_data vals */
+		/* "Stringify" non frame_data vals; addresses and ports are
+		 * only made into text when drawn */
+		cinfo->text_on_demand = TRUE;
 		epan_dissect_fill_in_columns(&edt, FALSE, FALSE /* fill_fd_columns */);
+		cinfo->text_on_demand = FALSE;
 
 		for(col = 0; col < cinfo->num_cols; ++col) {
 			/* Skip columns based om frame_data because we already store those. */
@@ -1284,17 +1300,32 @@ packet_list_get_widest_column_string(PacketList *packet_list, gint col)
 		PacketListRecord *record;
 		guint vis_idx;
 
+		static gchar widest_value_str[COL_MAX_LEN];
 		gchar *widest_column_str = NULL;
 		guint widest_column_len = 0;
+		gchar buf[COL_MAX_LEN];
+		const gchar *text;
+		guint len;
 
 		if (!packet_list->columnized)
 			packet_list_dissect_and_cache_all(packet_list); /* XXX: need to handle case of "incomplete" ? */
 
 		for(vis_idx = 0; vis_idx < PACKET_LIST_RECORD_COUNT(packet_list->visible_rows); ++vis_idx) {
 			record = PACKET_LIST_RECORD_GET(packet_list->visible_rows, vis_idx);
-			if (record->fdata->col_text_len[col] > widest_column_len) {
-				widest_column_str = record->fdata->col_text[col];
-				widest_column_len = record->fdata->col_text_len[col];
+			if (record->fdata->col_values == NULL || record->fdata->col_values[col].type == COL_VAL_NONE) {
+				if (record->fdata->col_text_len[col] > widest_column_len) {
+					widest_column_str = record->fdata->col_text[col];
+					widest_column_len = record->fdata->col_text_len[col];
+				}
+				continue;
+			}
+			/* A raw value; its text only lives in buf */
+			text = col_get_text(record->fdata, &cfile.cinfo, col, buf);
+			len = (guint) strlen(text);
+			if (len > widest_column_len) {
+				g_strlcpy(widest_value_str, text, sizeof widest_value_str);
+				widest_column_str = widest_value_str;
+				widest_column_len = len;
 			}
 		}
 
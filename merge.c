@@ -28,46 +28,260 @@
 #include "wtap.h"
 #include "merge.h"
 
+/*
+ * Merge state that goes with an array of input files.  It's allocated
+ * in the same block, right after the last file, so that callers only
+ * have to free the array.
+ *
+ * "heap" is a binary min-heap of the files that have a packet read,
+ * ordered by the time stamp of that packet, so the next packet to
+ * write is found in O(log files) rather than by looking at every file.
+ *
+ * When the number of open files is limited, the files are opened once
+ * to find their first time stamp and closed again; "pending" is a
+ * second heap, of the closed files that have packets left, ordered by
+ * the time stamp of their next packet.  A file is only reopened when
+ * the merge gets to that packet and is closed again at its end, so
+ * files whose time ranges don't overlap, like the files of a ring
+ * buffer, are just copied one after the other with a single file open
+ * at a time.  If more than max_open files overlap in time, the open
+ * file whose packet comes last is closed to make room and is read
+ * again from its start up to that packet when the merge gets back to
+ * it; the bound holds, at the cost of the rereading.
+ */
+typedef struct merge_heap_s {
+  int   max_open;         /* 0 means no limit */
+  gboolean read_ahead;    /* files are read by threads of their own */
+  int   last;             /* file of the packet returned last, or -1 */
+  gboolean started;
+  int   heap_size;
+  int  *heap;             /* in_file_count entries */
+  int   pending_size;
+  int  *pending;          /* in_file_count entries */
+} merge_heap_t;
+
+#define MERGE_HEAP(count, files)  ((merge_heap_t *)(void *)&(files)[count])
+
+/*
+ * returns TRUE if first argument is earlier than second
+ */
+static gboolean
+is_earlier(struct wtap_nstime *l, struct wtap_nstime *r) {
+  if (l->secs > r->secs) {  /* left is later */
+    return FALSE;
+  } else if (l->secs < r->secs) { /* left is earlier */
+    return TRUE;
+  } else if (l->nsecs > r->nsecs) { /* tv_sec equal, l.usec later */
+    return FALSE;
+  }
+  /* either one < two or one == two
+   * either way, return one
+   */
+  return TRUE;
+}
+
+/*
+ * Open an input file and note what we need to know about it once it's
+ * closed again.
+ */
+static gboolean
+open_in_file(merge_in_file_t *file, gboolean read_ahead, int *err,
+             gchar **err_info)
+{
+  file->wth = wtap_open_offline(file->filename, err, err_info, FALSE);
+  if (!file->wth)
+    return FALSE;
+  if (read_ahead)
+    wtap_read_ahead(file->wth);
+  file->data_offset = 0;
+  file->file_type = wtap_file_type(file->wth);
+  file->frame_type = wtap_file_encap(file->wth);
+  file->snapshot_length = wtap_snapshot_length(file->wth);
+  return TRUE;
+}
+
+static void
+close_in_file(merge_in_file_t *file)
+{
+  if (file->wth) {
+    wtap_close(file->wth);
+    file->wth = NULL;
+  }
+}
+
+/*
+ * The time stamp of a file's next packet: the one read, while the file
+ * is open, or the one noted when it was closed
+ */
+static struct wtap_nstime *
+next_ts(merge_in_file_t *file)
+{
+  return file->wth ? &wtap_phdr(file->wth)->ts : &file->next_ts;
+}
+
+/*
+ * returns TRUE if the next packet of file a is to be written before
+ * the one of file b; of packets with the same time stamp, the one from
+ * the file given last goes first
+ */
+static gboolean
+heap_before(merge_in_file_t in_files[], int a, int b)
+{
+  struct wtap_nstime *ta = next_ts(&in_files[a]);
+  struct wtap_nstime *tb = next_ts(&in_files[b]);
+
+  if (ta->secs != tb->secs || ta->nsecs != tb->nsecs)
+    return is_earlier(ta, tb);
+  return a > b;
+}
+
+static void
+heap_sift_down(int *heap, int size, merge_in_file_t in_files[], int pos)
+{
+  int f = heap[pos];
+  int child;
+
+  for (;;) {
+    child = 2 * pos + 1;
+    if (child >= size)
+      break;
+    if (child + 1 < size &&
+        heap_before(in_files, heap[child + 1], heap[child]))
+      child++;
+    if (!heap_before(in_files, heap[child], f))
+      break;
+    heap[pos] = heap[child];
+    pos = child;
+  }
+  heap[pos] = f;
+}
+
+static void
+heap_sift_up(int *heap, merge_in_file_t in_files[], int pos)
+{
+  int f = heap[pos];
+  int parent;
+
+  while (pos > 0) {
+    parent = (pos - 1) / 2;
+    if (!heap_before(in_files, f, heap[parent]))
+      break;
+    heap[pos] = heap[parent];
+    pos = parent;
+  }
+  heap[pos] = f;
+}
+
+static void
+heap_push(int *heap, int *size, merge_in_file_t in_files[], int f)
+{
+  heap[*size] = f;
+  heap_sift_up(heap, in_files, (*size)++);
+}
+
+/* Take the file at pos out of a heap. */
+static void
+heap_remove(int *heap, int *size, merge_in_file_t in_files[], int pos)
+{
+  if (pos == --*size)
+    return;
+  heap[pos] = heap[*size];
+  heap_sift_down(heap, *size, in_files, pos);
+  heap_sift_up(heap, in_files, pos);
+}
+
 /*
  * Scan through the arguments and open the input files
  */
 gboolean
 merge_open_in_files(int in_file_count, char *const *in_file_names,
-                    merge_in_file_t **in_files, int *err, gchar **err_info,
-                    int *err_fileno)
+                    merge_in_file_t **in_files, int max_open, int *err,
+                    gchar **err_info, int *err_fileno)
 {
   int i, j;
   size_t files_size = in_file_count * sizeof(merge_in_file_t);
   merge_in_file_t *files;
+  merge_heap_t *mh;
   gint64 size;
+  gint64 data_offset;
 
-  files = (merge_in_file_t *)g_malloc(files_size);
+  files = (merge_in_file_t *)g_malloc(files_size + sizeof(merge_heap_t) +
+                                      2 * in_file_count * sizeof(int));
   *in_files = files;
 
+  mh = MERGE_HEAP(in_file_count, files);
+  mh->max_open = (max_open > 0 && max_open < in_file_count) ? max_open : 0;
+  mh->read_ahead = FALSE;
+  mh->last = -1;
+  mh->started = FALSE;
+  mh->heap_size = 0;
+  mh->heap = (int *)(void *)(mh + 1);
+  mh->pending_size = 0;
+  mh->pending = mh->heap + in_file_count;
+
   for (i = 0; i < in_file_count; i++) {
     files[i].filename    = in_file_names[i];
-    files[i].wth         = wtap_open_offline(in_file_names[i], err, err_info, FALSE);
     files[i].data_offset = 0;
+    files[i].packets_read = 0;
     files[i].state       = PACKET_NOT_PRESENT;
-    if (!files[i].wth) {
+    if (!open_in_file(&files[i], FALSE, err, err_info)) {
       /* Close the files we've already opened. */
       for (j = 0; j < i; j++)
-        wtap_close(files[j].wth);
+        close_in_file(&files[j]);
       *err_fileno = i;
       return FALSE;
     }
     size = wtap_file_size(files[i].wth, err);
     if (size == -1) {
       for (j = 0; j <= i; j++)
-        wtap_close(files[j].wth);
+        close_in_file(&files[j]);
       *err_fileno = i;
       return FALSE;
     }
     files[i].size = size;
+
+    if (mh->max_open) {
+      /*
+       * Note when the file starts and close it again; it's reopened
+       * when the merge gets there.
+       */
+      if (wtap_read(files[i].wth, err, err_info, &data_offset)) {
+        files[i].next_ts = wtap_phdr(files[i].wth)->ts;
+        close_in_file(&files[i]);
+        heap_push(mh->pending, &mh->pending_size, files, i);
+      } else if (*err != 0) {
+        for (j = 0; j <= i; j++)
+          close_in_file(&files[j]);
+        *err_fileno = i;
+        return FALSE;
+      } else {
+        files[i].state = AT_EOF;
+        close_in_file(&files[i]);
+      }
+    }
   }
+
   return TRUE;
 }
 
+/*
+ * Have the input files read and decoded by threads of their own, each
+ * some packets ahead of the merge; must be called before the first
+ * packet is read
+ */
+void
+merge_set_read_ahead(int count, merge_in_file_t in_files[])
+{
+  merge_heap_t *mh = MERGE_HEAP(count, in_files);
+  int i;
+
+  mh->read_ahead = TRUE;
+  for (i = 0; i < count; i++) {
+    if (in_files[i].wth != NULL)
+      wtap_read_ahead(in_files[i].wth);
+  }
+}
+
 /*
  * Scan through and close each input file
  */
@@ -76,7 +290,7 @@ merge_close_in_files(int count, merge_in_file_t in_files[])
 {
   int i;
   for (i = 0; i < count; i++) {
-    wtap_close(in_files[i].wth);
+    close_in_file(&in_files[i]);
   }
 }
 
@@ -94,10 +308,10 @@ merge_select_frame_type(int count, merge_in_file_t files[])
   int i;
   int selected_frame_type;
 
-  selected_frame_type = wtap_file_encap(files[0].wth);
+  selected_frame_type = files[0].frame_type;
 
   for (i = 1; i < count; i++) {
-    int this_frame_type = wtap_file_encap(files[i].wth);
+    int this_frame_type = files[i].frame_type;
     if (selected_frame_type != this_frame_type) {
       selected_frame_type = WTAP_ENCAP_PER_PACKET;
       break;
@@ -118,7 +332,7 @@ merge_max_snapshot_length(int count, merge_in_file_t in_files[])
   int snapshot_length;
 
   for (i = 0; i < count; i++) {
-    snapshot_length = wtap_snapshot_length(in_files[i].wth);
+    snapshot_length = in_files[i].snapshot_length;
     if (snapshot_length == 0) {
       /* Snapshot length of input file not known. */
       snapshot_length = WTAP_MAX_PACKET_SIZE;
@@ -130,23 +344,95 @@ merge_max_snapshot_length(int count, merge_in_file_t in_files[])
 }
 
 /*
- * returns TRUE if first argument is earlier than second
+ * Read the next packet of a file; returns FALSE on an error.  At the
+ * end of the file, it's taken out of the merge (and closed, if the
+ * number of open files is limited).
  */
 static gboolean
-is_earlier(struct wtap_nstime *l, struct wtap_nstime *r) {
-  if (l->secs > r->secs) {  /* left is later */
-    return FALSE;
-  } else if (l->secs < r->secs) { /* left is earlier */
-    return TRUE;
-  } else if (l->nsecs > r->nsecs) { /* tv_sec equal, l.usec later */
+read_in_file(merge_heap_t *mh, merge_in_file_t in_files[], int i, int *err,
+             gchar **err_info)
+{
+  if (in_files[i].wth == NULL &&
+      !open_in_file(&in_files[i], mh->read_ahead, err, err_info)) {
+    in_files[i].state = GOT_ERROR;
     return FALSE;
   }
-  /* either one < two or one == two
-   * either way, return one
-   */
+  if (!wtap_read(in_files[i].wth, err, err_info, &in_files[i].data_offset)) {
+    if (*err != 0) {
+      in_files[i].state = GOT_ERROR;
+      return FALSE;
+    }
+    in_files[i].state = AT_EOF;
+    if (mh->max_open)
+      close_in_file(&in_files[i]);
+  } else {
+    in_files[i].state = PACKET_PRESENT;
+    in_files[i].packets_read++;
+  }
   return TRUE;
 }
 
+/*
+ * Reopen a file that was closed to make room for others and read it
+ * again up to the packet it had read then, skipping the data of the
+ * packets before that one where wiretap can.
+ */
+static gboolean
+reopen_in_file(merge_heap_t *mh, merge_in_file_t *file, int *err,
+               gchar **err_info)
+{
+  gint64 data_offset = file->data_offset;
+  guint64 n;
+
+  if (!open_in_file(file, mh->read_ahead, err, err_info)) {
+    file->state = GOT_ERROR;
+    return FALSE;
+  }
+  for (n = 1; n < file->packets_read; n++) {
+    if (!wtap_read_header(file->wth, err, err_info, &file->data_offset))
+      goto failed;
+  }
+  if (!wtap_read(file->wth, err, err_info, &file->data_offset))
+    goto failed;
+  if (file->data_offset == data_offset) {
+    file->state = PACKET_PRESENT;
+    return TRUE;
+  }
+  *err = 0;
+
+failed:
+  if (*err == 0) {
+    /* EOF, or another packet where the one we had was */
+    *err = WTAP_ERR_BAD_RECORD;
+    *err_info = g_strdup_printf("merge: %s changed while it was closed",
+                                file->filename);
+  }
+  file->state = GOT_ERROR;
+  return FALSE;
+}
+
+/*
+ * Make room for another open file by closing the open one whose packet
+ * is to be written last; it goes back on the pending heap.
+ */
+static void
+park_latest_file(merge_heap_t *mh, merge_in_file_t in_files[])
+{
+  int pos, latest = 0;
+  int f;
+
+  for (pos = 1; pos < mh->heap_size; pos++) {
+    if (heap_before(in_files, mh->heap[latest], mh->heap[pos]))
+      latest = pos;
+  }
+  f = mh->heap[latest];
+  heap_remove(mh->heap, &mh->heap_size, in_files, latest);
+  in_files[f].next_ts = wtap_phdr(in_files[f].wth)->ts;
+  close_in_file(&in_files[f]);
+  in_files[f].state = PACKET_NOT_PRESENT;
+  heap_push(mh->pending, &mh->pending_size, in_files, f);
+}
+
 /*
  * Read the next packet, in chronological order, from the set of files
  * to be merged.
@@ -155,52 +441,70 @@ wtap *
 merge_read_packet(int in_file_count, merge_in_file_t in_files[], int *err,
                   gchar **err_info)
 {
-  int i;
-  int ei = -1;
-  struct wtap_nstime tv = { sizeof(time_t) > sizeof(int) ? LONG_MAX : INT_MAX, INT_MAX };
-  struct wtap_pkthdr *phdr;
+  merge_heap_t *mh = MERGE_HEAP(in_file_count, in_files);
+  int i, p;
+
+  if (!mh->started) {
+    /* Read the first packet of every file that's open. */
+    mh->started = TRUE;
+    for (i = 0; i < in_file_count; i++) {
+      if (in_files[i].state != PACKET_NOT_PRESENT || in_files[i].wth == NULL)
+        continue;
+      if (!read_in_file(mh, in_files, i, err, err_info))
+        return NULL;
+      if (in_files[i].state == PACKET_PRESENT)
+        heap_push(mh->heap, &mh->heap_size, in_files, i);
+    }
+  } else if (mh->last != -1) {
+    /*
+     * Replace the packet we returned last with the next one from the
+     * same file; it's still at the top of the heap.
+     */
+    i = mh->last;
+    mh->last = -1;
+    if (!read_in_file(mh, in_files, i, err, err_info))
+      return NULL;
+    if (in_files[i].state != PACKET_PRESENT)
+      heap_remove(mh->heap, &mh->heap_size, in_files, 0);
+    else
+      heap_sift_down(mh->heap, mh->heap_size, in_files, 0);
+  }
 
   /*
-   * Make sure we have a packet available from each file, if there are any
-   * packets left in the file in question, and search for the packet
-   * with the earliest time stamp.
+   * Bring in the closed files whose next packet goes before the
+   * earliest one we have, closing others if that many are open.  A
+   * file closed for that has its packet after the one brought in, so
+   * it isn't brought straight back.
    */
-  for (i = 0; i < in_file_count; i++) {
-    if (in_files[i].state == PACKET_NOT_PRESENT) {
-      /*
-       * No packet available, and we haven't seen an error or EOF yet,
-       * so try to read the next packet.
-       */
-      if (!wtap_read(in_files[i].wth, err, err_info, &in_files[i].data_offset)) {
-        if (*err != 0) {
-          in_files[i].state = GOT_ERROR;
-          return NULL;
-        }
-        in_files[i].state = AT_EOF;
-      } else
-        in_files[i].state = PACKET_PRESENT;
-    }
-    
-    if (in_files[i].state == PACKET_PRESENT) {
-      phdr = wtap_phdr(in_files[i].wth);
-      if (is_earlier(&phdr->ts, &tv)) {
-        tv = phdr->ts;
-        ei = i;
-      }
-    }
+  while (mh->pending_size > 0) {
+    p = mh->pending[0];
+    if (mh->heap_size > 0 && !heap_before(in_files, p, mh->heap[0]))
+      break;
+    heap_remove(mh->pending, &mh->pending_size, in_files, 0);
+    if (mh->heap_size >= mh->max_open)
+      park_latest_file(mh, in_files);
+    if (in_files[p].packets_read == 0) {
+      if (!read_in_file(mh, in_files, p, err, err_info))
+        return NULL;
+    } else if (!reopen_in_file(mh, &in_files[p], err, err_info))
+      return NULL;
+    if (in_files[p].state == PACKET_PRESENT)
+      heap_push(mh->heap, &mh->heap_size, in_files, p);
   }
 
-  if (ei == -1) {
+  if (mh->heap_size == 0) {
     /* All the streams are at EOF.  Return an EOF indication. */
     *err = 0;
     return NULL;
   }
 
   /* We'll need to read another packet from this file. */
-  in_files[ei].state = PACKET_NOT_PRESENT;
+  i = mh->heap[0];
+  in_files[i].state = PACKET_NOT_PRESENT;
+  mh->last = i;
 
   /* Return a pointer to the wtap structure for the file with that frame. */
-  return in_files[ei].wth;
+  return in_files[i].wth;
 }
 
 /*
@@ -211,6 +515,7 @@ wtap *
 merge_append_read_packet(int in_file_count, merge_in_file_t in_files[],
                          int *err, gchar **err_info)
 {
+  merge_heap_t *mh = MERGE_HEAP(in_file_count, in_files);
   int i;
 
   /*
@@ -219,15 +524,11 @@ merge_append_read_packet(int in_file_count, merge_in_file_t in_files[],
   for (i = 0; i < in_file_count; i++) {
     if (in_files[i].state == AT_EOF)
       continue; /* This file is already at EOF */
-    if (wtap_read(in_files[i].wth, err, err_info, &in_files[i].data_offset))
+    if (!read_in_file(mh, in_files, i, err, err_info))
+      return NULL; /* Read error - quit immediately. */
+    if (in_files[i].state == PACKET_PRESENT)
       break; /* We have a packet */
-    if (*err != 0) {
-      /* Read error - quit immediately. */
-      in_files[i].state = GOT_ERROR;
-      return NULL;
-    }
-    /* EOF - flag this file as being at EOF, and try the next one. */
-    in_files[i].state = AT_EOF;
+    /* EOF - try the next one. */
   }
   if (i == in_file_count) {
     /* All the streams are at EOF.  Return an EOF indication. */
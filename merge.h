@@ -41,17 +41,33 @@ typedef enum {
  */
 typedef struct merge_in_file_s {
   const char     *filename;
-  wtap           *wth;
+  wtap           *wth;		/* NULL while the file is closed */
   gint64          data_offset;
   in_file_state_e state;
   gint64          size;		/* file size */
+  int             file_type;
+  int             frame_type;
+  int             snapshot_length;
+  guint64         packets_read;	/* to find the place again after a reopen */
+  struct wtap_nstime next_ts;	/* time stamp of the next packet while the
+				   file is closed; only set if the open
+				   files are limited */
 } merge_in_file_t;
 
 /** Open a number of input files to merge.
+ *
+ * If max_open is less than in_file_count, each file is only opened to
+ * find the time stamp of its first packet and is closed again; while
+ * merging, no more than max_open files are open at a time.  A file is
+ * opened when the merge gets to its first packet and closed after its
+ * last one; if more than max_open files overlap in time, files are
+ * closed to make room and later read again from their start up to the
+ * packet they had got to, which is slow.
  * 
  * @param in_file_count number of entries in in_file_names and in_files
  * @param in_file_names filenames of the input files
- * @param in_files input file array to be filled (>= sizeof(merge_in_file_t) * in_file_count)
+ * @param in_files input file array to be allocated and filled; free it with g_free()
+ * @param max_open maximum number of files to keep open, 0 for no limit
  * @param err wiretap error, if failed
  * @param err_info wiretap error string, if failed
  * @param err_fileno file on which open failed, if failed
@@ -59,8 +75,19 @@ typedef struct merge_in_file_s {
  */
 extern gboolean
 merge_open_in_files(int in_file_count, char *const *in_file_names,
-                    merge_in_file_t **in_files, int *err, gchar **err_info,
-                    int *err_fileno);
+                    merge_in_file_t **in_files, int max_open, int *err,
+                    gchar **err_info, int *err_fileno);
+
+/** Read each input file on a thread of its own, some packets ahead of
+ * the merge, so that files are decompressed in parallel.  Every open
+ * file takes a thread and about a megabyte of buffers.  Call it before
+ * reading the first packet.
+ * 
+ * @param in_file_count number of entries in in_files
+ * @param in_files input file array
+ */
+extern void
+merge_set_read_ahead(int in_file_count, merge_in_file_t in_files[]);
 
 /** Close the input files again.
  * 
@@ -41,6 +41,12 @@
 #include <fcntl.h>
 #endif
 
+/*
+ * Read ahead on every input file if no more than this many are open at
+ * a time; each of them then has a thread and some buffers of its own.
+ */
+#define MAX_READ_AHEAD_FILES 64
+
 static int
 get_natural_int(const char *string, const char *name)
 {
@@ -110,6 +116,10 @@ usage(void)
   fprintf(stderr, "                    default is the same as the first input file.\n");
   fprintf(stderr, "                    an empty \"-T\" option will list the encapsulation types.\n");
   fprintf(stderr, "\n");
+  fprintf(stderr, "Input:\n");
+  fprintf(stderr, "  -m <max open>     keep no more than <max open> input files open at a time;\n");
+  fprintf(stderr, "                    files that overlap in time are reread to get back.\n");
+  fprintf(stderr, "\n");
   fprintf(stderr, "Miscellaneous:\n");
   fprintf(stderr, "  -h                display this help and exit.\n");
   fprintf(stderr, "  -v                verbose output.\n");
@@ -147,6 +157,7 @@ main(int argc, char *argv[])
   gboolean     verbose       = FALSE;
   int          in_file_count = 0;
   guint        snaplen = 0;
+  int          max_open = 0;
   int          file_type = WTAP_FILE_PCAP;	/* default to libpcap format */
   int          frame_type = -2;
   int          out_fd;
@@ -162,8 +173,14 @@ main(int argc, char *argv[])
   gboolean     got_read_error = FALSE, got_write_error = FALSE;
   int          count;
 
+#ifdef G_THREADS_ENABLED
+  /* Before any other GLib call; wiretap reads and writes in threads */
+  if (!g_thread_supported())
+    g_thread_init(NULL);
+#endif
+
   /* Process the options first */
-  while ((opt = getopt(argc, argv, "hvas:T:F:w:")) != -1) {
+  while ((opt = getopt(argc, argv, "hvam:s:T:F:w:")) != -1) {
 
     switch (opt) {
     case 'w':
@@ -198,6 +215,10 @@ main(int argc, char *argv[])
       verbose = TRUE;
       break;
 
+    case 'm':
+      max_open = get_positive_int(optarg, "maximum number of open files");
+      break;
+
     case 's':
       snaplen = get_positive_int(optarg, "snapshot length");
       break;
@@ -240,7 +261,7 @@ main(int argc, char *argv[])
   }
 
   /* open the input files */
-  if (!merge_open_in_files(in_file_count, &argv[optind], &in_files,
+  if (!merge_open_in_files(in_file_count, &argv[optind], &in_files, max_open,
                            &open_err, &err_info, &err_fileno)) {
     fprintf(stderr, "mergecap: Can't open %s: %s\n", argv[optind + err_fileno],
         wtap_strerror(open_err));
@@ -256,10 +277,13 @@ main(int argc, char *argv[])
     return 2;
   }
 
+  if ((max_open != 0 ? max_open : in_file_count) <= MAX_READ_AHEAD_FILES)
+    merge_set_read_ahead(in_file_count, in_files);
+
   if (verbose) {
     for (i = 0; i < in_file_count; i++)
       fprintf(stderr, "mergecap: %s is type %s.\n", argv[optind + i],
-              wtap_file_type_string(wtap_file_type(in_files[i].wth)));
+              wtap_file_type_string(in_files[i].file_type));
   }
 
   if (snaplen == 0) {
@@ -283,9 +307,9 @@ main(int argc, char *argv[])
          */
         int first_frame_type, this_frame_type;
 
-        first_frame_type = wtap_file_encap(in_files[0].wth);
+        first_frame_type = in_files[0].frame_type;
         for (i = 1; i < in_file_count; i++) {
-          this_frame_type = wtap_file_encap(in_files[i].wth);
+          this_frame_type = in_files[i].frame_type;
           if (first_frame_type != this_frame_type) {
             fprintf(stderr, "mergecap: multiple frame encapsulation types detected\n");
             fprintf(stderr, "          defaulting to WTAP_ENCAP_PER_PACKET\n");
@@ -331,6 +355,9 @@ main(int argc, char *argv[])
     exit(1);
   }
 
+  /* write the file on a thread of its own */
+  wtap_dump_write_behind(pdh, 0);
+
   /* do the merge (or append) */
   count = 1;
   for (;;) {
@@ -184,7 +184,7 @@ struct option {
 			}                                                                  \
 			return FALSE;                                                      \
 		}                                                                          \
-		written_length += (long)nwritten;                                          \
+		written_length += (gint64)nwritten;                                         \
 	} while (0);                                                                       \
 }
 
@@ -205,7 +205,7 @@ libpcap_fdopen(int fd, int *err)
    Returns TRUE on success, FALSE on failure.
    Sets "*err" to an error code, or 0 for a short write, on failure*/
 gboolean
-libpcap_write_file_header(FILE *fp, int linktype, int snaplen, long *bytes_written, int *err)
+libpcap_write_file_header(FILE *fp, int linktype, int snaplen, gint64 *bytes_written, int *err)
 {
 	struct pcap_hdr file_hdr;
 	size_t nwritten;
@@ -235,7 +235,7 @@ libpcap_write_file_header(FILE *fp, int linktype, int snaplen, long *bytes_writt
    Returns TRUE on success, FALSE on failure. */
 gboolean
 libpcap_write_packet(FILE *fp, const struct pcap_pkthdr *phdr, const u_char *pd,
-    long *bytes_written, int *err)
+    gint64 *bytes_written, int *err)
 {
 	struct pcaprec_hdr rec_hdr;
 	size_t nwritten;
@@ -266,10 +266,29 @@ libpcap_write_packet(FILE *fp, const struct pcap_pkthdr *phdr, const u_char *pd,
 	return TRUE;
 }
 
+size_t
+libpcap_packet_length(const struct pcap_pkthdr *phdr)
+{
+	return sizeof(struct pcaprec_hdr) + phdr->caplen;
+}
+
+void
+libpcap_format_packet(guint8 *buf, const struct pcap_pkthdr *phdr, const u_char *pd)
+{
+	struct pcaprec_hdr rec_hdr;
+
+	rec_hdr.ts_sec = phdr->ts.tv_sec;
+	rec_hdr.ts_usec = phdr->ts.tv_usec;
+	rec_hdr.incl_len = phdr->caplen;
+	rec_hdr.orig_len = phdr->len;
+	memcpy(buf, &rec_hdr, sizeof rec_hdr);
+	memcpy(buf + sizeof rec_hdr, pd, phdr->caplen);
+}
+
 gboolean
 libpcap_write_session_header_block(FILE *fp,
                                    char *appname,
-                                   long *bytes_written,
+                                   gint64 *bytes_written,
                                    int *err)
 {
 	struct shb shb;
@@ -317,7 +336,7 @@ libpcap_write_interface_description_block(FILE *fp,
                                           char *filter,
                                           int link_type,
                                           int snap_len,
-                                          long *bytes_written,
+                                          gint64 *bytes_written,
                                           int *err)
 {
 	struct idb idb;
@@ -384,7 +403,7 @@ libpcap_write_enhanced_packet_block(FILE *fp,
                                     const struct pcap_pkthdr *phdr,
                                     guint32 interface_id,
                                     const u_char *pd,
-                                    long *bytes_written,
+                                    gint64 *bytes_written,
                                     int *err)
 {
 	struct epb epb;
@@ -413,11 +432,50 @@ libpcap_write_enhanced_packet_block(FILE *fp,
 	return TRUE;
 }
 
+size_t
+libpcap_enhanced_packet_block_length(const struct pcap_pkthdr *phdr)
+{
+	return sizeof(struct epb) + ADD_PADDING(phdr->caplen) + sizeof(guint32);
+}
+
+void
+libpcap_format_enhanced_packet_block(guint8 *buf,
+                                     const struct pcap_pkthdr *phdr,
+                                     guint32 interface_id,
+                                     const u_char *pd)
+{
+	struct epb epb;
+	guint32 block_total_length;
+	guint64 timestamp;
+	guint8 *p;
+
+	block_total_length = (guint32)libpcap_enhanced_packet_block_length(phdr);
+	timestamp = (guint64)(phdr->ts.tv_sec) * 1000000 +
+	            (guint64)(phdr->ts.tv_usec);
+	epb.block_type = ENHANCED_PACKET_BLOCK_TYPE;
+	epb.block_total_length = block_total_length;
+	epb.interface_id = interface_id;
+	epb.timestamp_high = (guint32)((timestamp>>32) & 0xffffffff);
+	epb.timestamp_low = (guint32)(timestamp & 0xffffffff);
+	epb.captured_len = phdr->caplen;
+	epb.packet_len = phdr->len;
+	p = buf;
+	memcpy(p, &epb, sizeof(struct epb));
+	p += sizeof(struct epb);
+	memcpy(p, pd, phdr->caplen);
+	p += phdr->caplen;
+	if (phdr->caplen % 4) {
+		memset(p, 0, 4 - phdr->caplen % 4);
+		p += 4 - phdr->caplen % 4;
+	}
+	memcpy(p, &block_total_length, sizeof(guint32));
+}
+
 gboolean
 libpcap_write_interface_statistics_block(FILE *fp,
                                          guint32 interface_id,
                                          pcap_t *pd,
-                                         long *bytes_written,
+                                         gint64 *bytes_written,
                                          int *err)
 {
 	struct isb isb;
@@ -33,18 +33,27 @@ libpcap_fdopen(int fd, int *err);
    Returns TRUE on success, FALSE on failure.
    Sets "*err" to an error code, or 0 for a short write, on failure*/
 extern gboolean
-libpcap_write_file_header(FILE *fp, int linktype, int snaplen, long *bytes_written, int *err);
+libpcap_write_file_header(FILE *fp, int linktype, int snaplen, gint64 *bytes_written, int *err);
 
 /* Write a record for a packet to a dump file.
    Returns TRUE on success, FALSE on failure. */
 extern gboolean
 libpcap_write_packet(FILE *fp, const struct pcap_pkthdr *phdr, const u_char *pd,
-    long *bytes_written, int *err);
+    gint64 *bytes_written, int *err);
+
+/* Length of the record libpcap_write_packet() writes for a packet. */
+extern size_t
+libpcap_packet_length(const struct pcap_pkthdr *phdr);
+
+/* Put that record into "buf", which must have room for
+   libpcap_packet_length() bytes. */
+extern void
+libpcap_format_packet(guint8 *buf, const struct pcap_pkthdr *phdr, const u_char *pd);
 
 extern gboolean
 libpcap_write_session_header_block(FILE *fp,
                                    char *appname,
-                                   long *bytes_written,
+                                   gint64 *bytes_written,
                                    int *err);
 
 extern gboolean
@@ -53,14 +62,14 @@ libpcap_write_interface_description_block(FILE *fp,
                                           char *filter,
                                           int link_type,
                                           int snap_len,
-                                          long *bytes_written,
+                                          gint64 *bytes_written,
                                           int *err);
 
 extern gboolean
 libpcap_write_interface_statistics_block(FILE *fp,
                                          guint32 interface_id,
                                          pcap_t *pd,
-                                         long *bytes_written,
+                                         gint64 *bytes_written,
                                          int *err);
 
 extern gboolean
@@ -68,9 +77,19 @@ libpcap_write_enhanced_packet_block(FILE *fp,
                                     const struct pcap_pkthdr *phdr,
                                     guint32 interface_id,
                                     const u_char *pd,
-                                    long *bytes_written,
+                                    gint64 *bytes_written,
                                     int *err);
 
+/* The same for libpcap_write_enhanced_packet_block(). */
+extern size_t
+libpcap_enhanced_packet_block_length(const struct pcap_pkthdr *phdr);
+
+extern void
+libpcap_format_enhanced_packet_block(guint8 *buf,
+                                     const struct pcap_pkthdr *phdr,
+                                     guint32 interface_id,
+                                     const u_char *pd);
+
 extern gboolean
 libpcap_dump_flush(FILE *pd, int *err);
 
@@ -29,6 +29,7 @@
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <epan/epan.h>
@@ -36,6 +37,7 @@
 #include <epan/tvbuff.h>
 #include <epan/packet.h>
 #include <epan/emem.h>
+#include <epan/ipv4.h>
 
 #include "packet-range.h"
 #include "print.h"
@@ -72,6 +74,14 @@ typedef struct {
 	epan_dissect_t		*edt;
 } write_field_data_t;
 
+/* One column of a -T columnar record batch */
+typedef struct {
+    guint8 type;            /* COLUMNAR_TYPE_xxx */
+    GByteArray* validity;   /* one bit per row, set if the row has a value */
+    GByteArray* offsets;    /* rows + 1 32-bit offsets into data, variable width types only */
+    GByteArray* data;
+} columnar_column_t;
+
 struct _output_fields {
     gboolean print_header;
     gchar separator;
@@ -81,6 +91,12 @@ struct _output_fields {
     GHashTable* field_indicies;
     emem_strbuf_t** field_values;
     gchar quote;
+    gint* field_hfids;      /* first hfid registered under each field name, or -1 */
+    gboolean primed;        /* output_fields_prime_edt() was called for this packet */
+    GString* field_value;   /* reused to build each field's value */
+    guint batch_rows;       /* rows per -T columnar record batch */
+    guint rows;             /* rows in the current record batch */
+    columnar_column_t* columns;
 };
 
 static gboolean write_headers = FALSE;
@@ -94,12 +110,150 @@ static gboolean print_hex_data_buffer(print_stream_t *stream, const guchar *cp,
     guint length, packet_char_enc encoding);
 static void ps_clean_string(unsigned char *out, const unsigned char *in,
 			int outbuf_size);
-static void print_escaped_xml(FILE *fh, const char *unescaped_string);
+static void print_escaped_xml(const char *unescaped_string);
 
-static void print_pdml_geninfo(proto_tree *tree, FILE *fh);
+static void print_pdml_geninfo(proto_tree *tree);
 
 static void proto_tree_get_node_field_values(proto_node *node, gpointer data);
 
+/*
+ * Output buffer for the PDML, PSML, CSV and fields writers.  They append
+ * to it, and it is handed to stdio with one fwrite() per packet instead
+ * of one call per character or attribute.
+ */
+#define OUT_BUF_SIZE	65536
+
+static struct {
+	FILE	*fh;
+	gsize	len;
+	gchar	buf[OUT_BUF_SIZE];
+} out;
+
+static void
+out_begin(FILE *fh)
+{
+	out.fh = fh;
+	out.len = 0;
+}
+
+static void
+out_flush(void)
+{
+	if (out.len != 0)
+		fwrite(out.buf, 1, out.len, out.fh);
+	out.len = 0;
+}
+
+static void
+out_end(void)
+{
+	out_flush();
+	out.fh = NULL;
+}
+
+static void
+out_write(const gchar *p, gsize n)
+{
+	if (out.len + n > OUT_BUF_SIZE) {
+		out_flush();
+		if (n > OUT_BUF_SIZE) {
+			fwrite(p, 1, n, out.fh);
+			return;
+		}
+	}
+	memcpy(&out.buf[out.len], p, n);
+	out.len += n;
+}
+
+static void
+out_putc(gchar c)
+{
+	if (out.len == OUT_BUF_SIZE)
+		out_flush();
+	out.buf[out.len++] = c;
+}
+
+static void
+out_puts(const gchar *str)
+{
+	out_write(str, strlen(str));
+}
+
+/* Same as "%u" */
+static void
+out_uint(guint32 val)
+{
+	gchar digits[10];
+	int i = sizeof digits;
+
+	do {
+		digits[--i] = '0' + val % 10;
+		val /= 10;
+	} while (val != 0);
+	out_write(&digits[i], sizeof digits - i);
+}
+
+/* Same as "%d" */
+static void
+out_int(gint32 val)
+{
+	if (val < 0) {
+		out_putc('-');
+		out_uint(0U - (guint32)val);
+	} else
+		out_uint(val);
+}
+
+/* Same as "%0<width>u" */
+static void
+out_uint_padded(guint32 val, int width)
+{
+	gchar digits[10];
+	int i = sizeof digits;
+
+	do {
+		digits[--i] = '0' + val % 10;
+		val /= 10;
+	} while (val != 0);
+	while (i > 0 && (int)sizeof digits - i < width)
+		digits[--i] = '0';
+	out_write(&digits[i], sizeof digits - i);
+}
+
+/* Same as "%x", or "%X" if upper is TRUE */
+static void
+out_hex(guint32 val, gboolean upper)
+{
+	const gchar *hex = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+	gchar digits[8];
+	int i = sizeof digits;
+
+	do {
+		digits[--i] = hex[val & 0xf];
+		val >>= 4;
+	} while (val != 0);
+	out_write(&digits[i], sizeof digits - i);
+}
+
+/* Same as "%02x" for every byte */
+static void
+out_hex_bytes(const guint8 *pd, int length)
+{
+	static const gchar hex[] = "0123456789abcdef";
+	gchar chunk[256];
+	int i, n = 0;
+
+	for (i = 0; i < length; i++) {
+		chunk[n++] = hex[pd[i] >> 4];
+		chunk[n++] = hex[pd[i] & 0xf];
+		if (n == sizeof chunk) {
+			out_write(chunk, n);
+			n = 0;
+		}
+	}
+	out_write(chunk, n);
+}
+
 static FILE *
 open_print_dest(int to_file, const char *dest)
 {
@@ -249,15 +403,17 @@ proto_tree_write_pdml(epan_dissect_t *edt, FILE *fh)
 	 * created a visible protocol tree */
 	g_assert(data.src_list);
 
-	fprintf(fh, "<packet>\n");
+	out_begin(fh);
+	out_puts("<packet>\n");
 
 	/* Print a "geninfo" protocol as required by PDML */
-	print_pdml_geninfo(edt->tree, fh);
+	print_pdml_geninfo(edt->tree);
 
 	proto_tree_children_foreach(edt->tree, proto_tree_write_node_pdml,
 	    &data);
 
-	fprintf(fh, "</packet>\n\n");
+	out_puts("</packet>\n\n");
+	out_end();
 }
 
 /* Write out a tree's data, and any child nodes, as PDML */
@@ -284,17 +440,17 @@ proto_tree_write_node_pdml(proto_node *node, gpointer data)
 
 	/* Indent to the correct level */
 	for (i = -1; i < pdata->level; i++) {
-		fputs("  ", pdata->fh);
+		out_puts("  ");
 	}
 
 	if (wrap_in_fake_protocol) {
 		/* Open fake protocol wrapper */
-		fputs("<proto name=\"fake-field-wrapper\">\n", pdata->fh);
+		out_puts("<proto name=\"fake-field-wrapper\">\n");
 
 		/* Indent to increased level before writing out field */
 		pdata->level++;
 		for (i = -1; i < pdata->level; i++) {
-			fputs("  ", pdata->fh);
+			out_puts("  ");
 		}
 	}
 
@@ -309,21 +465,23 @@ proto_tree_write_node_pdml(proto_node *node, gpointer data)
 		}
 
 		/* Show empty name since it is a required field */
-		fputs("<field name=\"", pdata->fh);
-		fputs("\" show=\"", pdata->fh);
-		print_escaped_xml(pdata->fh, label_ptr);
+		out_puts("<field name=\"");
+		out_puts("\" show=\"");
+		print_escaped_xml(label_ptr);
 
-		fprintf(pdata->fh, "\" size=\"%d", fi->length);
-		fprintf(pdata->fh, "\" pos=\"%d", fi->start);
+		out_puts("\" size=\"");
+		out_int(fi->length);
+		out_puts("\" pos=\"");
+		out_int(fi->start);
 
-		fputs("\" value=\"", pdata->fh);
+		out_puts("\" value=\"");
 		write_pdml_field_hex_value(pdata, fi);
 
 		if (node->first_child != NULL) {
-			fputs("\">\n", pdata->fh);
+			out_puts("\">\n");
 		}
 		else {
-			fputs("\"/>\n", pdata->fh);
+			out_puts("\"/>\n");
 		}
 	}
 
@@ -332,19 +490,19 @@ proto_tree_write_node_pdml(proto_node *node, gpointer data)
 	else if (fi->hfinfo->id == proto_data) {
 
 		/* Write out field with data */
-		fputs("<field name=\"data\" value=\"", pdata->fh);
+		out_puts("<field name=\"data\" value=\"");
 		write_pdml_field_hex_value(pdata, fi);
-		fputs("\">\n", pdata->fh);
+		out_puts("\">\n");
 	}
 	/* Normal protocols and fields */
 	else {
 		if (fi->hfinfo->type == FT_PROTOCOL) {
-			fputs("<proto name=\"", pdata->fh);
+			out_puts("<proto name=\"");
 		}
 		else {
-			fputs("<field name=\"", pdata->fh);
+			out_puts("<field name=\"");
 		}
-		print_escaped_xml(pdata->fh, fi->hfinfo->abbrev);
+		print_escaped_xml(fi->hfinfo->abbrev);
 
 #if 0
 	/* PDML spec, see:
@@ -360,27 +518,29 @@ proto_tree_write_node_pdml(proto_node *node, gpointer data)
 	 * (like it's contained in the fi->rep->representation).
 	 * Unfortunately, we don't have the field data representation for
 	 * all fields, so this isn't currently possible */
-		fputs("\" showname=\"", pdata->fh);
-		print_escaped_xml(pdata->fh, fi->hfinfo->name);
+		out_puts("\" showname=\"");
+		print_escaped_xml(fi->hfinfo->name);
 #endif
 
 		if (fi->rep) {
-			fputs("\" showname=\"", pdata->fh);
-			print_escaped_xml(pdata->fh, fi->rep->representation);
+			out_puts("\" showname=\"");
+			print_escaped_xml(fi->rep->representation);
 		}
 		else {
 			label_ptr = label_str;
 			proto_item_fill_label(fi, label_str);
-			fputs("\" showname=\"", pdata->fh);
-			print_escaped_xml(pdata->fh, label_ptr);
+			out_puts("\" showname=\"");
+			print_escaped_xml(label_ptr);
 		}
 
 		if (PROTO_ITEM_IS_HIDDEN(node))
-			fprintf(pdata->fh, "\" hide=\"yes");
+			out_puts("\" hide=\"yes");
 
-		fprintf(pdata->fh, "\" size=\"%d", fi->length);
-		fprintf(pdata->fh, "\" pos=\"%d", fi->start);
-/*		fprintf(pdata->fh, "\" id=\"%d", fi->hfinfo->id);*/
+		out_puts("\" size=\"");
+		out_int(fi->length);
+		out_puts("\" pos=\"");
+		out_int(fi->start);
+/*		out_puts("\" id=\""); out_int(fi->hfinfo->id);*/
 
 		/* show, value, and unmaskedvalue attributes */
 		switch (fi->hfinfo->type)
@@ -388,7 +548,7 @@ proto_tree_write_node_pdml(proto_node *node, gpointer data)
 		case FT_PROTOCOL:
 			break;
 		case FT_NONE:
-			fputs("\" show=\"\" value=\"",  pdata->fh);
+			out_puts("\" show=\"\" value=\"");
 			break;
 		default:
 			/* XXX - this is a hack until we can just call
@@ -408,8 +568,8 @@ proto_tree_write_node_pdml(proto_node *node, gpointer data)
 					chop_len++;
 				}
 
-				fputs("\" show=\"", pdata->fh);
-				print_escaped_xml(pdata->fh, &dfilter_string[chop_len]);
+				out_puts("\" show=\"");
+				print_escaped_xml(&dfilter_string[chop_len]);
 			}
 
 			/*
@@ -420,11 +580,11 @@ proto_tree_write_node_pdml(proto_node *node, gpointer data)
 			 * they might be generated fields.
 			 */
 			if (fi->length > 0) {
-				fputs("\" value=\"", pdata->fh);
+				out_puts("\" value=\"");
 
 				if (fi->hfinfo->bitmask!=0) {
-					fprintf(pdata->fh, "%X", fvalue_get_uinteger(&fi->value));
-					fputs("\" unmaskedvalue=\"", pdata->fh);
+					out_hex(fvalue_get_uinteger(&fi->value), TRUE);
+					out_puts("\" unmaskedvalue=\"");
 					write_pdml_field_hex_value(pdata, fi);
 				}
 				else {
@@ -434,13 +594,13 @@ proto_tree_write_node_pdml(proto_node *node, gpointer data)
 		}
 
 		if (node->first_child != NULL) {
-			fputs("\">\n", pdata->fh);
+			out_puts("\">\n");
 		}
 		else if (fi->hfinfo->id == proto_data) {
-			fputs("\">\n", pdata->fh);
+			out_puts("\">\n");
 		}
 		else {
-			fputs("\"/>\n", pdata->fh);
+			out_puts("\"/>\n");
 		}
 	}
 
@@ -460,24 +620,24 @@ proto_tree_write_node_pdml(proto_node *node, gpointer data)
 	if (node->first_child != NULL) {
 		/* Indent to correct level */
 		for (i = -1; i < pdata->level; i++) {
-			fputs("  ", pdata->fh);
+			out_puts("  ");
 		}
 		/* Close off current element */
 		if (fi->hfinfo->id != proto_data) {   /* Data protocol uses simple tags */
 			if (fi->hfinfo->type == FT_PROTOCOL) {
-				fputs("</proto>\n", pdata->fh);
+				out_puts("</proto>\n");
 			}
 			else {
-				fputs("</field>\n", pdata->fh);
+				out_puts("</field>\n");
 			}
 		} else {
-			fputs("</field>\n", pdata->fh);
+			out_puts("</field>\n");
 		}
 	}
 
 	/* Close off fake wrapper protocol */
 	if (wrap_in_fake_protocol) {
-		fputs("</proto>\n", pdata->fh);
+		out_puts("</proto>\n");
 	}
 }
 
@@ -486,7 +646,7 @@ proto_tree_write_node_pdml(proto_node *node, gpointer data)
  * but we produce a 'geninfo' protocol in the PDML to conform to spec.
  * The 'frame' protocol follows the 'geninfo' protocol in the PDML. */
 static void
-print_pdml_geninfo(proto_tree *tree, FILE *fh)
+print_pdml_geninfo(proto_tree *tree)
 {
 	guint32 num, len, caplen;
 	nstime_t *timestamp;
@@ -534,33 +694,50 @@ print_pdml_geninfo(proto_tree *tree, FILE *fh)
 	g_ptr_array_free(finfo_array, TRUE);
 
 	/* Print geninfo start */
-	fprintf(fh,
-"  <proto name=\"geninfo\" pos=\"0\" showname=\"General information\" size=\"%u\">\n",
-		frame_finfo->length);
+	out_puts("  <proto name=\"geninfo\" pos=\"0\" showname=\"General information\" size=\"");
+	out_uint(frame_finfo->length);
+	out_puts("\">\n");
 
 	/* Print geninfo.num */
-	fprintf(fh,
-"    <field name=\"num\" pos=\"0\" show=\"%u\" showname=\"Number\" value=\"%x\" size=\"%u\"/>\n",
-		num, num, frame_finfo->length);
+	out_puts("    <field name=\"num\" pos=\"0\" show=\"");
+	out_uint(num);
+	out_puts("\" showname=\"Number\" value=\"");
+	out_hex(num, FALSE);
+	out_puts("\" size=\"");
+	out_uint(frame_finfo->length);
+	out_puts("\"/>\n");
 
 	/* Print geninfo.len */
-	fprintf(fh,
-"    <field name=\"len\" pos=\"0\" show=\"%u\" showname=\"Frame Length\" value=\"%x\" size=\"%u\"/>\n",
-		len, len, frame_finfo->length);
+	out_puts("    <field name=\"len\" pos=\"0\" show=\"");
+	out_uint(len);
+	out_puts("\" showname=\"Frame Length\" value=\"");
+	out_hex(len, FALSE);
+	out_puts("\" size=\"");
+	out_uint(frame_finfo->length);
+	out_puts("\"/>\n");
 
 	/* Print geninfo.caplen */
-	fprintf(fh,
-"    <field name=\"caplen\" pos=\"0\" show=\"%u\" showname=\"Captured Length\" value=\"%x\" size=\"%u\"/>\n",
-		caplen, caplen, frame_finfo->length);
+	out_puts("    <field name=\"caplen\" pos=\"0\" show=\"");
+	out_uint(caplen);
+	out_puts("\" showname=\"Captured Length\" value=\"");
+	out_hex(caplen, FALSE);
+	out_puts("\" size=\"");
+	out_uint(frame_finfo->length);
+	out_puts("\"/>\n");
 
 	/* Print geninfo.timestamp */
-	fprintf(fh,
-"    <field name=\"timestamp\" pos=\"0\" show=\"%s\" showname=\"Captured Time\" value=\"%d.%09d\" size=\"%u\"/>\n",
-		abs_time_to_str(timestamp, ABSOLUTE_TIME_LOCAL, TRUE), (int) timestamp->secs, timestamp->nsecs, frame_finfo->length);
+	out_puts("    <field name=\"timestamp\" pos=\"0\" show=\"");
+	out_puts(abs_time_to_str(timestamp, ABSOLUTE_TIME_LOCAL, TRUE));
+	out_puts("\" showname=\"Captured Time\" value=\"");
+	out_int((int) timestamp->secs);
+	out_putc('.');
+	out_uint_padded(timestamp->nsecs, 9);
+	out_puts("\" size=\"");
+	out_uint(frame_finfo->length);
+	out_puts("\"/>\n");
 
 	/* Print geninfo end */
-	fprintf(fh,
-"  </proto>\n");
+	out_puts("  </proto>\n");
 }
 
 void
@@ -583,30 +760,33 @@ proto_tree_write_psml(epan_dissect_t *edt, FILE *fh)
 {
 	gint	i;
 
+	out_begin(fh);
+
 	/* if this is the first packet, we have to create the PSML structure output */
 	if(write_headers) {
-	    fprintf(fh, "<structure>\n");
+	    out_puts("<structure>\n");
 
 	    for(i=0; i < edt->pi.cinfo->num_cols; i++) {
-		fprintf(fh, "<section>");
-		print_escaped_xml(fh, edt->pi.cinfo->col_title[i]);
-		fprintf(fh, "</section>\n");
+		out_puts("<section>");
+		print_escaped_xml(edt->pi.cinfo->col_title[i]);
+		out_puts("</section>\n");
 	    }
 
-	    fprintf(fh, "</structure>\n\n");
+	    out_puts("</structure>\n\n");
 
 	    write_headers = FALSE;
 	}
 
-	fprintf(fh, "<packet>\n");
+	out_puts("<packet>\n");
 
 	for(i=0; i < edt->pi.cinfo->num_cols; i++) {
-	    fprintf(fh, "<section>");
-	    print_escaped_xml(fh, edt->pi.cinfo->col_data[i]);
-	    fprintf(fh, "</section>\n");
+	    out_puts("<section>");
+	    print_escaped_xml(edt->pi.cinfo->col_data[i]);
+	    out_puts("</section>\n");
 	}
 
-	fprintf(fh, "</packet>\n\n");
+	out_puts("</packet>\n\n");
+	out_end();
 }
 
 void
@@ -626,20 +806,26 @@ proto_tree_write_csv(epan_dissect_t *edt, FILE *fh)
 {
         gint    i;
 
+        out_begin(fh);
+
         /* if this is the first packet, we have to write the CSV header */
         if(write_headers) {
-            for(i=0; i < edt->pi.cinfo->num_cols - 1; i++)
-	        fprintf(fh, "\"%s\",", edt->pi.cinfo->col_title[i]);
-
-            fprintf(fh, "\"%s\"\n", edt->pi.cinfo->col_title[i]);
+            for(i=0; i < edt->pi.cinfo->num_cols; i++) {
+                out_putc('"');
+                out_puts(edt->pi.cinfo->col_title[i]);
+                out_puts(i < edt->pi.cinfo->num_cols - 1 ? "\"," : "\"\n");
+            }
 
 	    write_headers = FALSE;
         }
 
-        for(i=0; i < edt->pi.cinfo->num_cols - 1; i++)
-            fprintf(fh, "\"%s\",", edt->pi.cinfo->col_data[i]);
+        for(i=0; i < edt->pi.cinfo->num_cols; i++) {
+            out_putc('"');
+            out_puts(edt->pi.cinfo->col_data[i]);
+            out_puts(i < edt->pi.cinfo->num_cols - 1 ? "\"," : "\"\n");
+        }
 
-        fprintf(fh, "\"%s\"\n", edt->pi.cinfo->col_data[i]);
+        out_end();
 }
 
 void
@@ -728,53 +914,63 @@ get_field_data(GSList *src_list, field_info *fi)
 	return NULL;	/* not found */
 }
 
-/* Print a string, escaping out certain characters that need to
- * escaped out for XML. */
+/* Replacement for each byte that has to be escaped out for XML, or
+ * NULL if the byte can be copied as is; filled in on first use. */
+static const char *xml_escapes[256];
+static char xml_hex_escapes[256][5];
+
 static void
-print_escaped_xml(FILE *fh, const char *unescaped_string)
+init_xml_escapes(void)
 {
-	const char *p;
-	char temp_str[8];
+	int c;
 
-	for (p = unescaped_string; *p != '\0'; p++) {
-		switch (*p) {
-			case '&':
-				fputs("&amp;", fh);
-				break;
-			case '<':
-				fputs("&lt;", fh);
-				break;
-			case '>':
-				fputs("&gt;", fh);
-				break;
-			case '"':
-				fputs("&quot;", fh);
-				break;
-			case '\'':
-				fputs("&apos;", fh);
-				break;
-			default:
-				if (g_ascii_isprint(*p))
-					fputc(*p, fh);
-				else {
-					g_snprintf(temp_str, sizeof(temp_str), "\\x%x", (guint8)*p);
-					fputs(temp_str, fh);
-				}
+	for (c = 0; c < 256; c++) {
+		if (!g_ascii_isprint(c)) {
+			g_snprintf(xml_hex_escapes[c], sizeof xml_hex_escapes[c], "\\x%x", c);
+			xml_escapes[c] = xml_hex_escapes[c];
 		}
 	}
+	xml_escapes['&'] = "&amp;";
+	xml_escapes['<'] = "&lt;";
+	xml_escapes['>'] = "&gt;";
+	xml_escapes['"'] = "&quot;";
+	xml_escapes['\''] = "&apos;";
+}
+
+/* Print a string, escaping out certain characters that need to
+ * escaped out for XML.  Runs of characters that need no escaping
+ * are copied in one go. */
+static void
+print_escaped_xml(const char *unescaped_string)
+{
+	const guint8 *p = (const guint8 *)unescaped_string;
+	const guint8 *run;
+
+	if (xml_escapes[0] == NULL)
+		init_xml_escapes();
+
+	while (*p != '\0') {
+		for (run = p; xml_escapes[*p] == NULL; p++)
+			;
+		if (p != run)
+			out_write((const gchar *)run, p - run);
+		if (*p == '\0')
+			break;
+		out_puts(xml_escapes[*p]);
+		p++;
+	}
 }
 
 static void
 write_pdml_field_hex_value(write_pdml_data *pdata, field_info *fi)
 {
-	int i;
 	const guint8 *pd;
 
 	if (!fi->ds_tvb)
 		return;
 
 	if (fi->length > tvb_length_remaining(fi->ds_tvb, fi->start)) {
-		fprintf(pdata->fh, "field length invalid!");
+		out_puts("field length invalid!");
 		return;
 	}
 
@@ -783,9 +979,7 @@ write_pdml_field_hex_value(write_pdml_data *pdata, field_info *fi)
 
 	if (pd) {
 		/* Print a simple hex dump */
-		for (i = 0 ; i < fi->length; i++) {
-			fprintf(pdata->fh, "%02x", pd[i]);
-		}
+		out_hex_bytes(pd, fi->length);
 	}
 }
 
@@ -1271,6 +1465,12 @@ output_fields_t* output_fields_new()
     fields->field_indicies = NULL;
     fields->field_values = NULL;
     fields->quote='\0';
+    fields->field_hfids = NULL;
+    fields->primed = FALSE;
+    fields->field_value = NULL;
+    fields->batch_rows = COLUMNAR_DEFAULT_BATCH_ROWS;
+    fields->rows = 0;
+    fields->columns = NULL;
     return fields;
 }
 
@@ -1303,6 +1503,21 @@ void output_fields_free(output_fields_t* fields)
         }
         g_ptr_array_free(fields->fields, TRUE);
     }
+    g_free(fields->field_hfids);
+    if(NULL != fields->field_value) {
+        g_string_free(fields->field_value, TRUE);
+    }
+    if(NULL != fields->columns) {
+        gsize i;
+        for(i = 0; i < fields->fields->len; ++i) {
+            g_byte_array_free(fields->columns[i].validity, TRUE);
+            if(NULL != fields->columns[i].offsets) {
+                g_byte_array_free(fields->columns[i].offsets, TRUE);
+            }
+            g_byte_array_free(fields->columns[i].data, TRUE);
+        }
+        g_free(fields->columns);
+    }
 
     g_free(fields);
 }
@@ -1407,6 +1622,21 @@ gboolean output_fields_set_option(output_fields_t* info, gchar* option)
         return TRUE;
     }
 
+    if(0 == strcmp(option_name, "batch")) {
+        gchar* end;
+        unsigned long rows;
+
+        if(NULL == option_value || '\0' == *option_value) {
+            return FALSE;
+        }
+        rows = strtoul(option_value, &end, 10);
+        if('\0' != *end || 0 == rows || rows > G_MAXINT) {
+            return FALSE;
+        }
+        info->batch_rows = (guint)rows;
+        return TRUE;
+    }
+
     if(0 == strcmp(option_name, "quote")) {
         switch(NULL == option_value ? '\0' : *option_value) {
         default: /* Fall through */
@@ -1437,6 +1667,7 @@ void output_fields_list_options(FILE *fh)
     fputs("occurrence=f|l|a  Select the occurrence of a field to use;\n     \"f\" = first, \"l\" = last, \"a\" = all (def: a: all)\n", fh);
     fputs("aggregator=,|/s|<character>   Set the aggregator to use;\n     \",\" = comma, \"/s\" = space (def: ,: comma)\n", fh);
     fputs("quote=d|s|n   Print either d: double-quotes, s: single quotes or \n     n: no quotes around field values (def: n: none)\n", fh);
+    fputs("batch=<rows>   Set the number of rows per record batch for -T columnar\n     (def: 4096)\n", fh);
 }
 
 
@@ -1461,6 +1692,225 @@ void write_fields_preamble(output_fields_t* fields, FILE *fh)
     fputc('\n', fh);
 }
 
+/* Resolve the field names once; all fields registered under the same
+ * name are chained from the first one. */
+static void output_fields_resolve(output_fields_t* fields)
+{
+    gsize i;
+    header_field_info* hfinfo;
+
+    if(NULL != fields->field_hfids) {
+        return;
+    }
+    fields->field_hfids = g_new(gint, fields->fields->len);
+    for(i = 0; i < fields->fields->len; ++i) {
+        hfinfo = proto_registrar_get_byname((gchar *)g_ptr_array_index(fields->fields, i));
+        fields->field_hfids[i] = hfinfo ? hfinfo->id : -1;
+    }
+    fields->field_value = g_string_sized_new(256);
+}
+
+void output_fields_prime_edt(output_fields_t* fields, epan_dissect_t *edt)
+{
+    gsize i;
+    header_field_info* hfinfo;
+
+    g_assert(fields);
+    g_assert(edt);
+
+    if(NULL == edt->tree || NULL == fields->fields) {
+        return;
+    }
+
+    output_fields_resolve(fields);
+
+    for(i = 0; i < fields->fields->len; ++i) {
+        if(fields->field_hfids[i] < 0) {
+            continue;
+        }
+        for(hfinfo = proto_registrar_get_nth(fields->field_hfids[i]);
+            hfinfo != NULL; hfinfo = hfinfo->same_name_next) {
+            proto_tree_prime_hfid(edt->tree, hfinfo->id);
+        }
+    }
+    fields->primed = TRUE;
+}
+
+static void
+append_field_uint64_dec(GString* buf, guint64 val)
+{
+    gchar digits[20];
+    int i = sizeof digits;
+
+    do {
+        digits[--i] = '0' + (gchar)(val % 10);
+        val /= 10;
+    } while (val != 0);
+    g_string_append_len(buf, &digits[i], sizeof digits - i);
+}
+
+static void
+append_field_int64_dec(GString* buf, gint64 val)
+{
+    if (val < 0) {
+        g_string_append_c(buf, '-');
+        append_field_uint64_dec(buf, (guint64)0 - (guint64)val);
+    } else {
+        append_field_uint64_dec(buf, (guint64)val);
+    }
+}
+
+/* Same as "0x%0<width>x", i.e. at least width digits. */
+static void
+append_field_uint64_hex(GString* buf, guint64 val, int width)
+{
+    static const gchar hex[16] = "0123456789abcdef";
+    gchar digits[2 + 16];
+    int i;
+
+    while (width < 16 && (val >> (4 * width)) != 0)
+        width++;
+    digits[0] = '0';
+    digits[1] = 'x';
+    for (i = width; i > 0; i--) {
+        digits[1 + i] = hex[val & 0xf];
+        val >>= 4;
+    }
+    g_string_append_len(buf, digits, 2 + width);
+}
+
+/* Appends the value of an integer field to buf, formatted exactly like
+ * the value part of its "match selected" display filter string.
+ * Returns FALSE if the field has to go through get_node_field_value(). */
+static gboolean
+append_field_value_fast(GString* buf, field_info* fi)
+{
+    header_field_info* hfinfo = fi->hfinfo;
+    int hex_width;
+
+    if (hfinfo->type == FT_FRAMENUM) {
+        append_field_uint64_dec(buf, fvalue_get_uinteger(&fi->value));
+        return TRUE;
+    }
+    if (hfinfo->strings && (hfinfo->display & BASE_DISPLAY_E_MASK) == BASE_NONE) {
+        /* Printed as the matching value_string */
+        return FALSE;
+    }
+
+    switch(hfinfo->display & BASE_DISPLAY_E_MASK) {
+    case BASE_DEC:
+    case BASE_DEC_HEX:
+    case BASE_OCT:
+    case BASE_CUSTOM:
+        switch(hfinfo->type) {
+        case FT_UINT8:
+        case FT_UINT16:
+        case FT_UINT24:
+        case FT_UINT32:
+            append_field_uint64_dec(buf, fvalue_get_uinteger(&fi->value));
+            return TRUE;
+        case FT_UINT64:
+            append_field_uint64_dec(buf, fvalue_get_integer64(&fi->value));
+            return TRUE;
+        case FT_INT8:
+        case FT_INT16:
+        case FT_INT24:
+        case FT_INT32:
+            append_field_int64_dec(buf, fvalue_get_sinteger(&fi->value));
+            return TRUE;
+        case FT_INT64:
+            append_field_int64_dec(buf, (gint64)fvalue_get_integer64(&fi->value));
+            return TRUE;
+        default:
+            return FALSE;
+        }
+    case BASE_HEX:
+    case BASE_HEX_DEC:
+        switch(hfinfo->type) {
+        case FT_UINT8:
+            hex_width = 2;
+            break;
+        case FT_UINT16:
+            hex_width = 4;
+            break;
+        case FT_UINT24:
+            hex_width = 6;
+            break;
+        case FT_UINT32:
+            hex_width = 8;
+            break;
+        case FT_UINT64:
+            append_field_uint64_hex(buf, fvalue_get_integer64(&fi->value), 16);
+            return TRUE;
+        default:
+            return FALSE;
+        }
+        append_field_uint64_hex(buf, fvalue_get_uinteger(&fi->value), hex_width);
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+/* Builds the value of field i in fields->field_value from the finfos
+ * the primed tree collected for it.  Returns FALSE if there is none. */
+static gboolean
+get_primed_field_value(output_fields_t* fields, gsize i, epan_dissect_t *edt)
+{
+    GString* buf = fields->field_value;
+    header_field_info* hfinfo;
+    GPtrArray* finfos;
+    field_info* fi;
+    const gchar* value;
+    gsize start;
+    guint j;
+    gboolean found = FALSE;
+
+    g_string_truncate(buf, 0);
+    if(fields->field_hfids[i] < 0) {
+        return FALSE;
+    }
+
+    for(hfinfo = proto_registrar_get_nth(fields->field_hfids[i]);
+        hfinfo != NULL; hfinfo = hfinfo->same_name_next) {
+        finfos = proto_get_finfo_ptr_array(edt->tree, hfinfo->id);
+        if(NULL == finfos) {
+            continue;
+        }
+        for(j = 0; j < finfos->len; ++j) {
+            fi = (field_info *)g_ptr_array_index(finfos, j);
+
+            if(found) {
+                if(fields->occurrence == 'f') {
+                    return TRUE;
+                }
+                start = buf->len;
+                if(fields->occurrence == 'a') {
+                    g_string_append_c(buf, fields->aggregator);
+                }
+            } else {
+                start = 0;
+            }
+
+            if(!append_field_value_fast(buf, fi)) {
+                value = get_node_field_value(fi, edt); /* ep_alloced string */
+                if(NULL == value || '\0' == *value) {
+                    g_string_truncate(buf, start);
+                    continue;
+                }
+                g_string_append(buf, value);
+            }
+
+            if(found && fields->occurrence == 'l') {
+                /* keep only the value of the last occurrence of the field */
+                g_string_erase(buf, 0, start);
+            }
+            found = TRUE;
+        }
+    }
+    return found;
+}
+
 static void proto_tree_get_node_field_values(proto_node *node, gpointer data)
 {
     write_field_data_t *call_data;
@@ -1515,6 +1965,29 @@ void proto_tree_write_fields(output_fields_t* fields, epan_dissect_t *edt, FILE
     data.fields = fields;
     data.edt = edt;
 
+    if(fields->primed) {
+        /* The values were collected during dissection, per field,
+         * so there is no need to walk the tree. */
+        fields->primed = FALSE;
+        out_begin(fh);
+        for(i = 0; i < fields->fields->len; ++i) {
+            if(0 != i) {
+                out_putc(fields->separator);
+            }
+            if(get_primed_field_value(fields, i, edt)) {
+                if(fields->quote != '\0') {
+                    out_putc(fields->quote);
+                }
+                out_write(fields->field_value->str, fields->field_value->len);
+                if(fields->quote != '\0') {
+                    out_putc(fields->quote);
+                }
+            }
+        }
+        out_end();
+        return;
+    }
+
     if(NULL == fields->field_indicies) {
         /* Prepare a lookup table from string abbreviation for field to its index. */
         fields->field_indicies = g_hash_table_new(g_str_hash, g_str_equal);
@@ -1536,20 +2009,22 @@ void proto_tree_write_fields(output_fields_t* fields, epan_dissect_t *edt, FILE
     proto_tree_children_foreach(edt->tree, proto_tree_get_node_field_values,
                                 &data);
 
+    out_begin(fh);
     for(i = 0; i < fields->fields->len; ++i) {
         if(0 != i) {
-            fputc(fields->separator, fh);
+            out_putc(fields->separator);
         }
         if(NULL != fields->field_values[i]) {
             if(fields->quote != '\0') {
-                fputc(fields->quote, fh);
+                out_putc(fields->quote);
             }
-            fputs(fields->field_values[i]->str, fh);
+            out_puts(fields->field_values[i]->str);
             if(fields->quote != '\0') {
-                fputc(fields->quote, fh);
+                out_putc(fields->quote);
             }
         }
     }
+    out_end();
 }
 
 void write_fields_finale(output_fields_t* fields _U_ , FILE *fh _U_)
@@ -1557,6 +2032,318 @@ void write_fields_finale(output_fields_t* fields _U_ , FILE *fh _U_)
     /* Nothing to do */
 }
 
+/*
+ * -T columnar: the fields given with -e as typed columns, in record
+ * batches of fields->batch_rows packets.  The layout is described in
+ * the tshark man page; all integers are little-endian:
+ *
+ *   "WSCOLS\0\1", guint32 column count,
+ *   per column: guint8 type, guint8 0, guint16 name length, name
+ *   per batch:  guint32 row count, then per column the validity bitmap
+ *               and either rows fixed width values or rows + 1 guint32
+ *               offsets followed by the bytes they index
+ *   guint32 0 at the end of the stream.
+ */
+static const guint8 columnar_magic[8] = { 'W', 'S', 'C', 'O', 'L', 'S', 0, 1 };
+
+static guint8
+columnar_type_of(const header_field_info* hfinfo)
+{
+    switch(hfinfo->type) {
+    case FT_INT8:
+    case FT_INT16:
+    case FT_INT24:
+    case FT_INT32:
+    case FT_INT64:
+        return COLUMNAR_TYPE_INT64;
+    case FT_BOOLEAN:
+    case FT_UINT8:
+    case FT_UINT16:
+    case FT_UINT24:
+    case FT_UINT32:
+    case FT_UINT64:
+    case FT_FRAMENUM:
+        return COLUMNAR_TYPE_UINT64;
+    case FT_FLOAT:
+    case FT_DOUBLE:
+        return COLUMNAR_TYPE_DOUBLE;
+    case FT_IPv4:
+        return COLUMNAR_TYPE_IPV4;
+    case FT_IPv6:
+        return COLUMNAR_TYPE_IPV6;
+    case FT_ABSOLUTE_TIME:
+        return COLUMNAR_TYPE_TIME_NS;
+    case FT_RELATIVE_TIME:
+        return COLUMNAR_TYPE_DURATION_NS;
+    case FT_ETHER:
+    case FT_BYTES:
+    case FT_UINT_BYTES:
+        return COLUMNAR_TYPE_BINARY;
+    default:
+        return COLUMNAR_TYPE_STRING;
+    }
+}
+
+static guint
+columnar_type_width(guint8 type)
+{
+    switch(type) {
+    case COLUMNAR_TYPE_IPV4:
+        return 4;
+    case COLUMNAR_TYPE_IPV6:
+        return 16;
+    case COLUMNAR_TYPE_BINARY:
+    case COLUMNAR_TYPE_STRING:
+        return 0;
+    default:
+        return 8;
+    }
+}
+
+static void
+columnar_append_le(GByteArray* buf, guint64 val, guint len)
+{
+    guint8 bytes[8];
+    guint i;
+
+    for (i = 0; i < len; i++) {
+        bytes[i] = (guint8)val;
+        val >>= 8;
+    }
+    g_byte_array_append(buf, bytes, len);
+}
+
+static void
+columnar_write_le(guint64 val, guint len, FILE *fh)
+{
+    guint8 bytes[8];
+    guint i;
+
+    for (i = 0; i < len; i++) {
+        bytes[i] = (guint8)val;
+        val >>= 8;
+    }
+    fwrite(bytes, 1, len, fh);
+}
+
+void write_columnar_preamble(output_fields_t* fields, FILE *fh)
+{
+    gsize i;
+    header_field_info* hfinfo;
+
+    g_assert(fields);
+    g_assert(fh);
+
+    output_fields_resolve(fields);
+    fields->columns = g_new0(columnar_column_t, fields->fields->len);
+
+    fwrite(columnar_magic, 1, sizeof columnar_magic, fh);
+    columnar_write_le(fields->fields->len, 4, fh);
+
+    for(i = 0; i < fields->fields->len; ++i) {
+        const gchar* field = (const gchar *)g_ptr_array_index(fields->fields, i);
+        columnar_column_t* column = &fields->columns[i];
+        gsize name_len = strlen(field);
+
+        /* All fields registered under one name must agree on the
+         * column type, or the column falls back to strings. */
+        column->type = COLUMNAR_TYPE_STRING;
+        if(fields->field_hfids[i] >= 0) {
+            hfinfo = proto_registrar_get_nth(fields->field_hfids[i]);
+            column->type = columnar_type_of(hfinfo);
+            for(hfinfo = hfinfo->same_name_next; hfinfo != NULL;
+                hfinfo = hfinfo->same_name_next) {
+                if(columnar_type_of(hfinfo) != column->type) {
+                    column->type = COLUMNAR_TYPE_STRING;
+                    break;
+                }
+            }
+        }
+
+        column->validity = g_byte_array_new();
+        column->data = g_byte_array_new();
+        if(0 == columnar_type_width(column->type)) {
+            column->offsets = g_byte_array_new();
+            columnar_append_le(column->offsets, 0, 4);
+        }
+
+        if(name_len > G_MAXUINT16) {
+            name_len = G_MAXUINT16;
+        }
+        fputc(column->type, fh);
+        fputc(0, fh);
+        columnar_write_le(name_len, 2, fh);
+        fwrite(field, 1, name_len, fh);
+    }
+}
+
+/* Returns the occurrence of field i stored in a typed column: the last
+ * one with occurrence=l, the first one otherwise. */
+static field_info*
+get_primed_field_finfo(output_fields_t* fields, gsize i, epan_dissect_t *edt)
+{
+    header_field_info* hfinfo;
+    GPtrArray* finfos;
+    field_info* fi = NULL;
+
+    if(fields->field_hfids[i] < 0) {
+        return NULL;
+    }
+    for(hfinfo = proto_registrar_get_nth(fields->field_hfids[i]);
+        hfinfo != NULL; hfinfo = hfinfo->same_name_next) {
+        finfos = proto_get_finfo_ptr_array(edt->tree, hfinfo->id);
+        if(NULL == finfos || 0 == finfos->len) {
+            continue;
+        }
+        if(fields->occurrence != 'l') {
+            return (field_info *)g_ptr_array_index(finfos, 0);
+        }
+        fi = (field_info *)g_ptr_array_index(finfos, finfos->len - 1);
+    }
+    return fi;
+}
+
+/* Appends the value of fi to column; returns FALSE if it has none. */
+static gboolean
+columnar_append_value(columnar_column_t* column, field_info* fi)
+{
+    const nstime_t* ts;
+    guint64 val;
+    guint32 addr;
+    gdouble d;
+
+    switch(column->type) {
+    case COLUMNAR_TYPE_INT64:
+        if(fi->hfinfo->type == FT_INT64) {
+            val = fvalue_get_integer64(&fi->value);
+        } else {
+            val = (guint64)(gint64)fvalue_get_sinteger(&fi->value);
+        }
+        break;
+    case COLUMNAR_TYPE_UINT64:
+        if(fi->hfinfo->type == FT_UINT64) {
+            val = fvalue_get_integer64(&fi->value);
+        } else if(fi->hfinfo->type == FT_BOOLEAN) {
+            val = fvalue_get_uinteger(&fi->value) ? 1 : 0;
+        } else {
+            val = fvalue_get_uinteger(&fi->value);
+        }
+        break;
+    case COLUMNAR_TYPE_DOUBLE:
+        d = fvalue_get_floating(&fi->value);
+        memcpy(&val, &d, sizeof val);
+        break;
+    case COLUMNAR_TYPE_IPV4:
+        /* Stored in network byte order, like the IPv6 addresses */
+        addr = ipv4_get_net_order_addr((ipv4_addr *)fvalue_get(&fi->value));
+        g_byte_array_append(column->data, (guint8 *)&addr, 4);
+        return TRUE;
+    case COLUMNAR_TYPE_IPV6:
+        g_byte_array_append(column->data, (guint8 *)fvalue_get(&fi->value), 16);
+        return TRUE;
+    case COLUMNAR_TYPE_TIME_NS:
+    case COLUMNAR_TYPE_DURATION_NS:
+        ts = (const nstime_t *)fvalue_get(&fi->value);
+        val = (guint64)((gint64)ts->secs * 1000000000 + ts->nsecs);
+        break;
+    case COLUMNAR_TYPE_BINARY:
+        g_byte_array_append(column->data, (guint8 *)fvalue_get(&fi->value),
+                            fvalue_length(&fi->value));
+        return TRUE;
+    default:
+        g_assert_not_reached();
+        return FALSE;
+    }
+    columnar_append_le(column->data, val, 8);
+    return TRUE;
+}
+
+static void
+columnar_write_batch(output_fields_t* fields, FILE *fh)
+{
+    gsize i;
+
+    if(0 == fields->rows) {
+        return;
+    }
+    columnar_write_le(fields->rows, 4, fh);
+    for(i = 0; i < fields->fields->len; ++i) {
+        columnar_column_t* column = &fields->columns[i];
+
+        fwrite(column->validity->data, 1, column->validity->len, fh);
+        g_byte_array_set_size(column->validity, 0);
+        if(NULL != column->offsets) {
+            fwrite(column->offsets->data, 1, column->offsets->len, fh);
+            g_byte_array_set_size(column->offsets, 0);
+            columnar_append_le(column->offsets, 0, 4);
+        }
+        fwrite(column->data->data, 1, column->data->len, fh);
+        g_byte_array_set_size(column->data, 0);
+    }
+    fields->rows = 0;
+}
+
+void proto_tree_write_columnar(output_fields_t* fields, epan_dissect_t *edt, FILE *fh)
+{
+    gsize i;
+    gboolean primed;
+
+    g_assert(fields);
+    g_assert(fields->columns);
+    g_assert(edt);
+    g_assert(fh);
+
+    /* Without priming there are no values to fetch; the row is empty */
+    primed = fields->primed;
+    fields->primed = FALSE;
+
+    for(i = 0; i < fields->fields->len; ++i) {
+        columnar_column_t* column = &fields->columns[i];
+        guint width = columnar_type_width(column->type);
+        gboolean present = FALSE;
+        field_info* fi;
+
+        if(primed && column->type == COLUMNAR_TYPE_STRING) {
+            /* Same text, occurrences and aggregator as -T fields */
+            if(get_primed_field_value(fields, i, edt)) {
+                g_byte_array_append(column->data, (guint8 *)fields->field_value->str,
+                                    (guint)fields->field_value->len);
+                present = TRUE;
+            }
+        } else if(primed) {
+            fi = get_primed_field_finfo(fields, i, edt);
+            present = (NULL != fi) && columnar_append_value(column, fi);
+        }
+
+        if(0 == fields->rows % 8) {
+            g_byte_array_append(column->validity, (const guint8 *)"", 1);
+        }
+        if(present) {
+            column->validity->data[column->validity->len - 1] |= 1 << (fields->rows % 8);
+        }
+
+        if(0 == width) {
+            columnar_append_le(column->offsets, column->data->len, 4);
+        } else if(!present) {
+            static const guint8 zeros[16];
+            g_byte_array_append(column->data, zeros, width);
+        }
+    }
+
+    if(++fields->rows == fields->batch_rows) {
+        columnar_write_batch(fields, fh);
+    }
+}
+
+void write_columnar_finale(output_fields_t* fields, FILE *fh)
+{
+    g_assert(fields);
+    g_assert(fh);
+
+    columnar_write_batch(fields, fh);
+    columnar_write_le(0, 4, fh);
+}
+
 /* Returns an ep_alloced string or a static constant*/
 const gchar* get_node_field_value(field_info* fi, epan_dissect_t* edt)
 {
@@ -119,6 +119,10 @@ extern void output_fields_add(output_fields_t* info, const gchar* field);
 extern gsize output_fields_num_fields(output_fields_t* info);
 extern gboolean output_fields_set_option(output_fields_t* info, gchar* option);
 extern void output_fields_list_options(FILE *fh);
+/* Prime the epan_dissect_t with the fields to be printed, so that
+ * proto_tree_write_fields() can fetch their values without walking
+ * the protocol tree.  Call it for each packet after epan_dissect_init(). */
+extern void output_fields_prime_edt(output_fields_t* info, epan_dissect_t *edt);
 /*
  * Higher-level packet-printing code.
  */
@@ -147,6 +151,27 @@ extern void write_fields_preamble(output_fields_t* fields, FILE *fh);
 extern void proto_tree_write_fields(output_fields_t* fields, epan_dissect_t *edt, FILE *fh);
 extern void write_fields_finale(output_fields_t* fields, FILE *fh);
 
+/*
+ * Typed column batches of the fields, see "-T columnar" in the tshark
+ * man page.  proto_tree_write_columnar() needs the edt to have been
+ * primed with output_fields_prime_edt().
+ */
+#define COLUMNAR_TYPE_INT64         1   /* 8 bytes */
+#define COLUMNAR_TYPE_UINT64        2   /* 8 bytes */
+#define COLUMNAR_TYPE_DOUBLE        3   /* 8 bytes, IEEE 754 */
+#define COLUMNAR_TYPE_IPV4          4   /* 4 bytes, network byte order */
+#define COLUMNAR_TYPE_IPV6          5   /* 16 bytes */
+#define COLUMNAR_TYPE_TIME_NS       6   /* 8 bytes, ns since the epoch */
+#define COLUMNAR_TYPE_DURATION_NS   7   /* 8 bytes, ns */
+#define COLUMNAR_TYPE_BINARY        8   /* variable width */
+#define COLUMNAR_TYPE_STRING        9   /* variable width, UTF-8 */
+
+#define COLUMNAR_DEFAULT_BATCH_ROWS 4096
+
+extern void write_columnar_preamble(output_fields_t* fields, FILE *fh);
+extern void proto_tree_write_columnar(output_fields_t* fields, epan_dissect_t *edt, FILE *fh);
+extern void write_columnar_finale(output_fields_t* fields, FILE *fh);
+
 extern const gchar* get_node_field_value(field_info* fi, epan_dissect_t* edt);
 
 #endif /* print.h */
@@ -67,6 +67,7 @@
 
 #include "pcapio.h"
 #include "ringbuffer.h"
+#include "capture_index.h"
 #include <wsutil/file_util.h>
 
 
@@ -99,11 +100,16 @@ static int ringbuf_open_file(rb_file *rfile, int *err)
   char    filenum[5+1];
   char    timestr[14+1];
   time_t  current_time;
+  gchar  *idxname;
 
   if (rfile->name != NULL) {
     if (rb_data.unlimited == FALSE) {
       /* remove old file (if any, so ignore error) */
       ws_unlink(rfile->name);
+      /* and its index, if dumpcap -x wrote one */
+      idxname = capture_index_filename(rfile->name);
+      ws_unlink(idxname);
+      g_free(idxname);
     }
     g_free(rfile->name);
   }
@@ -38,6 +38,7 @@
 #include <epan/tap.h>
 #include <epan/stat_cmd_args.h>
 #include <epan/strutil.h>
+#include <epan/rollup.h>
 #include "register.h"
 
 
@@ -54,6 +55,7 @@ typedef struct _io_stat_t {
 #define CALC_TYPE_MIN	3
 #define CALC_TYPE_MAX	4
 #define CALC_TYPE_AVG	5
+#define CALC_TYPE_PCT	6	/* io,rollup only */
 
 typedef struct _io_stat_item_t {
 	io_stat_t *parent;
@@ -516,71 +518,84 @@ static calc_type_ent_t calc_type_table[] = {
 	{ NULL, 0 }
 };
 
-static void
-register_io_tap(io_stat_t *io, int i, const char *filter)
+/* Parse an optional FUNC(field) prefix of a column filter, returning the
+ * display filter that follows it.  Percentiles, P<n>(field), are only
+ * accepted if pct is non-NULL.
+ */
+static const char *
+parse_io_calc(const char *filter, int *calc_type, int *hf_index, double *pct)
 {
-	GString *error_string;
 	const char *flt;
 	int j;
 	size_t namelen;
 	const char *p, *parenp;
+	const char *func_name;
 	char *field;
+	char *endp;
 	header_field_info *hfi;
 
-	io->items[i].prev=&io->items[i];
-	io->items[i].next=NULL;
-	io->items[i].parent=io;
-	io->items[i].time=0;
-	io->items[i].calc_type=CALC_TYPE_BYTES;
-	io->items[i].frames=0;
-	io->items[i].counter=0;
-	io->items[i].num=0;
-	io->filters[i]=filter;
+	*calc_type=CALC_TYPE_BYTES;
+	*hf_index=-1;
 	flt=filter;
 
 	field=NULL;
 	hfi=NULL;
-	for(j=0; calc_type_table[j].func_name; j++){
+	func_name=NULL;
+	p=NULL;
+	for(j=0; filter && calc_type_table[j].func_name; j++){
 		namelen=strlen(calc_type_table[j].func_name);
-		if(filter
-		    && strncmp(filter, calc_type_table[j].func_name, namelen) == 0
+		if(strncmp(filter, calc_type_table[j].func_name, namelen) == 0
 		    && *(filter+namelen)=='('){
-			io->items[i].calc_type=calc_type_table[j].calc_type;
-
+			*calc_type=calc_type_table[j].calc_type;
+			func_name=calc_type_table[j].func_name;
 			p=filter+namelen+1;
-			parenp=strchr(p, ')');
-			if(!parenp){
-				fprintf(stderr, "tshark: Closing parenthesis missing from calculated expression.\n");
-				exit(10);
-			}
-			/* bail out if there was no field specified */
-			if(parenp==p){
-				fprintf(stderr, "tshark: You didn't specify a field name for %s(*).\n",
-				    calc_type_table[j].func_name);
-				exit(10);
-			}
-			field=g_malloc(parenp-p+1);
-			if(!field){
-				fprintf(stderr, "tshark: Out of memory.\n");
-				exit(10);
-			}
-			memcpy(field, p, parenp-p);
-			field[parenp-p] = '\0';
-			flt=parenp + 1;
-
-			hfi=proto_registrar_get_byname(field);
-			if(!hfi){
-				fprintf(stderr, "tshark: There is no field named '%s'.\n",
-				    field);
-				g_free(field);
+			break;
+		}
+	}
+	if(!p && pct && filter && filter[0]=='P' && g_ascii_isdigit(filter[1])){
+		*pct=g_ascii_strtod(filter+1, &endp);
+		if(*endp=='('){
+			if(*pct<=0 || *pct>100){
+				fprintf(stderr, "tshark: Percentile must be between 0 and 100.\n");
 				exit(10);
 			}
+			*calc_type=CALC_TYPE_PCT;
+			func_name="P<n>";
+			p=endp+1;
+		}
+	}
+	if(p){
+		parenp=strchr(p, ')');
+		if(!parenp){
+			fprintf(stderr, "tshark: Closing parenthesis missing from calculated expression.\n");
+			exit(10);
+		}
+		/* bail out if there was no field specified */
+		if(parenp==p){
+			fprintf(stderr, "tshark: You didn't specify a field name for %s(*).\n",
+			    func_name);
+			exit(10);
+		}
+		field=g_malloc(parenp-p+1);
+		if(!field){
+			fprintf(stderr, "tshark: Out of memory.\n");
+			exit(10);
+		}
+		memcpy(field, p, parenp-p);
+		field[parenp-p] = '\0';
+		flt=parenp + 1;
 
-			io->items[i].hf_index=hfi->id;
-			break;
+		hfi=proto_registrar_get_byname(field);
+		if(!hfi){
+			fprintf(stderr, "tshark: There is no field named '%s'.\n",
+			    field);
+			g_free(field);
+			exit(10);
 		}
+
+		*hf_index=hfi->id;
 	}
-	if(hfi && io->items[i].calc_type!=CALC_TYPE_BYTES){
+	if(hfi && *calc_type!=CALC_TYPE_BYTES){
 		/* check that the type is compatible */
 		switch(hfi->type){
 		case FT_UINT8:
@@ -596,19 +611,20 @@ register_io_tap(io_stat_t *io, int i, const char *filter)
 			/* these types support all calculations */
 			break;
 		case FT_RELATIVE_TIME:
-			/* this type only supports SUM, COUNT, MAX, MIN, AVG */
-			switch(io->items[i].calc_type){
+			/* this type only supports SUM, COUNT, MAX, MIN, AVG, P<n> */
+			switch(*calc_type){
 			case CALC_TYPE_SUM:
 			case CALC_TYPE_COUNT:
 			case CALC_TYPE_MAX:
 			case CALC_TYPE_MIN:
 			case CALC_TYPE_AVG:
+			case CALC_TYPE_PCT:
 				break;
 			default:
 				fprintf(stderr,
 				    "tshark: %s is a relative-time field, so %s(*) calculations are not supported on it.",
 				    field,
-				    calc_type_table[j].func_name);
+				    func_name);
 				exit(10);
 			}
 			break;
@@ -617,11 +633,11 @@ register_io_tap(io_stat_t *io, int i, const char *filter)
 			 * XXX - support all operations on floating-point
 			 * numbers?
 			 */
-			if(io->items[i].calc_type!=CALC_TYPE_COUNT){
+			if(*calc_type!=CALC_TYPE_COUNT){
 				fprintf(stderr,
 				    "tshark: %s doesn't have integral values, so %s(*) calculations are not supported on it.\n",
 				    field,
-				    calc_type_table[j].func_name);
+				    func_name);
 				exit(10);
 			}
 			break;
@@ -629,12 +645,24 @@ register_io_tap(io_stat_t *io, int i, const char *filter)
 		g_free(field);
 	}
 
-/*
-CALC_TYPE_SUM	2
-CALC_TYPE_MIN	3
-CALC_TYPE_MAX	4
-CALC_TYPE_AVG	5
-*/
+	return flt;
+}
+
+static void
+register_io_tap(io_stat_t *io, int i, const char *filter)
+{
+	GString *error_string;
+	const char *flt;
+
+	io->items[i].prev=&io->items[i];
+	io->items[i].next=NULL;
+	io->items[i].parent=io;
+	io->items[i].time=0;
+	io->items[i].frames=0;
+	io->items[i].counter=0;
+	io->items[i].num=0;
+	io->filters[i]=filter;
+	flt=parse_io_calc(filter, &io->items[i].calc_type, &io->items[i].hf_index, NULL);
 
 	error_string=register_tap_listener("frame", &io->items[i], flt, TL_REQUIRES_PROTO_TREE, NULL, iostat_packet, i?NULL:iostat_draw);
 	if(error_string){
@@ -726,8 +754,402 @@ iostat_init(const char *optarg, void* userdata _U_)
 	}
 }
 
+
+/*
+ * -z io,rollup: the io,stat columns kept in a rollup (see epan/rollup.h)
+ * so that memory use does not grow with the length of the capture.  The
+ * last (coarsest) level is printed row by row as its buckets close; the
+ * finer levels keep only a window of the most recent buckets, which is
+ * printed at the end.
+ */
+typedef struct _io_rollup_t {
+	rollup_t *rollup;
+	guint num_levels;
+	guint64 *intervals;	/* unit is ms */
+	guint64 *keeps;		/* unit is ms */
+	guint32 num_items;
+	struct _io_rollup_item_t *items;
+	gboolean header_done;
+} io_rollup_t;
+
+typedef struct _io_rollup_item_t {
+	io_rollup_t *parent;
+	guint column;
+	const char *filter;
+	int calc_type;
+	int hf_index;
+	double pct;
+} io_rollup_item_t;
+
+static gboolean
+iorollup_field_value(field_info *fi, int type, gint64 *val)
+{
+	nstime_t *t;
+
+	switch(type){
+	case FT_UINT8:
+	case FT_UINT16:
+	case FT_UINT24:
+	case FT_UINT32:
+		*val=fvalue_get_uinteger(&fi->value);
+		return TRUE;
+	case FT_UINT64:
+	case FT_INT64:
+		*val=(gint64)fvalue_get_integer64(&fi->value);
+		return TRUE;
+	case FT_INT8:
+	case FT_INT16:
+	case FT_INT24:
+	case FT_INT32:
+		*val=fvalue_get_sinteger(&fi->value);
+		return TRUE;
+	case FT_RELATIVE_TIME:
+		t=fvalue_get(&fi->value);
+		*val=(gint64)t->secs*1000+t->nsecs/1000000;
+		return TRUE;
+	}
+	return FALSE;
+}
+
+static int
+iorollup_packet(void *arg, packet_info *pinfo, epan_dissect_t *edt, const void *dummy _U_)
+{
+	io_rollup_item_t *it = arg;
+	rollup_t *r = it->parent->rollup;
+	gint64 t;
+	gint64 val;
+	GPtrArray *gp;
+	guint i;
+	int type;
+
+	t=(gint64)pinfo->fd->rel_ts.secs*1000+pinfo->fd->rel_ts.nsecs/1000000;
+	if(t<0){
+		return FALSE;
+	}
+
+	rollup_add_frame(r, it->column, (guint64)t);
+	if(it->calc_type==CALC_TYPE_BYTES){
+		rollup_add_value(r, it->column, (guint64)t, pinfo->fd->pkt_len);
+		return TRUE;
+	}
+
+	gp=proto_get_finfo_ptr_array(edt->tree, it->hf_index);
+	if(!gp){
+		return TRUE;
+	}
+	type=proto_registrar_get_ftype(it->hf_index);
+	for(i=0;i<gp->len;i++){
+		/* COUNT() takes any field; only the number of values matters */
+		if(!iorollup_field_value(gp->pdata[i], type, &val)){
+			val=0;
+		}
+		rollup_add_value(r, it->column, (guint64)t, val);
+	}
+
+	return TRUE;
+}
+
+static void
+iorollup_print_time(guint64 ms)
+{
+	printf("%03" G_GINT64_MODIFIER "u.%03u", ms/1000, (guint)(ms%1000));
+}
+
+static void
+iorollup_print_table_header(io_rollup_t *io)
+{
+	guint32 i;
+	char name[16];
+
+	printf("                ");
+	for(i=0;i<io->num_items;i++){
+		printf("|   Column #%-2u   ",i);
+	}
+	printf("\n");
+	printf("Time            ");
+	for(i=0;i<io->num_items;i++){
+		switch(io->items[i].calc_type){
+		case CALC_TYPE_BYTES:
+			printf("|frames|  bytes  ");
+			break;
+		case CALC_TYPE_COUNT:
+			printf("|          COUNT ");
+			break;
+		case CALC_TYPE_SUM:
+			printf("|            SUM ");
+			break;
+		case CALC_TYPE_MIN:
+			printf("|            MIN ");
+			break;
+		case CALC_TYPE_MAX:
+			printf("|            MAX ");
+			break;
+		case CALC_TYPE_AVG:
+			printf("|            AVG ");
+			break;
+		case CALC_TYPE_PCT:
+			g_snprintf(name, sizeof(name), "P%g", io->items[i].pct);
+			printf("|%15s ", name);
+			break;
+		}
+	}
+	printf("\n");
+}
+
+static void
+iorollup_print_header(io_rollup_t *io)
+{
+	guint32 i;
+	guint l;
+
+	printf("\n");
+	printf("===================================================================\n");
+	printf("IO Rollup Statistics\n");
+	for(l=0;l<io->num_levels;l++){
+		printf("Level #%u: interval ", l);
+		iorollup_print_time(io->intervals[l]);
+		if(l==io->num_levels-1){
+			printf(" secs, streamed\n");
+		} else {
+			printf(" secs, last ");
+			iorollup_print_time(io->keeps[l]);
+			printf(" secs\n");
+		}
+	}
+	for(i=0;i<io->num_items;i++){
+		printf("Column #%u: %s\n",i,io->items[i].filter?io->items[i].filter:"");
+	}
+	printf("\n");
+	printf("Level #%u\n", io->num_levels-1);
+	iorollup_print_table_header(io);
+	io->header_done=TRUE;
+}
+
+static void
+iorollup_print_row(rollup_t *r _U_, guint level _U_, guint64 start, guint64 interval,
+    const rollup_agg_t *aggs, void *arg)
+{
+	io_rollup_t *io = arg;
+	io_rollup_item_t *it;
+	const rollup_agg_t *a;
+	guint32 i;
+	gint64 val;
+
+	if(!io->header_done){
+		iorollup_print_header(io);
+	}
+
+	iorollup_print_time(start);
+	printf("-");
+	iorollup_print_time(start+interval);
+	printf("  ");
+	for(i=0;i<io->num_items;i++){
+		it=&io->items[i];
+		a=&aggs[i];
+		switch(it->calc_type){
+		case CALC_TYPE_BYTES:
+			printf("%6" G_GINT64_MODIFIER "u %9" G_GINT64_MODIFIER "u ", a->frames, (guint64)a->sum);
+			continue;
+		case CALC_TYPE_COUNT:
+			printf(" %15" G_GINT64_MODIFIER "u ", a->count);
+			continue;
+		case CALC_TYPE_SUM:
+			val=a->sum;
+			break;
+		case CALC_TYPE_MIN:
+			val=a->count?a->min:0;
+			break;
+		case CALC_TYPE_MAX:
+			val=a->count?a->max:0;
+			break;
+		case CALC_TYPE_AVG:
+			val=a->count?a->sum/(gint64)a->count:0;
+			break;
+		case CALC_TYPE_PCT:
+			val=rollup_agg_percentile(a, it->pct);
+			break;
+		default:
+			continue;
+		}
+		switch(proto_registrar_get_ftype(it->hf_index)){
+		case FT_INT8:
+		case FT_INT16:
+		case FT_INT24:
+		case FT_INT32:
+		case FT_INT64:
+			printf(" %15" G_GINT64_MODIFIER "d ", val);
+			break;
+		case FT_RELATIVE_TIME:
+			printf(" %11" G_GINT64_MODIFIER "d.%03d ", val/1000, (gint)(val%1000));
+			break;
+		default:
+			printf(" %15" G_GINT64_MODIFIER "u ", (guint64)val);
+			break;
+		}
+	}
+	printf("\n");
+}
+
+static void
+iorollup_draw(void *arg)
+{
+	io_rollup_item_t *mit = arg;
+	io_rollup_t *io = mit->parent;
+	guint l;
+
+	/* close the last bucket of the streamed level */
+	rollup_flush(io->rollup);
+	if(!io->header_done){
+		iorollup_print_header(io);
+	}
+
+	for(l=0;l+1<io->num_levels;l++){
+		printf("\n");
+		printf("Level #%u\n", l);
+		iorollup_print_table_header(io);
+		rollup_foreach(io->rollup, l, iorollup_print_row, io);
+	}
+	if(rollup_dropped(io->rollup)){
+		printf("\n%" G_GINT64_MODIFIER "u late values dropped\n", rollup_dropped(io->rollup));
+	}
+	printf("===================================================================\n");
+}
+
+static void
+register_io_rollup_tap(io_rollup_t *io, guint i, const char *filter)
+{
+	GString *error_string;
+	const char *flt;
+	io_rollup_item_t *it = &io->items[i];
+
+	it->parent=io;
+	it->column=i;
+	it->filter=filter;
+	it->pct=0;
+	flt=parse_io_calc(filter, &it->calc_type, &it->hf_index, &it->pct);
+	if(it->calc_type==CALC_TYPE_PCT){
+		rollup_enable_sketch(io->rollup, i);
+	}
+
+	error_string=register_tap_listener("frame", it, flt, TL_REQUIRES_PROTO_TREE, NULL, iorollup_packet, i?NULL:iorollup_draw);
+	if(error_string){
+		fprintf(stderr, "tshark: Couldn't register io,rollup tap: %s\n",
+		    error_string->str);
+		g_string_free(error_string, TRUE);
+		exit(1);
+	}
+}
+
+/* "<interval>[:<keep>]/..." in seconds, finest level first */
+static void
+iorollup_parse_levels(io_rollup_t *io, const char *spec, size_t len)
+{
+	gchar *levels_str;
+	gchar **levels;
+	guint l;
+	double interval, keep;
+	char *endp;
+	guint64 slots;
+
+	levels_str=g_strndup(spec, len);
+	levels=g_strsplit(levels_str, "/", 0);
+	g_free(levels_str);
+
+	for(io->num_levels=0;levels[io->num_levels];io->num_levels++)
+		;
+	io->intervals=g_malloc(sizeof(guint64)*io->num_levels);
+	io->keeps=g_malloc(sizeof(guint64)*io->num_levels);
+
+	for(l=0;l<io->num_levels;l++){
+		interval=g_ascii_strtod(levels[l], &endp);
+		keep=-1;
+		if(*endp==':'){
+			keep=g_ascii_strtod(endp+1, &endp);
+		}
+		if(endp==levels[l] || *endp!='\0' || interval<0.001){
+			fprintf(stderr, "tshark: invalid io,rollup level \"%s\", expected <interval>[:<keep>] with an interval >=0.001 seconds\n", levels[l]);
+			exit(10);
+		}
+		io->intervals[l]=(guint64)(interval*1000.0+0.9);
+		io->keeps[l]=keep<0?0:(guint64)(keep*1000.0+0.9);
+	}
+	g_strfreev(levels);
+
+	for(l=0;l<io->num_levels;l++){
+		if(l==io->num_levels-1){
+			/* only the open bucket; everything before it has been printed */
+			rollup_add_level(io->rollup, io->intervals[l], 1, TRUE);
+			break;
+		}
+		/* by default a level covers one interval of the next one */
+		if(io->keeps[l]==0){
+			io->keeps[l]=io->intervals[l+1];
+		}
+		slots=(io->keeps[l]+io->intervals[l]-1)/io->intervals[l];
+		if(slots>G_MAXINT32){
+			fprintf(stderr, "tshark: io,rollup level #%u would keep too many intervals\n", l);
+			exit(10);
+		}
+		rollup_add_level(io->rollup, io->intervals[l], (guint)slots, FALSE);
+	}
+}
+
+static void
+iorollup_init(const char *optarg, void* userdata _U_)
+{
+	io_rollup_t *io;
+	const char *spec, *filter, *str, *pos;
+	char *tmp;
+	guint i;
+
+	spec=optarg+strlen("io,rollup,");
+	filter=strchr(spec, ',');
+	if(*spec=='\0' || filter==spec){
+		fprintf(stderr, "tshark: invalid \"-z io,rollup,<interval>[:<keep>][/<interval>[:<keep>]...][,<filter>]\" argument\n");
+		exit(1);
+	}
+
+	io=g_malloc0(sizeof(io_rollup_t));
+
+	/* find how many ',' separated filters we have */
+	io->num_items=1;
+	if(filter && filter[1]!='\0'){
+		for(str=filter+1;(str=strchr(str,','));str++){
+			io->num_items++;
+		}
+	}
+	io->rollup=rollup_new(io->num_items);
+	iorollup_parse_levels(io, spec, filter?(size_t)(filter-spec):strlen(spec));
+	rollup_set_row_cb(io->rollup, iorollup_print_row, io);
+
+	io->items=g_malloc0(sizeof(io_rollup_item_t)*io->num_items);
+	if(!filter || filter[1]=='\0'){
+		register_io_rollup_tap(io, 0, NULL);
+		return;
+	}
+
+	/* for each filter, register a tap listener */
+	i=0;
+	str=filter+1;
+	do{
+		pos=strchr(str,',');
+		if(pos==str){
+			register_io_rollup_tap(io, i, NULL);
+		} else if(pos==NULL) {
+			tmp=g_strdup(str);
+			register_io_rollup_tap(io, i, tmp);
+		} else {
+			tmp=g_strndup(str, pos-str);
+			register_io_rollup_tap(io, i, tmp);
+		}
+		str=pos+1;
+		i++;
+	} while(pos);
+}
+
 void
 register_tap_listener_iostat(void)
 {
 	register_stat_cmd_arg("io,stat,", iostat_init, NULL);
+	register_stat_cmd_arg("io,rollup,", iorollup_init, NULL);
 }
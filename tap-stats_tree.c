@@ -29,24 +29,32 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <errno.h>
 #include <glib.h>
 #include <epan/stats_tree_priv.h>
 #include <epan/stat_cmd_args.h>
 #include <epan/report_err.h>
+#include <wsutil/file_util.h>
 
 /* actually unused */
 struct _st_node_pres {
 	void *dummy;
 };
 
+/* only used by "-z <abbr>,save,<file>" trees */
 struct _tree_pres {
-	void** dummy;
+	gchar *save_file;	/* write the tree here instead of printing it */
 };
 
 struct _tree_cfg_pres {
 	gchar *init_string;	
+	gchar *save_string;
+	gchar *merge_string;
 };
 
+/* the trees of "-z <abbr>,merge,<file>", by abbr */
+static GHashTable *merge_trees = NULL;
+
 static void
 draw_stats_tree(void *psp)
 {
@@ -71,6 +79,149 @@ draw_stats_tree(void *psp)
 	
 }
 
+static void
+save_stats_tree(void *psp)
+{
+	stats_tree *st = (stats_tree *)psp;
+	GByteArray *buf = g_byte_array_new();
+	FILE *fh;
+	
+	stats_tree_serialize(st,buf);
+	
+	fh = ws_fopen(st->pr->save_file,"wb");
+	if (fh == NULL) {
+		report_open_failure(st->pr->save_file,errno,TRUE);
+	} else {
+		if (fwrite(buf->data,1,buf->len,fh) != buf->len || fclose(fh) != 0) {
+			report_write_failure(st->pr->save_file,errno);
+		}
+	}
+	
+	g_byte_array_free(buf,TRUE);
+}
+
+/* -z <abbr>,save,<file>[,<filter>] */
+static void
+init_stats_tree_save(const char *optarg, void *userdata _U_)
+{
+	char *abbr = stats_tree_get_abbr(optarg);
+	GString	*error_string;
+	stats_tree_cfg *cfg = NULL;
+	stats_tree *st = NULL;
+	const char *file;
+	const char *filter;
+	tree_pres *pr;
+	
+	cfg = abbr ? stats_tree_get_cfg_by_abbr(abbr) : NULL;
+	g_free(abbr);
+	if (cfg == NULL) {
+		report_failure("no such stats_tree found in stats_tree registry for '%s'",optarg);
+		return;
+	}
+	
+	file = optarg + strlen(cfg->pr->save_string);
+	filter = strchr(file,',');
+	if (file == filter || *file == '\0') {
+		report_failure("stats_tree for: %s needs a file name to save to",cfg->name);
+		return;
+	}
+	
+	pr = g_malloc(sizeof(tree_pres));
+	pr->save_file = filter ? g_strndup(file,filter-file) : g_strdup(file);
+	st = stats_tree_new(cfg,pr,filter ? filter+1 : NULL);
+	
+	error_string = register_tap_listener(st->cfg->tapname,
+					     st,
+					     st->filter,
+					     st->cfg->flags,
+					     stats_tree_reset,
+					     stats_tree_packet,
+					     save_stats_tree);
+	
+	if (error_string) {
+		report_failure("stats_tree for: %s failed to attach to the tap: %s",cfg->name,error_string->str);
+		g_string_free(error_string, TRUE);
+		/* frees pr too */
+		stats_tree_free(st);
+		return;
+	}
+	
+	if (cfg->init) cfg->init(st);
+}
+
+/* -z <abbr>,merge,<file>: all the files given for one abbr are merged
+   into one tree, which also counts the packets read, and is printed */
+static void
+init_stats_tree_merge(const char *optarg, void *userdata _U_)
+{
+	char *abbr = stats_tree_get_abbr(optarg);
+	GString	*error_string;
+	stats_tree_cfg *cfg = NULL;
+	stats_tree *st = NULL;
+	const char *file;
+	gchar *contents;
+	gsize len;
+	GError *err = NULL;
+	gchar *file_abbr, *file_filter;
+	const gchar *errmsg;
+	
+	cfg = abbr ? stats_tree_get_cfg_by_abbr(abbr) : NULL;
+	g_free(abbr);
+	if (cfg == NULL) {
+		report_failure("no such stats_tree found in stats_tree registry for '%s'",optarg);
+		return;
+	}
+	
+	file = optarg + strlen(cfg->pr->merge_string);
+	if (!g_file_get_contents(file,&contents,&len,&err)) {
+		report_failure("stats_tree for: %s could not read %s: %s",cfg->name,file,err->message);
+		g_error_free(err);
+		return;
+	}
+	
+	if (!merge_trees) merge_trees = g_hash_table_new(g_str_hash,g_str_equal);
+	st = g_hash_table_lookup(merge_trees,cfg->abbr);
+	
+	if (st == NULL) {
+		/* the first file gives the filter */
+		errmsg = stats_tree_serialized_info((guint8 *)contents,len,&file_abbr,&file_filter);
+		if (errmsg) {
+			report_failure("stats_tree for: %s could not merge %s: %s",cfg->name,file,errmsg);
+			g_free(contents);
+			return;
+		}
+		st = stats_tree_new(cfg,NULL,file_filter);
+		g_free(file_abbr);
+		g_free(file_filter);
+		
+		error_string = register_tap_listener(st->cfg->tapname,
+						     st,
+						     st->filter,
+						     st->cfg->flags,
+						     stats_tree_reset,
+						     stats_tree_packet,
+						     draw_stats_tree);
+		
+		if (error_string) {
+			report_failure("stats_tree for: %s failed to attach to the tap: %s",cfg->name,error_string->str);
+			g_string_free(error_string, TRUE);
+			stats_tree_free(st);
+			g_free(contents);
+			return;
+		}
+		
+		/* create the nodes of init first, so they keep their ids */
+		if (cfg->init) cfg->init(st);
+		g_hash_table_insert(merge_trees,cfg->abbr,st);
+	}
+	
+	errmsg = stats_tree_merge_serialized(st,(guint8 *)contents,len);
+	if (errmsg) {
+		report_failure("stats_tree for: %s could not merge %s: %s",cfg->name,file,errmsg);
+	}
+	g_free(contents);
+}
+
 static void
 init_stats_tree(const char *optarg, void *userdata _U_)
 {
@@ -125,14 +276,20 @@ register_stats_tree_tap (gpointer k _U_, gpointer v, gpointer p _U_)
 	
 	cfg->pr = (tree_cfg_pres *)g_malloc(sizeof(tree_cfg_pres));
 	cfg->pr->init_string = g_strdup_printf("%s,tree", cfg->abbr);
+	cfg->pr->save_string = g_strdup_printf("%s,save,", cfg->abbr);
+	cfg->pr->merge_string = g_strdup_printf("%s,merge,", cfg->abbr);
 
 	register_stat_cmd_arg(cfg->pr->init_string, init_stats_tree, NULL);
+	register_stat_cmd_arg(cfg->pr->save_string, init_stats_tree_save, NULL);
+	register_stat_cmd_arg(cfg->pr->merge_string, init_stats_tree_merge, NULL);
 	
 }
 
 static void
 free_tree_presentation(stats_tree *st)
 {
+	if (st->pr)
+		g_free(st->pr->save_file);
 	g_free(st->pr);
 }
 
@@ -49,6 +49,8 @@ WIRESHARK=$WS_BIN_PATH/wireshark
 TSHARK=$WS_BIN_PATH/tshark
 CAPINFOS=$WS_BIN_PATH/capinfos
 DUMPCAP=$WS_BIN_PATH/dumpcap
+TEXT2PCAP=$WS_BIN_PATH/text2pcap
+CAPSEARCH=$WS_BIN_PATH/capsearch
 
 # interface with at least a few packets/sec traffic on it
 # (e.g. start a web radio to generate some traffic :-)
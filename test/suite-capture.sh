@@ -199,6 +199,121 @@ capture_step_fifo() {
 	fi
 }
 
+# write packets from a pipe through the writer thread (-W) and compare
+# the file with the one written the usual way
+capture_step_writer_thread() {
+	# 4 packets, doubled 12 times: 16384 packets, some 5 MB, so several
+	# 1 MB blocks, and a pause for a partly filled one to go out
+	tail -c +25 $CAPFILE > ./testout_body.bin
+	for (( x=0; x<12; x++ ))
+	do
+		cat ./testout_body.bin ./testout_body.bin > ./testout_body2.bin
+		mv ./testout_body2.bin ./testout_body.bin
+	done
+
+	(head -c 24 $CAPFILE; cat ./testout_body.bin; sleep 2; cat ./testout_body.bin) | \
+		$DUT -i - -w ./testout.pcap > ./testout.txt 2>&1
+	RETURNVALUE=$?
+	if [ ! $RETURNVALUE -eq $EXIT_OK ]; then
+		echo
+		cat ./testout.txt
+		test_step_failed "exit status of $DUT: $RETURNVALUE"
+		return
+	fi
+
+	(head -c 24 $CAPFILE; cat ./testout_body.bin; sleep 2; cat ./testout_body.bin) | \
+		$DUT -i - -W 1 -w ./testout2.pcap > ./testout.txt 2>&1
+	RETURNVALUE=$?
+	if [ ! $RETURNVALUE -eq $EXIT_OK ]; then
+		echo
+		cat ./testout.txt
+		test_step_failed "exit status of $DUT -W: $RETURNVALUE"
+		return
+	fi
+
+	$CAPINFOS ./testout2.pcap > ./testout2.txt
+	grep -Ei 'Number of packets:[[:blank:]]+32768' ./testout2.txt > /dev/null
+	if [ $? -ne 0 ]; then
+		echo
+		cat ./testout.txt ./testout2.txt
+		test_step_failed "Not all packets were written."
+		return
+	fi
+
+	if cmp -s ./testout.pcap ./testout2.pcap; then
+		test_step_ok
+	else
+		echo
+		cat ./testout.txt
+		test_step_failed "The writer thread wrote a different file."
+	fi
+}
+
+# count the packets capsearch copies out of the indexed ring buffer;
+# "none" if it finds none and so writes no file
+capture_index_count() {
+	rm -f ./testout2.pcap
+	$CAPSEARCH "$@" -w ./testout2.pcap ./testout_ring_*.pcap >> ./testout.txt 2>&1
+	if [ ! -f ./testout2.pcap ]; then
+		echo none
+		return
+	fi
+	$CAPINFOS ./testout2.pcap 2>> ./testout.txt | \
+		sed -n 's/^Number of packets:[[:blank:]]*//p'
+}
+
+# write indexes of the files of a ring buffer fed from a pipe (-x) and
+# pick packets out of them with capsearch
+capture_step_index() {
+	# 5 UDP packets each of ports 1000 to 1007, from 1.1.1.1 to 2.2.2.2
+	rm -f ./testout_udp.bin
+	for (( port=1000; port<1008; port++ ))
+	do
+		for (( x=0; x<5; x++ ))
+		do
+			echo "000000 00 01 02 03 04 05 06 07 08 09 0a 0b 0c 0d 0e 0f"
+			echo "000010 10 11 12 13 14 15 16 17 18 19 1a 1b 1c 1d 1e 1f"
+		done > ./testout.txt
+		$TEXT2PCAP -q -u $port,80 ./testout.txt ./testout2.pcap
+		tail -c +25 ./testout2.pcap >> ./testout_udp.bin
+	done
+
+	# 50 rounds of those and the 4 DHCP packets of $CAPFILE, two of which
+	# are from 192.168.0.1 port 67; some 300 kB in 64 kB files
+	(head -c 24 $CAPFILE
+	 for (( x=0; x<50; x++ ))
+	 do
+		tail -c +25 $CAPFILE
+		cat ./testout_udp.bin
+	 done) | \
+		$DUT -i - -x -b filesize:64 -w ./testout_ring.pcap > ./testout.txt 2>&1
+	RETURNVALUE=$?
+	if [ ! $RETURNVALUE -eq $EXIT_OK ]; then
+		echo
+		cat ./testout.txt
+		test_step_failed "exit status of $DUT: $RETURNVALUE"
+		return
+	fi
+	for f in ./testout_ring_*.pcap
+	do
+		if [ ! -f "$f.idx" ]; then
+			test_step_failed "No index for $f!"
+			return
+		fi
+	done
+
+	COUNTS="`capture_index_count -P 1003` `capture_index_count -H 192.168.0.1`"
+	COUNTS="$COUNTS `capture_index_count -H 192.168.0.1 -P 67`"
+	COUNTS="$COUNTS `capture_index_count -H 2.2.2.2 -P 68` `capture_index_count -P 9`"
+	if [ "$COUNTS" = "250 100 100 none none" ]; then
+		test_step_ok
+	else
+		echo
+		cat ./testout.txt
+		test_step_failed "capsearch found $COUNTS packets, not 250 100 100 none none."
+	fi
+}
+
 # capture exactly 2 times 10 packets (multiple files)
 capture_step_2multi_10packets() {
         if [ $SKIP_CAPTURE -ne 0 ] ; then
@@ -378,6 +493,8 @@ dumpcap_capture_suite() {
 	if [ $TEST_FIFO ]; then
 		test_step_add "Capture via fifo" capture_step_fifo
 	fi
+	test_step_add "Capture from a pipe with the writer thread: -W" capture_step_writer_thread
+	test_step_add "Index a ring buffer and search it: -x, capsearch" capture_step_index
 	# read (display) filters intentionally doesn't work with dumpcap!
 	#test_step_add "Capture read filter (${TRAFFIC_CAPTURE_DURATION}s)" capture_step_read_filter
 	test_step_add "Capture snapshot length 68 bytes (${TRAFFIC_CAPTURE_DURATION}s)" capture_step_snapshot
@@ -389,6 +506,9 @@ capture_cleanup_step() {
 	rm -f ./testout2.txt
 	rm -f ./testout.pcap
 	rm -f ./testout2.pcap
+	rm -f ./testout_body.bin
+	rm -f ./testout_udp.bin
+	rm -f ./testout_ring_*
 }
 
 capture_suite() {
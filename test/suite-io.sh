@@ -125,6 +125,44 @@ io_step_input_piping() {
 	fi
 }
 
+# text dumps in text2pcap/, converted both in one thread and in several
+io_step_text2pcap() {
+	for input in od hexdump comments timestamps malformed ; do
+		for jobs in 1 4 ; do
+			# the time stamps of the dumps are taken as local time
+			TZ=UTC $DUT -q -j $jobs -t "%Y-%m-%d %H:%M:%S." \
+				text2pcap/$input.txt ./testout.pcap > ./testout.txt 2>&1
+			RETURNVALUE=$?
+			if [ ! $RETURNVALUE -eq $EXIT_OK ]; then
+				echo
+				cat ./testout.txt
+				test_step_failed "exit status of $DUT for $input.txt: $RETURNVALUE"
+				return
+			fi
+
+			# text2pcap writes in the byte order of the host, so
+			# compare the packets TShark reads from the files
+			$TSHARK -r text2pcap/$input.pcap -t e -x > ./testout.txt 2>&1
+			RETURNVALUE=$?
+			if [ ! $RETURNVALUE -eq $EXIT_OK ]; then
+				echo
+				cat ./testout.txt
+				test_step_failed "exit status of $TSHARK for $input.pcap: $RETURNVALUE"
+				return
+			fi
+			$TSHARK -r ./testout.pcap -t e -x > ./testout2.txt 2>&1
+			diff ./testout.txt ./testout2.txt > /dev/null
+			if [ $? -ne 0 ]; then
+				echo
+				diff ./testout.txt ./testout2.txt
+				test_step_failed "$input.txt with -j $jobs doesn't give the packets of $input.pcap"
+				return
+			fi
+		done
+	done
+	test_step_ok
+}
+
 wireshark_io_suite() {
 	# Q: quit after cap, k: start capture immediately
 	DUT="$WIRESHARK"
@@ -138,6 +176,11 @@ tshark_io_suite() {
 	#test_step_add "Piping" io_step_input_piping
 }
 
+text2pcap_io_suite() {
+	DUT=$TEXT2PCAP
+	test_step_add "Text dumps" io_step_text2pcap
+}
+
 dumpcap_io_suite() {
 	#DUT="$DUMPCAP -Q"
 	DUT=$DUMPCAP
@@ -156,6 +199,7 @@ io_suite() {
 	test_step_set_pre io_cleanup_step
 	test_step_set_post io_cleanup_step
 	test_suite_add "TShark file I/O" tshark_io_suite
+	test_suite_add "Text2pcap file I/O" text2pcap_io_suite
 	#test_suite_add "Wireshark file I/O" wireshark_io_suite
 	#test_suite_add "Dumpcap file I/O" dumpcap_io_suite
 }
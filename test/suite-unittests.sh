@@ -78,6 +78,16 @@ unittests_step_tvbtest() {
 	unittests_step_test
 }
 
+unittests_step_addr_resolv_test() {
+	DUT=../epan/addr_resolv_test
+	unittests_step_test
+}
+
+unittests_step_time_fmt_test() {
+	DUT=../epan/time_fmt_test
+	unittests_step_test
+}
+
 unittests_cleanup_step() {
 	rm -f ./testout.txt
 }
@@ -88,4 +98,6 @@ unittests_suite() {
 	test_step_add "exntest" unittests_step_exntest
 	test_step_add "reassemble_test" unittests_step_reassemble_test
 	test_step_add "tvbtest" unittests_step_tvbtest
+	test_step_add "addr_resolv_test" unittests_step_addr_resolv_test
+	test_step_add "time_fmt_test" unittests_step_time_fmt_test
 }
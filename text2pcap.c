@@ -114,6 +114,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <wsutil/file_util.h>
+#include <wsutil/processors.h>
 
 #include <time.h>
 #include <glib.h>
@@ -212,6 +213,10 @@ static FILE *output_file = NULL;
 /* Offset base to parse */
 static unsigned long offset_base = 16;
 
+/* Threads to parse the input with; 0 means one per processor */
+#define MAX_JOBS 16
+static int max_jobs = 0;
+
 extern FILE *yyin;
 
 /* ----- State machine -----------------------------------------------------------*/
@@ -351,6 +356,16 @@ struct pcaprec_hdr {
 /* Link-layer type; see net/bpf.h for details */
 static unsigned long pcap_link_type = 1;   /* Default is DLT-EN10MB */
 
+/* A record is put together here, and written with one fwrite() */
+#define RECORD_BUF_LEN (sizeof(struct pcaprec_hdr) + sizeof(HDR_ETHERNET) + \
+                        sizeof(HDR_IP) + sizeof(HDR_TCP) + sizeof(HDR_SCTP) + \
+                        sizeof(HDR_DATA_CHUNK) + MAX_PACKET + 64)
+static guint8 record_buf[RECORD_BUF_LEN];
+static size_t record_len = 0;
+
+/* Output is written in blocks of this size */
+#define OUTPUT_BUF_LEN (1024*1024)
+
 /*----------------------------------------------------------------------
  * Parse a single hex number
  * Will abort the program if it can't parse the number
@@ -535,6 +550,24 @@ number_of_padding_bytes (unsigned long length)
     return 4 - remainder;
 }
 
+/*----------------------------------------------------------------------
+ * Add to the record being put together
+ */
+static void
+write_record_data (const void *data, size_t len)
+{
+    if (record_len + len > sizeof(record_buf)) {
+        fwrite(record_buf, record_len, 1, output_file);
+        record_len = 0;
+        if (len > sizeof(record_buf)) {
+            fwrite(data, len, 1, output_file);
+            return;
+        }
+    }
+    memcpy(record_buf + record_len, data, len);
+    record_len += len;
+}
+
 /*----------------------------------------------------------------------
  * Write current packet out
  */
@@ -574,12 +607,12 @@ write_current_packet (void)
         if (ts_fmt == NULL) { ts_usec++; }	/* fake packet counter */
         ph.incl_len = length;
         ph.orig_len = length;
-        fwrite(&ph, sizeof(ph), 1, output_file);
+        write_record_data(&ph, sizeof(ph));
 
         /* Write Ethernet header */
         if (hdr_ethernet) {
             HDR_ETHERNET.l3pid = g_htons(hdr_ethernet_proto);
-            fwrite(&HDR_ETHERNET, sizeof(HDR_ETHERNET), 1, output_file);
+            write_record_data(&HDR_ETHERNET, sizeof(HDR_ETHERNET));
         }
 
         /* Write IP header */
@@ -588,7 +621,7 @@ write_current_packet (void)
             HDR_IP.protocol = (guint8) hdr_ip_proto;
             HDR_IP.hdr_checksum = 0;
             HDR_IP.hdr_checksum = in_checksum(&HDR_IP, sizeof(HDR_IP));
-            fwrite(&HDR_IP, sizeof(HDR_IP), 1, output_file);
+            write_record_data(&HDR_IP, sizeof(HDR_IP));
         }
 
 	/* initialize pseudo header for checksum calculation */
@@ -612,7 +645,7 @@ write_current_packet (void)
 	    if (HDR_UDP.checksum == 0) /* differenciate between 'none' and 0 */
 	    	    HDR_UDP.checksum = g_htons(1);
 
-            fwrite(&HDR_UDP, sizeof(HDR_UDP), 1, output_file);
+            write_record_data(&HDR_UDP, sizeof(HDR_UDP));
         }
 
         /* Write TCP header */
@@ -630,7 +663,7 @@ write_current_packet (void)
 	    if (HDR_TCP.checksum == 0) /* differenciate between 'none' and 0 */
 	    	    HDR_TCP.checksum = g_htons(1);
 
-            fwrite(&HDR_TCP, sizeof(HDR_TCP), 1, output_file);
+            write_record_data(&HDR_TCP, sizeof(HDR_TCP));
         }
 
         /* Compute DATA chunk header and append padding */
@@ -659,22 +692,25 @@ write_current_packet (void)
               HDR_SCTP.checksum  = crc32c((guint8 *)&HDR_DATA_CHUNK, sizeof(HDR_DATA_CHUNK), HDR_SCTP.checksum);
             HDR_SCTP.checksum  = g_htonl(finalize_crc32c(crc32c(packet_buf, curr_offset, HDR_SCTP.checksum)));
 
-            fwrite(&HDR_SCTP, sizeof(HDR_SCTP), 1, output_file);
+            write_record_data(&HDR_SCTP, sizeof(HDR_SCTP));
         }
 
         /* Write DATA chunk header */
         if (hdr_data_chunk) {
-            fwrite(&HDR_DATA_CHUNK, sizeof(HDR_DATA_CHUNK), 1, output_file);
+            write_record_data(&HDR_DATA_CHUNK, sizeof(HDR_DATA_CHUNK));
         }
         /* Write packet */
-        fwrite(packet_buf, curr_offset, 1, output_file);
+        write_record_data(packet_buf, curr_offset);
 
         /* Write Ethernet trailer */
         if (hdr_ethernet && eth_trailer_length > 0) {
             memset(tempbuf, 0, eth_trailer_length);
-            fwrite(tempbuf, eth_trailer_length, 1, output_file);
+            write_record_data(tempbuf, eth_trailer_length);
         }
 
+        fwrite(record_buf, record_len, 1, output_file);
+        record_len = 0;
+
         if (!quiet)
             fprintf(stderr, "Wrote packet of %lu bytes at %u\n", curr_offset, g_ntohl(HDR_TCP.seq_num));
         num_packets_written ++;
@@ -1022,6 +1058,410 @@ parse_token (token_t token, char *str)
 
 }
 
+/*----------------------------------------------------------------------
+ * Fast path for the common layout
+ *
+ * Lines made of an offset of three to eight digits, bytes, and text
+ * with no '#' in it are parsed here, with a table lookup per digit,
+ * rather than by the scanner; all other lines are handed to the
+ * scanner as they are.  The input is read in large blocks, cut at the
+ * starts of packets into a chunk per thread; the threads parse their
+ * chunks into bytes, and the lines are then applied to the packets in
+ * order, so the output is the same as if the scanner had read it all.
+ */
+
+/* Input read at a time, per thread */
+#define INPUT_CHUNK_LEN (1024*1024)
+
+typedef struct {
+    const char    *text;        /* the line, including its end of line */
+    guint32        text_len;
+    gboolean       scanner;     /* to be handed to the scanner; may be
+                                   several lines */
+    unsigned long  offset;      /* the offset, read as hex */
+    const char    *offset_str;  /* the offset token, as the scanner has it */
+    int            offset_len;
+    guint32        data;        /* where its bytes are in the chunk's data */
+    guint32        data_len;
+} hex_line_t;
+
+typedef struct {
+    const char    *start;
+    const char    *end;
+    GArray        *lines;       /* of hex_line_t */
+    guint8        *data;        /* the bytes of all the lines */
+    size_t         data_size;
+} hex_chunk_t;
+
+static gint8 hex_value[256];
+
+static void
+init_hex_value (void)
+{
+    int i;
+
+    for (i = 0; i < 256; i++)
+        hex_value[i] = -1;
+    for (i = 0; i < 10; i++)
+        hex_value['0' + i] = i;
+    for (i = 0; i < 6; i++) {
+        hex_value['a' + i] = 10 + i;
+        hex_value['A' + i] = 10 + i;
+    }
+}
+
+#define IS_HEX(c)   (hex_value[(guchar)(c)] >= 0)
+#define IS_BLANK(c) ((c) == ' ' || (c) == '\t')
+
+/*
+ * Can the input be cut before "p", the start of a line?  The scanner
+ * may not end a token at the newline before it if "p" starts with a
+ * '\r' (part of an end of line) or if there's a '#' just before that
+ * newline (a comment that goes on to the next line).
+ */
+static gboolean
+is_line_boundary (const char *start, const char *p)
+{
+    return p - start >= 2 && p[-1] == '\n' && *p != '\r' && p[-2] != '#';
+}
+
+/*
+ * Parse the line at "p" if it's in the common layout; returns the start
+ * of the next line, or NULL if the line is to be handed to the scanner.
+ *
+ * This has to cut the line into tokens just as the scanner would: the
+ * offset must be followed by a blank, perhaps after a ':'; a byte is two
+ * digits followed by a blank or an end of line; and anything else starts
+ * the text, which is ignored.  The end of line takes a '\r' after the
+ * newline along with it, unless the newline ends a byte or offset.
+ */
+static const char *
+parse_hex_line (const char *p, const char *end, hex_line_t *line, guint8 *data)
+{
+    const char *s, *w, *nl;
+    unsigned long offset = 0;
+    guint32 n = 0;
+    gboolean eol_hex;
+
+    while (p < end && IS_BLANK(*p))
+        p++;
+    s = p;
+    while (p < end && IS_HEX(*p)) {
+        offset = (offset << 4) | hex_value[(guchar)*p];
+        p++;
+    }
+    if (p - s < 3 || p - s > 8 || p >= end)
+        return NULL;
+    if (*p == ':')
+        p++;
+    if (p >= end || !IS_BLANK(*p))
+        return NULL;
+    line->offset = offset;
+    line->offset_str = s;
+    line->offset_len = (int)(p + 1 - s);
+
+    for (;;) {
+        while (p < end && IS_BLANK(*p))
+            p++;
+        if (end - p < 3 || !IS_HEX(p[0]) || !IS_HEX(p[1]))
+            break;
+        if (IS_BLANK(p[2])) {
+            data[n++] = (hex_value[(guchar)p[0]] << 4) | hex_value[(guchar)p[1]];
+            p += 3;
+        } else if (p[2] == '\n') {
+            data[n++] = (hex_value[(guchar)p[0]] << 4) | hex_value[(guchar)p[1]];
+            line->data_len = n;
+            return p + 3;
+        } else if (end - p >= 4 && p[2] == '\r' && p[3] == '\n') {
+            data[n++] = (hex_value[(guchar)p[0]] << 4) | hex_value[(guchar)p[1]];
+            line->data_len = n;
+            return p + 4;
+        } else
+            break;
+    }
+    line->data_len = n;
+
+    /* The text, if any */
+    nl = memchr(p, '\n', end - p);
+    if (nl == NULL || memchr(p, '#', nl - p) != NULL)
+        return NULL;
+    /* Does it end with a byte or offset, ending at the newline? */
+    w = nl;
+    if (w > p && w[-1] == '\r')
+        w--;
+    s = w;
+    while (s > p && !IS_BLANK(s[-1]))
+        s--;
+    eol_hex = (s < w);
+    for (; s < w; s++) {
+        if (!IS_HEX(*s)) {
+            eol_hex = FALSE;
+            break;
+        }
+    }
+    nl++;
+    if (!eol_hex && nl < end && *nl == '\r')
+        nl++;
+    return nl;
+}
+
+/*
+ * Cut a chunk into lines, parsing those in the common layout.
+ */
+static void
+parse_hex_chunk (hex_chunk_t *chunk)
+{
+    const char *p = chunk->start;
+    const char *end = chunk->end;
+    const char *next;
+    hex_line_t line, *prev;
+    guint32 data = 0;
+
+    g_array_set_size(chunk->lines, 0);
+    while (p < end) {
+        /* A blank line is just an end of line, which does nothing here */
+        next = p;
+        while (next < end && IS_BLANK(*next))
+            next++;
+        if (next < end && *next == '\r')
+            next++;
+        if (next < end && *next == '\n') {
+            next++;
+            if (next < end && *next == '\r')
+                next++;
+            p = next;
+            continue;
+        }
+
+        line.text = p;
+        line.data = data;
+        next = parse_hex_line(p, end, &line, chunk->data + data);
+        if (next != NULL) {
+            line.scanner = FALSE;
+            data += line.data_len;
+        } else {
+            /* Hand the scanner this line and any it may run into */
+            next = p;
+            do {
+                next = memchr(next, '\n', end - next);
+                next = (next == NULL) ? end : next + 1;
+            } while (next < end && !is_line_boundary(p, next));
+            line.scanner = TRUE;
+            line.data_len = 0;
+            if (chunk->lines->len != 0) {
+                prev = &g_array_index(chunk->lines, hex_line_t,
+                                      chunk->lines->len - 1);
+                if (prev->scanner && prev->text + prev->text_len == p) {
+                    prev->text_len = (guint32)(next - prev->text);
+                    p = next;
+                    continue;
+                }
+            }
+        }
+        line.text_len = (guint32)(next - p);
+        g_array_append_val(chunk->lines, line);
+        p = next;
+    }
+}
+
+#ifdef G_THREADS_ENABLED
+static gpointer
+parse_hex_chunk_thread (gpointer data)
+{
+    parse_hex_chunk((hex_chunk_t *)data);
+    return NULL;
+}
+#endif
+
+/*
+ * Apply a parsed line to the packets, as parse_token() would apply its
+ * tokens; returns FALSE, having done nothing, if text on the line would
+ * go into the preamble, leaving the line to the scanner.
+ */
+static gboolean
+apply_hex_line (const hex_line_t *line, const guint8 *data)
+{
+    unsigned long num;
+    unsigned long room;
+    guint32 n, len;
+    char str[16];
+
+    if (offset_base == 16)
+        num = line->offset;
+    else {
+        memcpy(str, line->offset_str, line->offset_len);
+        str[line->offset_len] = '\0';
+        num = parse_num(str, TRUE);
+    }
+    switch (state) {
+    case INIT:
+        if (num != 0)
+            return FALSE;
+        start_new_packet();
+        break;
+
+    case START_OF_LINE:
+        if (num == 0) {
+            start_new_packet();
+            packet_start = 0;
+        } else if ((num - packet_start) != curr_offset) {
+            /* A bad offset ends the packet */
+            if (num >= curr_offset)
+                return FALSE;
+            unwrite_bytes(curr_offset - num);
+        }
+        break;
+
+    default:
+        return FALSE;
+    }
+
+    for (n = 0; n < line->data_len; n += len) {
+        room = (max_offset > curr_offset) ? max_offset - curr_offset : 1;
+        len = line->data_len - n;
+        if (len > room)
+            len = (guint32)room;
+        memcpy(&packet_buf[curr_offset], data + n, len);
+        curr_offset += len;
+        if (curr_offset >= max_offset) /* packet full */
+            start_new_packet();
+    }
+    state = START_OF_LINE;
+    return TRUE;
+}
+
+/*
+ * Where to cut the input between "from" and "to": at the first packet
+ * start, or, failing that, the first place it can be cut at all.
+ */
+static const char *
+find_chunk_end (const char *start, const char *from, const char *to)
+{
+    const char *p, *cut = NULL;
+
+    for (p = from; p < to; p++) {
+        p = memchr(p, '\n', to - p);
+        if (p == NULL || ++p >= to)
+            break;
+        if (!is_line_boundary(start, p))
+            continue;
+        if (to - p >= 3 && p[0] == '0' && p[1] == '0' && p[2] == '0') {
+            cut = p;
+            break;
+        }
+        if (cut == NULL)
+            cut = p;
+    }
+    return (cut != NULL) ? cut : to;
+}
+
+/*
+ * Read and convert the input.
+ */
+static void
+parse_input (int n_jobs)
+{
+    hex_chunk_t chunks[MAX_JOBS];
+#ifdef G_THREADS_ENABLED
+    GThread *threads[MAX_JOBS];
+#endif
+    char *buf;
+    size_t buf_size, buf_len = 0, n;
+    const char *end, *p;
+    hex_line_t *line;
+    gboolean eof = FALSE;
+    int i, j;
+    guint k;
+
+    init_hex_value();
+    buf_size = n_jobs * INPUT_CHUNK_LEN;
+    buf = g_malloc(buf_size);
+    for (i = 0; i < n_jobs; i++) {
+        chunks[i].lines = g_array_new(FALSE, FALSE, sizeof(hex_line_t));
+        chunks[i].data = NULL;
+        chunks[i].data_size = 0;
+    }
+
+    while (!eof || buf_len != 0) {
+        if (!eof) {
+            n = fread(buf + buf_len, 1, buf_size - buf_len, input_file);
+            if (n == 0) {
+                if (ferror(input_file)) {
+                    fprintf(stderr, "Error reading %s: %s\n",
+                            input_filename, g_strerror(errno));
+                    exit(-1);
+                }
+                eof = TRUE;
+            }
+            buf_len += n;
+        }
+
+        /* Leave the last, possibly incomplete, line for the next block */
+        end = buf + buf_len;
+        if (!eof) {
+            for (p = end - 1; p > buf && !is_line_boundary(buf, p); p--)
+                ;
+            if (p == buf) {
+                /* a very long line */
+                buf_size *= 2;
+                buf = g_realloc(buf, buf_size);
+                continue;
+            }
+            end = p;
+        }
+
+        /* Cut it into chunks, and parse them */
+        p = buf;
+        for (i = 0; i < n_jobs; i++) {
+            chunks[i].start = p;
+            if (i == n_jobs - 1)
+                chunks[i].end = end;
+            else
+                chunks[i].end = find_chunk_end(buf, p + (end - p) / (n_jobs - i), end);
+            p = chunks[i].end;
+            /* A byte takes at least three characters */
+            n = (chunks[i].end - chunks[i].start) / 3 + 1;
+            if (n > chunks[i].data_size) {
+                chunks[i].data_size = n;
+                chunks[i].data = g_realloc(chunks[i].data, n);
+            }
+        }
+        for (i = 1; i < n_jobs; i++) {
+#ifdef G_THREADS_ENABLED
+            threads[i] = NULL;
+            if (chunks[i].end != chunks[i].start)
+                threads[i] = g_thread_create(parse_hex_chunk_thread, &chunks[i],
+                                             TRUE, NULL);
+            if (threads[i] == NULL)
+#endif
+                parse_hex_chunk(&chunks[i]);
+        }
+        parse_hex_chunk(&chunks[0]);
+
+        for (i = 0; i < n_jobs; i++) {
+#ifdef G_THREADS_ENABLED
+            if (i != 0 && threads[i] != NULL)
+                g_thread_join(threads[i]);
+#endif
+            for (k = 0; k < chunks[i].lines->len; k++) {
+                line = &g_array_index(chunks[i].lines, hex_line_t, k);
+                if (line->scanner ||
+                    !apply_hex_line(line, chunks[i].data + line->data))
+                    scan_text(line->text, line->text_len);
+            }
+        }
+
+        buf_len -= end - buf;
+        memmove(buf, end, buf_len);
+    }
+
+    for (j = 0; j < n_jobs; j++) {
+        g_array_free(chunks[j].lines, TRUE);
+        g_free(chunks[j].data);
+    }
+    g_free(buf);
+}
+
 /*----------------------------------------------------------------------
  * Print usage string and exit
  */
@@ -1044,6 +1484,8 @@ usage (void)
             "\n"
             "Input:\n"
             "  -o hex|oct|dec         parse offsets as (h)ex, (o)ctal or (d)ecimal; default is hex.\n"
+            "  -j <jobs>              parse the input with up to <jobs> threads; default is\n"
+            "                         the number of processors, up to %d.\n"
             "  -t <timefmt>           treat the text before the packet as a date/time code;\n"
             "                         the specified argument is a format string of the sort\n"
             "                         supported by strptime.\n"
@@ -1095,7 +1537,7 @@ usage (void)
             "  -d                     show detailed debug of parser states.\n"
             "  -q                     generate no output at all (automatically turns off -d).\n"
             "",
-            VERSION, MAX_PACKET);
+            VERSION, MAX_JOBS, MAX_PACKET);
 
     exit(-1);
 }
@@ -1110,12 +1552,21 @@ parse_options (int argc, char *argv[])
     char *p;
 
     /* Scan CLI parameters */
-    while ((c = getopt(argc, argv, "dhqe:i:l:m:o:u:s:S:t:T:")) != -1) {
+    while ((c = getopt(argc, argv, "dhqe:i:j:l:m:o:u:s:S:t:T:")) != -1) {
         switch(c) {
         case '?': usage(); break;
         case 'h': usage(); break;
         case 'd': if (!quiet) debug++; break;
         case 'q': quiet = TRUE; debug = FALSE; break;
+        case 'j':
+            max_jobs = strtol(optarg, &p, 10);
+            if (p == optarg || *p != '\0' || max_jobs < 1) {
+                fprintf(stderr, "Bad argument for '-j': %s\n", optarg);
+                usage();
+            }
+            if (max_jobs > MAX_JOBS)
+                max_jobs = MAX_JOBS;
+            break;
         case 'l': pcap_link_type = strtol(optarg, NULL, 0); break;
         case 'm': max_offset = strtol(optarg, NULL, 0); break;
         case 'o':
@@ -1353,15 +1804,31 @@ parse_options (int argc, char *argv[])
 
 int main(int argc, char *argv[])
 {
+#ifdef G_THREADS_ENABLED
+    /* Before any other GLib call */
+    if (!g_thread_supported())
+        g_thread_init(NULL);
+#endif
+
     parse_options(argc, argv);
 
     assert(input_file != NULL);
     assert(output_file != NULL);
 
+    setvbuf(output_file, NULL, _IOFBF, OUTPUT_BUF_LEN);
+
     write_file_header();
 
-    yyin = input_file;
-    yylex();
+    if (debug >= 2) {
+        /* Let the scanner see every token, so they're all shown */
+        yyin = input_file;
+        yylex();
+    } else {
+        /* One thread per processor if -j isn't given */
+        if (max_jobs == 0)
+            max_jobs = get_processor_count(MAX_JOBS);
+        parse_input(max_jobs);
+    }
 
     write_current_packet();
     if (debug)
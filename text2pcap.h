@@ -46,4 +46,6 @@ void parse_token(token_t token, char *str);
 
 int yylex(void);
 
+void scan_text(const char *text, int len);
+
 #endif
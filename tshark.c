@@ -120,7 +120,8 @@ static gboolean perform_two_pass_analysis;
 typedef enum {
 	WRITE_TEXT,	/* summary or detail text */
 	WRITE_XML,	/* PDML or PSML */
-	WRITE_FIELDS	/* User defined list of fields */
+	WRITE_FIELDS,	/* User defined list of fields */
+	WRITE_COLUMNAR	/* User defined list of fields, as binary column batches */
 	/* Add CSV and the like here */
 } output_action_e;
 
@@ -276,9 +277,10 @@ print_usage(gboolean print_ver)
   fprintf(output, "  -V                       add output of packet tree        (Packet Details)\n");
   fprintf(output, "  -S                       display packets even when writing to a file\n");
   fprintf(output, "  -x                       add output of hex and ASCII dump (Packet Bytes)\n");
-  fprintf(output, "  -T pdml|ps|psml|text|fields\n");
+  fprintf(output, "  -T pdml|ps|psml|text|fields|columnar\n");
   fprintf(output, "                           format of text output (def: text)\n");
-  fprintf(output, "  -e <field>               field to print if -Tfields selected (e.g. tcp.port);\n");
+  fprintf(output, "  -e <field>               field to print if -Tfields or -Tcolumnar selected\n");
+  fprintf(output, "                           (e.g. tcp.port);\n");
   fprintf(output, "                           this option can be repeated to print multiple fields\n");
   fprintf(output, "  -E<fieldsoption>=<value> set options for output when -Tfields selected:\n");
   fprintf(output, "     header=y|n            switch headers on and off\n");
@@ -286,6 +288,7 @@ print_usage(gboolean print_ver)
   fprintf(output, "     occurrence=f|l|a      print first, last or all occurrences of each field\n");
   fprintf(output, "     aggregator=,|/s|<char> select comma, space, printable character as aggregator\n");
   fprintf(output, "     quote=d|s|n           select double, single, no quotes for values\n");
+  fprintf(output, "     batch=<rows>          rows per record batch for -Tcolumnar\n");
   fprintf(output, "  -t ad|a|r|d|dd|e         output format of time stamps (def: r: rel. to first)\n");
   fprintf(output, "  -u s|hms                 output format of seconds (def: s: seconds)\n");
   fprintf(output, "  -l                       flush standard output after each packet\n");
@@ -824,6 +827,12 @@ main(int argc, char *argv[])
 
   static const char    optstring[] = OPTSTRING;
 
+#ifdef G_THREADS_ENABLED
+  /* Before any other GLib call; name resolution uses threads */
+  if (!g_thread_supported())
+    g_thread_init(NULL);
+#endif
+
   /*
    * Get credential information for later use.
    */
@@ -1237,9 +1246,12 @@ main(int argc, char *argv[])
         } else if(strcmp(optarg, "fields") == 0) {
           output_action = WRITE_FIELDS;
           verbose = TRUE; /* Need full tree info */
+        } else if(strcmp(optarg, "columnar") == 0) {
+          output_action = WRITE_COLUMNAR;
+          verbose = TRUE; /* Need full tree info */
         } else {
           cmdarg_err("Invalid -T parameter.");
-          cmdarg_err_cont("It must be \"ps\", \"text\", \"pdml\", \"psml\" or \"fields\".");
+          cmdarg_err_cont("It must be \"ps\", \"text\", \"pdml\", \"psml\", \"fields\" or \"columnar\".");
           return 1;
         }
         break;
@@ -1315,13 +1327,16 @@ main(int argc, char *argv[])
   }
 
   /* If we specified output fields, but not the output field type... */
-  if(WRITE_FIELDS != output_action && 0 != output_fields_num_fields(output_fields)) {
+  if(WRITE_FIELDS != output_action && WRITE_COLUMNAR != output_action &&
+     0 != output_fields_num_fields(output_fields)) {
         cmdarg_err("Output fields were specified with \"-e\", "
             "but \"-Tfields\" was not specified.");
         return 1;
-  } else if(WRITE_FIELDS == output_action && 0 == output_fields_num_fields(output_fields)) {
-        cmdarg_err("\"-Tfields\" was specified, but no fields were "
-                    "specified with \"-e\".");
+  } else if((WRITE_FIELDS == output_action || WRITE_COLUMNAR == output_action) &&
+            0 == output_fields_num_fields(output_fields)) {
+        cmdarg_err("\"-T%s\" was specified, but no fields were "
+                    "specified with \"-e\".",
+                    WRITE_FIELDS == output_action ? "fields" : "columnar");
 
         return 1;
   }
@@ -2383,6 +2398,13 @@ process_packet_first_pass(capture_file *cf,
     /* Run the read filter if we have one. */
     if (cf->rfcode)
       passed = dfilter_apply_edt(cf->rfcode, &edt);
+
+    /* Start looking up the addresses the second pass will print, so that
+       they can all be resolved at once between the passes. */
+    if (passed && (g_resolv_flags & RESOLV_NETWORK)) {
+      host_name_lookup_queue(&edt.pi.net_src);
+      host_name_lookup_queue(&edt.pi.net_dst);
+    }
   }
 
   if (passed) {
@@ -2440,6 +2462,12 @@ process_packet_second_pass(capture_file *cf, frame_data *fdata,
 
     col_custom_prime_edt(&edt, &cf->cinfo);
 
+    /* If we're printing fields, prime the epan_dissect_t with them so
+       their values are collected during dissection. */
+    if (print_packet_info &&
+        (output_action == WRITE_FIELDS || output_action == WRITE_COLUMNAR))
+      output_fields_prime_edt(output_fields, &edt);
+
     tap_queue_init(&edt);
 
     /* We only need the columns if either
@@ -2511,6 +2539,24 @@ process_packet_second_pass(capture_file *cf, frame_data *fdata,
 }
 #endif
 
+/* How many packets load_cap_file() reads at a time */
+#define READ_BATCH_SIZE 64
+
+/* Read the next packets of the sequential pass into "recs".  With -c,
+   no more are read than can still be counted, so as not to wait on a
+   pipe for packets that wouldn't be used; *max_recs is set to how many
+   were asked for, so that fewer means the end of the file or an
+   error. */
+static int
+read_batch(capture_file *cf, struct wtap_batch_rec *recs,
+           int max_packet_count, int *max_recs, int *err, gchar **err_info)
+{
+  *max_recs = READ_BATCH_SIZE;
+  if (max_packet_count > 0 && max_packet_count < *max_recs)
+    *max_recs = max_packet_count;
+  return wtap_read_batch(cf->wth, recs, *max_recs, err, err_info);
+}
+
 static int
 load_cap_file(capture_file *cf, char *save_file, int out_file_type,
     int max_packet_count, gint64 max_byte_count)
@@ -2521,6 +2567,8 @@ load_cap_file(capture_file *cf, char *save_file, int out_file_type,
   int          err;
   gchar        *err_info = NULL;
   gint64       data_offset;
+  struct wtap_batch_rec recs[READ_BATCH_SIZE];
+  int          max_recs, n_recs, i;
   char         *save_file_string = NULL;
   gboolean     filtering_tap_listeners;
   guint        tap_flags;
@@ -2592,20 +2640,26 @@ load_cap_file(capture_file *cf, char *save_file, int out_file_type,
     frame_data *fdata;
     int old_max_packet_count = max_packet_count;
 
-    while (wtap_read(cf->wth, &err, &err_info, &data_offset)) {
-      if (process_packet_first_pass(cf, data_offset, wtap_phdr(cf->wth),
-                         wtap_pseudoheader(cf->wth), wtap_buf_ptr(cf->wth))) {
-        /* Stop reading if we have the maximum number of packets;
-         * When the -c option has not been used, max_packet_count
-         * starts at 0, which practically means, never stop reading.
-         * (unless we roll over max_packet_count ?)
-         */
-        if( (--max_packet_count == 0) || (max_byte_count != 0 && data_offset >= max_byte_count)) {
-          err = 0; /* This is not an error */
-          break;
+    do {
+      n_recs = read_batch(cf, recs, max_packet_count, &max_recs, &err,
+                          &err_info);
+      for (i = 0; i < n_recs; i++) {
+        data_offset = recs[i].data_offset;
+        if (process_packet_first_pass(cf, data_offset, &recs[i].phdr,
+                           &recs[i].pseudo_header, recs[i].data)) {
+          /* Stop reading if we have the maximum number of packets;
+           * When the -c option has not been used, max_packet_count
+           * starts at 0, which practically means, never stop reading.
+           * (unless we roll over max_packet_count ?)
+           */
+          if( (--max_packet_count == 0) || (max_byte_count != 0 && data_offset >= max_byte_count)) {
+            err = 0; /* This is not an error */
+            n_recs = 0;
+            break;
+          }
         }
       }
-    }
+    } while (n_recs == max_recs);
 
     /* Close the sequential I/O side, to free up memory it requires. */
     wtap_sequential_close(cf->wth);
@@ -2616,6 +2670,11 @@ load_cap_file(capture_file *cf, char *save_file, int out_file_type,
 
     max_packet_count = old_max_packet_count;
 
+    /* Resolve the addresses seen in the first pass before printing any
+       packets. */
+    if (g_resolv_flags & RESOLV_NETWORK)
+      host_name_lookup_wait();
+
     for (fdata = cf->plist_start; err == 0 && fdata != NULL; fdata = fdata->next) {
       if (wtap_seek_read(cf->wth, fdata->file_off, &cf->pseudo_header,
           cf->pd, fdata->cap_len, &err, &err_info)) {
@@ -2650,34 +2709,39 @@ load_cap_file(capture_file *cf, char *save_file, int out_file_type,
 #endif
   }
   else {
-    while (wtap_read(cf->wth, &err, &err_info, &data_offset)) {
-      if (process_packet(cf, data_offset, wtap_phdr(cf->wth),
-                         wtap_pseudoheader(cf->wth), wtap_buf_ptr(cf->wth),
-                         filtering_tap_listeners, tap_flags)) {
-        /* Either there's no read filtering or this packet passed the
-           filter, so, if we're writing to a capture file, write
-           this packet out. */
-        if (pdh != NULL) {
-          if (!wtap_dump(pdh, wtap_phdr(cf->wth),
-                         wtap_pseudoheader(cf->wth), wtap_buf_ptr(cf->wth),
-                         &err)) {
-            /* Error writing to a capture file */
-            show_capture_file_io_error(save_file, err, FALSE);
-            wtap_dump_close(pdh, &err);
-            exit(2);
+    do {
+      n_recs = read_batch(cf, recs, max_packet_count, &max_recs, &err,
+                          &err_info);
+      for (i = 0; i < n_recs; i++) {
+        data_offset = recs[i].data_offset;
+        if (process_packet(cf, data_offset, &recs[i].phdr,
+                           &recs[i].pseudo_header, recs[i].data,
+                           filtering_tap_listeners, tap_flags)) {
+          /* Either there's no read filtering or this packet passed the
+             filter, so, if we're writing to a capture file, write
+             this packet out. */
+          if (pdh != NULL) {
+            if (!wtap_dump(pdh, &recs[i].phdr, &recs[i].pseudo_header,
+                           recs[i].data, &err)) {
+              /* Error writing to a capture file */
+              show_capture_file_io_error(save_file, err, FALSE);
+              wtap_dump_close(pdh, &err);
+              exit(2);
+            }
+          }
+          /* Stop reading if we have the maximum number of packets;
+           * When the -c option has not been used, max_packet_count
+           * starts at 0, which practically means, never stop reading.
+           * (unless we roll over max_packet_count ?)
+           */
+          if( (--max_packet_count == 0) || (max_byte_count != 0 && data_offset >= max_byte_count)) {
+            err = 0; /* This is not an error */
+            n_recs = 0;
+            break;
           }
-        }
-        /* Stop reading if we have the maximum number of packets;
-         * When the -c option has not been used, max_packet_count
-         * starts at 0, which practically means, never stop reading.
-         * (unless we roll over max_packet_count ?)
-         */
-        if( (--max_packet_count == 0) || (max_byte_count != 0 && data_offset >= max_byte_count)) {
-          err = 0; /* This is not an error */
-          break;
         }
       }
-    }
+    } while (n_recs == max_recs);
   }
 
   if (err != 0) {
@@ -2811,6 +2875,12 @@ process_packet(capture_file *cf, gint64 offset, const struct wtap_pkthdr *whdr,
 
     col_custom_prime_edt(&edt, &cf->cinfo);
 
+    /* If we're printing fields, prime the epan_dissect_t with them so
+       their values are collected during dissection. */
+    if (print_packet_info &&
+        (output_action == WRITE_FIELDS || output_action == WRITE_COLUMNAR))
+      output_fields_prime_edt(output_fields, &edt);
+
     tap_queue_init(&edt);
 
     /* We only need the columns if either
@@ -2906,6 +2976,14 @@ write_preamble(capture_file *cf)
     write_fields_preamble(output_fields, stdout);
     return !ferror(stdout);
 
+  case WRITE_COLUMNAR:
+#ifdef _WIN32
+    /* set output pipe to binary mode to avoid Windows text-mode processing (eg: for CR/LF)  */
+    _setmode(1, O_BINARY);
+#endif
+    write_columnar_preamble(output_fields, stdout);
+    return !ferror(stdout);
+
   default:
     g_assert_not_reached();
     return FALSE;
@@ -3204,6 +3282,9 @@ print_packet(capture_file *cf, epan_dissect_t *edt)
       proto_tree_write_fields(output_fields, edt, stdout);
       printf("\n");
       return !ferror(stdout);
+    case WRITE_COLUMNAR:
+      proto_tree_write_columnar(output_fields, edt, stdout);
+      return !ferror(stdout);
     }
   } else {
     /* Just fill in the columns. */
@@ -3221,6 +3302,7 @@ print_packet(capture_file *cf, epan_dissect_t *edt)
         proto_tree_write_psml(edt, stdout);
         return !ferror(stdout);
     case WRITE_FIELDS: /*No non-verbose "fields" format */
+    case WRITE_COLUMNAR:
         g_assert_not_reached();
         break;
     }
@@ -3253,6 +3335,10 @@ write_finale(void)
     write_fields_finale(output_fields, stdout);
     return !ferror(stdout);
 
+  case WRITE_COLUMNAR:
+    write_columnar_finale(output_fields, stdout);
+    return !ferror(stdout);
+
   default:
     g_assert_not_reached();
     return FALSE;
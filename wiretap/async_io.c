@@ -0,0 +1,494 @@
+/* async_io.c
+ *
+ * $Id$
+ *
+ * Reading ahead of, and writing behind, the caller on threads of their own
+ *
+ * Wiretap Library
+ * Copyright (c) 1998 by Gilbert Ramirez <gram@alumni.rice.edu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "wtap-int.h"
+#include "buffer.h"
+
+#ifdef G_THREADS_ENABLED
+
+/*
+ * Both directions work the same way: a fixed number of buffers go round
+ * between the caller and a thread through two queues, one of buffers for
+ * the thread to work on and one of buffers it's done with.  When the
+ * thread falls behind, the caller waits for a buffer and vice versa, so
+ * the memory used is bounded.
+ *
+ * Each buffer holds many records, so that the queues, and their locks,
+ * are only used once in a while.
+ */
+
+/*
+ * Read-ahead
+ *
+ * The thread calls the file type's read routine, which fills in the
+ * phdr, pseudo-header and frame buffer of the wtap as usual, and copies
+ * the record into a chunk.  The caller's wtap_read() takes the records
+ * out of the chunks, and wtap_phdr() and friends point into the chunk.
+ */
+#define RA_CHUNKS		4
+#define RA_CHUNK_RECORDS	256
+#define RA_CHUNK_BYTES		(256 * 1024)
+
+typedef struct {
+	struct wtap_pkthdr	phdr;
+	union wtap_pseudo_header pseudo_header;
+	gint64			data_offset;
+	size_t			data_start;	/* in the chunk's data */
+} ra_record_t;
+
+typedef struct {
+	guint		count;
+	ra_record_t	records[RA_CHUNK_RECORDS];
+	guint8		*data;
+	size_t		data_len;
+	size_t		data_size;
+	gboolean	end;		/* the last chunk, at EOF or an error */
+	int		err;
+	gchar		*err_info;
+} ra_chunk_t;
+
+struct wtap_read_ahead {
+	GThread		*thread;
+	GAsyncQueue	*free_q;	/* chunks for the thread to fill */
+	GAsyncQueue	*full_q;	/* chunks for wtap_read() */
+	ra_chunk_t	*cur;		/* chunk wtap_read() is taking from */
+	guint		next;		/* next record of it */
+	ra_record_t	*rec;		/* record returned last */
+	ra_chunk_t	chunks[RA_CHUNKS];
+};
+
+static gpointer
+read_ahead_thread(gpointer data)
+{
+	wtap *wth = data;
+	struct wtap_read_ahead *ra = wth->read_ahead;
+	ra_chunk_t *c;
+	ra_record_t *r;
+	guint32 caplen;
+
+	for (;;) {
+		c = g_async_queue_pop(ra->free_q);
+		if ((gpointer)c == (gpointer)ra)
+			break;	/* told to stop */
+
+		c->count = 0;
+		c->data_len = 0;
+		c->err = 0;
+		c->err_info = NULL;
+		while (c->count < RA_CHUNK_RECORDS && c->data_len < RA_CHUNK_BYTES) {
+			r = &c->records[c->count];
+			if (!wtap_read_packet(wth, &c->err, &c->err_info,
+			    &r->data_offset)) {
+				c->end = TRUE;
+				break;
+			}
+			caplen = wth->phdr.caplen;
+			if (c->data_len + caplen > c->data_size) {
+				c->data_size = c->data_len + caplen + RA_CHUNK_BYTES / 4;
+				c->data = g_realloc(c->data, c->data_size);
+			}
+			r->phdr = wth->phdr;
+			r->pseudo_header = wth->pseudo_header;
+			r->data_start = c->data_len;
+			memcpy(c->data + c->data_len,
+			    buffer_start_ptr(wth->frame_buffer), caplen);
+			c->data_len += caplen;
+			c->count++;
+		}
+
+		g_async_queue_push(ra->full_q, c);
+		if (c->end)
+			break;
+	}
+	return NULL;
+}
+
+gboolean
+wtap_read_ahead(wtap *wth)
+{
+	struct wtap_read_ahead *ra;
+	int i;
+
+	if (wth->read_ahead != NULL)
+		return TRUE;
+
+	/* g_thread_init() is up to the program, before any other GLib call */
+	if (!g_thread_supported())
+		return FALSE;
+
+	ra = g_malloc0(sizeof(struct wtap_read_ahead));
+	ra->free_q = g_async_queue_new();
+	ra->full_q = g_async_queue_new();
+	for (i = 0; i < RA_CHUNKS; i++) {
+		ra->chunks[i].data_size = RA_CHUNK_BYTES;
+		ra->chunks[i].data = g_malloc(RA_CHUNK_BYTES);
+		g_async_queue_push(ra->free_q, &ra->chunks[i]);
+	}
+
+	wth->read_ahead = ra;
+	ra->thread = g_thread_create(read_ahead_thread, wth, TRUE, NULL);
+	if (ra->thread == NULL) {
+		wth->read_ahead = NULL;
+		g_async_queue_unref(ra->free_q);
+		g_async_queue_unref(ra->full_q);
+		for (i = 0; i < RA_CHUNKS; i++)
+			g_free(ra->chunks[i].data);
+		g_free(ra);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+gboolean
+wtap_read_ahead_next(wtap *wth, int *err, gchar **err_info,
+    gint64 *data_offset)
+{
+	struct wtap_read_ahead *ra = wth->read_ahead;
+	ra_chunk_t *c;
+
+	for (;;) {
+		c = ra->cur;
+		if (c != NULL && ra->next < c->count) {
+			ra->rec = &c->records[ra->next++];
+			*data_offset = ra->rec->data_offset;
+			return TRUE;
+		}
+		if (c != NULL && c->end) {
+			/* Hand over the error once; after that it's just EOF. */
+			*err = c->err;
+			*err_info = c->err_info;
+			c->err = 0;
+			c->err_info = NULL;
+			return FALSE;
+		}
+		if (c != NULL)
+			g_async_queue_push(ra->free_q, c);
+		ra->cur = g_async_queue_pop(ra->full_q);
+		ra->next = 0;
+	}
+}
+
+struct wtap_pkthdr *
+wtap_read_ahead_phdr(wtap *wth)
+{
+	return &wth->read_ahead->rec->phdr;
+}
+
+union wtap_pseudo_header *
+wtap_read_ahead_pseudoheader(wtap *wth)
+{
+	return &wth->read_ahead->rec->pseudo_header;
+}
+
+guint8 *
+wtap_read_ahead_buf_ptr(wtap *wth)
+{
+	struct wtap_read_ahead *ra = wth->read_ahead;
+
+	return ra->cur->data + ra->rec->data_start;
+}
+
+void
+wtap_read_ahead_stop(wtap *wth)
+{
+	struct wtap_read_ahead *ra = wth->read_ahead;
+	ra_chunk_t *c;
+	int i;
+
+	if (ra == NULL)
+		return;
+
+	/* If the thread is still going, it stops when it next wants a chunk. */
+	g_async_queue_push(ra->free_q, ra);
+	g_thread_join(ra->thread);
+
+	while ((c = g_async_queue_try_pop(ra->full_q)) != NULL)
+		g_free(c->err_info);
+	if (ra->cur != NULL)
+		g_free(ra->cur->err_info);
+	g_async_queue_unref(ra->free_q);
+	g_async_queue_unref(ra->full_q);
+	for (i = 0; i < RA_CHUNKS; i++)
+		g_free(ra->chunks[i].data);
+	g_free(ra);
+	wth->read_ahead = NULL;
+}
+
+/*
+ * Write-behind
+ *
+ * Whatever the dump routines write goes into a block; full blocks are
+ * written out by the thread.  Only file types whose dump routines write
+ * the file from start to end, without seeking back to patch a header,
+ * can be written this way.
+ */
+#define WB_BLOCKS		3
+
+typedef struct {
+	guint8		*data;
+	size_t		len;
+} wb_block_t;
+
+struct wtap_write_behind {
+	GThread		*thread;
+	GAsyncQueue	*free_q;	/* blocks to fill */
+	GAsyncQueue	*full_q;	/* blocks for the thread to write */
+	wb_block_t	*cur;
+	size_t		block_size;
+	volatile int	err;		/* first error the thread got */
+	wb_block_t	blocks[WB_BLOCKS];
+};
+
+static gpointer
+write_behind_thread(gpointer data)
+{
+	wtap_dumper *wdh = data;
+	struct wtap_write_behind *wb = wdh->write_behind;
+	wb_block_t *b;
+	int err;
+
+	for (;;) {
+		b = g_async_queue_pop(wb->full_q);
+		if ((gpointer)b == (gpointer)wb)
+			break;	/* told to stop */
+
+		/* After an error, throw the rest away; it's reported once. */
+		if (wb->err == 0 && b->len != 0 &&
+		    !wtap_dump_file_write_direct(wdh, b->data, b->len, &err))
+			wb->err = err;
+		b->len = 0;
+		g_async_queue_push(wb->free_q, b);
+	}
+	return NULL;
+}
+
+gboolean
+wtap_dump_write_behind(wtap_dumper *wdh, size_t block_size)
+{
+	struct wtap_write_behind *wb;
+	int i;
+
+	if (wdh->write_behind != NULL)
+		return TRUE;
+
+	switch (wdh->file_type) {
+
+	case WTAP_FILE_PCAP:
+	case WTAP_FILE_PCAP_NSEC:
+	case WTAP_FILE_PCAP_AIX:
+	case WTAP_FILE_PCAP_SS991029:
+	case WTAP_FILE_PCAP_NOKIA:
+	case WTAP_FILE_PCAP_SS990417:
+	case WTAP_FILE_PCAP_SS990915:
+	case WTAP_FILE_PCAPNG:
+		break;
+
+	default:
+		/* the dump routines seek in the file */
+		return FALSE;
+	}
+
+	if (!g_thread_supported())
+		return FALSE;
+
+	if (block_size == 0)
+		block_size = WTAP_WRITE_BEHIND_BLOCK_SIZE;
+
+	wb = g_malloc0(sizeof(struct wtap_write_behind));
+	wb->block_size = block_size;
+	wb->free_q = g_async_queue_new();
+	wb->full_q = g_async_queue_new();
+	for (i = 0; i < WB_BLOCKS; i++) {
+		wb->blocks[i].data = g_malloc(block_size);
+		if (i > 0)
+			g_async_queue_push(wb->free_q, &wb->blocks[i]);
+	}
+	wb->cur = &wb->blocks[0];
+
+	/* What the dump routines wrote already goes out first. */
+	wtap_dump_flush(wdh);
+
+	wdh->write_behind = wb;
+	wb->thread = g_thread_create(write_behind_thread, wdh, TRUE, NULL);
+	if (wb->thread == NULL) {
+		wdh->write_behind = NULL;
+		g_async_queue_unref(wb->free_q);
+		g_async_queue_unref(wb->full_q);
+		for (i = 0; i < WB_BLOCKS; i++)
+			g_free(wb->blocks[i].data);
+		g_free(wb);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+gboolean
+wtap_write_behind_write(wtap_dumper *wdh, const void *buf, size_t bufsize,
+    int *err)
+{
+	struct wtap_write_behind *wb = wdh->write_behind;
+	const guint8 *p = buf;
+	size_t n;
+
+	if (wb->err != 0) {
+		*err = wb->err;
+		return FALSE;
+	}
+
+	while (bufsize != 0) {
+		n = wb->block_size - wb->cur->len;
+		if (n > bufsize)
+			n = bufsize;
+		memcpy(wb->cur->data + wb->cur->len, p, n);
+		wb->cur->len += n;
+		p += n;
+		bufsize -= n;
+
+		if (wb->cur->len == wb->block_size) {
+			g_async_queue_push(wb->full_q, wb->cur);
+			wb->cur = g_async_queue_pop(wb->free_q);
+		}
+	}
+	return TRUE;
+}
+
+/*
+ * Wait until everything written so far has been handed to the file;
+ * returns the first error the thread got, if any.
+ */
+int
+wtap_write_behind_sync(wtap_dumper *wdh)
+{
+	struct wtap_write_behind *wb = wdh->write_behind;
+	wb_block_t *held[WB_BLOCKS];
+	int i;
+
+	/* The thread is done once it has given back every block. */
+	g_async_queue_push(wb->full_q, wb->cur);
+	for (i = 0; i < WB_BLOCKS; i++)
+		held[i] = g_async_queue_pop(wb->free_q);
+	wb->cur = held[0];
+	for (i = 1; i < WB_BLOCKS; i++)
+		g_async_queue_push(wb->free_q, held[i]);
+
+	return wb->err;
+}
+
+int
+wtap_write_behind_stop(wtap_dumper *wdh)
+{
+	struct wtap_write_behind *wb = wdh->write_behind;
+	int err, i;
+
+	if (wb == NULL)
+		return 0;
+
+	err = wtap_write_behind_sync(wdh);
+	g_async_queue_push(wb->full_q, wb);
+	g_thread_join(wb->thread);
+
+	g_async_queue_unref(wb->free_q);
+	g_async_queue_unref(wb->full_q);
+	for (i = 0; i < WB_BLOCKS; i++)
+		g_free(wb->blocks[i].data);
+	g_free(wb);
+	wdh->write_behind = NULL;
+	return err;
+}
+
+#else /* G_THREADS_ENABLED */
+
+gboolean
+wtap_read_ahead(wtap *wth _U_)
+{
+	return FALSE;
+}
+
+gboolean
+wtap_read_ahead_next(wtap *wth _U_, int *err _U_, gchar **err_info _U_,
+    gint64 *data_offset _U_)
+{
+	g_assert_not_reached();
+	return FALSE;
+}
+
+struct wtap_pkthdr *
+wtap_read_ahead_phdr(wtap *wth _U_)
+{
+	g_assert_not_reached();
+	return NULL;
+}
+
+union wtap_pseudo_header *
+wtap_read_ahead_pseudoheader(wtap *wth _U_)
+{
+	g_assert_not_reached();
+	return NULL;
+}
+
+guint8 *
+wtap_read_ahead_buf_ptr(wtap *wth _U_)
+{
+	g_assert_not_reached();
+	return NULL;
+}
+
+void
+wtap_read_ahead_stop(wtap *wth _U_)
+{
+}
+
+gboolean
+wtap_dump_write_behind(wtap_dumper *wdh _U_, size_t block_size _U_)
+{
+	return FALSE;
+}
+
+gboolean
+wtap_write_behind_write(wtap_dumper *wdh _U_, const void *buf _U_,
+    size_t bufsize _U_, int *err _U_)
+{
+	g_assert_not_reached();
+	return FALSE;
+}
+
+int
+wtap_write_behind_sync(wtap_dumper *wdh _U_)
+{
+	return 0;
+}
+
+int
+wtap_write_behind_stop(wtap_dumper *wdh _U_)
+{
+	return 0;
+}
+
+#endif /* G_THREADS_ENABLED */
@@ -329,10 +329,14 @@ wtap* wtap_open_offline(const char *filename, int *err, char **err_info,
 	/* initialization */
 	wth->file_encap = WTAP_ENCAP_UNKNOWN;
 	wth->data_offset = 0;
+	wth->subtype_read_header = NULL;
+	wth->subtype_read_batch = NULL;
 	wth->subtype_sequential_close = NULL;
 	wth->subtype_close = NULL;
 	wth->tsprecision = WTAP_FILE_TSPREC_USEC;
 	wth->priv = NULL;
+	wth->read_ahead = NULL;
+	wth->batch_buffer = NULL;
 
 	init_open_routines();
 
@@ -752,15 +756,15 @@ static wtap_dumper* wtap_dump_alloc_wdh(int filetype, int encap, int snaplen,
 					gboolean compressed, int *err);
 static gboolean wtap_dump_open_finish(wtap_dumper *wdh, int filetype, gboolean compressed, int *err);
 
-static FILE_T wtap_dump_file_open(wtap_dumper *wdh, const char *filename);
-static FILE_T wtap_dump_file_fdopen(wtap_dumper *wdh, int fd);
+static FILE *wtap_dump_file_open(wtap_dumper *wdh, const char *filename);
+static FILE *wtap_dump_file_fdopen(wtap_dumper *wdh, int fd);
 static int wtap_dump_file_close(wtap_dumper *wdh);
 
 wtap_dumper* wtap_dump_open(const char *filename, int filetype, int encap,
 				int snaplen, gboolean compressed, int *err)
 {
 	wtap_dumper *wdh;
-	FILE_T fh;
+	FILE *fh;
 
 	/* Check whether we can open a capture file with that file type
 	   and that encapsulation. */
@@ -812,7 +816,7 @@ wtap_dumper* wtap_dump_fdopen(int fd, int filetype, int encap, int snaplen,
 				gboolean compressed, int *err)
 {
 	wtap_dumper *wdh;
-	FILE_T fh;
+	FILE *fh;
 
 	/* Check whether we can open a capture file with that file type
 	   and that encapsulation. */
@@ -893,10 +897,13 @@ static wtap_dumper* wtap_dump_alloc_wdh(int filetype, int encap, int snaplen,
 	wdh->snaplen = snaplen;
 	wdh->encap = encap;
 	wdh->compressed = compressed;
+	wdh->gzfh = NULL;
 	wdh->bytes_dumped = 0;
 	wdh->priv = NULL;
 	wdh->subtype_write = NULL;
 	wdh->subtype_close = NULL;
+	wdh->subtype_flush = NULL;
+	wdh->write_behind = NULL;
 	return wdh;
 }
 
@@ -936,9 +943,15 @@ gboolean wtap_dump(wtap_dumper *wdh, const struct wtap_pkthdr *phdr,
 
 void wtap_dump_flush(wtap_dumper *wdh)
 {
+	if (wdh->subtype_flush != NULL)
+		(wdh->subtype_flush)(wdh);
+	if (wdh->write_behind != NULL)
+		wtap_write_behind_sync(wdh);
 #ifdef HAVE_LIBZ
 	if(wdh->compressed) {
-		gzflush(wdh->fh, Z_SYNC_FLUSH);	/* XXX - is Z_SYNC_FLUSH the right one? */
+		/* finish the block being filled, so that what's been
+		   written so far can be read */
+		gzwfile_flush(wdh->gzfh);
 	} else
 #endif
 	{
@@ -949,12 +962,20 @@ void wtap_dump_flush(wtap_dumper *wdh)
 gboolean wtap_dump_close(wtap_dumper *wdh, int *err)
 {
 	gboolean ret = TRUE;
+	int wb_err;
 
 	if (wdh->subtype_close != NULL) {
 		/* There's a close routine for this dump stream. */
 		if (!(wdh->subtype_close)(wdh, err))
 			ret = FALSE;
 	}
+	/* Write out what's still buffered. */
+	wb_err = wtap_write_behind_stop(wdh);
+	if (wb_err != 0) {
+		if (ret && err != NULL)
+			*err = wb_err;
+		ret = FALSE;
+	}
 	errno = WTAP_ERR_CANT_CLOSE;
 	/* Don't close stdout */
 	if (wdh->fh != stdout) {
@@ -991,16 +1012,23 @@ void wtap_set_bytes_dumped(wtap_dumper *wdh, gint64 bytes_dumped)
 
 /* internally open a file for writing (compressed or not) */
 #ifdef HAVE_LIBZ
-static FILE_T wtap_dump_file_open(wtap_dumper *wdh, const char *filename)
+static FILE *wtap_dump_file_open(wtap_dumper *wdh, const char *filename)
 {
-	if(wdh->compressed) {
-		return gzopen(filename, "wb");
-	} else {
-		return ws_fopen(filename, "wb");
+	FILE *fh;
+
+	fh = ws_fopen(filename, "wb");
+	if (fh != NULL && wdh->compressed) {
+		/* compressed in blocks, so it can be read randomly */
+		wdh->gzfh = gzwfile_open(fh);
+		if (wdh->gzfh == NULL) {
+			fclose(fh);
+			return NULL;
+		}
 	}
+	return fh;
 }
 #else
-static FILE_T wtap_dump_file_open(wtap_dumper *wdh _U_, const char *filename)
+static FILE *wtap_dump_file_open(wtap_dumper *wdh _U_, const char *filename)
 {
 	return ws_fopen(filename, "wb");
 }
@@ -1008,16 +1036,23 @@ static FILE_T wtap_dump_file_open(wtap_dumper *wdh _U_, const char *filename)
 
 /* internally open a file for writing (compressed or not) */
 #ifdef HAVE_LIBZ
-static FILE_T wtap_dump_file_fdopen(wtap_dumper *wdh, int fd)
+static FILE *wtap_dump_file_fdopen(wtap_dumper *wdh, int fd)
 {
-	if(wdh->compressed) {
-		return gzdopen(fd, "wb");
-	} else {
-		return fdopen(fd, "wb");
+	FILE *fh;
+
+	fh = fdopen(fd, "wb");
+	if (fh != NULL && wdh->compressed) {
+		/* compressed in blocks, so it can be read randomly */
+		wdh->gzfh = gzwfile_open(fh);
+		if (wdh->gzfh == NULL) {
+			fclose(fh);
+			return NULL;
+		}
 	}
+	return fh;
 }
 #else
-static FILE_T wtap_dump_file_fdopen(wtap_dumper *wdh _U_, int fd)
+static FILE *wtap_dump_file_fdopen(wtap_dumper *wdh _U_, int fd)
 {
 	return fdopen(fd, "wb");
 }
@@ -1027,31 +1062,29 @@ static FILE_T wtap_dump_file_fdopen(wtap_dumper *wdh _U_, int fd)
 gboolean
 wtap_dump_file_write(wtap_dumper *wdh, const void *buf, size_t bufsize,
     int *err)
+{
+	if (wdh->write_behind != NULL)
+		return wtap_write_behind_write(wdh, buf, bufsize, err);
+	return wtap_dump_file_write_direct(wdh, buf, bufsize, err);
+}
+
+/* write raw bytes to the file itself, rather than to the write-behind
+   buffer */
+gboolean
+wtap_dump_file_write_direct(wtap_dumper *wdh, const void *buf, size_t bufsize,
+    int *err)
 {
 	size_t nwritten;
-#ifdef HAVE_LIBZ
-	int errnum;
-#endif
 
 #ifdef HAVE_LIBZ
 	if (wdh->compressed) {
-		nwritten = gzwrite(wdh->fh, buf, (unsigned) bufsize);
+		nwritten = gzwfile_write(wdh->gzfh, buf, (unsigned) bufsize);
 		/*
-		 * At least according to zlib.h, gzwrite returns 0
-		 * on error; that appears to be the case in libz
-		 * 1.2.5.
+		 * gzwfile_write returns 0 on error, and keeps the
+		 * error for gzwfile_geterr.
 		 */
-		if (nwritten == 0) {
-			gzerror(wdh->fh, &errnum);
-			if (errnum == Z_ERRNO)
-				*err = errno;
-			else {
-				/*
-				 * XXX - what to do with this zlib-specific
-				 * number?
-				 */
-				*err = errnum;
-			}
+		if (nwritten == 0 && bufsize != 0) {
+			*err = gzwfile_geterr(wdh->gzfh);
 			return FALSE;
 		}
 	} else
@@ -1077,11 +1110,17 @@ wtap_dump_file_write(wtap_dumper *wdh, const void *buf, size_t bufsize,
 static int wtap_dump_file_close(wtap_dumper *wdh)
 {
 #ifdef HAVE_LIBZ
+	int save_errno;
+
 	if(wdh->compressed) {
-		return gzclose(wdh->fh);
-	} else
-#endif
-	{
-		return fclose(wdh->fh);
+		/* write what's left, and the block index */
+		if (gzwfile_close(wdh->gzfh) == -1) {
+			save_errno = errno;
+			fclose(wdh->fh);
+			errno = save_errno;
+			return EOF;
+		}
 	}
+#endif
+	return fclose(wdh->fh);
 }
@@ -126,6 +126,213 @@
 
 #ifdef HAVE_LIBZ
 
+/*
+ * Block-compressed gzip files.  Every member starts with a header with
+ * FEXTRA set, and a BGZF "BC" subfield holding the size of the member
+ * less one first in the extra field.  The data members hold at most
+ * GZ_BLOCK_DATA_MAX bytes each; they're followed by index members, empty
+ * but for a "WI" subfield with the compressed and uncompressed size of
+ * each data member (little-endian 32-bit numbers), then by a trailer
+ * member with a "WT" subfield holding where the index members start,
+ * relative to the first member, and the number of data members (64 and
+ * 32 bits), and last by the BGZF end-of-file block.
+ */
+#define GZ_HEADER_LEN		12	/* up to and including XLEN */
+#define GZ_BC_LEN		6	/* the "BC" subfield */
+#define GZ_FOOTER_LEN		8	/* CRC32 and ISIZE */
+#define GZ_EMPTY_LEN		(2 + GZ_FOOTER_LEN)	/* empty deflate data, and footer */
+#define GZ_MEMBER_MAX		65536
+#define GZ_BLOCK_DATA_MAX	0xff00
+#define GZ_INDEX_ENTRIES_MAX	8000	/* per index member */
+#define GZ_TRAILER_LEN		(GZ_HEADER_LEN + GZ_BC_LEN + 4 + 12 + GZ_EMPTY_LEN)
+
+static const guint8 gz_eof_block[28] = {
+	0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff,
+	0x06, 0x00, 0x42, 0x43, 0x02, 0x00, 0x1b, 0x00, 0x03, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+struct wtap_reader {
+	gzFile gz;
+	int fd;			/* -1, or, if the file has a block index, the
+				   file, of which gz reads a dup() */
+	gint64 base;		/* offset in the data at which gz started */
+	guint32 nblocks;	/* 0 if there's no block index */
+	gint64 *cstart;		/* where each block starts, compressed and */
+	gint64 *ustart;		/* uncompressed, and where the last one ends */
+	gboolean compressed;	/* not read as is */
+};
+
+static gboolean
+gz_read_fully(int fd, void *buf, unsigned int len)
+{
+	guint8 *p = (guint8 *)buf;
+	int n;
+
+	while (len != 0) {
+		n = (int)ws_read(fd, p, len);
+		if (n <= 0)
+			return FALSE;
+		p += n;
+		len -= n;
+	}
+	return TRUE;
+}
+
+/* Does a member with a "BC" subfield start here? */
+static gboolean
+gz_is_block(const guint8 *p)
+{
+	return p[0] == 0x1f && p[1] == 0x8b && p[2] == Z_DEFLATED &&
+	    (p[3] & 0x04) != 0 && pletohs(p + 10) >= GZ_BC_LEN &&
+	    p[12] == 'B' && p[13] == 'C' && pletohs(p + 14) == 2;
+}
+
+/* Does "fd" start with the gzip magic number?  The file offset is left
+   as it was; if it can't be, as for a pipe, the answer is TRUE. */
+static gboolean
+gz_is_compressed(int fd)
+{
+	guint8 magic[2];
+	gint64 start;
+	gboolean compressed;
+
+	start = ws_lseek(fd, 0, SEEK_CUR);
+	if (start == -1)
+		return TRUE;
+	compressed = gz_read_fully(fd, magic, sizeof magic) &&
+	    magic[0] == 0x1f && magic[1] == 0x8b;
+	if (ws_lseek(fd, (off_t)start, SEEK_SET) != start)
+		return TRUE;
+	return compressed;
+}
+
+/* If "fd" is a block-compressed file with a block index, read the index
+   into "fh"; the file offset is left as it was. */
+static gboolean
+gz_read_block_index(FILE_T fh, int fd)
+{
+	guint8 head[GZ_HEADER_LEN + GZ_BC_LEN];
+	guint8 tail[GZ_TRAILER_LEN + sizeof gz_eof_block];
+	guint8 *member = NULL;
+	guint8 *p;
+	gint64 start, end, index_off, coff, uoff;
+	guint32 nblocks, i, n, xlen, slen;
+	gboolean ok = FALSE;
+
+	start = ws_lseek(fd, 0, SEEK_CUR);
+	if (start == -1)
+		return FALSE;	/* a pipe */
+	if (!gz_read_fully(fd, head, sizeof head) || !gz_is_block(head))
+		goto done;
+
+	end = ws_lseek(fd, -(int)sizeof tail, SEEK_END);
+	if (end < start || !gz_read_fully(fd, tail, sizeof tail))
+		goto done;
+	p = tail + GZ_HEADER_LEN + GZ_BC_LEN;
+	if (!gz_is_block(tail) || pletohs(tail + 10) != GZ_BC_LEN + 4 + 12 ||
+	    p[0] != 'W' || p[1] != 'T' || pletohs(p + 2) != 12 ||
+	    memcmp(tail + GZ_TRAILER_LEN, gz_eof_block, sizeof gz_eof_block) != 0)
+		goto done;
+	index_off = start + (gint64)pletohll(p + 4);
+	nblocks = pletohl(p + 12);
+	/* every data member takes at least a header */
+	if (nblocks == 0 || index_off > end ||
+	    nblocks > (index_off - start) / (GZ_HEADER_LEN + GZ_BC_LEN) ||
+	    ws_lseek(fd, (off_t)index_off, SEEK_SET) != index_off)
+		goto done;
+
+	fh->cstart = g_new(gint64, nblocks + 1);
+	fh->ustart = g_new(gint64, nblocks + 1);
+	member = (guint8 *)g_malloc(GZ_MEMBER_MAX);
+	coff = start;
+	uoff = 0;
+	for (i = 0; i < nblocks; ) {
+		if (!gz_read_fully(fd, member, GZ_HEADER_LEN + GZ_BC_LEN) ||
+		    !gz_is_block(member))
+			goto done;
+		xlen = pletohs(member + 10);
+		p = member + GZ_HEADER_LEN + GZ_BC_LEN;
+		if (xlen < GZ_BC_LEN + 4 ||
+		    GZ_HEADER_LEN + xlen + GZ_EMPTY_LEN > GZ_MEMBER_MAX ||
+		    !gz_read_fully(fd, p, xlen - GZ_BC_LEN + GZ_EMPTY_LEN))
+			goto done;
+		slen = pletohs(p + 2);
+		if (p[0] != 'W' || p[1] != 'I' ||
+		    slen != xlen - GZ_BC_LEN - 4 || slen % 8 != 0 ||
+		    slen > GZ_INDEX_ENTRIES_MAX * 8)
+			goto done;
+		for (n = 0; n < slen / 8 && i < nblocks; n++, i++) {
+			/* no member is empty, so the offsets must increase */
+			if (pletohl(p + 4 + n * 8) == 0 ||
+			    pletohl(p + 8 + n * 8) == 0)
+				goto done;
+			fh->cstart[i] = coff;
+			fh->ustart[i] = uoff;
+			coff += pletohl(p + 4 + n * 8);
+			uoff += pletohl(p + 8 + n * 8);
+		}
+	}
+	fh->cstart[nblocks] = coff;
+	fh->ustart[nblocks] = uoff;
+	if (coff == index_off) {
+		fh->nblocks = nblocks;
+		ok = TRUE;
+	}
+
+done:
+	g_free(member);
+	if (ws_lseek(fd, (off_t)start, SEEK_SET) != start)
+		ok = FALSE;
+	if (!ok) {
+		g_free(fh->cstart);
+		g_free(fh->ustart);
+		fh->cstart = NULL;
+		fh->ustart = NULL;
+		fh->nblocks = 0;
+	}
+	return ok;
+}
+
+FILE_T
+filed_open(int fd, const char *mode)
+{
+	FILE_T fh;
+	int gzfd;
+
+	fh = g_new(struct wtap_reader, 1);
+	fh->fd = -1;
+	fh->base = 0;
+	fh->nblocks = 0;
+	fh->cstart = NULL;
+	fh->ustart = NULL;
+	fh->compressed = (*mode == 'r') ? gz_is_compressed(fd) : TRUE;
+
+	if (*mode == 'r' && strchr(mode + 1, '+') == NULL &&
+	    gz_read_block_index(fh, fd)) {
+		/* gz gets a descriptor of its own, so that file_seek()
+		   can replace it */
+		gzfd = ws_dup(fd);
+		fh->gz = (gzfd == -1) ? NULL : gzdopen(gzfd, mode);
+		if (fh->gz == NULL) {
+			if (gzfd != -1)
+				ws_close(gzfd);
+			g_free(fh->cstart);
+			g_free(fh->ustart);
+			g_free(fh);
+			return NULL;
+		}
+		fh->fd = fd;
+	} else {
+		fh->gz = gzdopen(fd, mode);
+		if (fh->gz == NULL) {
+			g_free(fh);
+			return NULL;
+		}
+	}
+	return fh;
+}
+
 FILE_T
 file_open(const char *path, const char *mode)
 {
@@ -161,7 +368,7 @@ file_open(const char *path, const char *mode)
 		return NULL;
 
 	/* open zlib file handle */
-	ft = gzdopen(fd, mode);
+	ft = filed_open(fd, mode);
 	if (ft == NULL) {
 		ws_close(fd);
 		return NULL;
@@ -170,13 +377,117 @@ file_open(const char *path, const char *mode)
 	return ft;
 }
 
+int
+file_read(void *buf, unsigned int bsize, unsigned int count, FILE_T file)
+{
+	return gzread(file->gz, buf, bsize * count);
+}
+
+int
+file_getc(FILE_T file)
+{
+	return gzgetc(file->gz);
+}
+
+char *
+file_gets(char *buf, int len, FILE_T file)
+{
+	return gzgets(file->gz, buf, len);
+}
+
+int
+file_eof(FILE_T file)
+{
+	return gzeof(file->gz);
+}
+
+gboolean
+file_iscompressed(FILE_T file)
+{
+	return file->compressed;
+}
+
+#ifdef HAVE_GZCLEARERR
+void
+file_clearerr(FILE_T file)
+{
+	gzclearerr(file->gz);
+}
+#endif
+
+int
+file_close(FILE_T file)
+{
+	int ret;
+
+	ret = gzclose(file->gz);
+	if (file->fd != -1)
+		ws_close(file->fd);
+	g_free(file->cstart);
+	g_free(file->ustart);
+	g_free(file);
+	return ret;
+}
+
+/* Get ready to seek to "offset" in a file with a block index: unless
+   that's ahead in the block being read, start reading again at the block
+   it's in, which file_seek() can then inflate its way through. */
+static gboolean
+gz_seek_block(FILE_T fh, gint64 offset, int *err)
+{
+	guint32 lo, hi, mid;
+	gint64 cur;
+	int gzfd;
+	gzFile gz;
+
+	/* the last block starting at or before "offset" */
+	lo = 0;
+	hi = fh->nblocks - 1;
+	while (lo < hi) {
+		mid = lo + (hi - lo + 1) / 2;
+		if (fh->ustart[mid] <= offset)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+
+	cur = file_tell(fh);
+	if (offset >= cur && cur >= fh->ustart[lo])
+		return TRUE;
+
+	if (ws_lseek(fh->fd, (off_t)fh->cstart[lo], SEEK_SET) == -1 ||
+	    (gzfd = ws_dup(fh->fd)) == -1) {
+		*err = errno;
+		return FALSE;
+	}
+	gz = gzdopen(gzfd, "rb");
+	if (gz == NULL) {
+		*err = errno;
+		ws_close(gzfd);
+		return FALSE;
+	}
+	gzclose(fh->gz);
+	fh->gz = gz;
+	fh->base = fh->ustart[lo];
+	return TRUE;
+}
+
 gint64
 file_seek(void *stream, gint64 offset, int whence, int *err)
 {
+	FILE_T fh = (FILE_T)stream;
 	gint64 ret;
 
+	if (fh->nblocks != 0 && whence != SEEK_END) {
+		if (whence == SEEK_CUR)
+			offset += file_tell(fh);
+		whence = SEEK_SET;
+		if (!gz_seek_block(fh, offset, err))
+			return -1;
+	}
+
 	/* XXX - z_off_t is usually long, won't work >= 2GB! */
-	ret = (gint64) gzseek(stream, (z_off_t)offset, whence);
+	ret = (gint64) gzseek(fh->gz, (z_off_t)(whence == SEEK_SET ? offset - fh->base : offset), whence);
 	if (ret == -1) {
 		/*
 		 * XXX - "gzseek()", as of zlib 1.1.4, doesn't set
@@ -190,28 +501,26 @@ file_seek(void *stream, gint64 offset, int whence, int *err)
 		*err = file_error(stream);
 		if (*err == 0)
 			*err = errno;
+		return ret;
 	}
-	return ret;
+	return ret + fh->base;
 }
 
 gint64
 file_tell(void *stream)
 {
+	FILE_T fh = (FILE_T)stream;
+
 	/* XXX - z_off_t is usually long, won't work >= 2GB! */
-	return (gint64)gztell(stream);
+	return (gint64)gztell(fh->gz) + fh->base;
 }
 
-/*
- * Routine to return a Wiretap error code (0 for no error, an errno
- * for a file error, or a WTAP_ERR_ code for other errors) for an
- * I/O stream.
- */
-int
-file_error(void *fh)
+static int
+gz_error(gzFile gz)
 {
 	int errnum;
 
-	gzerror(fh, &errnum);
+	gzerror(gz, &errnum);
 	switch (errnum) {
 
 	case Z_OK:		/* no error */
@@ -228,6 +537,223 @@ file_error(void *fh)
 	}
 }
 
+/*
+ * Routine to return a Wiretap error code (0 for no error, an errno
+ * for a file error, or a WTAP_ERR_ code for other errors) for an
+ * I/O stream.
+ */
+int
+file_error(void *fh)
+{
+	return gz_error(((FILE_T)fh)->gz);
+}
+
+struct wtap_writer {
+	FILE *fh;
+	z_stream strm;
+	guint8 *in;		/* the data of the block being filled */
+	unsigned int in_len;
+	guint8 *out;		/* a member being put together */
+	GArray *index;		/* compressed and uncompressed size of each
+				   block written */
+	gint64 offset;		/* compressed bytes written */
+	int err;		/* 0, or what went wrong */
+};
+
+static void
+gzw_put16(guint8 *p, unsigned int v)
+{
+	p[0] = (guint8)v;
+	p[1] = (guint8)(v >> 8);
+}
+
+static void
+gzw_put32(guint8 *p, guint32 v)
+{
+	gzw_put16(p, v & 0xffff);
+	gzw_put16(p + 2, v >> 16);
+}
+
+/* Write a member with "len" bytes of data, and "extra_len" bytes of
+   subfields after the "BC" one; a member with data is a block. */
+static int
+gzw_write_member(GZWFILE_T state, const guint8 *extra, unsigned int extra_len,
+    const guint8 *data, unsigned int len)
+{
+	guint8 *p = state->out;
+	unsigned int hdr_len = GZ_HEADER_LEN + GZ_BC_LEN + extra_len;
+	unsigned int size;
+	guint32 entry[2];
+	int ret;
+
+	/* header: ID1, ID2, CM, FLG (FEXTRA), MTIME, XFL, OS (unknown) */
+	memset(p, 0, 10);
+	p[0] = 0x1f;
+	p[1] = 0x8b;
+	p[2] = Z_DEFLATED;
+	p[3] = 0x04;
+	p[9] = 0xff;
+	gzw_put16(p + 10, GZ_BC_LEN + extra_len);
+	p[12] = 'B';
+	p[13] = 'C';
+	gzw_put16(p + 14, 2);
+	if (extra_len != 0)
+		memcpy(p + GZ_HEADER_LEN + GZ_BC_LEN, extra, extra_len);
+
+	deflateReset(&state->strm);
+	state->strm.next_in = (Bytef *)data;
+	state->strm.avail_in = len;
+	state->strm.next_out = p + hdr_len;
+	state->strm.avail_out = GZ_MEMBER_MAX - hdr_len - GZ_FOOTER_LEN;
+	ret = deflate(&state->strm, Z_FINISH);
+	if (ret != Z_STREAM_END) {
+		/* can't happen; a block always fits */
+		state->err = WTAP_ERR_ZLIB + (ret == Z_OK ? Z_BUF_ERROR : ret);
+		return -1;
+	}
+	size = (unsigned int)(state->strm.next_out - p);
+	gzw_put32(p + size, (guint32)crc32(crc32(0L, Z_NULL, 0), data, len));
+	gzw_put32(p + size + 4, len);
+	size += GZ_FOOTER_LEN;
+	gzw_put16(p + 16, size - 1);
+
+	if (fwrite(p, 1, size, state->fh) != size) {
+		state->err = ferror(state->fh) ? errno : WTAP_ERR_SHORT_WRITE;
+		return -1;
+	}
+	state->offset += size;
+	if (len != 0) {
+		entry[0] = size;
+		entry[1] = len;
+		g_array_append_vals(state->index, entry, 2);
+	}
+	return 0;
+}
+
+GZWFILE_T
+gzwfile_open(FILE *fh)
+{
+	GZWFILE_T state;
+
+	state = g_new(struct wtap_writer, 1);
+	memset(&state->strm, 0, sizeof state->strm);
+	/* raw deflate; the gzip header and footer are ours */
+	if (deflateInit2(&state->strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+	    -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		g_free(state);
+		errno = ENOMEM;
+		return NULL;
+	}
+	state->fh = fh;
+	state->in = (guint8 *)g_malloc(GZ_BLOCK_DATA_MAX);
+	state->in_len = 0;
+	state->out = (guint8 *)g_malloc(GZ_MEMBER_MAX);
+	state->index = g_array_new(FALSE, FALSE, sizeof(guint32));
+	state->offset = 0;
+	state->err = 0;
+	return state;
+}
+
+unsigned int
+gzwfile_write(GZWFILE_T state, const void *buf, unsigned int len)
+{
+	const guint8 *p = (const guint8 *)buf;
+	unsigned int n, left = len;
+
+	if (state->err != 0)
+		return 0;
+	while (left != 0) {
+		n = GZ_BLOCK_DATA_MAX - state->in_len;
+		if (n > left)
+			n = left;
+		memcpy(state->in + state->in_len, p, n);
+		state->in_len += n;
+		p += n;
+		left -= n;
+		if (state->in_len == GZ_BLOCK_DATA_MAX) {
+			if (gzw_write_member(state, NULL, 0, state->in, state->in_len) == -1)
+				return 0;
+			state->in_len = 0;
+		}
+	}
+	return len;
+}
+
+int
+gzwfile_flush(GZWFILE_T state)
+{
+	if (state->err != 0)
+		return -1;
+	if (state->in_len != 0) {
+		if (gzw_write_member(state, NULL, 0, state->in, state->in_len) == -1)
+			return -1;
+		state->in_len = 0;
+	}
+	if (fflush(state->fh) == EOF) {
+		state->err = errno;
+		return -1;
+	}
+	return 0;
+}
+
+int
+gzwfile_close(GZWFILE_T state)
+{
+	guint8 *extra;
+	guint32 nblocks, i, n;
+	gint64 index_off;
+	int ret = 0;
+
+	if (state->err == 0 && state->in_len != 0)
+		gzw_write_member(state, NULL, 0, state->in, state->in_len);
+
+	/* the index */
+	nblocks = state->index->len / 2;
+	index_off = state->offset;
+	extra = (guint8 *)g_malloc(4 + GZ_INDEX_ENTRIES_MAX * 8);
+	for (i = 0; i < nblocks && state->err == 0; i += n) {
+		n = MIN(nblocks - i, GZ_INDEX_ENTRIES_MAX);
+		extra[0] = 'W';
+		extra[1] = 'I';
+		gzw_put16(extra + 2, n * 8);
+		for (n = 0; n < MIN(nblocks - i, GZ_INDEX_ENTRIES_MAX); n++) {
+			gzw_put32(extra + 4 + n * 8, g_array_index(state->index, guint32, (i + n) * 2));
+			gzw_put32(extra + 8 + n * 8, g_array_index(state->index, guint32, (i + n) * 2 + 1));
+		}
+		gzw_write_member(state, extra, 4 + n * 8, NULL, 0);
+	}
+	if (state->err == 0) {
+		extra[0] = 'W';
+		extra[1] = 'T';
+		gzw_put16(extra + 2, 12);
+		gzw_put32(extra + 4, (guint32)index_off);
+		gzw_put32(extra + 8, (guint32)(index_off >> 32));
+		gzw_put32(extra + 12, nblocks);
+		gzw_write_member(state, extra, 16, NULL, 0);
+	}
+	g_free(extra);
+	if (state->err == 0 &&
+	    fwrite(gz_eof_block, 1, sizeof gz_eof_block, state->fh) != sizeof gz_eof_block)
+		state->err = ferror(state->fh) ? errno : WTAP_ERR_SHORT_WRITE;
+
+	if (state->err != 0) {
+		errno = state->err;
+		ret = -1;
+	}
+	deflateEnd(&state->strm);
+	g_free(state->in);
+	g_free(state->out);
+	g_array_free(state->index, TRUE);
+	g_free(state);
+	return ret;
+}
+
+int
+gzwfile_geterr(GZWFILE_T state)
+{
+	return state->err;
+}
+
 #else /* HAVE_LIBZ */
 
 gint64
@@ -30,14 +30,46 @@ extern int file_error(void *fh);
 
 #ifdef HAVE_LIBZ
 
+/*
+ * A FILE_T reads through zlib, so that gzipped files are read as if they
+ * weren't; if the file is block-compressed, as wtap_dump() writes gzipped
+ * files, file_seek() uses the block index at its end to start inflating
+ * at the block holding the new offset rather than at the beginning.
+ */
 extern FILE_T file_open(const char *path, const char *mode);
-#define filed_open gzdopen
-/* XX: gzread and gzwrite return number of *bytes* (not number of elements) */
-#define file_read(buf, bsize, count, file) gzread((file),(buf),(unsigned)((count)*(bsize)))
-#define file_close gzclose
-#define file_getc gzgetc
-#define file_gets(buf, len, file) gzgets((file), (buf), (len))
-#define file_eof gzeof
+extern FILE_T filed_open(int fd, const char *mode);
+/* XX: returns number of *bytes* (not number of elements), as gzread does */
+extern int file_read(void *buf, unsigned int bsize, unsigned int count, FILE_T file);
+extern int file_close(FILE_T file);
+extern int file_getc(FILE_T file);
+extern char *file_gets(char *buf, int len, FILE_T file);
+extern int file_eof(FILE_T file);
+/* TRUE if the file is read inflated, and offsets in it aren't offsets
+   in the file as stored */
+extern gboolean file_iscompressed(FILE_T file);
+#ifdef HAVE_GZCLEARERR
+extern void file_clearerr(FILE_T file);
+#endif
+
+/*
+ * Block-compressed gzip output: the data is cut into blocks of at most
+ * 65280 bytes, each compressed into a gzip member of its own with a
+ * BGZF "BC" extra field, so it's still a gzip file, and BGZF tools can
+ * read it too.  On close an index of the blocks is appended, in the
+ * extra fields of empty members, followed by a BGZF end-of-file block.
+ */
+typedef struct wtap_writer *GZWFILE_T;
+
+/* Write compressed to "fh", which gzwfile_close() leaves open */
+extern GZWFILE_T gzwfile_open(FILE *fh);
+/* Returns "len", or 0 on error */
+extern unsigned int gzwfile_write(GZWFILE_T state, const void *buf, unsigned int len);
+/* Compress what's buffered into a block, and flush "fh"; 0 or -1 on error */
+extern int gzwfile_flush(GZWFILE_T state);
+/* Write the rest and the index, and free "state"; 0 or -1 on error */
+extern int gzwfile_close(GZWFILE_T state);
+/* The error of the last failure, as for file_error() */
+extern int gzwfile_geterr(GZWFILE_T state);
 
 #else /* No zLib */
 
@@ -49,6 +81,7 @@ extern FILE_T file_open(const char *path, const char *mode);
 #define file_getc fgetc
 #define file_gets fgets
 #define file_eof feof
+#define file_iscompressed(file) FALSE
 
 #endif /* HAVE_LIBZ */
 
@@ -52,6 +52,7 @@ typedef struct {
 	swapped_type_t lengths_swapped;
 	guint16	version_major;
 	guint16	version_minor;
+	gint64	skip_limit;	/* size of the file, for libpcap_skip_rec_data() */
 } libpcap_t;
 
 /* On some systems, the FDDI MAC addresses are bit-swapped. */
@@ -69,6 +70,13 @@ static libpcap_try_t libpcap_try(wtap *wth, int *err);
 
 static gboolean libpcap_read(wtap *wth, int *err, gchar **err_info,
     gint64 *data_offset);
+static gboolean libpcap_read_packet_header(wtap *wth, int *err,
+    gchar **err_info, gint64 *data_offset);
+static int libpcap_read_batch(wtap *wth, struct wtap_batch_rec *recs,
+    int max_recs, int *err, gchar **err_info);
+static gboolean libpcap_read_rec(wtap *wth, struct wtap_pkthdr *phdr,
+    union wtap_pseudo_header *pseudo_header, Buffer *buf, gboolean skip_data,
+    int *err, gchar **err_info, gint64 *data_offset);
 static gboolean libpcap_seek_read(wtap *wth, gint64 seek_off,
     union wtap_pseudo_header *pseudo_header, guchar *pd, int length,
     int *err, gchar **err_info);
@@ -77,6 +85,7 @@ static int libpcap_read_header(wtap *wth, int *err, gchar **err_info,
 static void adjust_header(wtap *wth, struct pcaprec_hdr *hdr);
 static gboolean libpcap_read_rec_data(FILE_T fh, guchar *pd, int length,
     int *err);
+static gboolean libpcap_skip_rec_data(wtap *wth, guint length, int *err);
 static gboolean libpcap_dump(wtap_dumper *wdh, const struct wtap_pkthdr *phdr,
     const union wtap_pseudo_header *pseudo_header, const guchar *pd, int *err);
 
@@ -262,8 +271,11 @@ int libpcap_open(wtap *wth, int *err, gchar **err_info)
 	libpcap->byte_swapped = byte_swapped;
 	libpcap->version_major = hdr.version_major;
 	libpcap->version_minor = hdr.version_minor;
+	libpcap->skip_limit = -1;
 	wth->priv = (void *)libpcap;
 	wth->subtype_read = libpcap_read;
+	wth->subtype_read_header = libpcap_read_packet_header;
+	wth->subtype_read_batch = libpcap_read_batch;
 	wth->subtype_seek_read = libpcap_seek_read;
 	wth->file_encap = file_encap;
 	wth->snapshot_length = hdr.snaplen;
@@ -596,6 +608,39 @@ static libpcap_try_t libpcap_try(wtap *wth, int *err)
 /* Read the next packet */
 static gboolean libpcap_read(wtap *wth, int *err, gchar **err_info,
     gint64 *data_offset)
+{
+	buffer_clean(wth->frame_buffer);
+	return libpcap_read_rec(wth, &wth->phdr, &wth->pseudo_header,
+	    wth->frame_buffer, FALSE, err, err_info, data_offset);
+}
+
+static gboolean libpcap_read_packet_header(wtap *wth, int *err,
+    gchar **err_info, gint64 *data_offset)
+{
+	buffer_clean(wth->frame_buffer);
+	return libpcap_read_rec(wth, &wth->phdr, &wth->pseudo_header,
+	    wth->frame_buffer, TRUE, err, err_info, data_offset);
+}
+
+static int libpcap_read_batch(wtap *wth, struct wtap_batch_rec *recs,
+    int max_recs, int *err, gchar **err_info)
+{
+	int n;
+
+	for (n = 0; n < max_recs; n++) {
+		if (!libpcap_read_rec(wth, &recs[n].phdr, &recs[n].pseudo_header,
+		    wth->batch_buffer, FALSE, err, err_info,
+		    &recs[n].data_offset))
+			break;
+	}
+	return n;
+}
+
+/* Read a record into "phdr" and "pseudo_header", appending its data to
+   "buf". */
+static gboolean libpcap_read_rec(wtap *wth, struct wtap_pkthdr *phdr,
+    union wtap_pseudo_header *pseudo_header, Buffer *buf, gboolean skip_data,
+    int *err, gchar **err_info, gint64 *data_offset)
 {
 	struct pcaprec_ss990915_hdr hdr;
 	guint packet_size;
@@ -603,6 +648,7 @@ static gboolean libpcap_read(wtap *wth, int *err, gchar **err_info,
 	int bytes_read;
 	guchar fddi_padding[3];
 	int phdr_len;
+	guchar *pd = NULL;
 	libpcap_t *libpcap;
 
 	bytes_read = libpcap_read_header(wth, err, err_info, &hdr);
@@ -643,8 +689,8 @@ static gboolean libpcap_read(wtap *wth, int *err, gchar **err_info,
 
 	libpcap = (libpcap_t *)wth->priv;
 	phdr_len = pcap_process_pseudo_header(wth->fh, wth->file_type,
-	    wth->file_encap, packet_size, TRUE, &wth->phdr,
-	    &wth->pseudo_header, err, err_info);
+	    wth->file_encap, packet_size, TRUE, phdr, pseudo_header, err,
+	    err_info);
 	if (phdr_len < 0)
 		return FALSE;	/* error */
 
@@ -655,23 +701,32 @@ static gboolean libpcap_read(wtap *wth, int *err, gchar **err_info,
 	packet_size -= phdr_len;
 	wth->data_offset += phdr_len;
 
-	buffer_assure_space(wth->frame_buffer, packet_size);
-	if (!libpcap_read_rec_data(wth->fh, buffer_start_ptr(wth->frame_buffer),
-	    packet_size, err))
-		return FALSE;	/* Read error */
+	if (skip_data) {
+		if (!libpcap_skip_rec_data(wth, packet_size, err))
+			return FALSE;	/* Read error */
+	} else {
+		buffer_assure_space(buf, packet_size);
+		pd = buffer_end_ptr(buf);
+		if (!libpcap_read_rec_data(wth->fh, pd, packet_size, err))
+			return FALSE;	/* Read error */
+		buffer_increase_length(buf, packet_size);
+	}
 	wth->data_offset += packet_size;
 
 	/* Update the Timestamp, if not already done */
 	if (wth->file_encap != WTAP_ENCAP_ERF) {
-	  wth->phdr.ts.secs = hdr.hdr.ts_sec;
+	  phdr->ts.secs = hdr.hdr.ts_sec;
 	  if(wth->tsprecision == WTAP_FILE_TSPREC_NSEC) {
-	    wth->phdr.ts.nsecs = hdr.hdr.ts_usec;
+	    phdr->ts.nsecs = hdr.hdr.ts_usec;
 	  } else {
-	    wth->phdr.ts.nsecs = hdr.hdr.ts_usec * 1000;
+	    phdr->ts.nsecs = hdr.hdr.ts_usec * 1000;
 	  }
 	}
-	wth->phdr.caplen = packet_size;
-	wth->phdr.len = orig_size;
+	phdr->caplen = packet_size;
+	phdr->len = orig_size;
+
+	if (skip_data)
+		return TRUE;
 
 	if (wth->file_encap == WTAP_ENCAP_ATM_PDUS) {
 		if (wth->file_type == WTAP_FILE_PCAP_NOKIA) {
@@ -681,8 +736,8 @@ static gboolean libpcap_read(wtap *wth, int *err, gchar **err_info,
 			 * Guess the traffic type based on the packet
 			 * contents.
 			 */
-			atm_guess_traffic_type(buffer_start_ptr(wth->frame_buffer),
-			    wth->phdr.caplen, &wth->pseudo_header);
+			atm_guess_traffic_type(pd, phdr->caplen,
+			    pseudo_header);
 		} else {
 			/*
 			 * SunATM.
@@ -691,15 +746,15 @@ static gboolean libpcap_read(wtap *wth, int *err, gchar **err_info,
 			 * type of LANE traffic it is based on the packet
 			 * contents.
 			 */
-			if (wth->pseudo_header.atm.type == TRAF_LANE) {
-				atm_guess_lane_type(buffer_start_ptr(wth->frame_buffer),
-				    wth->phdr.caplen, &wth->pseudo_header);
+			if (pseudo_header->atm.type == TRAF_LANE) {
+				atm_guess_lane_type(pd, phdr->caplen,
+				    pseudo_header);
 			}
 		}
 	}
 
-	pcap_read_post_process(wth->file_encap, wth->phdr.caplen,
-	    libpcap->byte_swapped, buffer_start_ptr(wth->frame_buffer));
+	pcap_read_post_process(wth->file_encap, phdr->caplen,
+	    libpcap->byte_swapped, pd);
 	return TRUE;
 }
 
@@ -891,6 +946,38 @@ libpcap_read_rec_data(FILE_T fh, guchar *pd, int length, int *err)
 	return TRUE;
 }
 
+/* Skip the packet data of the record being read, for wtap_read_header().
+
+   It's seeked over if it's at least WTAP_SKIP_SEEK_MIN bytes, the file
+   isn't compressed and the record lies within the file, and read
+   otherwise: a gzipped file has to be inflated anyway, and a record cut
+   off by the end of the file must still get a short read rather than
+   leave a seek past the end. */
+static gboolean
+libpcap_skip_rec_data(wtap *wth, guint length, int *err)
+{
+	libpcap_t *libpcap = (libpcap_t *)wth->priv;
+
+	if (length >= WTAP_SKIP_SEEK_MIN && !file_iscompressed(wth->fh)) {
+		if (libpcap->skip_limit == -1) {
+			libpcap->skip_limit = wtap_file_size(wth, err);
+			if (libpcap->skip_limit == -1)
+				return FALSE;
+		}
+		if (wth->data_offset + length <= libpcap->skip_limit) {
+			if (file_seek(wth->fh, length, SEEK_CUR, err) == -1) {
+				if (*err == 0)
+					*err = WTAP_ERR_CANT_READ;
+				return FALSE;
+			}
+			return TRUE;
+		}
+	}
+	buffer_assure_space(wth->frame_buffer, length);
+	return libpcap_read_rec_data(wth->fh,
+	    buffer_start_ptr(wth->frame_buffer), length, err);
+}
+
 /* Returns 0 if we could write the specified encapsulation type,
    an error indication otherwise. */
 int libpcap_dump_can_write_encap(int encap)
@@ -60,6 +60,12 @@ static gboolean
 pcapng_read(wtap *wth, int *err, gchar **err_info,
     gint64 *data_offset);
 static gboolean
+pcapng_read_packet_header(wtap *wth, int *err, gchar **err_info,
+    gint64 *data_offset);
+static int
+pcapng_read_batch(wtap *wth, struct wtap_batch_rec *recs, int max_recs,
+    int *err, gchar **err_info);
+static gboolean
 pcapng_seek_read(wtap *wth, gint64 seek_off,
     union wtap_pseudo_header *pseudo_header, guchar *pd, int length,
     int *err, gchar **err_info);
@@ -150,6 +156,9 @@ typedef struct pcapng_option_header_s {
 #define BLOCK_TYPE_EPB 0x00000006 /* Enhanced Packet Block */
 #define BLOCK_TYPE_SHB 0x0A0D0D0A /* Section Header Block */
 
+/* Largest packet block read in one go; that leaves some room for options */
+#define PCAPNG_BUFFERED_BLOCK_MAX (WTAP_MAX_PACKET_SIZE + 4096)
+
 
 
 /* Capture section */
@@ -197,8 +206,13 @@ typedef struct wtapng_packet_s {
 	/* options */
 	gchar				*opt_comment;	/* NULL if not available */
 	guint64				drop_count;
-	guint32				pack_flags;     /* XXX - 0 for now (any value for "we don't have it"?) */
+	guint32				pack_flags;     /* 0 if not available */
 	/* pack_hash */
+	/* Where the options are, in the block buffer, so only valid until
+	   the next block is read; opt_comment and pack_flags are taken from
+	   them, anything else can be looked up with pcapng_packet_option(). */
+	const guint8			*options;
+	guint32				options_len;
 
 	guint32 			pseudo_header_len;
 	int				wtap_encap;
@@ -266,6 +280,8 @@ typedef struct wtapng_block_s {
 	struct wtap_pkthdr *packet_header;
 	const guchar *frame_buffer;
 	int *file_encap;
+	gboolean skip_data;	/* skip the packet data, for wtap_read_header() */
+	Buffer *block_buffer;	/* to read a packet block into in one go, or NULL */
 } wtapng_block_t;
 
 typedef struct interface_data_s {
@@ -281,6 +297,10 @@ typedef struct {
 	gint8 if_fcslen;
 	GArray *interface_data;
 	guint number_of_interfaces;
+	gint64 skip_limit;	/* size of the file, for pcapng_read_packet_data() */
+	gboolean file_phdrs;	/* an interface has pseudo-headers in the packet data */
+	Buffer seq_block;	/* block buffers for sequential and random reads */
+	Buffer rand_block;
 } pcapng_t;
 
 static int
@@ -544,6 +564,7 @@ pcapng_read_if_descr_block(FILE_T fh, pcapng_block_header_t *bh, pcapng_t *pn,
 	pcapng_option_header_t oh;
 	interface_data_t int_data;
 	gint encap;
+	union wtap_pseudo_header pseudo_header;
 	char option_content[100]; /* XXX - size might need to be increased, if we see longer options */
 
 
@@ -725,6 +746,12 @@ pcapng_read_if_descr_block(FILE_T fh, pcapng_block_header_t *bh, pcapng_t *pn,
 		}
 	}
 
+	/* packet blocks of such an interface can't be read in one go, as
+	   pcap_process_pseudo_header() reads the pseudo-header from the file */
+	memset(&pseudo_header, 0, sizeof pseudo_header);
+	if (pcap_get_phdr_size(encap, &pseudo_header) != 0)
+		pn->file_phdrs = TRUE;
+
 	int_data.wtap_encap = encap;
 	int_data.time_units_per_second = time_units_per_second;
 	g_array_append_val(pn->interface_data, int_data);
@@ -733,33 +760,50 @@ pcapng_read_if_descr_block(FILE_T fh, pcapng_block_header_t *bh, pcapng_t *pn,
 }
 
 
-static int
-pcapng_read_packet_block(FILE_T fh, pcapng_block_header_t *bh, pcapng_t *pn, wtapng_block_t *wblock, int *err, gchar **err_info _U_, gboolean enhanced)
+/* Read the captured data of a packet into wblock->frame_buffer or, if
+ * wblock->skip_data is set, skip it.  It's seeked over if it's at least
+ * WTAP_SKIP_SEEK_MIN bytes, the file isn't compressed and the block lies
+ * within the file, and read otherwise: a gzipped file has to be inflated
+ * anyway, and a block cut off by the end of the file must still get a
+ * short read rather than leave a seek past the end. */
+static gboolean
+pcapng_read_packet_data(FILE_T fh, pcapng_t *pn, wtapng_block_t *wblock, guint32 length, int *err)
 {
 	int bytes_read;
-	int block_read;
-	int to_read;
-	guint64 file_offset64;
-	pcapng_enhanced_packet_block_t epb;
-	pcapng_packet_block_t pb;
-	guint32 block_total_length;
-	pcapng_option_header_t oh;
-	gint wtap_encap;
-	int pseudo_header_len;
-	char option_content[100]; /* XXX - size might need to be increased, if we see longer options */
 
+	if (wblock->skip_data && length >= WTAP_SKIP_SEEK_MIN &&
+	    !file_iscompressed(fh) && file_tell(fh) + length <= pn->skip_limit) {
+		if (file_seek(fh, length, SEEK_CUR, err) == -1) {
+			if (*err == 0)
+				*err = WTAP_ERR_CANT_READ;
+			return FALSE;
+		}
+		return TRUE;
+	}
 
-	/* "(Enhanced) Packet Block" read fixed part */
 	errno = WTAP_ERR_CANT_READ;
-	if (enhanced) {
-		bytes_read = file_read(&epb, 1, sizeof epb, fh);
-		if (bytes_read != sizeof epb) {
-			pcapng_debug0("pcapng_read_packet_block: failed to read packet data");
-			*err = file_error(fh);
-			return 0;
-		}
-		block_read = bytes_read;
+	bytes_read = file_read((guchar *) (wblock->frame_buffer), 1, length, fh);
+	if (bytes_read != (int) length) {
+		*err = file_error(fh);
+		if (*err == 0)
+			*err = WTAP_ERR_SHORT_READ;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/* Fill in wblock->data.packet from the fixed part of a Packet Block or an
+ * Enhanced Packet Block, and check the lengths in it. */
+static gboolean
+pcapng_process_packet_fields(pcapng_t *pn, wtapng_block_t *wblock,
+			     gboolean enhanced, const void *fixed,
+			     int *err, gchar **err_info)
+{
+	pcapng_enhanced_packet_block_t epb;
+	pcapng_packet_block_t pb;
 
+	if (enhanced) {
+		memcpy(&epb, fixed, sizeof epb);
 		if (pn->byte_swapped) {
 			wblock->data.packet.interface_id	= BSWAP32(epb.interface_id);
 			wblock->data.packet.drops_count		= -1; /* invalid */
@@ -776,14 +820,7 @@ pcapng_read_packet_block(FILE_T fh, pcapng_block_header_t *bh, pcapng_t *pn, wta
 			wblock->data.packet.packet_len		= epb.packet_len;
 		}
 	} else {
-		bytes_read = file_read(&pb, 1, sizeof pb, fh);
-		if (bytes_read != sizeof pb) {
-			pcapng_debug0("pcapng_read_packet_block: failed to read packet data");
-			*err = file_error(fh);
-			return 0;
-		}
-		block_read = bytes_read;
-
+		memcpy(&pb, fixed, sizeof pb);
 		if (pn->byte_swapped) {
 			wblock->data.packet.interface_id	= BSWAP16(pb.interface_id);
 			wblock->data.packet.drops_count		= BSWAP16(pb.drops_count);
@@ -805,13 +842,13 @@ pcapng_read_packet_block(FILE_T fh, pcapng_block_header_t *bh, pcapng_t *pn, wta
 		*err = WTAP_ERR_BAD_RECORD;
 		*err_info = g_strdup_printf("pcapng_read_packet_block: cap_len %u is larger than packet_len %u.",
 		    wblock->data.packet.cap_len, wblock->data.packet.packet_len);
-		return 0;
+		return FALSE;
 	}
 	if (wblock->data.packet.cap_len > WTAP_MAX_PACKET_SIZE) {
 		*err = WTAP_ERR_BAD_RECORD;
 		*err_info = g_strdup_printf("pcapng_read_packet_block: cap_len %u is larger than WTAP_MAX_PACKET_SIZE %u.",
 		    wblock->data.packet.cap_len, WTAP_MAX_PACKET_SIZE);
-		return 0;
+		return FALSE;
 	}
 	pcapng_debug3("pcapng_read_packet_block: packet data: packet_len %u captured_len %u interface_id %u",
 	              wblock->data.packet.packet_len,
@@ -821,8 +858,146 @@ pcapng_read_packet_block(FILE_T fh, pcapng_block_header_t *bh, pcapng_t *pn, wta
 		*err = WTAP_ERR_BAD_RECORD;
 		*err_info = g_strdup_printf("pcapng_read_packet_block: packet_len %u is larger than WTAP_MAX_PACKET_SIZE %u.",
 		    wblock->data.packet.packet_len, WTAP_MAX_PACKET_SIZE);
+		return FALSE;
+	}
+
+	/* Option defaults, for a block without options */
+	wblock->data.packet.opt_comment = NULL;
+	wblock->data.packet.drop_count  = -1;
+	wblock->data.packet.pack_flags  = 0;
+	wblock->data.packet.options     = NULL;
+	wblock->data.packet.options_len = 0;
+
+	return TRUE;
+}
+
+/* Look up option "code" among the options of a packet block, which are
+ * only located when the block is read.  Returns its content, which isn't
+ * NUL-terminated, and sets *len to its length, or returns NULL if the
+ * block hasn't got the option.  The content is in the block buffer, so
+ * it's only valid until the next block is read. */
+static const guint8 *
+pcapng_packet_option(pcapng_t *pn, const wtapng_packet_t *packet,
+		     guint16 code, guint16 *len)
+{
+	const guint8 *opt = packet->options;
+	guint32 left = packet->options_len;
+	pcapng_option_header_t oh;
+	guint32 opt_len;
+
+	while (left >= sizeof oh) {
+		/*  Don't cast the buffer into the option header--the
+		 *  options may not be aligned correctly.
+		 */
+		memcpy(&oh, opt, sizeof oh);
+		if (pn->byte_swapped) {
+			oh.option_code   = BSWAP16(oh.option_code);
+			oh.option_length = BSWAP16(oh.option_length);
+		}
+		if (oh.option_code == 0)	/* opt_endofopt */
+			break;
+		if (oh.option_length > left - sizeof oh) {
+			pcapng_debug1("pcapng_packet_option: option %u runs past the end of the block",
+				      oh.option_code);
+			break;
+		}
+		if (oh.option_code == code) {
+			*len = oh.option_length;
+			return opt + sizeof oh;
+		}
+
+		/* on to the next option, over the padding */
+		opt_len = (guint32)sizeof oh + oh.option_length;
+		if (opt_len % 4)
+			opt_len += 4 - (opt_len % 4);
+		if (opt_len >= left)
+			break;
+		opt += opt_len;
+		left -= opt_len;
+	}
+	return NULL;
+}
+
+/* The comment (opt_comment) of a packet block, g_malloc()ed, or NULL */
+static gchar *
+pcapng_packet_comment(pcapng_t *pn, const wtapng_packet_t *packet)
+{
+	const guint8 *content;
+	guint16 len;
+
+	content = pcapng_packet_option(pn, packet, 1, &len);
+	if (content == NULL || len == 0)
+		return NULL;
+	return g_strndup((const gchar *)content, len);
+}
+
+/* The flags (pack_flags / epb_flags) of a packet block, or 0 */
+static guint32
+pcapng_packet_flags(pcapng_t *pn, const wtapng_packet_t *packet)
+{
+	const guint8 *content;
+	guint16 len;
+	guint32 flags;
+
+	content = pcapng_packet_option(pn, packet, 2, &len);
+	if (content == NULL)
+		return 0;
+	if (len != 4) {
+		pcapng_debug1("pcapng_packet_flags: pack_flags length %u not 4 as expected", len);
+		return 0;
+	}
+	memcpy(&flags, content, sizeof flags);
+	if (pn->byte_swapped)
+		flags = BSWAP32(flags);
+	return flags;
+}
+
+/* Fill in the options of a packet block that are kept in
+ * wblock->data.packet, once they've been located. */
+static void
+pcapng_process_packet_options(pcapng_t *pn, wtapng_block_t *wblock)
+{
+	if (wblock->data.packet.options_len == 0)
+		return;
+	wblock->data.packet.opt_comment = pcapng_packet_comment(pn, &wblock->data.packet);
+	wblock->data.packet.pack_flags = pcapng_packet_flags(pn, &wblock->data.packet);
+}
+
+static int
+pcapng_read_packet_block(FILE_T fh, pcapng_block_header_t *bh, pcapng_t *pn, wtapng_block_t *wblock, int *err, gchar **err_info, gboolean enhanced)
+{
+	int bytes_read;
+	int block_read;
+	int to_read;
+	guint64 file_offset64;
+	pcapng_enhanced_packet_block_t epb;
+	pcapng_packet_block_t pb;
+	void *fixed;
+	int fixed_len;
+	guint32 block_total_length;
+	gint wtap_encap;
+	int pseudo_header_len;
+
+
+	/* "(Enhanced) Packet Block" read fixed part */
+	if (enhanced) {
+		fixed = &epb;
+		fixed_len = (int)sizeof epb;
+	} else {
+		fixed = &pb;
+		fixed_len = (int)sizeof pb;
+	}
+	errno = WTAP_ERR_CANT_READ;
+	bytes_read = file_read(fixed, 1, fixed_len, fh);
+	if (bytes_read != fixed_len) {
+		pcapng_debug0("pcapng_read_packet_block: failed to read packet data");
+		*err = file_error(fh);
 		return 0;
 	}
+	block_read = bytes_read;
+
+	if (!pcapng_process_packet_fields(pn, wblock, enhanced, fixed, err, err_info))
+		return 0;
 
 	wtap_encap = pcapng_get_encap(wblock->data.packet.interface_id, pn);
 	pcapng_debug3("pcapng_read_packet_block: encapsulation = %d (%s), pseudo header size = %d.",
@@ -851,17 +1026,12 @@ pcapng_read_packet_block(FILE_T fh, pcapng_block_header_t *bh, pcapng_t *pn, wta
 	}
 
 	/* "(Enhanced) Packet Block" read capture data */
-	errno = WTAP_ERR_CANT_READ;
-	bytes_read = file_read((guchar *) (wblock->frame_buffer), 1, wblock->data.packet.cap_len - pseudo_header_len, fh);
-	if (bytes_read != (int) (wblock->data.packet.cap_len - pseudo_header_len)) {
-		*err = file_error(fh);
+	if (!pcapng_read_packet_data(fh, pn, wblock, wblock->data.packet.cap_len - pseudo_header_len, err)) {
 		pcapng_debug1("pcapng_read_packet_block: couldn't read %u bytes of captured data",
 			      wblock->data.packet.cap_len - pseudo_header_len);
-		if (*err == 0)
-			*err = WTAP_ERR_SHORT_READ;
 		return 0;
 	}
-	block_read += bytes_read;
+	block_read += wblock->data.packet.cap_len - pseudo_header_len;
 
 	/* jump over potential padding bytes at end of the packet data */
 	if( (wblock->data.packet.cap_len % 4) != 0) {
@@ -882,67 +1052,173 @@ pcapng_read_packet_block(FILE_T fh, pcapng_block_header_t *bh, pcapng_t *pn, wta
 		block_total_length = bh->block_total_length;
 	}
 
-	/* Option defaults */
-	wblock->data.packet.opt_comment = NULL;
-	wblock->data.packet.drop_count  = -1;
-	wblock->data.packet.pack_flags  = 0;    /* XXX - is 0 ok to signal "not used"? */
-
-	/* Options */
-	errno = WTAP_ERR_CANT_READ;
+	/* Options, read in one go into the block buffer */
 	to_read = block_total_length
         - (int)sizeof(pcapng_block_header_t)
         - block_read    /* fixed and variable part, including padding */
         - (int)sizeof(bh->block_total_length);
-	while(to_read > 0) {
-		/* read option */
-		bytes_read = pcapng_read_option(fh, pn, &oh, option_content, sizeof(option_content), err, err_info);
-		if (bytes_read <= 0) {
-			pcapng_debug0("pcapng_read_packet_block: failed to read option");
-			return bytes_read;
+	if (to_read > 0) {
+		buffer_assure_space(wblock->block_buffer, to_read);
+		errno = WTAP_ERR_CANT_READ;
+		bytes_read = file_read(buffer_start_ptr(wblock->block_buffer), 1, to_read, fh);
+		if (bytes_read != to_read) {
+			pcapng_debug0("pcapng_read_packet_block: failed to read options");
+			*err = file_error(fh);
+			if (*err != 0)
+				return -1;
+			return 0;
 		}
-		block_read += bytes_read;
-		to_read -= bytes_read;
+		wblock->data.packet.options = buffer_start_ptr(wblock->block_buffer);
+		wblock->data.packet.options_len = to_read;
+		block_read += to_read;
+		pcapng_process_packet_options(pn, wblock);
+	}
 
-		/* handle option content */
-		switch(oh.option_code) {
-		    case(0): /* opt_endofopt */
-			if(to_read != 0) {
-				pcapng_debug1("pcapng_read_packet_block: %u bytes after opt_endofopt", to_read);
-			}
-			/* padding should be ok here, just get out of this */
-			to_read = 0;
-			break;
-		    case(1): /* opt_comment */
-			if(oh.option_length > 0 && oh.option_length < sizeof(option_content)) {
-				wblock->data.packet.opt_comment = g_strndup(option_content, sizeof(option_content));
-				pcapng_debug1("pcapng_read_packet_block: opt_comment %s", wblock->data.packet.opt_comment);
-			} else {
-				pcapng_debug1("pcapng_read_packet_block: opt_comment length %u seems strange", oh.option_length);
-			}
-			break;
-		    case(2): /* pack_flags / epb_flags */
-			if(oh.option_length == 4) {
-				/*  Don't cast a char[] into a guint32--the
-				 *  char[] may not be aligned correctly.
-				 */
-				memcpy(&wblock->data.packet.pack_flags, option_content, sizeof(guint32));
-				if(pn->byte_swapped)
-					wblock->data.packet.pack_flags = BSWAP32(wblock->data.packet.pack_flags);
-				pcapng_debug1("pcapng_read_if_descr_block: pack_flags %u (ignored)", wblock->data.packet.pack_flags);
-			} else {
-				pcapng_debug1("pcapng_read_if_descr_block: pack_flags length %u not 4 as expected", oh.option_length);
-			}
-			break;
-		    default:
-			pcapng_debug2("pcapng_read_packet_block: unknown option %u - ignoring %u bytes",
-				      oh.option_code, oh.option_length);
+	if (!wblock->skip_data) {
+		pcap_read_post_process(wtap_encap,
+		    (int) (wblock->data.packet.cap_len - pseudo_header_len),
+		    pn->byte_swapped, (guchar *) (wblock->frame_buffer));
+	}
+	return block_read;
+}
+
+/* Whether pcapng_read_buffered_packet_block() can read this (Enhanced)
+ * Packet Block: not if a pseudo-header has to be read from the file
+ * first, nor if the block is too big to buffer or has packet data that
+ * wtap_read_header() would rather seek over. */
+static gboolean
+pcapng_can_buffer_packet_block(pcapng_block_header_t *bh, pcapng_t *pn,
+			       wtapng_block_t *wblock)
+{
+	if (wblock->block_buffer == NULL || pn->file_phdrs)
+		return FALSE;
+	if (bh->block_total_length < sizeof(pcapng_block_header_t) +
+	    sizeof(pcapng_enhanced_packet_block_t) + sizeof(bh->block_total_length) ||
+	    bh->block_total_length > PCAPNG_BUFFERED_BLOCK_MAX)
+		return FALSE;
+	if (wblock->skip_data && bh->block_total_length >= WTAP_SKIP_SEEK_MIN)
+		return FALSE;
+	return TRUE;
+}
+
+/* Read the rest of an (Enhanced) Packet Block, its second block length
+ * included, with one file_read() into wblock->block_buffer and take it
+ * apart there, rather than field by field and option by option as
+ * pcapng_read_packet_block() does; it fails the same way on a block cut
+ * off by the end of the file, though.  Returns what it read, or
+ * what pcapng_read_block() would on failure. */
+static int
+pcapng_read_buffered_packet_block(FILE_T fh, pcapng_block_header_t *bh, pcapng_t *pn, wtapng_block_t *wblock, int *err, gchar **err_info, gboolean enhanced)
+{
+	guint32 fixed_len;
+	guint32 block_len;	/* what follows the block header */
+	guint32 data_end;	/* end of the packet data and its padding */
+	guint32 block_total_length;
+	int bytes_read;
+	int more;
+	guint8 *block;
+	gint wtap_encap;
+
+	if (enhanced)
+		fixed_len = (guint32)sizeof(pcapng_enhanced_packet_block_t);
+	else
+		fixed_len = (guint32)sizeof(pcapng_packet_block_t);
+
+	/* (the "block total length" of some example files don't contain the packet data padding bytes!) */
+	block_len = bh->block_total_length - (guint32)sizeof(pcapng_block_header_t);
+	if (block_len % 4)
+		block_len += 4 - (block_len % 4);
+
+	buffer_assure_space(wblock->block_buffer, block_len);
+	block = buffer_start_ptr(wblock->block_buffer);
+	errno = WTAP_ERR_CANT_READ;
+	bytes_read = file_read(block, 1, block_len, fh);
+	if (bytes_read < (int)fixed_len) {
+		pcapng_debug0("pcapng_read_buffered_packet_block: failed to read packet data");
+		*err = file_error(fh);
+		return 0;
+	}
+
+	if (!pcapng_process_packet_fields(pn, wblock, enhanced, block, err, err_info))
+		return 0;
+
+	data_end = fixed_len + wblock->data.packet.cap_len;
+	if (data_end % 4)
+		data_end += 4 - (data_end % 4);
+	if (data_end + 4 > block_len) {
+		/* No room for the data in the block total length; the
+		   second block length follows the data padding then. */
+		if (bytes_read == (int)block_len) {
+			buffer_assure_space(wblock->block_buffer, data_end + 4);
+			block = buffer_start_ptr(wblock->block_buffer);
+			errno = WTAP_ERR_CANT_READ;
+			more = file_read(block + block_len, 1, data_end + 4 - block_len, fh);
+			if (more > 0)
+				bytes_read += more;
 		}
+		block_len = data_end + 4;
 	}
 
-	pcap_read_post_process(wtap_encap,
-	    (int) (wblock->data.packet.cap_len - pseudo_header_len),
-	    pn->byte_swapped, (guchar *) (wblock->frame_buffer));
-	return block_read;
+	if (bytes_read != (int)block_len) {
+		*err = file_error(fh);
+		if (bytes_read < (int)(fixed_len + wblock->data.packet.cap_len)) {
+			pcapng_debug1("pcapng_read_buffered_packet_block: couldn't read %u bytes of captured data",
+				      wblock->data.packet.cap_len);
+			if (*err == 0)
+				*err = WTAP_ERR_SHORT_READ;
+			return 0;
+		}
+		if (data_end < block_len - 4 && bytes_read < (int)block_len - 4) {
+			/* cut off in the options, which is taken as the
+			   end of the file */
+			pcapng_debug0("pcapng_read_buffered_packet_block: failed to read options");
+			if (*err != 0)
+				return -1;
+			return 0;
+		}
+		pcapng_debug0("pcapng_read_buffered_packet_block: couldn't read second block length");
+		if (*err == 0)
+			*err = WTAP_ERR_SHORT_READ;
+		return -1;
+	}
+
+	/* sanity check: first and second block lengths must match */
+	memcpy(&block_total_length, block + block_len - 4, sizeof block_total_length);
+	if (pn->byte_swapped)
+		block_total_length = BSWAP32(block_total_length);
+	if (block_total_length != bh->block_total_length) {
+		*err = WTAP_ERR_BAD_RECORD;
+		*err_info = g_strdup_printf("pcapng_read_block: total block lengths (first %u and second %u) don't match",
+			      bh->block_total_length, block_total_length);
+		return -1;
+	}
+
+	/* No interface has a pseudo-header in the file, so this only sets
+	   up the pseudo-header, without reading anything. */
+	wtap_encap = pcapng_get_encap(wblock->data.packet.interface_id, pn);
+	memset((void *)wblock->pseudo_header, 0, sizeof(union wtap_pseudo_header));
+	if (pcap_process_pseudo_header(fh, WTAP_FILE_PCAPNG, wtap_encap,
+	    wblock->data.packet.cap_len, TRUE, wblock->packet_header,
+	    (union wtap_pseudo_header *)wblock->pseudo_header,
+	    err, err_info) < 0)
+		return 0;
+	wblock->data.packet.pseudo_header_len = 0;
+
+	if (!wblock->skip_data) {
+		memcpy((guchar *) (wblock->frame_buffer), block + fixed_len,
+		    wblock->data.packet.cap_len);
+		pcap_read_post_process(wtap_encap,
+		    (int) wblock->data.packet.cap_len,
+		    pn->byte_swapped, (guchar *) (wblock->frame_buffer));
+	}
+
+	if (data_end < block_len - 4) {
+		wblock->data.packet.options = block + data_end;
+		wblock->data.packet.options_len = block_len - 4 - data_end;
+		pcapng_process_packet_options(pn, wblock);
+	}
+
+	return (int)block_len;
 }
 
 
@@ -1024,17 +1300,12 @@ pcapng_read_simple_packet_block(FILE_T fh, pcapng_block_header_t *bh, pcapng_t *
 	((union wtap_pseudo_header *) wblock->pseudo_header)->eth.fcs_len = pn->if_fcslen;
 
 	/* "Simple Packet Block" read capture data */
-	errno = WTAP_ERR_CANT_READ;
-	bytes_read = file_read((guchar *) (wblock->frame_buffer), 1, wblock->data.simple_packet.cap_len, fh);
-	if (bytes_read != (int) wblock->data.simple_packet.cap_len) {
-		*err = file_error(fh);
+	if (!pcapng_read_packet_data(fh, pn, wblock, wblock->data.simple_packet.cap_len, err)) {
 		pcapng_debug1("pcapng_read_simple_packet_block: couldn't read %u bytes of captured data",
 			      wblock->data.simple_packet.cap_len);
-		if (*err == 0)
-			*err = WTAP_ERR_SHORT_READ;
 		return 0;
 	}
-	block_read += bytes_read;
+	block_read += wblock->data.simple_packet.cap_len;
 
 	/* jump over potential padding bytes at end of the packet data */
 	if ((wblock->data.simple_packet.cap_len % 4) != 0) {
@@ -1047,8 +1318,10 @@ pcapng_read_simple_packet_block(FILE_T fh, pcapng_block_header_t *bh, pcapng_t *
 		block_read += 4 - (wblock->data.simple_packet.cap_len % 4);
 	}
 
-	pcap_read_post_process(encap, (int) wblock->data.simple_packet.cap_len,
-	    pn->byte_swapped, (guchar *) (wblock->frame_buffer));
+	if (!wblock->skip_data) {
+		pcap_read_post_process(encap, (int) wblock->data.simple_packet.cap_len,
+		    pn->byte_swapped, (guchar *) (wblock->frame_buffer));
+	}
 	return block_read;
 }
 
@@ -1232,6 +1505,16 @@ pcapng_read_block(FILE_T fh, gboolean first_block, pcapng_t *pn, wtapng_block_t
 			return 0;	/* not a pcap-ng file */
 	}
 
+	if ((bh.block_type == BLOCK_TYPE_PB || bh.block_type == BLOCK_TYPE_EPB) &&
+	    pcapng_can_buffer_packet_block(&bh, pn, wblock)) {
+		/* this checks the second block length as well */
+		bytes_read = pcapng_read_buffered_packet_block(fh, &bh, pn, wblock, err, err_info, bh.block_type == BLOCK_TYPE_EPB);
+		if (bytes_read <= 0) {
+			return bytes_read;
+		}
+		return block_read + bytes_read;
+	}
+
 	switch(bh.block_type) {
 		case(BLOCK_TYPE_SHB):
 			bytes_read = pcapng_read_section_header_block(fh, first_block, &bh, pn, wblock, err, err_info);
@@ -1303,12 +1586,16 @@ pcapng_open(wtap *wth, int *err, gchar **err_info)
 	pn.version_minor = -1;
 	pn.interface_data = NULL;
 	pn.number_of_interfaces = 0;
+	pn.skip_limit = -1;
+	pn.file_phdrs = FALSE;
 
 	/* we don't expect any packet blocks yet */
 	wblock.frame_buffer = NULL;
 	wblock.pseudo_header = NULL;
 	wblock.packet_header = NULL;
 	wblock.file_encap = &wth->file_encap;
+	wblock.skip_data = FALSE;
+	wblock.block_buffer = NULL;
 
 	pcapng_debug0("pcapng_open: opening file");
 	/* read first block */
@@ -1339,7 +1626,11 @@ pcapng_open(wtap *wth, int *err, gchar **err_info)
 	pcapng = (pcapng_t *)g_malloc(sizeof(pcapng_t));
 	wth->priv = (void *)pcapng;
 	*pcapng = pn;
+	buffer_init(&pcapng->seq_block, 1500);
+	buffer_init(&pcapng->rand_block, 1500);
 	wth->subtype_read = pcapng_read;
+	wth->subtype_read_header = pcapng_read_packet_header;
+	wth->subtype_read_batch = pcapng_read_batch;
 	wth->subtype_seek_read = pcapng_seek_read;
 	wth->subtype_close = pcapng_close;
 	wth->file_type = WTAP_FILE_PCAPNG;
@@ -1348,15 +1639,24 @@ pcapng_open(wtap *wth, int *err, gchar **err_info)
 }
 
 
-/* classic wtap: read packet */
+/* classic wtap: read packet, into "phdr" and "pseudo_header", appending
+ * its data to "buf" */
 static gboolean
-pcapng_read(wtap *wth, int *err, gchar **err_info, gint64 *data_offset)
+pcapng_read_rec(wtap *wth, struct wtap_pkthdr *phdr,
+    union wtap_pseudo_header *pseudo_header, Buffer *buf, gboolean skip_data,
+    int *err, gchar **err_info, gint64 *data_offset)
 {
 	pcapng_t *pcapng = (pcapng_t *)wth->priv;
 	int bytes_read;
 	guint64 ts;
 	wtapng_block_t wblock;
 
+	if (skip_data && pcapng->skip_limit == -1) {
+		pcapng->skip_limit = wtap_file_size(wth, err);
+		if (pcapng->skip_limit == -1)
+			return FALSE;
+	}
+
 	pcapng_debug1("pcapng_read: wth->data_offset is initially %" G_GINT64_MODIFIER "u", wth->data_offset);
 	*data_offset = wth->data_offset;
 	pcapng_debug1("pcapng_read: *data_offset is initially set to %" G_GINT64_MODIFIER "u", *data_offset);
@@ -1365,15 +1665,17 @@ pcapng_read(wtap *wth, int *err, gchar **err_info, gint64 *data_offset)
 	 * should make use of the caplen of the packet.
 	 */
 	if (wth->snapshot_length > 0) {
-		buffer_assure_space(wth->frame_buffer, wth->snapshot_length);
+		buffer_assure_space(buf, wth->snapshot_length);
 	} else {
-		buffer_assure_space(wth->frame_buffer, WTAP_MAX_PACKET_SIZE);
+		buffer_assure_space(buf, WTAP_MAX_PACKET_SIZE);
 	}
 
-	wblock.frame_buffer  = buffer_start_ptr(wth->frame_buffer);
-	wblock.pseudo_header = &wth->pseudo_header;
-	wblock.packet_header = &wth->phdr;
+	wblock.frame_buffer  = buffer_end_ptr(buf);
+	wblock.pseudo_header = pseudo_header;
+	wblock.packet_header = phdr;
 	wblock.file_encap    = &wth->file_encap;
+	wblock.skip_data     = skip_data;
+	wblock.block_buffer  = &pcapng->seq_block;
 
 	/* read next block */
 	while (1) {
@@ -1396,11 +1698,14 @@ pcapng_read(wtap *wth, int *err, gchar **err_info, gint64 *data_offset)
 		pcapng_debug1("pcapng_read: *data_offset is updated to %" G_GINT64_MODIFIER "u", *data_offset);
 	}
 
+	/* Nothing takes the comment of a packet any further yet */
+	g_free(wblock.data.packet.opt_comment);
+
 	/* Combine the two 32-bit pieces of the timestamp into one 64-bit value */
 	ts = (((guint64)wblock.data.packet.ts_high) << 32) | ((guint64)wblock.data.packet.ts_low);
 
-	wth->phdr.caplen = wblock.data.packet.cap_len - wblock.data.packet.pseudo_header_len;
-	wth->phdr.len = wblock.data.packet.packet_len - wblock.data.packet.pseudo_header_len;
+	phdr->caplen = wblock.data.packet.cap_len - wblock.data.packet.pseudo_header_len;
+	phdr->len = wblock.data.packet.packet_len - wblock.data.packet.pseudo_header_len;
 	if (wblock.data.packet.interface_id < pcapng->number_of_interfaces) {
 		interface_data_t int_data;
 		guint64 time_units_per_second;
@@ -1409,11 +1714,11 @@ pcapng_read(wtap *wth, int *err, gchar **err_info, gint64 *data_offset)
 		id = (gint)wblock.data.packet.interface_id;
 		int_data = g_array_index(pcapng->interface_data, interface_data_t, id);
 		time_units_per_second = int_data.time_units_per_second;
-		wth->phdr.pkt_encap = int_data.wtap_encap;
-		wth->phdr.ts.secs = (time_t)(ts / time_units_per_second);
-		wth->phdr.ts.nsecs = (int)(((ts % time_units_per_second) * 1000000000) / time_units_per_second);
+		phdr->pkt_encap = int_data.wtap_encap;
+		phdr->ts.secs = (time_t)(ts / time_units_per_second);
+		phdr->ts.nsecs = (int)(((ts % time_units_per_second) * 1000000000) / time_units_per_second);
 	} else {
-		wth->phdr.pkt_encap = WTAP_ENCAP_UNKNOWN;
+		phdr->pkt_encap = WTAP_ENCAP_UNKNOWN;
 		*err = WTAP_ERR_BAD_RECORD;
 		*err_info = g_strdup_printf("pcapng: interface index %u is not less than interface count %u.",
 		    wblock.data.packet.interface_id, pcapng->number_of_interfaces);
@@ -1422,13 +1727,46 @@ pcapng_read(wtap *wth, int *err, gchar **err_info, gint64 *data_offset)
 		return FALSE;
 	}
 
-	/*pcapng_debug2("Read length: %u Packet length: %u", bytes_read, wth->phdr.caplen);*/
+	/*pcapng_debug2("Read length: %u Packet length: %u", bytes_read, phdr->caplen);*/
+	if (!skip_data)
+		buffer_increase_length(buf, phdr->caplen);
 	wth->data_offset = *data_offset + bytes_read;
 	pcapng_debug1("pcapng_read: wth->data_offset is finally %" G_GINT64_MODIFIER "u", wth->data_offset);
 
 	return TRUE;
 }
 
+static gboolean
+pcapng_read(wtap *wth, int *err, gchar **err_info, gint64 *data_offset)
+{
+	buffer_clean(wth->frame_buffer);
+	return pcapng_read_rec(wth, &wth->phdr, &wth->pseudo_header,
+	    wth->frame_buffer, FALSE, err, err_info, data_offset);
+}
+
+static gboolean
+pcapng_read_packet_header(wtap *wth, int *err, gchar **err_info, gint64 *data_offset)
+{
+	buffer_clean(wth->frame_buffer);
+	return pcapng_read_rec(wth, &wth->phdr, &wth->pseudo_header,
+	    wth->frame_buffer, TRUE, err, err_info, data_offset);
+}
+
+static int
+pcapng_read_batch(wtap *wth, struct wtap_batch_rec *recs, int max_recs,
+    int *err, gchar **err_info)
+{
+	int n;
+
+	for (n = 0; n < max_recs; n++) {
+		if (!pcapng_read_rec(wth, &recs[n].phdr, &recs[n].pseudo_header,
+		    wth->batch_buffer, FALSE, err, err_info,
+		    &recs[n].data_offset))
+			break;
+	}
+	return n;
+}
+
 
 /* classic wtap: seek to file position and read packet */
 static gboolean
@@ -1453,6 +1791,8 @@ pcapng_seek_read(wtap *wth, gint64 seek_off,
 	wblock.pseudo_header = pseudo_header;
 	wblock.packet_header = &wth->phdr;
 	wblock.file_encap = &wth->file_encap;
+	wblock.skip_data = FALSE;
+	wblock.block_buffer = &pcapng->rand_block;
 
 	/* read the block */
 	bytes_read = pcapng_read_block(wth->random_fh, FALSE, pcapng, &wblock, err, err_info);
@@ -1468,6 +1808,7 @@ pcapng_seek_read(wtap *wth, gint64 seek_off,
 		pcapng_debug1("pcapng_seek_read: block type %u not PB/EPB", wblock.type);
 		return FALSE;
 	}
+	g_free(wblock.data.packet.opt_comment);
 
 	return TRUE;
 }
@@ -1483,15 +1824,53 @@ pcapng_close(wtap *wth)
 	if (pcapng->interface_data != NULL) {
 		g_array_free(pcapng->interface_data, TRUE);
 	}
+	buffer_free(&pcapng->seq_block);
+	buffer_free(&pcapng->rand_block);
 }
 
 
 
+/* Enhanced Packet Blocks are put together in a buffer, which is written
+   out once it has this much in it, before any other block and when the
+   file is flushed or closed */
+#define PCAPNG_DUMP_BUFFER_SIZE (64 * 1024)
+
 typedef struct {
 	GArray *interface_data;
 	guint number_of_interfaces;
+	Buffer epbs;
+	int flush_err;		/* error from pcapng_dump_flush(), for a later
+				   pcapng_dump() or pcapng_dump_close() */
 } pcapng_dump_t;
 
+static gboolean
+pcapng_write_epbs(wtap_dumper *wdh, int *err)
+{
+	pcapng_dump_t *pcapng = (pcapng_dump_t *)wdh->priv;
+	gboolean ret;
+
+	if (pcapng->flush_err != 0) {
+		*err = pcapng->flush_err;
+		return FALSE;
+	}
+	if (buffer_length(&pcapng->epbs) == 0)
+		return TRUE;
+	ret = wtap_dump_file_write(wdh, buffer_start_ptr(&pcapng->epbs),
+	    buffer_length(&pcapng->epbs), err);
+	buffer_clean(&pcapng->epbs);
+	return ret;
+}
+
+static void
+pcapng_dump_flush(wtap_dumper *wdh)
+{
+	pcapng_dump_t *pcapng = (pcapng_dump_t *)wdh->priv;
+	int err;
+
+	if (!pcapng_write_epbs(wdh, &err))
+		pcapng->flush_err = err;
+}
+
 static gboolean
 pcapng_write_section_header_block(wtap_dumper *wdh, wtapng_block_t *wblock, int *err)
 {
@@ -1538,6 +1917,10 @@ pcapng_write_if_descr_block(wtap_dumper *wdh, wtapng_block_t *wblock, int *err)
 	pcapng_interface_description_block_t idb;
 
 
+	/* the packets before it go first */
+	if (!pcapng_write_epbs(wdh, err))
+		return FALSE;
+
 	pcapng_debug3("pcapng_write_if_descr_block: encap = %d (%s), snaplen = %d",
 	              wblock->data.if_descr.link_type,
 	              wtap_encap_string(wtap_pcap_encap_to_wtap_encap(wblock->data.if_descr.link_type)),
@@ -1580,6 +1963,7 @@ pcapng_write_if_descr_block(wtap_dumper *wdh, wtapng_block_t *wblock, int *err)
 static gboolean
 pcapng_write_packet_block(wtap_dumper *wdh, wtapng_block_t *wblock, int *err)
 {
+	pcapng_dump_t *pcapng = (pcapng_dump_t *)wdh->priv;
 	pcapng_block_header_t bh;
 	pcapng_enhanced_packet_block_t epb;
 	const guint32 zero_pad = 0;
@@ -1593,21 +1977,45 @@ pcapng_write_packet_block(wtap_dumper *wdh, wtapng_block_t *wblock, int *err)
 		pad_len = 0;
 	}
 
-	/* write (enhanced) packet block header */
+	/* (enhanced) packet block header */
 	bh.block_type = wblock->type;
 	bh.block_total_length = (guint32)sizeof(bh) + (guint32)sizeof(epb) + phdr_len + wblock->data.packet.cap_len + pad_len /* + options */ + 4;
 
-	if (!wtap_dump_file_write(wdh, &bh, sizeof bh, err))
-		return FALSE;
-	wdh->bytes_dumped += sizeof bh;
-
-	/* write block fixed content */
+	/* block fixed content */
 	epb.interface_id	= wblock->data.packet.interface_id;
 	epb.timestamp_high	= wblock->data.packet.ts_high;
 	epb.timestamp_low	= wblock->data.packet.ts_low;
 	epb.captured_len	= wblock->data.packet.cap_len + phdr_len;
 	epb.packet_len		= wblock->data.packet.packet_len + phdr_len;
 
+	if (phdr_len == 0) {
+		/* put the whole block in the buffer */
+		buffer_append(&pcapng->epbs, (guchar *)&bh, sizeof bh);
+		buffer_append(&pcapng->epbs, (guchar *)&epb, sizeof epb);
+		buffer_append(&pcapng->epbs, (guchar *)wblock->frame_buffer,
+		    wblock->data.packet.cap_len);
+		buffer_append(&pcapng->epbs, (guchar *)&zero_pad, pad_len);
+		/* XXX - (optional) block options */
+		buffer_append(&pcapng->epbs, (guchar *)&bh.block_total_length,
+		    sizeof bh.block_total_length);
+		wdh->bytes_dumped += bh.block_total_length;
+
+		if (buffer_length(&pcapng->epbs) >= PCAPNG_DUMP_BUFFER_SIZE)
+			return pcapng_write_epbs(wdh, err);
+		return TRUE;
+	}
+
+	/* pcap_write_phdr() writes to the file, so write the block
+	   piece by piece after what's buffered */
+	if (!pcapng_write_epbs(wdh, err))
+		return FALSE;
+
+	/* write (enhanced) packet block header */
+	if (!wtap_dump_file_write(wdh, &bh, sizeof bh, err))
+		return FALSE;
+	wdh->bytes_dumped += sizeof bh;
+
+	/* write block fixed content */
 	if (!wtap_dump_file_write(wdh, &epb, sizeof epb, err))
 		return FALSE;
 	wdh->bytes_dumped += sizeof epb;
@@ -1779,14 +2187,18 @@ static gboolean pcapng_dump(wtap_dumper *wdh,
 
 /* Finish writing to a dump file.
    Returns TRUE on success, FALSE on failure. */
-static gboolean pcapng_dump_close(wtap_dumper *wdh, int *err _U_)
+static gboolean pcapng_dump_close(wtap_dumper *wdh, int *err)
 {
 	pcapng_dump_t *pcapng = (pcapng_dump_t *)wdh->priv;
+	gboolean ret;
 
 	pcapng_debug0("pcapng_dump_close");
+	ret = pcapng_write_epbs(wdh, err);
+	buffer_free(&pcapng->epbs);
+	wdh->subtype_flush = NULL;
 	g_array_free(pcapng->interface_data, TRUE);
 	pcapng->number_of_interfaces = 0;
-	return TRUE;
+	return ret;
 }
 
 
@@ -1807,10 +2219,13 @@ pcapng_dump_open(wtap_dumper *wdh, gboolean cant_seek _U_, int *err)
 	/* This is a pcapng file */
 	wdh->subtype_write = pcapng_dump;
 	wdh->subtype_close = pcapng_dump_close;
+	wdh->subtype_flush = pcapng_dump_flush;
 	pcapng = (pcapng_dump_t *)g_malloc(sizeof(pcapng_dump_t));
 	wdh->priv = (void *)pcapng;
 	pcapng->interface_data = g_array_new(FALSE, FALSE, sizeof(interface_data_t));
 	pcapng->number_of_interfaces = 0;
+	buffer_init(&pcapng->epbs, PCAPNG_DUMP_BUFFER_SIZE);
+	pcapng->flush_err = 0;
 
 	/* write the section header block */
 	wblock.type = BLOCK_TYPE_SHB;
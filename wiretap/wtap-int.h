@@ -37,7 +37,7 @@
 
 #ifdef HAVE_LIBZ
 #include <zlib.h>
-#define FILE_T	gzFile
+#define FILE_T	struct wtap_reader *
 #else /* No zLib */
 #define FILE_T	FILE *
 #endif /* HAVE_LIBZ */
@@ -45,6 +45,8 @@
 #include "wtap.h"
 
 typedef gboolean (*subtype_read_func)(struct wtap*, int*, char**, gint64*);
+typedef int (*subtype_read_batch_func)(struct wtap*, struct wtap_batch_rec*,
+					int, int*, char**);
 typedef gboolean (*subtype_seek_read_func)(struct wtap*, gint64, union wtap_pseudo_header*,
 					guint8*, int, int *, char **);
 struct wtap {
@@ -62,6 +64,12 @@ struct wtap {
 	void			*priv;
 
 	subtype_read_func	subtype_read;
+	subtype_read_func	subtype_read_header;	/* NULL if the packet
+							   data can't be
+							   skipped */
+	subtype_read_batch_func	subtype_read_batch;	/* NULL to read a
+							   batch with
+							   subtype_read */
 	subtype_seek_read_func	subtype_seek_read;
 	void			(*subtype_sequential_close)(struct wtap*);
 	void			(*subtype_close)(struct wtap*);
@@ -71,6 +79,10 @@ struct wtap {
 						   types */
 	int			tsprecision;	/* timestamp precision of the lower 32bits
 						 * e.g. WTAP_FILE_TSPREC_USEC */
+	struct wtap_read_ahead	*read_ahead;	/* NULL unless wtap_read_ahead() */
+	struct Buffer		*batch_buffer;	/* data of the packets of a
+						   wtap_read_batch(), one after
+						   another */
 };
 
 struct wtap_dumper;
@@ -79,6 +91,7 @@ typedef gboolean (*subtype_write_func)(struct wtap_dumper*,
 		const struct wtap_pkthdr*, const union wtap_pseudo_header*,
 		const guchar*, int*);
 typedef gboolean (*subtype_close_func)(struct wtap_dumper*, int*);
+typedef void (*subtype_flush_func)(struct wtap_dumper*);
 
 struct wtap_dumper {
 	FILE*			fh;
@@ -86,19 +99,46 @@ struct wtap_dumper {
 	int			snaplen;
 	int			encap;
 	gboolean	compressed;
+	struct wtap_writer	*gzfh;	/* writes compressed to fh, if compressed */
 	gint64		bytes_dumped;
 
 	void			*priv;
 
 	subtype_write_func	subtype_write;
 	subtype_close_func	subtype_close;
+	subtype_flush_func	subtype_flush;	/* writes out what the dump routines
+						   buffer themselves; NULL if they don't */
 
 	int			tsprecision;	/* timestamp precision of the lower 32bits
 							 * e.g. WTAP_FILE_TSPREC_USEC */
+	struct wtap_write_behind *write_behind;	/* NULL unless wtap_dump_write_behind() */
 };
 
 extern gboolean wtap_dump_file_write(wtap_dumper *wdh, const void *buf,
     size_t bufsize, int *err);
+extern gboolean wtap_dump_file_write_direct(wtap_dumper *wdh, const void *buf,
+    size_t bufsize, int *err);
+
+/* wtap_read() without read-ahead */
+extern gboolean wtap_read_packet(wtap *wth, int *err, gchar **err_info,
+    gint64 *data_offset);
+
+/* Packet data skipped by a subtype_read_header routine is only seeked
+   over if there's at least this much of it; a seek throws away what
+   zlib has buffered, so shorter data is cheaper to read. */
+#define WTAP_SKIP_SEEK_MIN	(16 * 1024)
+
+/* async_io.c */
+extern gboolean wtap_read_ahead_next(wtap *wth, int *err, gchar **err_info,
+    gint64 *data_offset);
+extern struct wtap_pkthdr *wtap_read_ahead_phdr(wtap *wth);
+extern union wtap_pseudo_header *wtap_read_ahead_pseudoheader(wtap *wth);
+extern guint8 *wtap_read_ahead_buf_ptr(wtap *wth);
+extern void wtap_read_ahead_stop(wtap *wth);
+extern gboolean wtap_write_behind_write(wtap_dumper *wdh, const void *buf,
+    size_t bufsize, int *err);
+extern int wtap_write_behind_sync(wtap_dumper *wdh);
+extern int wtap_write_behind_stop(wtap_dumper *wdh);
 
 extern gint wtap_num_file_types;
 
@@ -610,6 +610,8 @@ const char
 void
 wtap_sequential_close(wtap *wth)
 {
+	wtap_read_ahead_stop(wth);
+
 	if (wth->subtype_sequential_close != NULL)
 		(*wth->subtype_sequential_close)(wth);
 
@@ -623,6 +625,12 @@ wtap_sequential_close(wtap *wth)
 		g_free(wth->frame_buffer);
 		wth->frame_buffer = NULL;
 	}
+
+	if (wth->batch_buffer) {
+		buffer_free(wth->batch_buffer);
+		g_free(wth->batch_buffer);
+		wth->batch_buffer = NULL;
+	}
 }
 
 void
@@ -647,14 +655,23 @@ wtap_cleareof(wtap *wth _U_) {
 #ifdef HAVE_LIBZ
 #ifdef HAVE_GZCLEARERR
 	/* Reset EOF */
-	if (gzeof(wth->fh))
-		gzclearerr(wth->fh);
+	if (file_eof(wth->fh))
+		file_clearerr(wth->fh);
 #endif
 #endif
 }
 
 gboolean
 wtap_read(wtap *wth, int *err, gchar **err_info, gint64 *data_offset)
+{
+	if (wth->read_ahead != NULL)
+		return wtap_read_ahead_next(wth, err, err_info, data_offset);
+	return wtap_read_packet(wth, err, err_info, data_offset);
+}
+
+static gboolean
+wtap_read_with(wtap *wth, subtype_read_func read_func, int *err,
+    gchar **err_info, gint64 *data_offset)
 {
 	/*
 	 * Set the packet encapsulation to the file's encapsulation
@@ -666,7 +683,7 @@ wtap_read(wtap *wth, int *err, gchar **err_info, gint64 *data_offset)
 	 */
 	wth->phdr.pkt_encap = wth->file_encap;
 
-	if (!wth->subtype_read(wth, err, err_info, data_offset))
+	if (!read_func(wth, err, err_info, data_offset))
 		return FALSE;	/* failure */
 
 	/*
@@ -687,6 +704,87 @@ wtap_read(wtap *wth, int *err, gchar **err_info, gint64 *data_offset)
 	return TRUE;	/* success */
 }
 
+gboolean
+wtap_read_packet(wtap *wth, int *err, gchar **err_info, gint64 *data_offset)
+{
+	return wtap_read_with(wth, wth->subtype_read, err, err_info,
+	    data_offset);
+}
+
+gboolean
+wtap_read_header(wtap *wth, int *err, gchar **err_info, gint64 *data_offset)
+{
+	/* The read-ahead thread has read the data anyway */
+	if (wth->read_ahead != NULL || wth->subtype_read_header == NULL)
+		return wtap_read(wth, err, err_info, data_offset);
+	return wtap_read_with(wth, wth->subtype_read_header, err, err_info,
+	    data_offset);
+}
+
+/* wtap_read_batch() for the file types without a subtype_read_batch
+   routine, and for files being read ahead */
+static int
+wtap_read_batch_packets(wtap *wth, struct wtap_batch_rec *recs, int max_recs,
+    int *err, gchar **err_info)
+{
+	int n;
+
+	for (n = 0; n < max_recs; n++) {
+		if (!wtap_read(wth, err, err_info, &recs[n].data_offset))
+			break;
+		recs[n].phdr = *wtap_phdr(wth);
+		recs[n].pseudo_header = *wtap_pseudoheader(wth);
+		buffer_append(wth->batch_buffer, wtap_buf_ptr(wth),
+		    recs[n].phdr.caplen);
+	}
+	return n;
+}
+
+int
+wtap_read_batch(wtap *wth, struct wtap_batch_rec *recs, int max_recs,
+    int *err, gchar **err_info)
+{
+	int n, i;
+	guint8 *data;
+
+	*err = 0;
+	if (wth->batch_buffer == NULL) {
+		wth->batch_buffer = g_malloc(sizeof(struct Buffer));
+		buffer_init(wth->batch_buffer, 64 * 1024);
+	}
+	buffer_clean(wth->batch_buffer);
+
+	if (wth->read_ahead == NULL && wth->subtype_read_batch != NULL) {
+		/*
+		 * As with wtap_read(), the read routine only has to set
+		 * the encapsulation of a packet if the file has none.
+		 */
+		for (i = 0; i < max_recs; i++)
+			recs[i].phdr.pkt_encap = wth->file_encap;
+		n = wth->subtype_read_batch(wth, recs, max_recs, err,
+		    err_info);
+	} else
+		n = wtap_read_batch_packets(wth, recs, max_recs, err,
+		    err_info);
+
+	/*
+	 * The data of the packets was appended to the buffer one after
+	 * another, and the buffer may have moved as it grew, so the
+	 * pointers are only set now.
+	 */
+	data = buffer_start_ptr(wth->batch_buffer);
+	for (i = 0; i < n; i++) {
+		recs[i].data = data;
+		data += recs[i].phdr.caplen;
+
+		/* As in wtap_read_with() */
+		if (recs[i].phdr.caplen > recs[i].phdr.len)
+			recs[i].phdr.caplen = recs[i].phdr.len;
+		g_assert(recs[i].phdr.pkt_encap != WTAP_ENCAP_PER_PACKET);
+	}
+	return n;
+}
+
 /*
  * Return an approximation of the amount of data we've read sequentially
  * from the file so far.  (gint64, in case that's 64 bits.)
@@ -708,18 +806,24 @@ wtap_read_so_far(wtap *wth, int *err)
 struct wtap_pkthdr*
 wtap_phdr(wtap *wth)
 {
+	if (wth->read_ahead != NULL)
+		return wtap_read_ahead_phdr(wth);
 	return &wth->phdr;
 }
 
 union wtap_pseudo_header*
 wtap_pseudoheader(wtap *wth)
 {
+	if (wth->read_ahead != NULL)
+		return wtap_read_ahead_pseudoheader(wth);
 	return &wth->pseudo_header;
 }
 
 guint8*
 wtap_buf_ptr(wtap *wth)
 {
+	if (wth->read_ahead != NULL)
+		return wtap_read_ahead_buf_ptr(wth);
 	return buffer_start_ptr(wth->frame_buffer);
 }
 
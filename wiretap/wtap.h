@@ -809,6 +809,14 @@ struct wtap_pkthdr {
 	int pkt_encap;
 };
 
+/* A packet read by wtap_read_batch() */
+struct wtap_batch_rec {
+	struct wtap_pkthdr	phdr;
+	union wtap_pseudo_header pseudo_header;
+	gint64			data_offset;	/* as from wtap_read() */
+	guint8			*data;		/* phdr.caplen bytes */
+};
+
 struct Buffer;
 struct wtap_dumper;
 
@@ -871,10 +879,40 @@ void wtap_cleareof(wtap *wth);
 gboolean wtap_read(wtap *wth, int *err, gchar **err_info,
     gint64 *data_offset);
 
+/* Like wtap_read(), but only wtap_phdr() and wtap_pseudoheader() are
+ * filled in: for the file types that allow it (libpcap and pcap-ng),
+ * the packet data is skipped, with a seek where the file isn't
+ * compressed, and wtap_buf_ptr() must not be used.  For callers that
+ * only want the lengths and time stamps of the packets. */
+gboolean wtap_read_header(wtap *wth, int *err, gchar **err_info,
+    gint64 *data_offset);
+
+/* Read up to "max_recs" packets into "recs", as that many wtap_read()
+ * calls would, but with the libpcap and pcap-ng readers going from one
+ * packet to the next without coming back here and without copying the
+ * data out of wtap_buf_ptr().  Returns the number of packets read; fewer
+ * than "max_recs" are read only at the end of the file, where *err is
+ * 0, or on an error.  The data of the packets is in a buffer of the wtap,
+ * valid until the next wtap_read_batch() or wtap_close(); wtap_phdr()
+ * and friends are not set. */
+int wtap_read_batch(wtap *wth, struct wtap_batch_rec *recs, int max_recs,
+    int *err, gchar **err_info);
+
 gboolean wtap_seek_read (wtap *wth, gint64 seek_off,
 	union wtap_pseudo_header *pseudo_header, guint8 *pd, int len,
 	int *err, gchar **err_info);
 
+/* Have a thread of its own read and decode the file a few hundred
+ * packets ahead of wtap_read(), which then only hands out what that
+ * thread has read; wtap_phdr(), wtap_pseudoheader() and wtap_buf_ptr()
+ * keep working as before.  Only for files that are read from start to
+ * end with wtap_read(), and not also with wtap_seek_read(); call it
+ * before the first wtap_read(), or between two once the packet read
+ * last isn't needed anymore.  Returns FALSE, leaving the file to be
+ * read as usual, if threads aren't available or the program hasn't
+ * called g_thread_init(). */
+gboolean wtap_read_ahead(wtap *wth);
+
 /*** get various information snippets about the current packet ***/
 struct wtap_pkthdr *wtap_phdr(wtap *wth);
 union wtap_pseudo_header *wtap_pseudoheader(wtap *wth);
@@ -906,6 +944,16 @@ wtap_dumper* wtap_dump_fdopen(int fd, int filetype, int encap, int snaplen,
 gboolean wtap_dump(wtap_dumper *, const struct wtap_pkthdr *,
 	const union wtap_pseudo_header *pseudo_header, const guchar *, int *err);
 void wtap_dump_flush(wtap_dumper *);
+
+/* Have a thread of its own write the file in blocks of block_size bytes
+ * (0 for WTAP_WRITE_BEHIND_BLOCK_SIZE), so that wtap_dump() only copies
+ * packets into a block.  Write errors are returned by a later
+ * wtap_dump() or by wtap_dump_close().  Returns FALSE, leaving the file
+ * to be written as usual, if threads aren't available or the program
+ * hasn't called g_thread_init(), or if the dump routines of the file
+ * type seek in the file. */
+#define WTAP_WRITE_BEHIND_BLOCK_SIZE	(4 * 1024 * 1024)
+gboolean wtap_dump_write_behind(wtap_dumper *wdh, size_t block_size);
 gint64 wtap_get_bytes_dumped(wtap_dumper *);
 void wtap_set_bytes_dumped(wtap_dumper *wdh, gint64 bytes_dumped);
 gboolean wtap_dump_close(wtap_dumper *, int *);
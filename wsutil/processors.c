@@ -0,0 +1,59 @@
+/* processors.c
+ * Routines for finding out about the processors
+ *
+ * $Id$
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "processors.h"
+
+/* Get the number of processors that are online, from 1 to "max". */
+int
+get_processor_count(int max)
+{
+	long n;
+#ifdef _WIN32
+	SYSTEM_INFO system_info;
+
+	GetSystemInfo(&system_info);
+	n = system_info.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+	n = sysconf(_SC_NPROCESSORS_ONLN);
+#else
+	n = 1;
+#endif
+	if (n > max)
+		n = max;
+	if (n < 1)
+		n = 1;
+	return (int)n;
+}
@@ -0,0 +1,37 @@
+/* processors.h
+ * Declarations of routines for finding out about the processors
+ *
+ * $Id$
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#ifndef __PROCESSORS_H__
+#define __PROCESSORS_H__
+
+/** Get the number of processors that are online, e.g. to pick how many
+ *  threads to work with by default.
+ *
+ * @param max Most that will be returned.
+ * @return    The number of processors, at least 1 (also if the system
+ *            can't tell) and no more than max.
+ */
+int get_processor_count(int max);
+
+#endif /* __PROCESSORS_H__ */